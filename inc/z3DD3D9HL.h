@@ -22,6 +22,15 @@ D3DX, встроенная в DirectX.
 
 
 #include "z3DD3D9HLDef.h"
+#include "z3DD3D9HLAlloc.h"
+#include "z3DD3D9HLCmdList.h"
+#include "z3DD3D9HLMeshOpt.h"
+#include "z3DD3D9HLObjCache.h"
+#include "z3DD3D9HLRTPool.h"
+#include "z3DD3D9HLDynRes.h"
+#include "z3DD3D9HLSprite.h"
+#include "z3DD3D9HLOcclusion.h"
+#include "z3DD3D9HLShaderCache.h"
 
 /** @file z3DD3D9HL.h */
 
@@ -88,6 +97,8 @@ z3DD3D9HL_ErrCodes D3D9HL_FindVideoModes(z3DD3D9HL_VideoMode* videoModes,
         Номер видеоадаптера может варьироваться от нуля до числа, меньшего на единицу числа видеоадаптеров,
         установленных в системе ( см. справку DX SDK ).
     @param deviceType тип устройства Direct3D9 ( см. справку DX SDK ).
+    @param policy политика выбора флагов создания устройства ( @see z3DD3D9HL_DeviceCreationPolicy ).
+        Если 0, используется политика по умолчанию без D3DCREATE_PUREDEVICE.
     @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
 */
 z3DD3D9HL_ErrCodes D3D9HL_CreateDevice(LPDIRECT3DDEVICE9* device,
@@ -101,7 +112,130 @@ z3DD3D9HL_ErrCodes D3D9HL_CreateDevice(LPDIRECT3DDEVICE9* device,
                                        bool fVSync = false,
                                        HWND hWnd = 0,
                                        uint32_t iAdapter = D3DADAPTER_DEFAULT,
-                                       D3DDEVTYPE deviceType = D3DDEVTYPE_HAL);
+                                       D3DDEVTYPE deviceType = D3DDEVTYPE_HAL,
+                                       const z3DD3D9HL_DeviceCreationPolicy* policy = 0);
+
+/** Получить адаптерную группу, в которую входит видеоадаптер.
+
+    Возможности главного адаптера ( D3DCAPS9::NumberOfAdaptersInGroup ) задают число голов, номера
+    адаптеров голов определяются по D3DCAPS9::MasterAdapterOrdinal и D3DCAPS9::AdapterOrdinalInGroup
+    всех адаптеров системы. Адаптер без других голов образует группу из одной головы.
+    @param [out] group для сохранения группы ( @see z3DD3D9HL_AdapterGroup ).
+    @param d3d указатель на объект главного интерфейса Direct3D9.
+    @param iAdapter номер любого адаптера группы.
+    @param deviceType тип устройства Direct3D9.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_GetAdapterGroup(z3DD3D9HL_AdapterGroup* group,
+                                          LPDIRECT3D9 d3d,
+                                          uint32_t iAdapter = D3DADAPTER_DEFAULT,
+                                          D3DDEVTYPE deviceType = D3DDEVTYPE_HAL);
+
+/** Создание одного устройства Direct3D9 на всех головах адаптерной группы (D3DCREATE_ADAPTERGROUP_DEVICE).
+
+    Устройство работает только в полноэкранном режиме. Ресурсы создаются один раз и доступны всем головам.
+    Кадр всех голов рисуется между одной парой D3D9HL_BeginDeviceRender() и D3D9HL_EndDeviceRender():
+    перед рисованием каждой головы вызывается D3D9HL_SetHeadRenderTarget(), а Present() показывает все головы.
+    В D3D9HL_BeginDeviceRender() передается массив параметров презентации, полученный из этой функции.
+    D3D9HL_SwitchVideoMode() устройство группы не переключает: видеорежимы голов меняются пересозданием
+    устройства этой функцией. Пул поверхностей ( @see RTPool ) и регулятор разрешения ( @see DynRes )
+    рассчитаны на задний буфер первой головы (цепочка обмена 0); для голов с другими видеорежимами
+    размеры поверхностей задаются явно.
+    @param [out] device указатель на указатель на устройство для сохранения адреса объекта созданного устройства.
+    @param [out] presentParams массив из group.numHeads_ элементов для сохранения параметров презентации голов.
+    @param [out] pVertexProcessingType для сохранения флага обработки вершин. Можно передать нуль.
+    @param d3d указатель на объект главного интерфейса Direct3D9.
+    @param group адаптерная группа, полученная из D3D9HL_GetAdapterGroup().
+    @param videoModes массив из group.numHeads_ видеорежимов; i-й видеорежим найден функцией D3D9HL_FindVideoModes
+        для адаптера group.adapters_[i] в полноэкранном режиме.
+    @param hWnds массив из group.numHeads_ окон голов. Первое окно - окно фокуса устройства.
+    @param multiSampleType уровень мультисэмплинга (см. справку DX SDK).
+    @param qualityLevel (см. справку DX SDK).
+    @param fVSync (false)true - (не)использовать вертикальную синхронизацию.
+    @param deviceType тип устройства Direct3D9.
+    @param policy политика выбора флагов создания устройства. Если 0, используется политика по умолчанию без D3DCREATE_PUREDEVICE.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_CreateGroupDevice(LPDIRECT3DDEVICE9* device,
+                                            D3DPRESENT_PARAMETERS* presentParams,
+                                            uint32_t* pVertexProcessingType,
+                                            LPDIRECT3D9 d3d,
+                                            const z3DD3D9HL_AdapterGroup& group,
+                                            const z3DD3D9HL_VideoMode* videoModes,
+                                            const HWND* hWnds,
+                                            D3DMULTISAMPLE_TYPE multiSampleType = D3DMULTISAMPLE_NONE,
+                                            DWORD qualityLevel = 0,
+                                            bool fVSync = false,
+                                            D3DDEVTYPE deviceType = D3DDEVTYPE_HAL,
+                                            const z3DD3D9HL_DeviceCreationPolicy* policy = 0);
+
+/** Назначить задний буфер головы адаптерной группы целью рендера 0.
+
+    Область вывода устанавливается устройством на весь задний буфер головы.
+    @param device указатель на устройство, созданное D3D9HL_CreateGroupDevice().
+    @param iHead номер головы.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_SetHeadRenderTarget(LPDIRECT3DDEVICE9 device, uint32_t iHead);
+
+/** Выбор флагов создания устройства по возможностям адаптера.
+
+    Возможности адаптера ( D3DCAPS9 ) запрашиваются один раз. Выбирается аппаратная обработка вершин,
+    если адаптер поддерживает аппаратные T&L, потоки вершин и вершинные шейдеры не ниже заданной в политике версии;
+    смешанная - если аппаратные T&L есть, но версия вершинных шейдеров недостаточна; иначе программная.
+    При аппаратной обработке вершин и разрешении политики добавляется D3DCREATE_PUREDEVICE.
+    @param [out] behaviorFlags для сохранения выбранных флагов создания устройства.
+    @param d3d указатель на объект главного интерфейса Direct3D9.
+    @param policy политика выбора флагов ( @see z3DD3D9HL_DeviceCreationPolicy ).
+    @param iAdapter номер видеоадаптера.
+    @param deviceType тип устройства Direct3D9 ( см. справку DX SDK ).
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ChooseDeviceCreationFlags(DWORD* behaviorFlags,
+                                                    LPDIRECT3D9 d3d,
+                                                    const z3DD3D9HL_DeviceCreationPolicy& policy,
+                                                    uint32_t iAdapter = D3DADAPTER_DEFAULT,
+                                                    D3DDEVTYPE deviceType = D3DDEVTYPE_HAL);
+
+/** Получить запомненный результат создания устройства на видеоадаптере.
+
+    Результат можно сохранить и восстановить при следующем запуске через D3D9HL_SetDeviceCreationOutcome(),
+    чтобы D3D9HL_CreateDevice() сразу пробовал успешную комбинацию флагов.
+    @param [out] outcome для сохранения результата ( @see z3DD3D9HL_DeviceCreationOutcome ).
+    @param iAdapter номер видеоадаптера.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_NOTFOUND, если устройство на адаптере еще не создавалось.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_GetDeviceCreationOutcome(z3DD3D9HL_DeviceCreationOutcome* outcome,
+                                                   uint32_t iAdapter = D3DADAPTER_DEFAULT);
+
+/** Восстановить результат создания устройства на видеоадаптере.
+
+    Результат, не соответствующий текущему адаптеру или версии его драйвера, при создании устройства игнорируется.
+    Нулевое значение behaviorFlags_ сбрасывает запомненный результат.
+    @param outcome результат, полученный ранее из D3D9HL_GetDeviceCreationOutcome().
+    @param iAdapter номер видеоадаптера.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_SetDeviceCreationOutcome(const z3DD3D9HL_DeviceCreationOutcome& outcome,
+                                                   uint32_t iAdapter = D3DADAPTER_DEFAULT);
+
+/** Зарегистрировать слушателя событий устройства ( @see z3DD3D9HL_DeviceListener ).
+
+    Функции onRelease_ вызываются в порядке, обратном порядку регистрации, функции onReset_ - в порядке
+    регистрации: после функций, переданных в D3D9HL_BeginDeviceRender() и D3D9HL_SwitchVideoMode().
+    Функции onEndRender_ вызываются в порядке регистрации.
+    @param listener слушатель. Слушатель с теми же функциями и данными повторно не добавляется,
+    в том числе для другого устройства.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_OUTOFMEMORY, если зарегистрировано
+    Z3D_D3D9HL_MAX_DEVICE_LISTENERS слушателей.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_AddDeviceListener(const z3DD3D9HL_DeviceListener& listener);
+
+/** Отменить регистрацию слушателя событий устройства.
+    @param listener слушатель с теми же функциями и данными, что и при регистрации. device_ не сравнивается.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_NOTFOUND, если слушатель не зарегистрирован.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_RemoveDeviceListener(const z3DD3D9HL_DeviceListener& listener);
 
 /** Запуск рендера на устройстве Direct3D9.
 
@@ -128,6 +262,62 @@ z3DD3D9HL_ErrCodes D3D9HL_BeginDeviceRender(LPDIRECT3DDEVICE9 device,
 */
 z3DD3D9HL_ErrCodes D3D9HL_EndDeviceRender(LPDIRECT3DDEVICE9 device, HWND hDestWindow = 0);
 
+/** Получить времена последнего кадра.
+
+    Кадры, в которых устройство было потеряно, не измеряются, и следующий после них кадр
+    не учитывается во времени между кадрами. С вертикальной синхронизацией время между кадрами
+    кратно периоду обновления экрана; нагрузку кадра показывает время рендера, не включающее
+    ожидание в Present(), и время выполнения кадра видеоадаптером ( @see z3DD3D9HL_GpuTimer ).
+    @param [out] timing для сохранения времен ( @see z3DD3D9HL_FrameTiming ).
+*/
+void D3D9HL_GetFrameTiming(z3DD3D9HL_FrameTiming* timing);
+
+/** Переключение видеорежима, мультисэмплинга или оконного режима без пересоздания устройства.
+
+    Параметры презентации строятся заново для заданного видеорежима, после чего устройство перезагружается
+    одним вызовом Reset() с вызовом функций освобождения и восстановления ресурсов. Устройство пересоздается,
+    только если меняется видеоадаптер, тип устройства или тип обработки вершин. Тип обработки вершин меняется,
+    только если policy->fUseCachedOutcome_ и сохраненный для адаптера результат ( @see D3D9HL_SetDeviceCreationOutcome )
+    задает другой тип, чем у текущего устройства. При пересоздании ресурсы D3DPOOL_MANAGED теряются и должны быть
+    загружены приложением заново, а слушатели событий прежнего устройства переходят к новому.
+    Нельзя вызывать между D3D9HL_BeginDeviceRender() и D3D9HL_EndDeviceRender(). Устройство адаптерной группы
+    ( @see D3D9HL_CreateGroupDevice ) не переключается: параметры презентации строятся для одной головы.
+    @param [in,out] device указатель на указатель на устройство. При пересоздании устройства сюда сохраняется новый адрес.
+    @param [in,out] presentParams текущие параметры презентации, заменяются новыми.
+    @param [out] pVertexProcessingType для сохранения флага обработки вершин. Можно передать нуль.
+    @param [out] stats для сохранения сведений о переключении ( @see z3DD3D9HL_ModeSwitchStats ). Можно передать нуль.
+    @param d3d указатель на объект главного интерфейса Direct3D9.
+    @param videoMode целевой видеорежим из массива, заполненного функцией D3D9HL_FindVideoModes.
+    @param releaseFunc функция освобождения ресурсов D3DPOOL_DEFAULT. Можно передать нуль.
+    @param resetFunc функция восстановления ресурсов D3DPOOL_DEFAULT. Можно передать нуль.
+    @param multiSampleType уровень мультисэмплинга (см. справку DX SDK).
+    @param qualityLevel (см. справку DX SDK).
+    @param fWindowed true(false) оконный (полноэкранный)режим работы приложения.
+    @param fVSync (false)true - (не)использовать вертикальную синхронизацию.
+    @param iAdapter номер видеоадаптера.
+    @param deviceType тип устройства Direct3D9 ( см. справку DX SDK ).
+    @param policy политика выбора флагов создания устройства ( @see z3DD3D9HL_DeviceCreationPolicy ).
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_DEVICE_LOST, если устройство потеряно:
+    новые параметры презентации применятся при его восстановлении в D3D9HL_BeginDeviceRender(),
+    которая вызовет только функцию восстановления ресурсов, так как освобождены они уже здесь.
+    Z3D_D3D9HL_INVALIDCALL для устройства адаптерной группы.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_SwitchVideoMode(LPDIRECT3DDEVICE9* device,
+                                          D3DPRESENT_PARAMETERS* presentParams,
+                                          uint32_t* pVertexProcessingType,
+                                          z3DD3D9HL_ModeSwitchStats* stats,
+                                          LPDIRECT3D9 d3d,
+                                          const z3DD3D9HL_VideoMode& videoMode,
+                                          Z3D_D3D9HL_ReleaseDeviceResourcesFunc releaseFunc,
+                                          Z3D_D3D9HL_ResetDeviceResourcesFunc resetFunc,
+                                          D3DMULTISAMPLE_TYPE multiSampleType = D3DMULTISAMPLE_NONE,
+                                          DWORD qualityLevel = 0,
+                                          bool fWindowed = false,
+                                          bool fVSync = false,
+                                          uint32_t iAdapter = D3DADAPTER_DEFAULT,
+                                          D3DDEVTYPE deviceType = D3DDEVTYPE_HAL,
+                                          const z3DD3D9HL_DeviceCreationPolicy* policy = 0);
+
 //-----------------------------------------------------------------------------
 
 
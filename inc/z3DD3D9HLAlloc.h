@@ -0,0 +1,111 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLALLOC_H
+#define Z3DD3D9HLALLOC_H
+
+/** @file z3DD3D9HLAlloc.h */
+
+/** @page Alloc Выделение памяти.
+
+Вся память, которую библиотека выделяет сама (например, временные массивы при поиске видеорежимов),
+запрашивается через распределитель, устанавливаемый функцией D3D9HL_SetAllocator(). По умолчанию
+используются malloc() и free().
+
+Подсистемы библиотеки, хранящие данные между вызовами, берут память из арены ( @see z3DD3D9HL_Arena ),
+предоставленной вызывающей стороной. Арена выделяет память последовательно из заданного блока
+и освобождает ее только целиком, поэтому не обращается к куче.
+@code
+    static uint8_t s_mem[64 * 1024];
+    z3DD3D9HL_Arena arena;
+    z3D::D3D9HL_ArenaInit(&arena, s_mem, sizeof(s_mem));
+    z3DD3D9HL_Allocator allocator;
+    z3D::D3D9HL_ArenaAllocator(&allocator, &arena);
+    z3D::D3D9HL_SetAllocator(&allocator);   // поиск видеорежимов больше не обращается к куче
+@endcode
+*/
+
+#include <stddef.h>
+
+#include "z3DD3D9HLDef.h"
+
+/// Выравнивание памяти по умолчанию
+#define Z3D_D3D9HL_DEFAULT_ALIGN 8
+
+/// Прототип функции выделения памяти. Возвращает 0, если память выделить не удалось.
+typedef void* (*Z3D_D3D9HL_AllocFunc)(size_t size, size_t alignment, void* userData);
+
+/// Прототип функции освобождения памяти, выделенной функцией типа Z3D_D3D9HL_AllocFunc.
+typedef void (*Z3D_D3D9HL_FreeFunc)(void* mem, void* userData);
+
+/// Распределитель памяти
+struct z3DD3D9HL_Allocator{
+    Z3D_D3D9HL_AllocFunc alloc_;    ///< функция выделения памяти
+    Z3D_D3D9HL_FreeFunc free_;      ///< функция освобождения памяти
+    void* userData_;                ///< данные, передаваемые функциям распределителя
+};
+
+/// Арена - последовательное выделение памяти из блока, предоставленного вызывающей стороной
+struct z3DD3D9HL_Arena{
+    uint8_t* mem_;                  ///< блок памяти
+    size_t capacity_;               ///< размер блока в байтах
+    size_t offset_;                 ///< число занятых байт
+    size_t peak_;                   ///< наибольшее число занятых байт с момента инициализации
+};
+
+namespace z3D
+{
+/** Установить распределитель памяти библиотеки.
+    @param allocator распределитель ( @see z3DD3D9HL_Allocator ). Если 0, восстанавливается распределитель по умолчанию.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_SetAllocator(const z3DD3D9HL_Allocator* allocator);
+
+/** Получить текущий распределитель памяти библиотеки.
+    @param [out] allocator для сохранения распределителя.
+*/
+void D3D9HL_GetAllocator(z3DD3D9HL_Allocator* allocator);
+
+/** Подготовить арену.
+    @param [out] arena арена.
+    @param mem блок памяти.
+    @param capacity размер блока в байтах.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ArenaInit(z3DD3D9HL_Arena* arena, void* mem, size_t capacity);
+
+/** Выделить память из арены.
+    @param arena арена.
+    @param size размер в байтах.
+    @param alignment выравнивание, степень двойки.
+    @return указатель на память или 0, если в арене недостаточно места.
+*/
+void* D3D9HL_ArenaAlloc(z3DD3D9HL_Arena* arena, size_t size, size_t alignment = Z3D_D3D9HL_DEFAULT_ALIGN);
+
+/** Освободить всю память арены.
+*/
+void D3D9HL_ArenaReset(z3DD3D9HL_Arena* arena);
+
+/** Получить отметку текущего заполнения арены для последующего возврата к ней.
+*/
+size_t D3D9HL_ArenaGetMarker(const z3DD3D9HL_Arena* arena);
+
+/** Освободить память арены, выделенную после получения отметки.
+    @param arena арена.
+    @param marker отметка, полученная из D3D9HL_ArenaGetMarker().
+*/
+void D3D9HL_ArenaRewind(z3DD3D9HL_Arena* arena, size_t marker);
+
+/** Получить распределитель, выделяющий память из арены.
+
+    Распределитель освобождает блок, только если тот выделен последним (порядок LIFO), поэтому
+    временная память библиотеки (например, при поиске видеорежимов) возвращается арене сразу.
+    Память остальных блоков возвращается вызовом D3D9HL_ArenaReset() или D3D9HL_ArenaRewind().
+    Перед каждым блоком хранится заголовок из двух size_t.
+    @param [out] allocator для сохранения распределителя.
+    @param arena арена, которая должна существовать, пока используется распределитель.
+*/
+void D3D9HL_ArenaAllocator(z3DD3D9HL_Allocator* allocator, z3DD3D9HL_Arena* arena);
+
+} // end of z3D
+#endif // Z3DD3D9HLALLOC_H
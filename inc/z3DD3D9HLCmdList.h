@@ -0,0 +1,130 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLCMDLIST_H
+#define Z3DD3D9HLCMDLIST_H
+
+/** @file z3DD3D9HLCmdList.h */
+
+/** @page CmdLists Списки команд.
+
+Устройство Direct3D9 допускает вызовы только из одного потока. Списки команд позволяют
+записывать вызовы устройства (установку состояний, констант, потоков вершин и рисование) из
+рабочих потоков, а затем воспроизводить их в потоке рендера между вызовами
+D3D9HL_BeginDeviceRender() и D3D9HL_EndDeviceRender().
+
+Каждый список пишет в память, предоставленную вызывающей стороной, и во время записи не
+выделяет память из кучи. Один список должен использоваться только одним потоком.
+Записываются указатели на объекты Direct3D9 без вызова AddRef(), поэтому объекты должны
+существовать до окончания воспроизведения.
+@code
+    // рабочий поток
+    z3DD3D9HL_CmdList cmdList;
+    z3D::D3D9HL_CmdListInit(&cmdList, threadMem, threadMemSize, iThread);
+    z3D::D3D9HL_CmdSetStreamSource(&cmdList, 0, vb, 0, sizeof(Vertex));
+    z3D::D3D9HL_CmdDrawPrimitive(&cmdList, D3DPT_TRIANGLELIST, 0, numTris);
+
+    // поток рендера
+    z3D::D3D9HL_ReplayCmdLists(device, cmdLists, numThreads);
+@endcode
+*/
+
+#include <d3d9.h>
+
+#include "z3DD3D9HLDef.h"
+
+/// Выравнивание памяти списка команд и размеров записанных команд
+#define Z3D_D3D9HL_CMDLIST_ALIGN 8
+
+/// Список команд устройства Direct3D9
+struct z3DD3D9HL_CmdList{
+    uint8_t* mem_;                  ///< память для записи команд, выделенная вызывающей стороной
+    uint32_t capacity_;             ///< размер памяти в байтах
+    uint32_t size_;                 ///< число занятых байт
+    uint32_t numCmds_;              ///< число записанных команд
+    uint32_t order_;                ///< ключ порядка воспроизведения среди других списков
+    bool fOverflow_;                ///< команда не была записана из-за нехватки памяти
+};
+
+namespace z3D
+{
+/** Подготовить список команд к записи.
+    @param [out] cmdList список команд.
+    @param mem память для записи команд, выровненная на Z3D_D3D9HL_CMDLIST_ALIGN байт.
+    @param capacity размер памяти в байтах.
+    @param order ключ порядка воспроизведения. Списки воспроизводятся в порядке возрастания ключа,
+    поэтому для детерминированного порядка ключи должны быть различными.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_CmdListInit(z3DD3D9HL_CmdList* cmdList, void* mem, uint32_t capacity, uint32_t order = 0);
+
+/** Очистить список команд для записи следующего кадра. Память списка сохраняется.
+    @param cmdList список команд.
+    @param order новый ключ порядка воспроизведения.
+*/
+void D3D9HL_CmdListReset(z3DD3D9HL_CmdList* cmdList, uint32_t order);
+
+/** @name Запись команд.
+Каждая функция возвращает Z3D_D3D9HL_OUTOFMEMORY, если в памяти списка не осталось места,
+при этом команда не записывается и устанавливается флаг fOverflow_ списка.
+*/
+///@{
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetRenderState(z3DD3D9HL_CmdList* cmdList, D3DRENDERSTATETYPE state, DWORD value);
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetSamplerState(z3DD3D9HL_CmdList* cmdList, DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value);
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetTexture(z3DD3D9HL_CmdList* cmdList, DWORD stage, LPDIRECT3DBASETEXTURE9 texture);
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetStreamSource(z3DD3D9HL_CmdList* cmdList,
+                                             UINT streamNumber,
+                                             LPDIRECT3DVERTEXBUFFER9 vertexBuffer,
+                                             UINT offsetInBytes,
+                                             UINT stride);
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetIndices(z3DD3D9HL_CmdList* cmdList, LPDIRECT3DINDEXBUFFER9 indexBuffer);
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetVertexDeclaration(z3DD3D9HL_CmdList* cmdList, LPDIRECT3DVERTEXDECLARATION9 decl);
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetVertexShader(z3DD3D9HL_CmdList* cmdList, LPDIRECT3DVERTEXSHADER9 shader);
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetPixelShader(z3DD3D9HL_CmdList* cmdList, LPDIRECT3DPIXELSHADER9 shader);
+
+/** Константы копируются в память списка.
+    @param vector4fCount число четырехкомпонентных векторов, начиная с регистра startRegister.
+    @return Z3D_D3D9HL_INVALIDCALL, если constantData равен 0 при ненулевом vector4fCount или размер
+    команды не помещается в uint32_t; флаг fOverflow_ при этом не устанавливается.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetVertexShaderConstantF(z3DD3D9HL_CmdList* cmdList,
+                                                      UINT startRegister,
+                                                      const float* constantData,
+                                                      UINT vector4fCount);
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetPixelShaderConstantF(z3DD3D9HL_CmdList* cmdList,
+                                                     UINT startRegister,
+                                                     const float* constantData,
+                                                     UINT vector4fCount);
+z3DD3D9HL_ErrCodes D3D9HL_CmdDrawPrimitive(z3DD3D9HL_CmdList* cmdList,
+                                           D3DPRIMITIVETYPE primitiveType,
+                                           UINT startVertex,
+                                           UINT primitiveCount);
+z3DD3D9HL_ErrCodes D3D9HL_CmdDrawIndexedPrimitive(z3DD3D9HL_CmdList* cmdList,
+                                                  D3DPRIMITIVETYPE primitiveType,
+                                                  INT baseVertexIndex,
+                                                  UINT minVertexIndex,
+                                                  UINT numVertices,
+                                                  UINT startIndex,
+                                                  UINT primitiveCount);
+///@}
+
+/** Воспроизвести списки команд на устройстве.
+
+    Вызывается в потоке рендера между D3D9HL_BeginDeviceRender() и D3D9HL_EndDeviceRender(),
+    после того как рабочие потоки закончили запись. Массив указателей упорядочивается по ключу
+    порядка воспроизведения (списки с равными ключами сохраняют взаимный порядок), затем команды
+    всех списков передаются устройству. Списки, переполнившиеся при записи, не воспроизводятся.
+    @param device указатель на устройство.
+    @param cmdLists массив указателей на списки команд. Порядок элементов массива изменяется.
+    @param numCmdLists число списков.
+    @param [out] pNumCmdsReplayed для сохранения числа воспроизведенных команд. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_OUTOFMEMORY, если хотя бы один список
+    переполнился при записи; остальные списки при этом воспроизводятся.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ReplayCmdLists(LPDIRECT3DDEVICE9 device,
+                                         z3DD3D9HL_CmdList** cmdLists,
+                                         uint32_t numCmdLists,
+                                         uint32_t* pNumCmdsReplayed = 0);
+
+} // end of z3D
+#endif // Z3DD3D9HLCMDLIST_H
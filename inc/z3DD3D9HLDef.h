@@ -33,7 +33,8 @@ enum z3DD3D9HL_ErrCodes{
     Z3D_D3D9HL_NOTAVAILABLE,        ///< запрошенная функция не поддерживается
     Z3D_D3D9HL_NO_PRELIMINARY_DONE, ///< какие-то предварительные операции или условия не выполнены
     Z3D_D3D9HL_DEVICE_LOST,         ///< устройство потеряно
-    Z3D_D3D9HL_DEVICE_NOT_RESET
+    Z3D_D3D9HL_DEVICE_NOT_RESET,
+    Z3D_D3D9HL_OUTOFMEMORY          ///< недостаточно памяти, предоставленной вызывающей стороной
 };
 
 /// Неопределенное значение индекса или порядкового номера
@@ -72,6 +73,73 @@ struct z3DD3D9HL_VideoMode{
     }
 };
 
+/// Максимальное число видеоадаптеров, для которых запоминаются результаты создания устройства
+#define Z3D_D3D9HL_MAX_ADAPTERS 16
+
+/** Политика создания устройства Direct3D9.
+
+Определяет, какие флаги создания устройства допустимо выбирать по возможностям адаптера.
+*/
+struct z3DD3D9HL_DeviceCreationPolicy{
+    bool fAllowPureDevice_;         ///< разрешить D3DCREATE_PUREDEVICE (Get-методы состояний устройства станут недоступны)
+    bool fMultithreaded_;           ///< создавать устройство с флагом D3DCREATE_MULTITHREADED
+    bool fFpuPreserve_;             ///< создавать устройство с флагом D3DCREATE_FPU_PRESERVE
+    bool fUseCachedOutcome_;        ///< начинать с типа обработки вершин и D3DCREATE_PUREDEVICE, ранее успешно примененных на этом адаптере
+    uint8_t minVSMajor_;            ///< минимальная старшая версия вершинных шейдеров для аппаратной обработки вершин
+    uint8_t minVSMinor_;            ///< минимальная младшая версия вершинных шейдеров для аппаратной обработки вершин
+
+    z3DD3D9HL_DeviceCreationPolicy() :
+        fAllowPureDevice_(true),
+        fMultithreaded_(false),
+        fFpuPreserve_(false),
+        fUseCachedOutcome_(true),
+        minVSMajor_(1),
+        minVSMinor_(1){
+    }
+};
+
+/** Результат создания устройства на видеоадаптере.
+
+Запоминается библиотекой для каждого адаптера. Может быть сохранен приложением между запусками
+и восстановлен функцией D3D9HL_SetDeviceCreationOutcome(). Результат действителен только для того же
+адаптера и той же версии драйвера.
+*/
+struct z3DD3D9HL_DeviceCreationOutcome{
+    uint32_t vendorId_;             ///< идентификатор производителя адаптера
+    uint32_t deviceId_;             ///< идентификатор модели адаптера
+    uint32_t subSysId_;             ///< идентификатор подсистемы
+    uint32_t driverVersionHigh_;    ///< старшая часть версии драйвера
+    uint32_t driverVersionLow_;     ///< младшая часть версии драйвера
+    D3DDEVTYPE deviceType_;         ///< тип устройства
+    DWORD behaviorFlags_;           ///< флаги, с которыми устройство было успешно создано (0 - результата нет)
+};
+
+/// Наибольшее число голов (выходов) адаптерной группы
+#define Z3D_D3D9HL_MAX_HEADS 8
+
+/** Адаптерная группа - видеоадаптеры одной видеокарты с несколькими выходами (головами).
+
+Устройство, созданное на группе, имеет по одной неявной цепочке обмена на голову и общие ресурсы.
+*/
+struct z3DD3D9HL_AdapterGroup{
+    uint32_t masterAdapter_;                    ///< номер главного адаптера группы
+    uint32_t numHeads_;                         ///< число голов
+    uint32_t adapters_[Z3D_D3D9HL_MAX_HEADS];   ///< номера адаптеров голов в порядке AdapterOrdinalInGroup
+};
+
+/// Времена последнего кадра, измеренные в D3D9HL_BeginDeviceRender() и D3D9HL_EndDeviceRender()
+struct z3DD3D9HL_FrameTiming{
+    uint32_t frameTimeUs_;          ///< время между двумя последними вызовами Present() в мкс (0 - еще не измерено)
+    uint32_t renderTimeUs_;         ///< время от BeginScene() до вызова Present() в мкс, без ожидания в Present()
+    uint32_t numFrames_;            ///< число завершенных кадров
+};
+
+/// Результат переключения видеорежима
+struct z3DD3D9HL_ModeSwitchStats{
+    bool fRecreated_;               ///< устройство было пересоздано, а не перезагружено через Reset()
+    uint32_t timeUs_;               ///< длительность переключения в микросекундах
+};
+
 /** Прототип функции для освобождения ресурсов устройства.
 В функция должен быть реализован пробег по всем ресурсам, созданныи при помощи D3DPOOL_DEFAULT,
 и их освобождение через вызов метода Release(). Более подробную тнформацию можно получить из справки DX SDK.
@@ -81,6 +149,30 @@ typedef bool (*Z3D_D3D9HL_ReleaseDeviceResourcesFunc)();
 /// Прототип функции для перезагрузки ресурсов устройства
 typedef bool (*Z3D_D3D9HL_ResetDeviceResourcesFunc)();
 
+/// Максимальное число слушателей событий устройства
+#define Z3D_D3D9HL_MAX_DEVICE_LISTENERS 16
+
+/// Прототип функции, вызываемой при событии устройства
+typedef void (*Z3D_D3D9HL_DeviceEventFunc)(LPDIRECT3DDEVICE9 device, void* userData);
+
+/** Слушатель событий устройства.
+
+Позволяет модулям библиотеки и приложению освобождать и восстанавливать свои ресурсы D3DPOOL_DEFAULT
+без участия функций, переданных в D3D9HL_BeginDeviceRender() и D3D9HL_SwitchVideoMode().
+onRelease_ вызывается перед Reset() или пересозданием устройства, onReset_ - после успешного Reset()
+или пересоздания (с новым устройством), onEndRender_ - в D3D9HL_EndDeviceRender() перед EndScene(),
+когда можно вывести накопленную за кадр геометрию. Любую из функций можно не задавать.
+Слушатель получает события только устройства device_; при пересоздании устройства в D3D9HL_SwitchVideoMode()
+device_ заменяется новым устройством. Слушатель с нулевым device_ получает события всех устройств.
+*/
+struct z3DD3D9HL_DeviceListener{
+    Z3D_D3D9HL_DeviceEventFunc onRelease_;      ///< освобождение ресурсов D3DPOOL_DEFAULT
+    Z3D_D3D9HL_DeviceEventFunc onReset_;        ///< восстановление ресурсов D3DPOOL_DEFAULT
+    Z3D_D3D9HL_DeviceEventFunc onEndRender_;    ///< завершение рендера кадра
+    void* userData_;                            ///< пользовательские данные, передаются в функции слушателя
+    LPDIRECT3DDEVICE9 device_;                  ///< устройство, события которого получает слушатель, или 0
+};
+
 #endif // Z3DD3D9HLDEF_H
 
 
@@ -0,0 +1,220 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLDYNRES_H
+#define Z3DD3D9HLDYNRES_H
+
+/** @file z3DD3D9HLDynRes.h */
+
+/** @page DynRes Динамическое разрешение и мультисэмплинг.
+
+Регулятор подбирает масштаб внутреннего разрешения рендера и уровень мультисэмплинга так, чтобы
+время кадра держалось около заданного. Уровни качества ( z3DD3D9HL_QualityLevel ) строятся по
+видеорежиму и проверенным устройством типам мультисэмплинга и упорядочены по возрастанию стоимости:
+сначала растет разрешение, затем мультисэмплинг.
+
+Регулятор не обращается к Direct3D9: D3D9HL_DynResUpdate() получает время кадра и возвращает решение,
+поэтому его поведение можно проверить моделированием.
+
+Время между вызовами Present() ( z3DD3D9HL_FrameTiming::frameTimeUs_ ) для регулятора не годится:
+с вертикальной синхронизацией оно кратно периоду обновления экрана и не бывает меньше его, поэтому
+запас времени не виден и качество не повышается. Регулятору передается время работы кадра без ожидания
+в Present(): наибольшее из времени выполнения кадра видеоадаптером ( @see z3DD3D9HL_GpuTimer ) и времени
+подготовки кадра процессором ( z3DD3D9HL_FrameTiming::renderTimeUs_ ). Смена уровня не требует Reset() устройства:
+сцена рисуется в поверхность из пула ( @see RTPool ) размера D3D9HL_DynResGetRTDesc(), которая затем
+растягивается на задний буфер. Поверхности прежнего размера освобождаются пулом за неиспользованием.
+Размер поверхности считается от заднего буфера пула, то есть первой головы устройства адаптерной группы.
+@code
+    z3DD3D9HL_QualityLevel levels[Z3D_D3D9HL_MAX_QUALITY_LEVELS];
+    uint32_t numLevels;
+    z3D::D3D9HL_DynResBuildLadder(levels, &numLevels, d3d, videoMode);
+    z3DD3D9HL_DynResParams params;
+    params.targetFrameTimeUs_ = 16667;
+    z3D::D3D9HL_DynResInit(&dynRes, levels, numLevels, params);
+    z3D::D3D9HL_GpuTimerInit(&gpuTimer, device);
+    ...
+    z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources);
+    z3D::D3D9HL_GpuTimerBeginFrame(&gpuTimer);
+    ...
+    z3D::D3D9HL_EndDeviceRender(device);
+    z3DD3D9HL_FrameTiming timing;
+    z3D::D3D9HL_GetFrameTiming(&timing);
+    z3D::D3D9HL_DynResUpdate(&dynRes, (gpuTimer.timeUs_ > timing.renderTimeUs_) ? gpuTimer.timeUs_ : timing.renderTimeUs_);
+    ...
+    z3D::D3D9HL_DynResGetRTDesc(&sceneDesc, &dynRes, &rtPool);
+    z3D::D3D9HL_RTPoolAcquire(&sceneRT, &sceneTex, &rtPool, device, sceneDesc, 0, 1);
+@endcode
+*/
+
+#include <d3d9.h>
+
+#include "z3DD3D9HLDef.h"
+#include "z3DD3D9HLRTPool.h"
+
+/// Наибольшее число уровней качества
+#define Z3D_D3D9HL_MAX_QUALITY_LEVELS 32
+
+/// Уровень качества рендера
+struct z3DD3D9HL_QualityLevel{
+    float scale_;                           ///< масштаб разрешения относительно заднего буфера, (0, 1]
+    D3DMULTISAMPLE_TYPE multiSampleType_;   ///< тип мультисэмплинга
+    DWORD multiSampleQuality_;              ///< качество мультисэмплинга
+    float cost_;                            ///< относительная стоимость: число отсчетов на пиксель заднего буфера
+};
+
+/// Параметры регулятора
+struct z3DD3D9HL_DynResParams{
+    uint32_t targetFrameTimeUs_;    ///< целевое время кадра в мкс
+    float smoothing_;               ///< вес нового измерения в скользящем среднем времени кадра, (0, 1]
+    float downThreshold_;           ///< понижать качество, если среднее больше target * downThreshold_
+    float upThreshold_;             ///< повышать качество, если прогноз для следующего уровня меньше target * upThreshold_
+    uint32_t downFrames_;           ///< число кадров подряд над порогом для понижения
+    uint32_t upFrames_;             ///< число кадров подряд под порогом для повышения
+    uint32_t settleFrames_;         ///< число кадров после смены уровня, в течение которых решения не принимаются
+
+    z3DD3D9HL_DynResParams() :
+        targetFrameTimeUs_(16667),
+        smoothing_(0.1f),
+        downThreshold_(1.05f),
+        upThreshold_(0.9f),
+        downFrames_(5),
+        upFrames_(60),
+        settleFrames_(10){
+    }
+};
+
+/// Регулятор динамического разрешения
+struct z3DD3D9HL_DynResController{
+    z3DD3D9HL_QualityLevel levels_[Z3D_D3D9HL_MAX_QUALITY_LEVELS];
+    uint32_t numLevels_;
+    uint32_t iLevel_;               ///< текущий уровень
+    z3DD3D9HL_DynResParams params_;
+    float avgFrameTimeUs_;          ///< скользящее среднее времени кадра (0 - измерений нет)
+    uint32_t numFramesOver_;        ///< число кадров подряд над порогом понижения
+    uint32_t numFramesUnder_;       ///< число кадров подряд под порогом повышения
+    uint32_t settleCounter_;        ///< число оставшихся кадров без решений
+    uint32_t numChanges_;           ///< число смен уровня
+};
+
+/// Число кадров, одновременно измеряемых видеоадаптером
+#define Z3D_D3D9HL_GPU_TIMER_FRAMES 4
+
+/// Запросы измерения одного кадра
+struct z3DD3D9HL_GpuTimerFrame{
+    LPDIRECT3DQUERY9 disjoint_;     ///< запрос D3DQUERYTYPE_TIMESTAMPDISJOINT вокруг кадра
+    LPDIRECT3DQUERY9 freq_;         ///< запрос D3DQUERYTYPE_TIMESTAMPFREQ
+    LPDIRECT3DQUERY9 begin_;        ///< метка времени начала кадра
+    LPDIRECT3DQUERY9 end_;          ///< метка времени конца кадра
+};
+
+/** Измеритель времени выполнения кадра видеоадаптером.
+
+    Метки времени D3DQUERYTYPE_TIMESTAMP ставятся после BeginScene() и перед EndScene(), поэтому
+    ожидание вертикальной синхронизации в Present() в измерение не попадает. Результаты читаются
+    без ожидания через несколько кадров; пока запросы всех Z3D_D3D9HL_GPU_TIMER_FRAMES кадров
+    без результата, новые кадры не измеряются. Кадры, в течение которых частота счетчика менялась
+    (D3DQUERYTYPE_TIMESTAMPDISJOINT), пропускаются.
+*/
+struct z3DD3D9HL_GpuTimer{
+    z3DD3D9HL_GpuTimerFrame frames_[Z3D_D3D9HL_GPU_TIMER_FRAMES];
+    uint32_t iFirst_;               ///< самый старый кадр без результата
+    uint32_t numPending_;           ///< число кадров без результата
+    bool fBegun_;                   ///< измерение текущего кадра начато
+    bool fCreated_;                 ///< запросы созданы
+    uint32_t timeUs_;               ///< время выполнения последнего измеренного кадра в мкс (0 - еще не измерено)
+    uint32_t numFrames_;            ///< число измеренных кадров
+    LPDIRECT3DDEVICE9 device_;      ///< устройство, для которого созданы запросы, или 0
+};
+
+namespace z3D
+{
+/** Построить уровни качества для видеорежима.
+
+    Для каждого масштаба и каждого типа мультисэмплинга (нет, 2, 4, 8 отсчетов), поддерживаемого для формата
+    заднего буфера и буфера глубины видеорежима, строится уровень. Поддержка проверяется так же, как в
+    D3D9HL_FindVideoModes(), но для каждого типа: видеорежим хранит только форматы, а не уровни качества.
+    Уровни используют качество 0: оно есть у каждого поддерживаемого типа, а смысл старших уровней задает
+    драйвер, и их стоимость по числу отсчетов не оценить. Из уровней выбирается цепочка, в которой
+    ни масштаб, ни число отсчетов не убывают, а стоимость растет.
+    @param [out] levels массив из Z3D_D3D9HL_MAX_QUALITY_LEVELS элементов для сохранения уровней.
+    @param [out] numLevels для сохранения числа уровней.
+    @param d3d указатель на объект главного интерфейса Direct3D9.
+    @param videoMode видеорежим, с которым создано устройство.
+    @param scales масштабы разрешения в порядке возрастания. Если нуль, используются 0.5, 0.625, 0.75, 0.875 и 1.
+    @param numScales число масштабов.
+    @param fWindowed true(false) оконный (полноэкранный)режим работы приложения.
+    @param iAdapter номер видеоадаптера.
+    @param deviceType тип устройства Direct3D9.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_DynResBuildLadder(z3DD3D9HL_QualityLevel* levels,
+                                            uint32_t* numLevels,
+                                            LPDIRECT3D9 d3d,
+                                            const z3DD3D9HL_VideoMode& videoMode,
+                                            const float* scales = 0,
+                                            uint32_t numScales = 0,
+                                            bool fWindowed = false,
+                                            uint32_t iAdapter = D3DADAPTER_DEFAULT,
+                                            D3DDEVTYPE deviceType = D3DDEVTYPE_HAL);
+
+/** Подготовить регулятор.
+    @param [out] dynRes регулятор.
+    @param levels уровни качества в порядке возрастания стоимости.
+    @param numLevels число уровней, не более Z3D_D3D9HL_MAX_QUALITY_LEVELS.
+    @param params параметры регулятора.
+    @param iStartLevel начальный уровень. Z3D_D3D9HL_NOINDEX - наивысший.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_DynResInit(z3DD3D9HL_DynResController* dynRes,
+                                     const z3DD3D9HL_QualityLevel* levels,
+                                     uint32_t numLevels,
+                                     const z3DD3D9HL_DynResParams& params,
+                                     uint32_t iStartLevel = Z3D_D3D9HL_NOINDEX);
+
+/** Учесть время очередного кадра и при необходимости сменить уровень качества.
+
+    Функция не обращается к Direct3D9.
+    @param dynRes регулятор.
+    @param frameTimeUs время кадра в мкс. Нулевое значение (кадр не измерен) пропускается.
+    @return true, если уровень качества сменился.
+*/
+bool D3D9HL_DynResUpdate(z3DD3D9HL_DynResController* dynRes, uint32_t frameTimeUs);
+
+/** Получить текущий уровень качества.
+*/
+const z3DD3D9HL_QualityLevel& D3D9HL_DynResGetLevel(const z3DD3D9HL_DynResController* dynRes);
+
+/** Заполнить описание поверхности рендера сцены для текущего уровня качества.
+    @param [out] desc описание для D3D9HL_RTPoolAcquire().
+    @param dynRes регулятор.
+    @param pool пул, задающий размеры и формат заднего буфера.
+    @param fDepth true(false) - буфер глубины (поверхность рендера).
+*/
+void D3D9HL_DynResGetRTDesc(z3DD3D9HL_RTDesc* desc,
+                            const z3DD3D9HL_DynResController* dynRes,
+                            const z3DD3D9HL_RTPool* pool,
+                            bool fDepth = false);
+
+/** Создать запросы измерителя и зарегистрировать его слушателем событий устройства.
+
+    Конец кадра отмечается в D3D9HL_EndDeviceRender() слушателем, поэтому работа слушателей,
+    зарегистрированных позже измерителя, в измерение не попадает: измеритель создается
+    последним ( @see D3D9HL_AddDeviceListener ). Измеритель не должен перемещаться в памяти
+    до вызова D3D9HL_GpuTimerShutdown().
+    @param [out] timer измеритель.
+    @param device указатель на устройство.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_NOTAVAILABLE, если устройство не поддерживает
+    метки времени.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_GpuTimerInit(z3DD3D9HL_GpuTimer* timer, LPDIRECT3DDEVICE9 device);
+
+/** Освободить запросы и отменить регистрацию слушателя.
+*/
+void D3D9HL_GpuTimerShutdown(z3DD3D9HL_GpuTimer* timer);
+
+/** Начать измерение кадра. Вызывается после успешного D3D9HL_BeginDeviceRender().
+*/
+void D3D9HL_GpuTimerBeginFrame(z3DD3D9HL_GpuTimer* timer);
+
+} // end of z3D
+#endif // Z3DD3D9HLDYNRES_H
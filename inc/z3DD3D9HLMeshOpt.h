@@ -0,0 +1,251 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLMESHOPT_H
+#define Z3DD3D9HLMESHOPT_H
+
+/** @file z3DD3D9HLMeshOpt.h */
+
+/** @page MeshOpt Оптимизация индексных буферов.
+
+Аналог функций D3DXOptimizeFaces() и D3DXOptimizeVertices(). Треугольники переупорядочиваются
+для повторного использования вершин из кэша преобразованных вершин (алгоритм Т. Форсайта),
+затем, при необходимости, группы треугольников упорядочиваются для уменьшения перерисовки.
+Вершины переупорядочиваются в порядке первого обращения к ним для локальности выборки.
+
+Все функции работают со списками треугольников ( D3DPT_TRIANGLELIST ) с 16- или 32-битными индексами.
+Массивы перестановок заполняются так же, как в D3DX: i-й элемент содержит исходный номер треугольника
+(вершины), оказавшегося на i-м месте.
+
+Временная память берется из арены, если она передана, иначе через распределитель библиотеки
+( @see D3D9HL_SetAllocator ).
+@code
+    z3DD3D9HL_VertexCacheStats before, after;
+    z3D::D3D9HL_ComputeVertexCacheStats(&before, indices, numFaces, numVertices, false);
+    z3D::D3D9HL_OptimizeFaces(faceRemap, indices, numFaces, numVertices, false);
+    z3D::D3D9HL_RemapFaces(newIndices, indices, faceRemap, numFaces, false);
+    z3D::D3D9HL_ComputeVertexCacheStats(&after, newIndices, numFaces, numVertices, false);
+@endcode
+*/
+
+#include "z3DD3D9HLDef.h"
+#include "z3DD3D9HLAlloc.h"
+
+/// Наибольший размер кэша вершин, учитываемый при оптимизации
+#define Z3D_D3D9HL_MAX_VCACHE_SIZE 64
+
+/// Размер кэша вершин по умолчанию
+#define Z3D_D3D9HL_DEFAULT_VCACHE_SIZE 24
+
+/// Наибольшее число потоков при оптимизации поднаборов сетки
+#define Z3D_D3D9HL_MAX_WORKER_THREADS 16
+
+/// Показатели использования кэша вершин
+struct z3DD3D9HL_VertexCacheStats{
+    float acmr_;                    ///< среднее число промахов кэша на треугольник (ACMR)
+    float atvr_;                    ///< отношение числа преобразованных вершин к числу используемых (ATVR)
+    uint32_t numTransformed_;       ///< число преобразованных вершин (промахов кэша)
+    uint32_t numUsedVertices_;      ///< число вершин, на которые ссылаются индексы
+};
+
+/// Поднабор сетки - непрерывный диапазон треугольников с общим материалом
+struct z3DD3D9HL_MeshSubset{
+    uint32_t faceStart_;            ///< номер первого треугольника
+    uint32_t faceCount_;            ///< число треугольников
+};
+
+namespace z3D
+{
+/** Вычислить показатели использования кэша вершин, моделируя кэш FIFO.
+    @param [out] stats для сохранения показателей ( @see z3DD3D9HL_VertexCacheStats ).
+    @param indices индексы списка треугольников.
+    @param numFaces число треугольников.
+    @param numVertices число вершин.
+    @param f32BitIndices true(false) - 32(16)-битные индексы.
+    @param cacheSize размер моделируемого кэша вершин.
+    @param scratch арена для временной памяти. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ComputeVertexCacheStats(z3DD3D9HL_VertexCacheStats* stats,
+                                                  const void* indices,
+                                                  uint32_t numFaces,
+                                                  uint32_t numVertices,
+                                                  bool f32BitIndices,
+                                                  uint32_t cacheSize = Z3D_D3D9HL_DEFAULT_VCACHE_SIZE,
+                                                  z3DD3D9HL_Arena* scratch = 0);
+
+/** Переупорядочить треугольники для повторного использования вершин из кэша.
+    @param [out] faceRemap массив из numFaces элементов для сохранения перестановки треугольников.
+    @param indices индексы списка треугольников.
+    @param numFaces число треугольников.
+    @param numVertices число вершин.
+    @param f32BitIndices true(false) - 32(16)-битные индексы.
+    @param cacheSize размер кэша вершин, от 4 до Z3D_D3D9HL_MAX_VCACHE_SIZE.
+    @param scratch арена для временной памяти. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeFaces(uint32_t* faceRemap,
+                                        const void* indices,
+                                        uint32_t numFaces,
+                                        uint32_t numVertices,
+                                        bool f32BitIndices,
+                                        uint32_t cacheSize = Z3D_D3D9HL_DEFAULT_VCACHE_SIZE,
+                                        z3DD3D9HL_Arena* scratch = 0);
+
+/** Переупорядочить треугольники поднаборов сетки, обрабатывая поднаборы параллельно.
+
+    Треугольники каждого поднабора переставляются только в пределах поднабора. Треугольники,
+    не входящие ни в один поднабор, остаются на месте.
+    @param [out] faceRemap массив из numFaces элементов для сохранения перестановки треугольников.
+    @param indices индексы списка треугольников.
+    @param numFaces число треугольников.
+    @param numVertices число вершин.
+    @param f32BitIndices true(false) - 32(16)-битные индексы.
+    @param subsets массив непересекающихся поднаборов.
+    @param numSubsets число поднаборов.
+    @param cacheSize размер кэша вершин, от 4 до Z3D_D3D9HL_MAX_VCACHE_SIZE.
+    @param numThreads число потоков, включая вызывающий, не более Z3D_D3D9HL_MAX_WORKER_THREADS.
+    @param scratch арена для временной памяти. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_INVALIDCALL, если поднабор выходит
+    за пределы сетки или пересекается с другим; потоки при этом не запускаются.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeFacesSubsets(uint32_t* faceRemap,
+                                               const void* indices,
+                                               uint32_t numFaces,
+                                               uint32_t numVertices,
+                                               bool f32BitIndices,
+                                               const z3DD3D9HL_MeshSubset* subsets,
+                                               uint32_t numSubsets,
+                                               uint32_t cacheSize = Z3D_D3D9HL_DEFAULT_VCACHE_SIZE,
+                                               uint32_t numThreads = 1,
+                                               z3DD3D9HL_Arena* scratch = 0);
+
+/** Упорядочить группы треугольников для уменьшения перерисовки.
+
+    Порядок, полученный из D3D9HL_OptimizeFaces(), разбивается на группы в местах, где кэш вершин
+    начинает заполняться заново, или где среднее число промахов в группе, считая с пустого кэша,
+    не превышает threshold * ACMR всей сетки. Поэтому ACMR после перестановки групп растет не более
+    чем в threshold раз. Группы, обращенные наружу от центра сетки, рисуются первыми.
+    Группы переставляются по всей сетке, поэтому для сетки из нескольких поднаборов нужна
+    D3D9HL_OptimizeOverdrawSubsets().
+    @param [in,out] faceRemap перестановка треугольников, полученная из D3D9HL_OptimizeFaces().
+    @param indices исходные индексы списка треугольников.
+    @param numFaces число треугольников.
+    @param positions позиции вершин (три числа с плавающей точкой на вершину).
+    @param positionStride расстояние между позициями соседних вершин в байтах.
+    @param numVertices число вершин.
+    @param f32BitIndices true(false) - 32(16)-битные индексы.
+    @param cacheSize размер кэша вершин.
+    @param threshold допустимый рост ACMR, не меньше 1. Чем больше, тем мельче группы.
+    @param scratch арена для временной памяти. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_INVALIDCALL, если faceRemap
+    не является перестановкой numFaces треугольников.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeOverdraw(uint32_t* faceRemap,
+                                           const void* indices,
+                                           uint32_t numFaces,
+                                           const float* positions,
+                                           uint32_t positionStride,
+                                           uint32_t numVertices,
+                                           bool f32BitIndices,
+                                           uint32_t cacheSize = Z3D_D3D9HL_DEFAULT_VCACHE_SIZE,
+                                           float threshold = 1.05f,
+                                           z3DD3D9HL_Arena* scratch = 0);
+
+/** Упорядочить группы треугольников для уменьшения перерисовки в пределах каждого поднабора.
+
+    Как D3D9HL_OptimizeOverdraw(), но группы и центр считаются для каждого поднабора отдельно,
+    и треугольники не выходят за границы своего поднабора.
+    @param [in,out] faceRemap перестановка треугольников, полученная из D3D9HL_OptimizeFacesSubsets().
+    @param indices исходные индексы списка треугольников.
+    @param numFaces число треугольников.
+    @param positions позиции вершин (три числа с плавающей точкой на вершину).
+    @param positionStride расстояние между позициями соседних вершин в байтах.
+    @param numVertices число вершин.
+    @param f32BitIndices true(false) - 32(16)-битные индексы.
+    @param subsets массив непересекающихся поднаборов.
+    @param numSubsets число поднаборов.
+    @param cacheSize размер кэша вершин.
+    @param threshold допустимый рост ACMR, не меньше 1.
+    @param scratch арена для временной памяти. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_INVALIDCALL, если поднаборы
+    пересекаются, или перестановка переносит треугольник из одного поднабора в другой или повторяет его.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeOverdrawSubsets(uint32_t* faceRemap,
+                                                  const void* indices,
+                                                  uint32_t numFaces,
+                                                  const float* positions,
+                                                  uint32_t positionStride,
+                                                  uint32_t numVertices,
+                                                  bool f32BitIndices,
+                                                  const z3DD3D9HL_MeshSubset* subsets,
+                                                  uint32_t numSubsets,
+                                                  uint32_t cacheSize = Z3D_D3D9HL_DEFAULT_VCACHE_SIZE,
+                                                  float threshold = 1.05f,
+                                                  z3DD3D9HL_Arena* scratch = 0);
+
+/** Переупорядочить вершины в порядке первого обращения к ним.
+
+    Неиспользуемые вершины помещаются в конец в исходном порядке.
+    @param [out] vertexRemap массив из numVertices элементов для сохранения перестановки вершин.
+    @param indices индексы списка треугольников (уже переупорядоченных).
+    @param numFaces число треугольников.
+    @param numVertices число вершин.
+    @param f32BitIndices true(false) - 32(16)-битные индексы.
+    @param scratch арена для временной памяти. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeVertices(uint32_t* vertexRemap,
+                                           const void* indices,
+                                           uint32_t numFaces,
+                                           uint32_t numVertices,
+                                           bool f32BitIndices,
+                                           z3DD3D9HL_Arena* scratch = 0);
+
+/** Применить перестановку треугольников.
+    @param [out] dstIndices индексы результата, не должны совпадать с srcIndices.
+    @param srcIndices исходные индексы.
+    @param faceRemap перестановка треугольников.
+    @param numFaces число треугольников.
+    @param f32BitIndices true(false) - 32(16)-битные индексы.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_RemapFaces(void* dstIndices,
+                                     const void* srcIndices,
+                                     const uint32_t* faceRemap,
+                                     uint32_t numFaces,
+                                     bool f32BitIndices);
+
+/** Применить перестановку вершин к индексам (на месте).
+    @param [in,out] indices индексы списка треугольников.
+    @param numFaces число треугольников.
+    @param vertexRemap перестановка вершин, полученная из D3D9HL_OptimizeVertices().
+    @param numVertices число вершин.
+    @param f32BitIndices true(false) - 32(16)-битные индексы.
+    @param scratch арена для временной памяти. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_INVALIDCALL, если vertexRemap
+    не является перестановкой numVertices вершин; индексы при этом не меняются.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_RemapIndices(void* indices,
+                                       uint32_t numFaces,
+                                       const uint32_t* vertexRemap,
+                                       uint32_t numVertices,
+                                       bool f32BitIndices,
+                                       z3DD3D9HL_Arena* scratch = 0);
+
+/** Применить перестановку вершин к вершинному буферу.
+    @param [out] dstVertices вершины результата, не должны совпадать с srcVertices.
+    @param srcVertices исходные вершины.
+    @param vertexStride размер вершины в байтах.
+    @param vertexRemap перестановка вершин, полученная из D3D9HL_OptimizeVertices().
+    @param numVertices число вершин.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_RemapVertices(void* dstVertices,
+                                        const void* srcVertices,
+                                        uint32_t vertexStride,
+                                        const uint32_t* vertexRemap,
+                                        uint32_t numVertices);
+
+} // end of z3D
+#endif // Z3DD3D9HLMESHOPT_H
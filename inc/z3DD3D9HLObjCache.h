@@ -0,0 +1,143 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLOBJCACHE_H
+#define Z3DD3D9HLOBJCACHE_H
+
+/** @file z3DD3D9HLObjCache.h */
+
+/** @page ObjCache Кэш объявлений вершин и шейдеров.
+
+Кэш возвращает один общий объект IDirect3DVertexDeclaration9, IDirect3DVertexShader9 или
+IDirect3DPixelShader9 для всех одинаковых массивов D3DVERTEXELEMENT9 и одинакового байт-кода шейдеров.
+Запросы объектов ( D3D9HL_ObjCacheRequest* ) можно выполнять из любых потоков одновременно: они не
+используют блокировок и возвращают номер записи кэша. Сами объекты создаются в потоке устройства
+функцией D3D9HL_ObjCacheCreatePending(), после чего доступны через D3D9HL_ObjCacheGet*().
+
+Каждый запрос увеличивает счетчик ссылок записи, D3D9HL_ObjCacheRelease() уменьшает его.
+Объекты записей без ссылок освобождаются функцией D3D9HL_ObjCacheTrim() и будут созданы снова
+при следующем запросе.
+
+Кэш регистрируется слушателем событий устройства ( @see D3D9HL_AddDeviceListener ). Reset() объекты
+переживают, а при пересоздании устройства (например, в D3D9HL_SwitchVideoMode()) освобождаются,
+и записи снова ожидают создания в D3D9HL_ObjCacheCreatePending() на новом устройстве. Номера записей
+при этом не меняются.
+@code
+    // поток загрузки
+    uint32_t hDecl;
+    z3D::D3D9HL_ObjCacheRequestVertexDecl(&objCache, elements, &hDecl);
+
+    // поток устройства, раз в кадр
+    z3D::D3D9HL_ObjCacheCreatePending(&objCache, device);
+    device->SetVertexDeclaration(z3D::D3D9HL_ObjCacheGetVertexDecl(&objCache, hDecl));
+@endcode
+*/
+
+#include <d3d9.h>
+
+#include "z3DD3D9HLDef.h"
+#include "z3DD3D9HLAlloc.h"
+
+struct z3DD3D9HL_ObjCacheEntry;
+
+/// Кэш объявлений вершин и шейдеров
+struct z3DD3D9HL_ObjCache{
+    z3DD3D9HL_ObjCacheEntry* entries_;  ///< таблица записей с открытой адресацией
+    uint32_t capacity_;                 ///< число записей, степень двойки
+    uint8_t* keyMem_;                   ///< память для копий ключей (элементов объявлений и байт-кода)
+    uint32_t keyMemCapacity_;           ///< размер памяти для ключей в байтах
+    volatile int32_t keyMemOffset_;     ///< число занятых байт памяти для ключей, не больше keyMemCapacity_
+    volatile int32_t fDirty_;           ///< есть записи, ожидающие создания объекта
+    volatile int32_t numEntries_;       ///< число занятых записей
+    volatile int32_t numLookups_;       ///< число запросов
+    volatile int32_t numHits_;          ///< число запросов, для которых запись уже существовала
+    LPDIRECT3DDEVICE9 device_;          ///< устройство, на котором созданы объекты, или 0
+};
+
+/// Статистика кэша объявлений вершин и шейдеров
+struct z3DD3D9HL_ObjCacheStats{
+    uint32_t numLookups_;               ///< число запросов
+    uint32_t numHits_;                  ///< число запросов, для которых запись уже существовала
+    uint32_t numEntries_;               ///< число различных ключей
+    uint32_t numObjects_;               ///< число созданных объектов Direct3D9
+    uint32_t numPending_;               ///< число записей, ожидающих создания объекта
+    uint32_t numFailed_;                ///< число записей, объект для которых создать не удалось
+    uint32_t keyBytes_;                 ///< объем памяти, занятой копиями ключей
+};
+
+namespace z3D
+{
+/** Подготовить кэш.
+
+    Память для таблицы записей и копий ключей берется из арены. Кэш регистрируется слушателем
+    событий устройства и не должен перемещаться в памяти до вызова D3D9HL_ObjCacheShutdown().
+    @param [out] objCache кэш.
+    @param arena арена.
+    @param capacity наибольшее число различных объектов, округляется вверх до степени двойки.
+    Для быстрого поиска рекомендуется задавать с запасом.
+    @param keyMemSize размер памяти для копий ключей в байтах.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_OUTOFMEMORY, если не хватило памяти арены
+    или места для слушателя событий устройства.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheInit(z3DD3D9HL_ObjCache* objCache,
+                                       z3DD3D9HL_Arena* arena,
+                                       uint32_t capacity,
+                                       uint32_t keyMemSize);
+
+/** Освободить все объекты Direct3D9 кэша и отменить регистрацию слушателя. Вызывается в потоке устройства.
+*/
+void D3D9HL_ObjCacheShutdown(z3DD3D9HL_ObjCache* objCache);
+
+/** @name Запрос объектов. Можно вызывать из любого потока.
+    @param objCache кэш.
+    @param elements массив элементов объявления, завершенный D3DDECL_END().
+    @param function байт-код шейдера.
+    @param [out] handle для сохранения номера записи кэша.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_OUTOFMEMORY, если в кэше нет места.
+*/
+///@{
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheRequestVertexDecl(z3DD3D9HL_ObjCache* objCache,
+                                                    const D3DVERTEXELEMENT9* elements,
+                                                    uint32_t* handle);
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheRequestVertexShader(z3DD3D9HL_ObjCache* objCache,
+                                                      const DWORD* function,
+                                                      uint32_t* handle);
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheRequestPixelShader(z3DD3D9HL_ObjCache* objCache,
+                                                     const DWORD* function,
+                                                     uint32_t* handle);
+///@}
+
+/** Отказаться от ссылки на запись кэша. Можно вызывать из любого потока.
+*/
+void D3D9HL_ObjCacheRelease(z3DD3D9HL_ObjCache* objCache, uint32_t handle);
+
+/** Создать объекты для запрошенных записей. Вызывается в потоке устройства.
+    @param objCache кэш.
+    @param device указатель на устройство.
+    @param [out] pNumCreated для сохранения числа созданных объектов. Можно передать нуль.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheCreatePending(z3DD3D9HL_ObjCache* objCache,
+                                                LPDIRECT3DDEVICE9 device,
+                                                uint32_t* pNumCreated = 0);
+
+/** Освободить объекты записей, на которые нет ссылок. Вызывается в потоке устройства.
+    @return число освобожденных объектов.
+*/
+uint32_t D3D9HL_ObjCacheTrim(z3DD3D9HL_ObjCache* objCache);
+
+/** @name Получение объектов. Вызывается в потоке устройства.
+Объекты возвращаются без вызова AddRef(). Если объект еще не создан, возвращается 0.
+*/
+///@{
+LPDIRECT3DVERTEXDECLARATION9 D3D9HL_ObjCacheGetVertexDecl(const z3DD3D9HL_ObjCache* objCache, uint32_t handle);
+LPDIRECT3DVERTEXSHADER9 D3D9HL_ObjCacheGetVertexShader(const z3DD3D9HL_ObjCache* objCache, uint32_t handle);
+LPDIRECT3DPIXELSHADER9 D3D9HL_ObjCacheGetPixelShader(const z3DD3D9HL_ObjCache* objCache, uint32_t handle);
+///@}
+
+/** Получить статистику кэша.
+*/
+void D3D9HL_ObjCacheGetStats(z3DD3D9HL_ObjCacheStats* stats, const z3DD3D9HL_ObjCache* objCache);
+
+} // end of z3D
+#endif // Z3DD3D9HLOBJCACHE_H
@@ -0,0 +1,201 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLOCCLUSION_H
+#define Z3DD3D9HLOCCLUSION_H
+
+/** @file z3DD3D9HLOcclusion.h */
+
+/** @page Occlusion Отсечение невидимых объектов запросами перекрытия.
+
+Видимость объектов определяется запросами D3DQUERYTYPE_OCCLUSION из пула. Результаты запросов читаются
+в следующих кадрах без ожидания (GetData() без D3DGETDATA_FLUSH): пока результата нет, объект
+считается таким же видимым, как при последней проверке. Видимый объект повторно не проверяется
+заданное число кадров, невидимый не рисуется, а проверяется по ограничивающему параллелепипеду.
+Ставший видимым объект поэтому появляется с задержкой в один-два кадра.
+
+Для каждого объекта D3D9HL_OcclusionTest() возвращает действие ( @see z3DD3D9HL_OcclusionAction ).
+Решение принимается без обращения к Direct3D9 ( D3D9HL_OcclusionBeginFrame(), D3D9HL_OcclusionTest(),
+D3D9HL_OcclusionSetResult() ), поэтому планирование запросов можно проверить моделированием.
+Запросы выдаются функциями D3D9HL_OcclusionBeginQuery() и D3D9HL_OcclusionEndQuery(), результаты
+читаются функцией D3D9HL_OcclusionPoll().
+
+Параллелепипед рисуется приложением с отключенной записью цвета и глубины. Пул регистрируется
+слушателем событий устройства ( @see D3D9HL_AddDeviceListener ): при потере устройства и смене
+видеорежима запросы освобождаются и создаются заново, а объекты с незавершенными запросами считаются видимыми.
+@code
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    z3D::D3D9HL_OcclusionPoll(&occlusion);
+    for (uint32_t i = 0; i < numObjects; ++i){
+        switch (z3D::D3D9HL_OcclusionTest(&occlusion, i)){
+        case Z3D_D3D9HL_OCCLUSION_DRAW:
+            DrawObject(i);
+            break;
+        case Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED:
+            z3D::D3D9HL_OcclusionBeginQuery(&occlusion, i);
+            DrawObject(i);
+            z3D::D3D9HL_OcclusionEndQuery(&occlusion, i);
+            break;
+        case Z3D_D3D9HL_OCCLUSION_QUERY_BOX:
+            z3D::D3D9HL_OcclusionBeginQuery(&occlusion, i);
+            DrawBoundingBox(i);
+            z3D::D3D9HL_OcclusionEndQuery(&occlusion, i);
+            break;
+        case Z3D_D3D9HL_OCCLUSION_SKIP:
+            break;
+        }
+    }
+@endcode
+Объекты лучше проверять в порядке удаления от камеры, чтобы перекрывающие объекты рисовались раньше.
+*/
+
+#include <d3d9.h>
+
+#include "z3DD3D9HLDef.h"
+#include "z3DD3D9HLAlloc.h"
+
+/// Действие с объектом в текущем кадре
+enum z3DD3D9HL_OcclusionAction{
+    Z3D_D3D9HL_OCCLUSION_DRAW,          ///< нарисовать объект
+    Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED,  ///< нарисовать объект внутри запроса
+    Z3D_D3D9HL_OCCLUSION_QUERY_BOX,     ///< не рисовать объект, нарисовать внутри запроса его ограничивающий параллелепипед
+    Z3D_D3D9HL_OCCLUSION_SKIP           ///< не рисовать объект
+};
+
+/// Параметры отсечения
+struct z3DD3D9HL_OcclusionParams{
+    uint32_t visibleFrames_;            ///< число кадров, в течение которых видимый объект не проверяется повторно
+    uint32_t visiblePixels_;            ///< наименьшее число пикселей, при котором объект считается видимым
+    uint32_t maxLatencyFrames_;         ///< число кадров, после которого запрос без результата отменяется, а объект считается видимым
+
+    z3DD3D9HL_OcclusionParams() :
+        visibleFrames_(8),
+        visiblePixels_(1),
+        maxLatencyFrames_(4){
+    }
+};
+
+/// Состояние объекта
+struct z3DD3D9HL_OcclusionObject{
+    uint32_t iQuery_;                   ///< запрос без результата или Z3D_D3D9HL_NOINDEX
+    uint32_t nextQueryFrame_;           ///< кадр, начиная с которого видимый объект проверяется снова
+    uint32_t lastPixels_;               ///< число пикселей по последнему результату
+    bool fVisible_;                     ///< объект видим по последнему результату
+};
+
+/// Запрос пула
+struct z3DD3D9HL_OcclusionQuery{
+    LPDIRECT3DQUERY9 query_;            ///< запрос Direct3D9
+    uint32_t iObject_;                  ///< проверяемый объект или Z3D_D3D9HL_NOINDEX, если запрос свободен
+    uint32_t issueFrame_;               ///< кадр, в котором запрос выдан
+    bool fIssued_;                      ///< запрос завершен вызовом D3D9HL_OcclusionEndQuery()
+};
+
+/// Статистика отсечения за кадр
+struct z3DD3D9HL_OcclusionStats{
+    uint32_t numTests_;                 ///< число проверенных объектов
+    uint32_t numQueries_;               ///< число выданных запросов
+    uint32_t numResults_;               ///< число полученных результатов
+    uint32_t numStallsAvoided_;         ///< число опросов запросов без результата, не ожидавших его
+    uint32_t numCulled_;                ///< число объектов, не нарисованных как невидимые
+    uint32_t numQueriesSaved_;          ///< число видимых объектов, нарисованных без запроса
+    uint32_t numPoolExhausted_;         ///< число объектов, нарисованных без запроса из-за нехватки запросов
+    uint32_t numAbandoned_;             ///< число запросов, отмененных без результата
+};
+
+/// Пул запросов перекрытия
+struct z3DD3D9HL_Occlusion{
+    z3DD3D9HL_OcclusionObject* objects_;
+    uint32_t numObjects_;
+    z3DD3D9HL_OcclusionQuery* queries_;
+    uint32_t numQueries_;
+    uint32_t* freeQueries_;             ///< стек номеров свободных запросов
+    uint32_t numFreeQueries_;
+    uint32_t frame_;                    ///< номер текущего кадра
+    z3DD3D9HL_OcclusionParams params_;
+    LPDIRECT3DDEVICE9 device_;          ///< устройство, для которого созданы запросы, или 0
+
+    z3DD3D9HL_OcclusionStats frameStats_;       ///< статистика текущего кадра
+    z3DD3D9HL_OcclusionStats lastFrameStats_;   ///< статистика прошлого кадра
+};
+
+namespace z3D
+{
+/** Подготовить пул без создания запросов Direct3D9.
+
+    Память для объектов и запросов берется из арены. Все объекты считаются видимыми и будут проверены
+    при первом вызове D3D9HL_OcclusionTest(). Пул без запросов Direct3D9 используется для моделирования:
+    результаты передаются функцией D3D9HL_OcclusionSetResult().
+    @param [out] occlusion пул.
+    @param arena арена.
+    @param numObjects число объектов.
+    @param numQueries число запросов.
+    @param params параметры отсечения.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OcclusionInit(z3DD3D9HL_Occlusion* occlusion,
+                                        z3DD3D9HL_Arena* arena,
+                                        uint32_t numObjects,
+                                        uint32_t numQueries,
+                                        const z3DD3D9HL_OcclusionParams& params);
+
+/** Создать запросы Direct3D9 и зарегистрировать пул слушателем событий устройства.
+
+    Пул не должен перемещаться в памяти до вызова D3D9HL_OcclusionShutdown().
+    @param occlusion пул, подготовленный D3D9HL_OcclusionInit().
+    @param device указатель на устройство.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_NOTAVAILABLE, если устройство не поддерживает
+    запросы перекрытия.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OcclusionCreateQueries(z3DD3D9HL_Occlusion* occlusion, LPDIRECT3DDEVICE9 device);
+
+/** Освободить запросы Direct3D9 и отменить регистрацию слушателя.
+*/
+void D3D9HL_OcclusionShutdown(z3DD3D9HL_Occlusion* occlusion);
+
+/** Начать кадр: отменить запросы, результат которых ждет дольше maxLatencyFrames_ кадров.
+
+    Функция не обращается к Direct3D9.
+*/
+void D3D9HL_OcclusionBeginFrame(z3DD3D9HL_Occlusion* occlusion);
+
+/** Прочитать готовые результаты запросов прошлых кадров без ожидания.
+    @return Число полученных результатов.
+*/
+uint32_t D3D9HL_OcclusionPoll(z3DD3D9HL_Occlusion* occlusion);
+
+/** Решить, что делать с объектом в текущем кадре.
+
+    Для действий Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED и Z3D_D3D9HL_OCCLUSION_QUERY_BOX объекту выделяется
+    запрос. Если свободных запросов нет, объект рисуется без запроса. Функция не обращается к Direct3D9.
+    @param occlusion пул.
+    @param iObject номер объекта.
+    @return Действие ( @see z3DD3D9HL_OcclusionAction ).
+*/
+z3DD3D9HL_OcclusionAction D3D9HL_OcclusionTest(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject);
+
+/** Учесть результат запроса объекта и освободить запрос.
+
+    Функция не обращается к Direct3D9 и вызывается из D3D9HL_OcclusionPoll().
+    @param occlusion пул.
+    @param iObject номер объекта, которому выделен запрос.
+    @param numPixels число прошедших тест глубины пикселей.
+*/
+void D3D9HL_OcclusionSetResult(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject, uint32_t numPixels);
+
+/** Начать запрос объекта перед выводом объекта или его параллелепипеда.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OcclusionBeginQuery(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject);
+
+/** Завершить запрос объекта после вывода.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_OcclusionEndQuery(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject);
+
+/** Получить статистику прошлого кадра.
+*/
+void D3D9HL_OcclusionGetStats(z3DD3D9HL_OcclusionStats* stats, const z3DD3D9HL_Occlusion* occlusion);
+
+} // end of z3D
+#endif // Z3DD3D9HLOCCLUSION_H
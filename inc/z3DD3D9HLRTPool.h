@@ -0,0 +1,164 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLRTPOOL_H
+#define Z3DD3D9HLRTPOOL_H
+
+/** @file z3DD3D9HLRTPool.h */
+
+/** @page RTPool Пул временных поверхностей рендера и буферов глубины.
+
+Пул выдает поверхности D3DPOOL_DEFAULT для промежуточных проходов (постобработка, тени и т.п.)
+вместо их создания и освобождения по требованию. Поверхность определяется размерами, форматом,
+типом и качеством мультисэмплинга и тем, является ли она буфером глубины ( @see z3DD3D9HL_RTDesc ).
+Нулевые размеры и D3DFMT_UNKNOWN заменяются параметрами заднего буфера первой цепочки обмена и
+текущего буфера глубины устройства; в оконном режиме это размеры окна, а не видеорежима. У устройства
+адаптерной группы это задний буфер первой головы: поверхности для остальных голов с другими
+видеорежимами запрашиваются с явными размерами и форматом.
+
+Каждый запрос указывает диапазон проходов кадра, в которых поверхность используется. Запросы с
+одинаковым описанием и непересекающимися диапазонами получают одну и ту же поверхность. Содержимое
+поверхности после последнего прохода диапазона не сохраняется. Поверхности, не запрашивавшиеся
+заданное число кадров, освобождаются.
+
+Пул регистрируется слушателем событий устройства ( @see D3D9HL_AddDeviceListener ): при потере
+устройства и смене видеорежима поверхности освобождаются и создаются заново при следующих запросах.
+@code
+    z3D::D3D9HL_RTPoolInit(&rtPool, device);
+    ...
+    z3D::D3D9HL_RTPoolBeginFrame(&rtPool);
+    z3DD3D9HL_RTDesc desc;
+    z3D::D3D9HL_RTPoolMakeDesc(&desc, &rtPool, false, 2);
+    z3D::D3D9HL_RTPoolAcquire(&bloomRT, &bloomTex, &rtPool, device, desc, 1, 2);
+    z3D::D3D9HL_RTPoolAcquire(&blurRT, &blurTex, &rtPool, device, desc, 3, 4); // та же поверхность
+@endcode
+*/
+
+#include <d3d9.h>
+
+#include "z3DD3D9HLDef.h"
+
+/// Наибольшее число поверхностей в пуле
+#define Z3D_D3D9HL_MAX_POOLED_SURFACES 64
+
+/// Наибольшее число запросов за кадр, получающих одну поверхность
+#define Z3D_D3D9HL_MAX_SURFACE_ALIASES 8
+
+/// Описание поверхности пула
+struct z3DD3D9HL_RTDesc{
+    uint32_t width_;                        ///< ширина, 0 - ширина заднего буфера
+    uint32_t height_;                       ///< высота, 0 - высота заднего буфера
+    D3DFORMAT format_;                      ///< формат, D3DFMT_UNKNOWN - формат заднего буфера или буфера глубины
+    D3DMULTISAMPLE_TYPE multiSampleType_;   ///< тип мультисэмплинга
+    DWORD multiSampleQuality_;              ///< качество мультисэмплинга
+    bool fDepth_;                           ///< буфер глубины и трафарета
+};
+
+/// Поверхность пула
+struct z3DD3D9HL_PooledSurface{
+    z3DD3D9HL_RTDesc desc_;                 ///< описание поверхности
+    LPDIRECT3DSURFACE9 surface_;            ///< поверхность
+    LPDIRECT3DTEXTURE9 texture_;            ///< текстура, которой принадлежит поверхность, или 0
+    uint32_t bytes_;                        ///< оценка занимаемой видеопамяти в байтах
+    uint32_t lastUsedFrame_;                ///< номер кадра последнего запроса
+    uint32_t numUses_;                      ///< число запросов в текущем кадре
+    uint32_t firstPass_[Z3D_D3D9HL_MAX_SURFACE_ALIASES];   ///< первые проходы запросов текущего кадра
+    uint32_t lastPass_[Z3D_D3D9HL_MAX_SURFACE_ALIASES];    ///< последние проходы запросов текущего кадра
+};
+
+/// Пул временных поверхностей
+struct z3DD3D9HL_RTPool{
+    z3DD3D9HL_PooledSurface surfaces_[Z3D_D3D9HL_MAX_POOLED_SURFACES];
+    uint32_t numSurfaces_;
+    uint32_t frame_;                        ///< номер текущего кадра
+    uint32_t maxIdleFrames_;                ///< число кадров без запросов, после которого поверхность освобождается
+
+    uint32_t width_;                        ///< ширина заднего буфера
+    uint32_t height_;                       ///< высота заднего буфера
+    D3DFORMAT colorFmt_;                    ///< формат заднего буфера
+    D3DFORMAT depthFmt_;                    ///< формат буфера глубины устройства или D3DFMT_UNKNOWN, если его нет
+    D3DMULTISAMPLE_TYPE multiSampleType_;   ///< мультисэмплинг заднего буфера
+    DWORD multiSampleQuality_;
+
+    uint32_t numAcquires_;
+    uint32_t numCreated_;
+    uint32_t numCreationsAvoided_;
+    uint32_t numReleased_;
+    uint32_t frameBytesRequested_;
+    uint32_t frameBytesUsed_;
+};
+
+/// Статистика пула
+struct z3DD3D9HL_RTPoolStats{
+    uint32_t numAcquires_;                  ///< число запросов
+    uint32_t numCreated_;                   ///< число созданных поверхностей
+    uint32_t numCreationsAvoided_;          ///< число запросов, обслуженных существующей поверхностью
+    uint32_t numReleased_;                  ///< число поверхностей, освобожденных за долгим неиспользованием
+    uint32_t numSurfaces_;                  ///< число поверхностей в пуле
+    uint32_t bytesAllocated_;               ///< оценка видеопамяти, занятой поверхностями пула
+    uint32_t frameBytesRequested_;          ///< сумма размеров поверхностей, запрошенных в текущем кадре
+    uint32_t frameBytesSaved_;              ///< память, сэкономленная в текущем кадре за счет совмещения поверхностей
+};
+
+namespace z3D
+{
+/** Подготовить пул и зарегистрировать его слушателем событий устройства.
+
+    Пул не должен перемещаться в памяти до вызова D3D9HL_RTPoolShutdown().
+    @param [out] pool пул.
+    @param device устройство. Параметры поверхностей по умолчанию берутся из его заднего буфера и
+    буфера глубины и обновляются после каждого Reset().
+    @param maxIdleFrames число кадров без запросов, после которого поверхность освобождается.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_RTPoolInit(z3DD3D9HL_RTPool* pool,
+                                     LPDIRECT3DDEVICE9 device,
+                                     uint32_t maxIdleFrames = 60);
+
+/** Освободить все поверхности и отменить регистрацию слушателя.
+*/
+void D3D9HL_RTPoolShutdown(z3DD3D9HL_RTPool* pool);
+
+/** Освободить все поверхности. Они будут созданы заново при следующих запросах.
+*/
+void D3D9HL_RTPoolRelease(z3DD3D9HL_RTPool* pool);
+
+/** Заполнить описание поверхности параметрами заднего буфера или буфера глубины.
+    @param [out] desc описание.
+    @param pool пул.
+    @param fDepth true(false) - буфер глубины (поверхность рендера).
+    @param divisor делитель размеров заднего буфера.
+*/
+void D3D9HL_RTPoolMakeDesc(z3DD3D9HL_RTDesc* desc, const z3DD3D9HL_RTPool* pool, bool fDepth, uint32_t divisor = 1);
+
+/** Начать кадр: забыть запросы прошлого кадра и освободить давно не запрашивавшиеся поверхности.
+*/
+void D3D9HL_RTPoolBeginFrame(z3DD3D9HL_RTPool* pool);
+
+/** Получить поверхность на диапазон проходов текущего кадра.
+
+    Поверхности рендера без мультисэмплинга создаются как текстуры, остальные - как поверхности.
+    Ссылки возвращаются без вызова AddRef() и действительны до освобождения поверхностей пула.
+    @param [out] surface для сохранения поверхности.
+    @param [out] texture для сохранения текстуры, которой принадлежит поверхность (0, если ее нет). Можно передать нуль.
+    @param pool пул.
+    @param device указатель на устройство.
+    @param desc описание поверхности.
+    @param firstPass первый проход, в котором используется поверхность.
+    @param lastPass последний проход, в котором используется поверхность.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_RTPoolAcquire(LPDIRECT3DSURFACE9* surface,
+                                        LPDIRECT3DTEXTURE9* texture,
+                                        z3DD3D9HL_RTPool* pool,
+                                        LPDIRECT3DDEVICE9 device,
+                                        const z3DD3D9HL_RTDesc& desc,
+                                        uint32_t firstPass,
+                                        uint32_t lastPass);
+
+/** Получить статистику пула.
+*/
+void D3D9HL_RTPoolGetStats(z3DD3D9HL_RTPoolStats* stats, const z3DD3D9HL_RTPool* pool);
+
+} // end of z3D
+#endif // Z3DD3D9HLRTPOOL_H
@@ -0,0 +1,251 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLSHADERCACHE_H
+#define Z3DD3D9HLSHADERCACHE_H
+
+/** @file z3DD3D9HLShaderCache.h */
+
+/** @page ShaderCache Дисковый кэш скомпилированных шейдеров.
+
+Кэш избавляет от повторной компиляции неизменившихся шейдеров при каждом запуске приложения.
+Ключ записи - 64-битный хэш текста шейдера, текстов всех включаемых им файлов (рекурсивно),
+макроопределений, точки входа, профиля, флагов компиляции и версии компилятора. Каждая запись
+хранится в отдельном файле каталога кэша и при попадании отображается в память без копирования.
+При промахе шейдер компилируется, а файл записи сначала пишется во временный файл и затем
+атомарно подменяет прежний (MoveFileEx() в Win32, rename() в POSIX), поэтому другой поток или
+процесс никогда не увидит недописанную запись. Файлы, отображение и потоки скрыты за слоем
+платформы, поэтому кэш работает и вне Windows с подключенным компилятором.
+
+Задания ( z3DD3D9HL_ShaderJob ) принадлежат вызывающей стороне и выполняются пулом потоков кэша.
+Компилятор подключаемый ( @see z3DD3D9HL_ShaderCompiler ), по умолчанию используется D3DXCompileShader().
+@code
+    z3DD3D9HL_ShaderCache cache;
+    z3D::D3D9HL_ShaderCacheInit(&cache, "ShaderCache", 4);
+
+    z3DD3D9HL_ShaderJob job;
+    z3D::D3D9HL_ShaderJobInit(&job, source, sourceSize, defines, "main", "vs_2_0");
+    z3D::D3D9HL_ShaderCacheSubmit(&cache, &job);
+    ...
+    if (z3D::D3D9HL_ShaderCacheWait(&cache, &job) == Z3D_D3D9HL_NONE)
+        device->CreateVertexShader(job.code_, &vs);
+    z3D::D3D9HL_ShaderCacheReleaseJob(&cache, &job);
+
+    z3D::D3D9HL_ShaderCacheShutdown(&cache);
+@endcode
+*/
+
+#include "z3DD3D9HLDef.h"
+
+/// Наибольшее число потоков компиляции
+#define Z3D_D3D9HL_MAX_SHADER_THREADS 16
+
+/// Наибольшая длина пути к каталогу кэша и к включаемому файлу, включая завершающий нуль
+#define Z3D_D3D9HL_MAX_SHADER_PATH 260
+
+/// Наибольшее число различных включаемых файлов, учитываемых в ключе одного шейдера
+#define Z3D_D3D9HL_MAX_SHADER_INCLUDES 64
+
+/// Макроопределение. Совпадает по раскладке с D3DXMACRO, массив завершается элементом с нулевым именем.
+struct z3DD3D9HL_ShaderDefine{
+    const char* name_;              ///< имя макроса
+    const char* definition_;        ///< значение макроса
+};
+
+/// Описание компилируемого шейдера. Память, на которую ссылаются поля, должна существовать до завершения задания.
+struct z3DD3D9HL_ShaderDesc{
+    const char* source_;                    ///< текст шейдера
+    uint32_t sourceSize_;                   ///< длина текста в байтах
+    const z3DD3D9HL_ShaderDefine* defines_; ///< макроопределения. Можно передать нуль.
+    const char* entry_;                     ///< имя точки входа
+    const char* profile_;                   ///< профиль ("vs_2_0", "ps_3_0" и т.д.)
+    DWORD flags_;                           ///< флаги компиляции D3DXSHADER_*
+};
+
+/// Блок памяти, возвращаемый компилятором
+struct z3DD3D9HL_ShaderBlob{
+    const void* data_;              ///< данные
+    uint32_t size_;                 ///< размер данных в байтах
+    void* handle_;                  ///< значение, по которому компилятор освобождает блок
+};
+
+/** Функция открытия включаемого файла.
+    @param fSystem true(false) - имя указано в угловых скобках (кавычках).
+    @param name имя файла из директивы #include.
+    @param [out] data для сохранения указателя на текст файла.
+    @param [out] size для сохранения длины текста.
+    @param userData пользовательские данные обработчика.
+    @return true, если файл открыт.
+*/
+typedef bool (*Z3D_D3D9HL_ShaderIncludeOpenFunc)(bool fSystem, const char* name, const void** data, uint32_t* size, void* userData);
+
+/// Функция закрытия включаемого файла, открытого Z3D_D3D9HL_ShaderIncludeOpenFunc
+typedef void (*Z3D_D3D9HL_ShaderIncludeCloseFunc)(const void* data, void* userData);
+
+/// Обработчик включаемых файлов. Вызывается из потоков кэша одновременно.
+struct z3DD3D9HL_ShaderIncludeHandler{
+    Z3D_D3D9HL_ShaderIncludeOpenFunc open_;
+    Z3D_D3D9HL_ShaderIncludeCloseFunc close_;
+    void* userData_;
+};
+
+/** Функция компиляции шейдера.
+    @param [out] code для сохранения байт-кода.
+    @param [out] errors для сохранения текста сообщений компилятора. Может остаться пустым.
+    @param desc описание шейдера.
+    @param include обработчик включаемых файлов. Может быть нулем.
+    @param userData пользовательские данные компилятора.
+    @return true, если шейдер скомпилирован.
+*/
+typedef bool (*Z3D_D3D9HL_ShaderCompileFunc)(z3DD3D9HL_ShaderBlob* code,
+                                             z3DD3D9HL_ShaderBlob* errors,
+                                             const z3DD3D9HL_ShaderDesc* desc,
+                                             const z3DD3D9HL_ShaderIncludeHandler* include,
+                                             void* userData);
+
+/// Функция освобождения блока, полученного от Z3D_D3D9HL_ShaderCompileFunc
+typedef void (*Z3D_D3D9HL_ShaderBlobReleaseFunc)(z3DD3D9HL_ShaderBlob* blob, void* userData);
+
+/// Компилятор шейдеров. Вызывается из потоков кэша одновременно.
+struct z3DD3D9HL_ShaderCompiler{
+    Z3D_D3D9HL_ShaderCompileFunc compile_;
+    Z3D_D3D9HL_ShaderBlobReleaseFunc release_;
+    uint32_t version_;              ///< версия компилятора, входит в ключ: смена версии делает старые записи недействительными
+    void* userData_;
+};
+
+/// Состояния задания компиляции
+enum z3DD3D9HL_ShaderJobState{
+    Z3D_D3D9HL_SHADERJOB_IDLE,      ///< задание не отправлено
+    Z3D_D3D9HL_SHADERJOB_QUEUED,    ///< задание ожидает или выполняется
+    Z3D_D3D9HL_SHADERJOB_DONE,      ///< байт-код получен
+    Z3D_D3D9HL_SHADERJOB_FAILED     ///< шейдер не скомпилирован
+};
+
+/// Задание компиляции. Принадлежит вызывающей стороне.
+struct z3DD3D9HL_ShaderJob{
+    z3DD3D9HL_ShaderDesc desc_;     ///< описание шейдера
+    volatile int32_t state_;        ///< состояние задания ( @see z3DD3D9HL_ShaderJobState )
+    uint64_t key_;                  ///< ключ записи кэша
+    const DWORD* code_;             ///< байт-код шейдера
+    uint32_t codeSize_;             ///< размер байт-кода в байтах
+    const char* errors_;            ///< сообщения компилятора или 0
+    uint32_t errorsSize_;           ///< длина сообщений компилятора
+    bool fFromCache_;               ///< байт-код загружен с диска
+
+    // закрытые поля
+    z3DD3D9HL_ShaderBlob codeBlob_;
+    z3DD3D9HL_ShaderBlob errorsBlob_;
+    const void* view_;              // отображенный файл записи
+    uint32_t viewSize_;
+    void* mapping_;
+    void* doneEvent_;               // событие завершения задания с ручным сбросом
+    z3DD3D9HL_ShaderJob* next_;
+};
+
+/// Кэш скомпилированных шейдеров
+struct z3DD3D9HL_ShaderCache{
+    char dir_[Z3D_D3D9HL_MAX_SHADER_PATH];  ///< каталог кэша
+    z3DD3D9HL_ShaderCompiler compiler_;     ///< компилятор
+    z3DD3D9HL_ShaderIncludeHandler include_;///< обработчик включаемых файлов
+    bool fInclude_;                         ///< обработчик включаемых файлов задан
+
+    void* lock_;                            ///< защищает очередь заданий
+    void* semaphore_;                       ///< число заданий в очереди
+    void* threads_[Z3D_D3D9HL_MAX_SHADER_THREADS];
+    uint32_t numThreads_;
+    z3DD3D9HL_ShaderJob* head_;
+    z3DD3D9HL_ShaderJob* tail_;
+    volatile int32_t fShutdown_;
+
+    volatile int32_t numRequests_;          ///< число отправленных заданий
+    volatile int32_t numHits_;              ///< число заданий, байт-код которых загружен с диска
+    volatile int32_t numCompiled_;          ///< число скомпилированных шейдеров
+    volatile int32_t numFailed_;            ///< число неудачных компиляций
+    volatile int32_t numWriteFailures_;     ///< число записей, не сохраненных на диск
+    volatile int32_t hashTimeUs_;           ///< суммарное время вычисления ключей в мкс
+    volatile int32_t compileTimeUs_;        ///< суммарное время компиляции в мкс
+};
+
+/// Статистика кэша шейдеров
+struct z3DD3D9HL_ShaderCacheStats{
+    uint32_t numRequests_;          ///< число отправленных заданий
+    uint32_t numHits_;              ///< число заданий, байт-код которых загружен с диска
+    uint32_t numMisses_;            ///< число заданий, потребовавших компиляции
+    uint32_t numCompiled_;          ///< число скомпилированных шейдеров
+    uint32_t numFailed_;            ///< число неудачных компиляций
+    uint32_t numWriteFailures_;     ///< число записей, не сохраненных на диск
+    uint32_t hashTimeUs_;           ///< суммарное время вычисления ключей в мкс
+    uint32_t compileTimeUs_;        ///< суммарное время компиляции в мкс
+};
+
+namespace z3D
+{
+/** Подготовить кэш и запустить потоки компиляции.
+    @param [out] cache кэш.
+    @param dir существующий каталог для файлов кэша. Длина пути не более Z3D_D3D9HL_MAX_SHADER_PATH - 40.
+    @param numThreads число потоков компиляции, не более Z3D_D3D9HL_MAX_SHADER_THREADS.
+    Нуль - задания выполняются в вызывающем потоке внутри D3D9HL_ShaderCacheSubmit().
+    @param compiler компилятор. Если нуль, используется D3DXCompileShader().
+    @param include обработчик включаемых файлов. Можно передать нуль, если шейдеры не используют #include.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ShaderCacheInit(z3DD3D9HL_ShaderCache* cache,
+                                          const char* dir,
+                                          uint32_t numThreads,
+                                          const z3DD3D9HL_ShaderCompiler* compiler = 0,
+                                          const z3DD3D9HL_ShaderIncludeHandler* include = 0);
+
+/** Дождаться выполнения всех отправленных заданий и остановить потоки компиляции.
+*/
+void D3D9HL_ShaderCacheShutdown(z3DD3D9HL_ShaderCache* cache);
+
+/** Подготовить задание.
+    @param [out] job задание.
+    @param source текст шейдера.
+    @param sourceSize длина текста в байтах.
+    @param defines макроопределения. Можно передать нуль.
+    @param entry имя точки входа.
+    @param profile профиль.
+    @param flags флаги компиляции D3DXSHADER_*.
+*/
+void D3D9HL_ShaderJobInit(z3DD3D9HL_ShaderJob* job,
+                          const char* source,
+                          uint32_t sourceSize,
+                          const z3DD3D9HL_ShaderDefine* defines,
+                          const char* entry,
+                          const char* profile,
+                          DWORD flags = 0);
+
+/** Отправить задание на выполнение.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ShaderCacheSubmit(z3DD3D9HL_ShaderCache* cache, z3DD3D9HL_ShaderJob* job);
+
+/** Проверить, завершено ли задание, не дожидаясь его выполнения.
+*/
+bool D3D9HL_ShaderJobIsDone(const z3DD3D9HL_ShaderJob* job);
+
+/** Дождаться завершения задания. Каждое задание оповещает свое событие, поэтому одно задание
+    могут ждать несколько потоков, а ожидание одного задания не зависит от остальных.
+    @return Z3D_D3D9HL_NONE, если байт-код получен, иначе Z3D_D3D9HL_NOTAVAILABLE.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ShaderCacheWait(z3DD3D9HL_ShaderCache* cache, z3DD3D9HL_ShaderJob* job);
+
+/** Освободить байт-код и сообщения завершенного задания. После вызова задание можно отправить снова.
+*/
+void D3D9HL_ShaderCacheReleaseJob(z3DD3D9HL_ShaderCache* cache, z3DD3D9HL_ShaderJob* job);
+
+/** Вычислить ключ записи кэша для шейдера.
+    @param [out] key для сохранения ключа.
+    @param cache кэш (используются обработчик включаемых файлов и версия компилятора).
+    @param desc описание шейдера.
+*/
+void D3D9HL_ShaderCacheComputeKey(uint64_t* key, const z3DD3D9HL_ShaderCache* cache, const z3DD3D9HL_ShaderDesc* desc);
+
+/** Получить статистику кэша.
+*/
+void D3D9HL_ShaderCacheGetStats(z3DD3D9HL_ShaderCacheStats* stats, const z3DD3D9HL_ShaderCache* cache);
+
+} // end of z3D
+#endif // Z3DD3D9HLSHADERCACHE_H
@@ -0,0 +1,257 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HLSPRITE_H
+#define Z3DD3D9HLSPRITE_H
+
+/** @file z3DD3D9HLSprite.h */
+
+/** @page Sprite Пакетный вывод спрайтов и текста.
+
+Спрайты (четырехугольники в экранных координатах) накапливаются в памяти в течение кадра и выводятся
+несколькими вызовами DrawIndexedPrimitive() из одного динамического буфера вершин. Слои выводятся
+по возрастанию. В слое сначала выводятся непрозрачные спрайты ( Z3D_D3D9HL_SPRITE_OPAQUE ), упорядоченные
+по текстуре, затем спрайты со смешиванием в порядке добавления. Подряд идущие спрайты с одинаковыми
+режимом смешивания и текстурой выводятся одним вызовом, поэтому спрайты со смешиванием стоит добавлять
+группами с общей текстурой (например, из одного атласа). Перекрывающиеся непрозрачные спрайты, порядок
+которых важен, нужно помещать в разные слои.
+
+Текст выводится символами из атласа ( @see z3DD3D9HL_GlyphAtlas ). Раскладка строки (положения
+символов с учетом переносов) запоминается в кэше, и повторный вывод той же строки ее не пересчитывает.
+
+Пакет регистрируется слушателем событий устройства ( @see D3D9HL_AddDeviceListener ): накопленные спрайты
+выводятся автоматически в D3D9HL_EndDeviceRender(), а буфер вершин D3DPOOL_DEFAULT освобождается и
+создается заново при потере устройства и смене видеорежима. Состояния устройства, установленные при
+выводе, не восстанавливаются.
+@code
+    z3D::D3D9HL_SpriteBatchInit(&sprites, &arena, device);
+    z3D::D3D9HL_GlyphAtlasCreate(&font, device, hFont);
+    ...
+    z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources);
+    z3D::D3D9HL_SpriteDraw(&sprites, iconTex, 10.0f, 10.0f, 32.0f, 32.0f);
+    z3D::D3D9HL_SpriteDrawText(&sprites, &font, "Score: 100", 50.0f, 10.0f);
+    z3D::D3D9HL_EndDeviceRender(device); // спрайты выводятся здесь
+@endcode
+*/
+
+#include <windows.h>
+#include <d3d9.h>
+
+#include "z3DD3D9HLDef.h"
+#include "z3DD3D9HLAlloc.h"
+
+/// Формат вершин спрайтов
+#define Z3D_D3D9HL_SPRITE_FVF (D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1)
+
+/// Наибольшее число спрайтов в буфере вершин (ограничено 16-битными индексами)
+#define Z3D_D3D9HL_MAX_SPRITES_PER_BUFFER 16384
+
+/// Число символов в атласе
+#define Z3D_D3D9HL_NUM_GLYPHS 256
+
+/// Режим смешивания спрайта
+enum z3DD3D9HL_SpriteBlend{
+    Z3D_D3D9HL_SPRITE_OPAQUE,           ///< без смешивания
+    Z3D_D3D9HL_SPRITE_ALPHA,            ///< смешивание по альфа-каналу
+    Z3D_D3D9HL_SPRITE_ADDITIVE,         ///< сложение с учетом альфа-канала
+    Z3D_D3D9HL_SPRITE_PREMULTIPLIED     ///< цвет текстуры заранее умножен на альфа-канал
+};
+
+/// Вершина спрайта
+struct z3DD3D9HL_SpriteVertex{
+    float x_, y_, z_, rhw_;             ///< экранные координаты
+    D3DCOLOR color_;                    ///< цвет
+    float u_, v_;                       ///< текстурные координаты
+};
+
+/// Символ атласа
+struct z3DD3D9HL_Glyph{
+    float u0_, v0_, u1_, v1_;           ///< текстурные координаты левого верхнего и правого нижнего углов
+    float xOffset_, yOffset_;           ///< смещение левого верхнего угла от позиции пера
+    float width_, height_;              ///< размеры в пикселях, нулевые у невидимых символов
+    float advance_;                     ///< сдвиг пера после символа
+};
+
+/// Атлас символов шрифта
+struct z3DD3D9HL_GlyphAtlas{
+    LPDIRECT3DTEXTURE9 texture_;        ///< текстура с изображениями символов
+    z3DD3D9HL_Glyph glyphs_[Z3D_D3D9HL_NUM_GLYPHS];    ///< символы по кодам
+    float lineHeight_;                  ///< расстояние между строками
+    uint32_t id_;                       ///< уникальный номер атласа, входит в ключ кэша раскладок
+    bool fOwnTexture_;                  ///< текстура создана D3D9HL_GlyphAtlasCreate()
+};
+
+/// Статистика вывода спрайтов
+struct z3DD3D9HL_SpriteStats{
+    uint32_t numSprites_;               ///< число выведенных спрайтов
+    uint32_t numDrawCalls_;             ///< число вызовов DrawIndexedPrimitive()
+    uint32_t numFlushes_;               ///< число выводов накопленных спрайтов
+    uint32_t numDiscards_;              ///< число блокировок буфера вершин с D3DLOCK_DISCARD
+    uint32_t numDropped_;               ///< число спрайтов, отброшенных вне D3D9HL_BeginDeviceRender()/D3D9HL_EndDeviceRender()
+    uint32_t numLayoutHits_;            ///< число раскладок текста, взятых из кэша
+    uint32_t numLayoutMisses_;          ///< число построенных раскладок текста
+};
+
+struct z3DD3D9HL_SpriteKey;
+struct z3DD3D9HL_TextLayout;
+
+/// Пакет спрайтов
+struct z3DD3D9HL_SpriteBatch{
+    z3DD3D9HL_SpriteVertex* vertices_;  ///< вершины накопленных спрайтов, по 4 на спрайт
+    z3DD3D9HL_SpriteKey* keys_;         ///< ключи упорядочивания накопленных спрайтов
+    uint32_t maxSprites_;               ///< наибольшее число накопленных спрайтов
+    uint32_t numSprites_;               ///< число накопленных спрайтов
+
+    LPDIRECT3DDEVICE9 device_;          ///< устройство, для которого созданы буферы
+    LPDIRECT3DVERTEXBUFFER9 vertexBuffer_;  ///< динамический буфер вершин D3DPOOL_DEFAULT
+    LPDIRECT3DINDEXBUFFER9 indexBuffer_;    ///< буфер индексов четырехугольников D3DPOOL_MANAGED
+    uint32_t bufferSprites_;            ///< размер буферов в спрайтах
+    uint32_t bufferOffset_;             ///< первый свободный спрайт буфера вершин
+
+    z3DD3D9HL_TextLayout* layouts_;     ///< кэш раскладок текста с открытой адресацией
+    uint32_t numLayouts_;               ///< число записей кэша, степень двойки
+    uint32_t maxTextLength_;            ///< наибольшая длина выводимой строки
+    uint32_t frame_;                    ///< номер кадра
+
+    z3DD3D9HL_SpriteStats frameStats_;  ///< статистика текущего кадра
+    z3DD3D9HL_SpriteStats lastFrameStats_;  ///< статистика последнего завершенного кадра
+};
+
+namespace z3D
+{
+/** Подготовить пакет и зарегистрировать его слушателем событий устройства.
+
+    Память для спрайтов и кэша раскладок берется из арены. Пакет не должен перемещаться в памяти
+    до вызова D3D9HL_SpriteBatchShutdown().
+    @param [out] batch пакет.
+    @param arena арена.
+    @param device указатель на устройство.
+    @param maxSprites наибольшее число спрайтов, накапливаемых до вывода. При переполнении накопленные
+    спрайты выводятся досрочно.
+    @param numLayouts число записей кэша раскладок текста, округляется вверх до степени двойки.
+    @param maxTextLength наибольшая длина строки в символах. Более длинные строки обрезаются.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). При ошибке буферы освобождаются, а память возвращается арене.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_SpriteBatchInit(z3DD3D9HL_SpriteBatch* batch,
+                                          z3DD3D9HL_Arena* arena,
+                                          LPDIRECT3DDEVICE9 device,
+                                          uint32_t maxSprites = 4096,
+                                          uint32_t numLayouts = 256,
+                                          uint32_t maxTextLength = 128);
+
+/** Освободить буферы пакета и отменить регистрацию слушателя.
+*/
+void D3D9HL_SpriteBatchShutdown(z3DD3D9HL_SpriteBatch* batch);
+
+/** Добавить спрайт.
+
+    Вызывается между D3D9HL_BeginDeviceRender() и D3D9HL_EndDeviceRender().
+    @param batch пакет.
+    @param texture текстура. Если нуль, спрайт закрашивается цветом color.
+    @param x, y экранные координаты левого верхнего угла в пикселях.
+    @param width, height размеры в пикселях.
+    @param color цвет, умножается на цвет текстуры.
+    @param uvRect текстурные координаты левого верхнего и правого нижнего углов (4 числа). Если нуль - вся текстура.
+    @param blend режим смешивания.
+    @param layer слой, 0..65535. Спрайты большего слоя выводятся позже.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_NO_PRELIMINARY_DONE, если рендер не начат;
+    спрайт при этом отбрасывается.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_SpriteDraw(z3DD3D9HL_SpriteBatch* batch,
+                                     LPDIRECT3DTEXTURE9 texture,
+                                     float x,
+                                     float y,
+                                     float width,
+                                     float height,
+                                     D3DCOLOR color = 0xFFFFFFFF,
+                                     const float* uvRect = 0,
+                                     z3DD3D9HL_SpriteBlend blend = Z3D_D3D9HL_SPRITE_ALPHA,
+                                     uint32_t layer = 0);
+
+/** Добавить строку текста.
+
+    Символ '\n' начинает новую строку. Если задана ширина maxWidth, слова, не умещающиеся в строке,
+    переносятся на следующую.
+    @param batch пакет.
+    @param atlas атлас символов.
+    @param text строка в однобайтовой кодировке атласа.
+    @param x, y экранные координаты левого верхнего угла первой строки в пикселях.
+    @param color цвет текста.
+    @param maxWidth ширина области вывода в пикселях, 0 - без переносов.
+    @param layer слой.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_SpriteDrawText(z3DD3D9HL_SpriteBatch* batch,
+                                         const z3DD3D9HL_GlyphAtlas* atlas,
+                                         const char* text,
+                                         float x,
+                                         float y,
+                                         D3DCOLOR color = 0xFFFFFFFF,
+                                         float maxWidth = 0.0f,
+                                         uint32_t layer = 0);
+
+/** Получить размеры строки текста. Раскладка строки запоминается в кэше.
+    @param [out] width для сохранения ширины в пикселях.
+    @param [out] height для сохранения высоты в пикселях.
+    Остальные параметры - как у D3D9HL_SpriteDrawText().
+*/
+void D3D9HL_SpriteMeasureText(float* width,
+                              float* height,
+                              z3DD3D9HL_SpriteBatch* batch,
+                              const z3DD3D9HL_GlyphAtlas* atlas,
+                              const char* text,
+                              float maxWidth = 0.0f);
+
+/** Вывести накопленные спрайты.
+
+    Вызывается автоматически в D3D9HL_EndDeviceRender(). Явный вызов нужен, если после спрайтов
+    в кадре выводится другая геометрия, которая должна их перекрыть.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_SpriteFlush(z3DD3D9HL_SpriteBatch* batch);
+
+/** Получить статистику последнего завершенного кадра.
+*/
+void D3D9HL_SpriteBatchGetStats(z3DD3D9HL_SpriteStats* stats, const z3DD3D9HL_SpriteBatch* batch);
+
+/** Подготовить атлас по готовой текстуре и описаниям символов (например, созданным внешним генератором шрифтов).
+    @param [out] atlas атлас.
+    @param texture текстура. Атлас не становится ее владельцем.
+    @param glyphs описания символов с кодами firstChar..firstChar + numChars - 1.
+    @param firstChar код первого символа.
+    @param numChars число символов.
+    @param lineHeight расстояние между строками в пикселях.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ).
+*/
+z3DD3D9HL_ErrCodes D3D9HL_GlyphAtlasInit(z3DD3D9HL_GlyphAtlas* atlas,
+                                         LPDIRECT3DTEXTURE9 texture,
+                                         const z3DD3D9HL_Glyph* glyphs,
+                                         uint32_t firstChar,
+                                         uint32_t numChars,
+                                         float lineHeight);
+
+/** Построить атлас по шрифту GDI.
+
+    Символы рисуются средствами GDI и копируются в текстуру D3DFMT_A8R8G8B8 пула D3DPOOL_MANAGED:
+    яркость символа записывается в альфа-канал, цвет - белый.
+    @param [out] atlas атлас.
+    @param device указатель на устройство.
+    @param font шрифт.
+    @param textureSize ширина и высота текстуры в пикселях.
+    @param firstChar код первого символа.
+    @param numChars число символов.
+    @return Код ошибки ( @see z3DD3D9HL_ErrCodes ). Z3D_D3D9HL_OUTOFMEMORY, если символы не уместились в текстуре.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_GlyphAtlasCreate(z3DD3D9HL_GlyphAtlas* atlas,
+                                           LPDIRECT3DDEVICE9 device,
+                                           HFONT font,
+                                           uint32_t textureSize = 512,
+                                           uint32_t firstChar = 32,
+                                           uint32_t numChars = 224);
+
+/** Освободить текстуру атласа, если она создана D3D9HL_GlyphAtlasCreate().
+*/
+void D3D9HL_GlyphAtlasRelease(z3DD3D9HL_GlyphAtlas* atlas);
+
+} // end of z3D
+#endif // Z3DD3D9HLSPRITE_H
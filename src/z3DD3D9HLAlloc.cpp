@@ -0,0 +1,172 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация распределителя памяти библиотеки и арены.
+*/
+
+#include <stdlib.h>
+#include "z3DD3D9HL.h"
+#include "z3DDebugSystem.h"
+
+namespace z3D_priv
+{
+/* Выделение памяти по умолчанию. Перед выровненным блоком хранится указатель, возвращенный malloc().
+*/
+void* D3D9HL_DefaultAlloc(size_t size, size_t alignment, void* /*userData*/){
+    if (alignment < sizeof(void*))
+        alignment = sizeof(void*);
+    uint8_t* raw = static_cast<uint8_t*>(malloc(size + alignment + sizeof(void*)));
+    if (raw == 0)
+        return 0;
+    size_t aligned = (reinterpret_cast<size_t>(raw) + sizeof(void*) + alignment - 1) & ~(alignment - 1);
+    reinterpret_cast<void**>(aligned)[-1] = raw;
+    return reinterpret_cast<void*>(aligned);
+}
+
+void D3D9HL_DefaultFree(void* mem, void* /*userData*/){
+    if (mem == 0)
+        return;
+    free(static_cast<void**>(mem)[-1]);
+}
+
+/* Заголовок перед блоком, выделенным распределителем арены: отметка арены до выделения и
+смещение конца блока. По ним освобождается блок, выделенный последним.
+*/
+struct D3D9HL_ArenaBlockHeader{
+    size_t marker_;
+    size_t end_;
+};
+
+void* D3D9HL_ArenaAllocFunc(size_t size, size_t alignment, void* userData){
+    z3DD3D9HL_Arena* arena = static_cast<z3DD3D9HL_Arena*>(userData);
+    if (alignment < sizeof(size_t))
+        alignment = sizeof(size_t);
+    size_t headerSize = (sizeof(D3D9HL_ArenaBlockHeader) + alignment - 1) & ~(alignment - 1);
+    size_t marker = z3D::D3D9HL_ArenaGetMarker(arena);
+    uint8_t* mem = static_cast<uint8_t*>(z3D::D3D9HL_ArenaAlloc(arena, headerSize + size, alignment));
+    if (mem == 0)
+        return 0;
+    D3D9HL_ArenaBlockHeader* header = reinterpret_cast<D3D9HL_ArenaBlockHeader*>(mem + headerSize) - 1;
+    header->marker_ = marker;
+    header->end_ = z3D::D3D9HL_ArenaGetMarker(arena);
+    return mem + headerSize;
+}
+
+/* Освободить блок, если он выделен последним (порядок LIFO). Остальные блоки возвращаются
+вместе с памятью арены.
+*/
+void D3D9HL_ArenaFreeFunc(void* mem, void* userData){
+    z3DD3D9HL_Arena* arena = static_cast<z3DD3D9HL_Arena*>(userData);
+    const D3D9HL_ArenaBlockHeader* header = static_cast<const D3D9HL_ArenaBlockHeader*>(mem) - 1;
+    if (header->end_ == z3D::D3D9HL_ArenaGetMarker(arena))
+        z3D::D3D9HL_ArenaRewind(arena, header->marker_);
+}
+
+static z3DD3D9HL_Allocator s_allocator = { D3D9HL_DefaultAlloc, D3D9HL_DefaultFree, 0 };
+
+/* Выделить память через текущий распределитель библиотеки.
+*/
+void* D3D9HL_Alloc(size_t size, size_t alignment){
+    return s_allocator.alloc_(size, alignment, s_allocator.userData_);
+}
+
+/* Освободить память, выделенную функцией D3D9HL_Alloc().
+*/
+void D3D9HL_Free(void* mem){
+    if (mem != 0)
+        s_allocator.free_(mem, s_allocator.userData_);
+}
+
+/* Выделить временную память из арены или, если арены нет, через распределитель библиотеки.
+*/
+void* D3D9HL_ScratchAlloc(z3DD3D9HL_Arena* arena, size_t size){
+    if (arena != 0)
+        return z3D::D3D9HL_ArenaAlloc(arena, size, Z3D_D3D9HL_DEFAULT_ALIGN);
+    return D3D9HL_Alloc(size, Z3D_D3D9HL_DEFAULT_ALIGN);
+}
+
+/* Освободить временную память, выделенную функцией D3D9HL_ScratchAlloc().
+    @param marker отметка арены, полученная перед выделением памяти.
+*/
+void D3D9HL_ScratchFree(z3DD3D9HL_Arena* arena, void* mem, size_t marker){
+    if (arena != 0)
+        z3D::D3D9HL_ArenaRewind(arena, marker);
+    else
+        D3D9HL_Free(mem);
+}
+} // end of z3D_priv
+
+namespace z3D
+{
+
+z3DD3D9HL_ErrCodes D3D9HL_SetAllocator(const z3DD3D9HL_Allocator* allocator){
+    if (allocator == 0){
+        z3D_priv::s_allocator.alloc_ = z3D_priv::D3D9HL_DefaultAlloc;
+        z3D_priv::s_allocator.free_ = z3D_priv::D3D9HL_DefaultFree;
+        z3D_priv::s_allocator.userData_ = 0;
+        return Z3D_D3D9HL_NONE;
+    }
+    Z3D_ASSERT_HIGH(allocator->alloc_ != 0 && allocator->free_ != 0, "incomplete allocator passed", true);
+    if (allocator->alloc_ == 0 || allocator->free_ == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    z3D_priv::s_allocator = *allocator;
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_GetAllocator(z3DD3D9HL_Allocator* allocator){
+    Z3D_ASSERT_HIGH(allocator != 0, "null passed", true);
+    *allocator = z3D_priv::s_allocator;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_ArenaInit(z3DD3D9HL_Arena* arena, void* mem, size_t capacity){
+    Z3D_ASSERT_HIGH(arena != 0, "null passed", true);
+    if (arena == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(mem != 0 || capacity == 0, "null passed", true);
+    if (mem == 0 && capacity != 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    arena->mem_ = static_cast<uint8_t*>(mem);
+    arena->capacity_ = capacity;
+    arena->offset_ = 0;
+    arena->peak_ = 0;
+    return Z3D_D3D9HL_NONE;
+}
+
+void* D3D9HL_ArenaAlloc(z3DD3D9HL_Arena* arena, size_t size, size_t alignment){
+    Z3D_ASSERT_HIGH(arena != 0, "null passed", true);
+    Z3D_ASSERT_HIGH(alignment != 0 && (alignment & (alignment - 1)) == 0, "alignment is not a power of two", true);
+    size_t base = reinterpret_cast<size_t>(arena->mem_);
+    size_t start = ((base + arena->offset_ + alignment - 1) & ~(alignment - 1)) - base;
+    if (start > arena->capacity_ || arena->capacity_ - start < size)
+        return 0;
+    arena->offset_ = start + size;
+    if (arena->peak_ < arena->offset_)
+        arena->peak_ = arena->offset_;
+    return arena->mem_ + start;
+}
+
+void D3D9HL_ArenaReset(z3DD3D9HL_Arena* arena){
+    Z3D_ASSERT_HIGH(arena != 0, "null passed", true);
+    arena->offset_ = 0;
+}
+
+size_t D3D9HL_ArenaGetMarker(const z3DD3D9HL_Arena* arena){
+    Z3D_ASSERT_HIGH(arena != 0, "null passed", true);
+    return arena->offset_;
+}
+
+void D3D9HL_ArenaRewind(z3DD3D9HL_Arena* arena, size_t marker){
+    Z3D_ASSERT_HIGH(arena != 0, "null passed", true);
+    Z3D_ASSERT_HIGH(marker <= arena->offset_, "arena marker is beyond the current offset", true);
+    if (marker <= arena->offset_)
+        arena->offset_ = marker;
+}
+
+void D3D9HL_ArenaAllocator(z3DD3D9HL_Allocator* allocator, z3DD3D9HL_Arena* arena){
+    Z3D_ASSERT_HIGH(allocator != 0 && arena != 0, "null passed", true);
+    allocator->alloc_ = z3D_priv::D3D9HL_ArenaAllocFunc;
+    allocator->free_ = z3D_priv::D3D9HL_ArenaFreeFunc;
+    allocator->userData_ = arena;
+}
+
+} // end of z3D
@@ -0,0 +1,423 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация списков команд устройства Direct3D9.
+*/
+
+#include <string.h>
+#include "z3DD3D9HL.h"
+#include "z3DDebugSystem.h"
+
+namespace z3D
+{
+namespace z3D_priv
+{
+bool D3D9HL_IsDeviceRenderBegun();
+
+// Типы записываемых команд
+enum D3D9HL_CmdType{
+    D3D9HL_CMD_SETRENDERSTATE,
+    D3D9HL_CMD_SETSAMPLERSTATE,
+    D3D9HL_CMD_SETTEXTURE,
+    D3D9HL_CMD_SETSTREAMSOURCE,
+    D3D9HL_CMD_SETINDICES,
+    D3D9HL_CMD_SETVERTEXDECLARATION,
+    D3D9HL_CMD_SETVERTEXSHADER,
+    D3D9HL_CMD_SETPIXELSHADER,
+    D3D9HL_CMD_SETVSCONSTANTF,
+    D3D9HL_CMD_SETPSCONSTANTF,
+    D3D9HL_CMD_DRAWPRIMITIVE,
+    D3D9HL_CMD_DRAWINDEXEDPRIMITIVE
+};
+
+// Заголовок команды. Размер команды включает заголовок и кратен Z3D_D3D9HL_CMDLIST_ALIGN.
+struct D3D9HL_CmdHeader{
+    uint32_t type_;
+    uint32_t size_;
+};
+
+struct D3D9HL_CmdState{
+    D3D9HL_CmdHeader header_;
+    DWORD index_;                   // номер сэмплера (для состояний сэмплера)
+    DWORD state_;
+    DWORD value_;
+};
+
+struct D3D9HL_CmdObject{
+    D3D9HL_CmdHeader header_;
+    DWORD index_;                   // номер стадии или потока
+    UINT offset_;
+    UINT stride_;
+    IUnknown* object_;
+};
+
+// За командой установки констант следуют vector4fCount_ * 4 чисел
+struct D3D9HL_CmdConstantF{
+    D3D9HL_CmdHeader header_;
+    UINT startRegister_;
+    UINT vector4fCount_;
+};
+
+// Наибольшее число векторов в команде установки констант
+const uint32_t D3D9HL_CMD_MAX_VECTOR4F_COUNT =
+    (0xFFFFFFFF - sizeof(D3D9HL_CmdConstantF) - Z3D_D3D9HL_CMDLIST_ALIGN) / (4 * sizeof(float));
+
+struct D3D9HL_CmdDraw{
+    D3D9HL_CmdHeader header_;
+    D3DPRIMITIVETYPE primitiveType_;
+    INT baseVertexIndex_;
+    UINT minVertexIndex_;
+    UINT numVertices_;
+    UINT start_;
+    UINT primitiveCount_;
+};
+
+inline uint32_t D3D9HL_CmdAlignedSize(uint32_t size){
+    return (size + Z3D_D3D9HL_CMDLIST_ALIGN - 1) & ~static_cast<uint32_t>(Z3D_D3D9HL_CMDLIST_ALIGN - 1);
+}
+
+/* Зарезервировать в списке место под команду.
+    @return указатель на заголовок команды или 0, если места нет.
+*/
+D3D9HL_CmdHeader* D3D9HL_CmdAlloc(z3DD3D9HL_CmdList* cmdList, uint32_t type, uint32_t size){
+    Z3D_ASSERT_HIGH(cmdList != 0 && cmdList->mem_ != 0, "command list is not initialized", true);
+    size = D3D9HL_CmdAlignedSize(size);
+    if (cmdList->capacity_ - cmdList->size_ < size){
+        cmdList->fOverflow_ = true;
+        return 0;
+    }
+    D3D9HL_CmdHeader* header = reinterpret_cast<D3D9HL_CmdHeader*>(cmdList->mem_ + cmdList->size_);
+    header->type_ = type;
+    header->size_ = size;
+    cmdList->size_ += size;
+    cmdList->numCmds_++;
+    return header;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdObjectRecord(z3DD3D9HL_CmdList* cmdList,
+                                          uint32_t type,
+                                          DWORD index,
+                                          IUnknown* object,
+                                          UINT offset = 0,
+                                          UINT stride = 0){
+    D3D9HL_CmdObject* cmd = reinterpret_cast<D3D9HL_CmdObject*>(D3D9HL_CmdAlloc(cmdList, type, sizeof(D3D9HL_CmdObject)));
+    if (cmd == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    cmd->index_ = index;
+    cmd->offset_ = offset;
+    cmd->stride_ = stride;
+    cmd->object_ = object;
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdConstantFRecord(z3DD3D9HL_CmdList* cmdList,
+                                             uint32_t type,
+                                             UINT startRegister,
+                                             const float* constantData,
+                                             UINT vector4fCount){
+    Z3D_ASSERT_HIGH(constantData != 0 || vector4fCount == 0, "null passed", true);
+    if (constantData == 0 && vector4fCount != 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    // Размер команды с выравниванием должен помещаться в uint32_t
+    Z3D_ASSERT_HIGH(vector4fCount <= D3D9HL_CMD_MAX_VECTOR4F_COUNT, "too many constants", true);
+    if (vector4fCount > D3D9HL_CMD_MAX_VECTOR4F_COUNT)
+        return Z3D_D3D9HL_INVALIDCALL;
+    uint32_t dataSize = static_cast<uint32_t>(vector4fCount * 4 * sizeof(float));
+    D3D9HL_CmdConstantF* cmd = reinterpret_cast<D3D9HL_CmdConstantF*>(
+        D3D9HL_CmdAlloc(cmdList, type, sizeof(D3D9HL_CmdConstantF) + dataSize));
+    if (cmd == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    cmd->startRegister_ = startRegister;
+    cmd->vector4fCount_ = vector4fCount;
+    memcpy(cmd + 1, constantData, dataSize);
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdDrawRecord(z3DD3D9HL_CmdList* cmdList,
+                                        uint32_t type,
+                                        D3DPRIMITIVETYPE primitiveType,
+                                        INT baseVertexIndex,
+                                        UINT minVertexIndex,
+                                        UINT numVertices,
+                                        UINT start,
+                                        UINT primitiveCount){
+    D3D9HL_CmdDraw* cmd = reinterpret_cast<D3D9HL_CmdDraw*>(D3D9HL_CmdAlloc(cmdList, type, sizeof(D3D9HL_CmdDraw)));
+    if (cmd == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    cmd->primitiveType_ = primitiveType;
+    cmd->baseVertexIndex_ = baseVertexIndex;
+    cmd->minVertexIndex_ = minVertexIndex;
+    cmd->numVertices_ = numVertices;
+    cmd->start_ = start;
+    cmd->primitiveCount_ = primitiveCount;
+    return Z3D_D3D9HL_NONE;
+}
+
+/* Передать устройству команды одного списка.
+    @return число воспроизведенных команд.
+*/
+uint32_t D3D9HL_ReplayCmdList(LPDIRECT3DDEVICE9 device, const z3DD3D9HL_CmdList* cmdList){
+    const uint8_t* cur = cmdList->mem_;
+    const uint8_t* end = cmdList->mem_ + cmdList->size_;
+    uint32_t numCmds = 0;
+    while (cur < end){
+        const D3D9HL_CmdHeader* header = reinterpret_cast<const D3D9HL_CmdHeader*>(cur);
+        switch (header->type_){
+        case D3D9HL_CMD_SETRENDERSTATE:{
+            const D3D9HL_CmdState* cmd = reinterpret_cast<const D3D9HL_CmdState*>(header);
+            device->SetRenderState(static_cast<D3DRENDERSTATETYPE>(cmd->state_), cmd->value_);
+            break;
+        }
+        case D3D9HL_CMD_SETSAMPLERSTATE:{
+            const D3D9HL_CmdState* cmd = reinterpret_cast<const D3D9HL_CmdState*>(header);
+            device->SetSamplerState(cmd->index_, static_cast<D3DSAMPLERSTATETYPE>(cmd->state_), cmd->value_);
+            break;
+        }
+        case D3D9HL_CMD_SETTEXTURE:{
+            const D3D9HL_CmdObject* cmd = reinterpret_cast<const D3D9HL_CmdObject*>(header);
+            device->SetTexture(cmd->index_, static_cast<LPDIRECT3DBASETEXTURE9>(cmd->object_));
+            break;
+        }
+        case D3D9HL_CMD_SETSTREAMSOURCE:{
+            const D3D9HL_CmdObject* cmd = reinterpret_cast<const D3D9HL_CmdObject*>(header);
+            device->SetStreamSource(static_cast<UINT>(cmd->index_),
+                                    static_cast<LPDIRECT3DVERTEXBUFFER9>(cmd->object_),
+                                    cmd->offset_,
+                                    cmd->stride_);
+            break;
+        }
+        case D3D9HL_CMD_SETINDICES:{
+            const D3D9HL_CmdObject* cmd = reinterpret_cast<const D3D9HL_CmdObject*>(header);
+            device->SetIndices(static_cast<LPDIRECT3DINDEXBUFFER9>(cmd->object_));
+            break;
+        }
+        case D3D9HL_CMD_SETVERTEXDECLARATION:{
+            const D3D9HL_CmdObject* cmd = reinterpret_cast<const D3D9HL_CmdObject*>(header);
+            device->SetVertexDeclaration(static_cast<LPDIRECT3DVERTEXDECLARATION9>(cmd->object_));
+            break;
+        }
+        case D3D9HL_CMD_SETVERTEXSHADER:{
+            const D3D9HL_CmdObject* cmd = reinterpret_cast<const D3D9HL_CmdObject*>(header);
+            device->SetVertexShader(static_cast<LPDIRECT3DVERTEXSHADER9>(cmd->object_));
+            break;
+        }
+        case D3D9HL_CMD_SETPIXELSHADER:{
+            const D3D9HL_CmdObject* cmd = reinterpret_cast<const D3D9HL_CmdObject*>(header);
+            device->SetPixelShader(static_cast<LPDIRECT3DPIXELSHADER9>(cmd->object_));
+            break;
+        }
+        case D3D9HL_CMD_SETVSCONSTANTF:{
+            const D3D9HL_CmdConstantF* cmd = reinterpret_cast<const D3D9HL_CmdConstantF*>(header);
+            device->SetVertexShaderConstantF(cmd->startRegister_,
+                                             reinterpret_cast<const float*>(cmd + 1),
+                                             cmd->vector4fCount_);
+            break;
+        }
+        case D3D9HL_CMD_SETPSCONSTANTF:{
+            const D3D9HL_CmdConstantF* cmd = reinterpret_cast<const D3D9HL_CmdConstantF*>(header);
+            device->SetPixelShaderConstantF(cmd->startRegister_,
+                                            reinterpret_cast<const float*>(cmd + 1),
+                                            cmd->vector4fCount_);
+            break;
+        }
+        case D3D9HL_CMD_DRAWPRIMITIVE:{
+            const D3D9HL_CmdDraw* cmd = reinterpret_cast<const D3D9HL_CmdDraw*>(header);
+            device->DrawPrimitive(cmd->primitiveType_, cmd->start_, cmd->primitiveCount_);
+            break;
+        }
+        case D3D9HL_CMD_DRAWINDEXEDPRIMITIVE:{
+            const D3D9HL_CmdDraw* cmd = reinterpret_cast<const D3D9HL_CmdDraw*>(header);
+            device->DrawIndexedPrimitive(cmd->primitiveType_,
+                                         cmd->baseVertexIndex_,
+                                         cmd->minVertexIndex_,
+                                         cmd->numVertices_,
+                                         cmd->start_,
+                                         cmd->primitiveCount_);
+            break;
+        }
+        default:
+            Z3D_ERROR1(Z3D_ERROR_PERMISSIBLE, 0, "unknown command type in command list: %d", header->type_, false);
+            return numCmds;
+        }
+        numCmds++;
+        cur += header->size_;
+    }
+    return numCmds;
+}
+} // end of z3D_priv
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdListInit(z3DD3D9HL_CmdList* cmdList, void* mem, uint32_t capacity, uint32_t order){
+    Z3D_ASSERT_HIGH(cmdList != 0, "null passed", true);
+    if (cmdList == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(mem != 0, "null passed", true);
+    if (mem == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(reinterpret_cast<size_t>(mem) % Z3D_D3D9HL_CMDLIST_ALIGN == 0, "command list memory is not aligned", true);
+    if (reinterpret_cast<size_t>(mem) % Z3D_D3D9HL_CMDLIST_ALIGN != 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    cmdList->mem_ = static_cast<uint8_t*>(mem);
+    cmdList->capacity_ = capacity & ~static_cast<uint32_t>(Z3D_D3D9HL_CMDLIST_ALIGN - 1);
+    D3D9HL_CmdListReset(cmdList, order);
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_CmdListReset(z3DD3D9HL_CmdList* cmdList, uint32_t order){
+    Z3D_ASSERT_HIGH(cmdList != 0, "null passed", true);
+    cmdList->size_ = 0;
+    cmdList->numCmds_ = 0;
+    cmdList->order_ = order;
+    cmdList->fOverflow_ = false;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetRenderState(z3DD3D9HL_CmdList* cmdList, D3DRENDERSTATETYPE state, DWORD value){
+    z3D_priv::D3D9HL_CmdState* cmd = reinterpret_cast<z3D_priv::D3D9HL_CmdState*>(
+        z3D_priv::D3D9HL_CmdAlloc(cmdList, z3D_priv::D3D9HL_CMD_SETRENDERSTATE, sizeof(z3D_priv::D3D9HL_CmdState)));
+    if (cmd == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    cmd->index_ = 0;
+    cmd->state_ = static_cast<DWORD>(state);
+    cmd->value_ = value;
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetSamplerState(z3DD3D9HL_CmdList* cmdList, DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value){
+    z3D_priv::D3D9HL_CmdState* cmd = reinterpret_cast<z3D_priv::D3D9HL_CmdState*>(
+        z3D_priv::D3D9HL_CmdAlloc(cmdList, z3D_priv::D3D9HL_CMD_SETSAMPLERSTATE, sizeof(z3D_priv::D3D9HL_CmdState)));
+    if (cmd == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    cmd->index_ = sampler;
+    cmd->state_ = static_cast<DWORD>(type);
+    cmd->value_ = value;
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetTexture(z3DD3D9HL_CmdList* cmdList, DWORD stage, LPDIRECT3DBASETEXTURE9 texture){
+    return z3D_priv::D3D9HL_CmdObjectRecord(cmdList, z3D_priv::D3D9HL_CMD_SETTEXTURE, stage, texture);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetStreamSource(z3DD3D9HL_CmdList* cmdList,
+                                             UINT streamNumber,
+                                             LPDIRECT3DVERTEXBUFFER9 vertexBuffer,
+                                             UINT offsetInBytes,
+                                             UINT stride){
+    return z3D_priv::D3D9HL_CmdObjectRecord(cmdList,
+                                            z3D_priv::D3D9HL_CMD_SETSTREAMSOURCE,
+                                            static_cast<DWORD>(streamNumber),
+                                            vertexBuffer,
+                                            offsetInBytes,
+                                            stride);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetIndices(z3DD3D9HL_CmdList* cmdList, LPDIRECT3DINDEXBUFFER9 indexBuffer){
+    return z3D_priv::D3D9HL_CmdObjectRecord(cmdList, z3D_priv::D3D9HL_CMD_SETINDICES, 0, indexBuffer);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetVertexDeclaration(z3DD3D9HL_CmdList* cmdList, LPDIRECT3DVERTEXDECLARATION9 decl){
+    return z3D_priv::D3D9HL_CmdObjectRecord(cmdList, z3D_priv::D3D9HL_CMD_SETVERTEXDECLARATION, 0, decl);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetVertexShader(z3DD3D9HL_CmdList* cmdList, LPDIRECT3DVERTEXSHADER9 shader){
+    return z3D_priv::D3D9HL_CmdObjectRecord(cmdList, z3D_priv::D3D9HL_CMD_SETVERTEXSHADER, 0, shader);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetPixelShader(z3DD3D9HL_CmdList* cmdList, LPDIRECT3DPIXELSHADER9 shader){
+    return z3D_priv::D3D9HL_CmdObjectRecord(cmdList, z3D_priv::D3D9HL_CMD_SETPIXELSHADER, 0, shader);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetVertexShaderConstantF(z3DD3D9HL_CmdList* cmdList,
+                                                      UINT startRegister,
+                                                      const float* constantData,
+                                                      UINT vector4fCount){
+    return z3D_priv::D3D9HL_CmdConstantFRecord(cmdList,
+                                               z3D_priv::D3D9HL_CMD_SETVSCONSTANTF,
+                                               startRegister,
+                                               constantData,
+                                               vector4fCount);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdSetPixelShaderConstantF(z3DD3D9HL_CmdList* cmdList,
+                                                     UINT startRegister,
+                                                     const float* constantData,
+                                                     UINT vector4fCount){
+    return z3D_priv::D3D9HL_CmdConstantFRecord(cmdList,
+                                               z3D_priv::D3D9HL_CMD_SETPSCONSTANTF,
+                                               startRegister,
+                                               constantData,
+                                               vector4fCount);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdDrawPrimitive(z3DD3D9HL_CmdList* cmdList,
+                                           D3DPRIMITIVETYPE primitiveType,
+                                           UINT startVertex,
+                                           UINT primitiveCount){
+    return z3D_priv::D3D9HL_CmdDrawRecord(cmdList,
+                                          z3D_priv::D3D9HL_CMD_DRAWPRIMITIVE,
+                                          primitiveType,
+                                          0,
+                                          0,
+                                          0,
+                                          startVertex,
+                                          primitiveCount);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_CmdDrawIndexedPrimitive(z3DD3D9HL_CmdList* cmdList,
+                                                  D3DPRIMITIVETYPE primitiveType,
+                                                  INT baseVertexIndex,
+                                                  UINT minVertexIndex,
+                                                  UINT numVertices,
+                                                  UINT startIndex,
+                                                  UINT primitiveCount){
+    return z3D_priv::D3D9HL_CmdDrawRecord(cmdList,
+                                          z3D_priv::D3D9HL_CMD_DRAWINDEXEDPRIMITIVE,
+                                          primitiveType,
+                                          baseVertexIndex,
+                                          minVertexIndex,
+                                          numVertices,
+                                          startIndex,
+                                          primitiveCount);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_ReplayCmdLists(LPDIRECT3DDEVICE9 device,
+                                         z3DD3D9HL_CmdList** cmdLists,
+                                         uint32_t numCmdLists,
+                                         uint32_t* pNumCmdsReplayed){
+    Z3D_ASSERT(device != 0, "null device passed", true);
+    if (device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT(cmdLists != 0 || numCmdLists == 0, "null passed", true);
+    if (cmdLists == 0 && numCmdLists != 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT(z3D_priv::D3D9HL_IsDeviceRenderBegun(), "BeginDeviceRender is not called yet", true);
+    if (!z3D_priv::D3D9HL_IsDeviceRenderBegun())
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+
+    // Упорядочиваем списки по ключу вставками: списков немного, порядок равных ключей сохраняется
+    for (uint32_t i = 1; i < numCmdLists; ++i){
+        z3DD3D9HL_CmdList* cmdList = cmdLists[i];
+        uint32_t j = i;
+        while (j > 0 && cmdLists[j - 1]->order_ > cmdList->order_){
+            cmdLists[j] = cmdLists[j - 1];
+            --j;
+        }
+        cmdLists[j] = cmdList;
+    }
+
+    uint32_t numCmds = 0;
+    bool fOverflow = false;
+    for (uint32_t i = 0; i < numCmdLists; ++i){
+        Z3D_ASSERT(!cmdLists[i]->fOverflow_, "command list overflowed during recording", true);
+        // Без пропущенных команд остальные команды списка выполнились бы с чужими состояниями
+        if (cmdLists[i]->fOverflow_){
+            fOverflow = true;
+            continue;
+        }
+        numCmds += z3D_priv::D3D9HL_ReplayCmdList(device, cmdLists[i]);
+    }
+    if (pNumCmdsReplayed != 0)
+        *pNumCmdsReplayed = numCmds;
+    return fOverflow ? Z3D_D3D9HL_OUTOFMEMORY : Z3D_D3D9HL_NONE;
+}
+
+} // end of z3D
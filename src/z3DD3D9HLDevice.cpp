@@ -4,7 +4,6 @@ It's licensed unser the MIT license (see "License.txt" for details).*/
 /* Реализация создания устройства Direct3D9.
 */
 
-#include <vector>
 #include <stdio.h>
 #include "z3DD3D9HL.h"
 #include "z3DD3D9HLPrivVideomode.h"
@@ -16,6 +15,43 @@ namespace z3D_priv
 uint32_t D3DFormat2Bpp( D3DFORMAT d3dfmt );
 bool D3DFormatHasAlpha( D3DFORMAT d3dfmt );
 bool D3DFormatHasStencil( D3DFORMAT d3dfmt );
+void* D3D9HL_Alloc(size_t size, size_t alignment);
+void D3D9HL_Free(void* mem);
+
+// Описание формата буфера глубины в таблице кандидатов
+struct D3D9HL_DepthFmtDesc{
+    D3DFORMAT fmt_;
+    uint8_t bpp_;                   // наименьшее число бит на пиксель экранного буфера, при котором формат рассматривается
+    bool fStencil_;
+};
+
+// Доступные форматы пикселей буфера глубины в порядке предпочтения согласно справки DX SDK
+static const D3D9HL_DepthFmtDesc s_dsFmtTable[] = {
+    { D3DFMT_D24S8,     32, true },
+    { D3DFMT_D24X4S4,   32, true },
+    { D3DFMT_D24X8,     32, false },
+    { D3DFMT_D32,       32, false },
+    { D3DFMT_D15S1,     16, true },
+    { D3DFMT_D16,       16, false }
+};
+
+// Пара форматов заднего буфера и дисплея в таблице кандидатов
+struct D3D9HL_BackBufferFmtDesc{
+    D3DFORMAT bbFmt_;
+    D3DFORMAT dpFmt_;
+    bool fAlpha_;
+};
+
+// Доступные форматы пикселей заднего буфера и дисплея для выбора согласно справки DX SDK
+static const D3D9HL_BackBufferFmtDesc s_bbFmtTable32[] = {
+    { D3DFMT_A8R8G8B8, D3DFMT_X8R8G8B8, true },
+    { D3DFMT_X8R8G8B8, D3DFMT_X8R8G8B8, false }
+};
+static const D3D9HL_BackBufferFmtDesc s_bbFmtTable16[] = {
+    { D3DFMT_A1R5G5B5, D3DFMT_X1R5G5B5, true },
+    { D3DFMT_X1R5G5B5, D3DFMT_X1R5G5B5, false },
+    { D3DFMT_R5G6B5,   D3DFMT_R5G6B5,   false }
+};
 
 /* Поиск подходящего формата глубины.
     @param d3d указатель на созданный объект главного интерфейса Direct3D9.
@@ -44,37 +80,20 @@ D3DFORMAT D3D9HL_FindApprDepthFormat(LPDIRECT3D9 d3d,
                                      D3DDEVTYPE deviceType = D3DDEVTYPE_HAL){
     Z3D_ASSERT_HIGH(d3d != 0, "null pointer to main Direct3D object passed", true);
 
-    // Доступные форматы пикселей буфера глубины для выбора согласно справки DX SDK
-    std::vector<D3DFORMAT> dsFmtVec;
-    dsFmtVec.reserve(7);
-    if (bpp == 32) {
-        // 32 bit
-        dsFmtVec.push_back(D3DFMT_D24S8);
-        dsFmtVec.push_back(D3DFMT_D24X4S4);
-        if (!fStencilOnly) {
-            dsFmtVec.push_back(D3DFMT_D24X8);
-            dsFmtVec.push_back(D3DFMT_D32);
-        }
-    }
-    // 16 bit
-    dsFmtVec.push_back(D3DFMT_D15S1);
-    if (!fStencilOnly)
-        dsFmtVec.push_back(D3DFMT_D16);
-
-    dsFmtVec.push_back(D3DFMT_UNKNOWN);
-
     // Перебор форматов с целью выбора наилучшего из поддерживаемых
-    size_t iFmtFound = Z3D_D3D9HL_NOINDEX;
-    for (size_t iFmt = 0; iFmt < dsFmtVec.size(); ++iFmt) {
-        if (dsFmtVec[iFmt] == D3DFMT_UNKNOWN)
-            break;
+    for (size_t iFmt = 0; iFmt < sizeof(s_dsFmtTable) / sizeof(s_dsFmtTable[0]); ++iFmt) {
+        const D3D9HL_DepthFmtDesc& fmtDesc = s_dsFmtTable[iFmt];
+        if (fmtDesc.bpp_ > bpp)
+            continue;
+        if (fStencilOnly && !fmtDesc.fStencil_)
+            continue;
         // Проверка возможности использования формата в качестве буфера глубины
         HRESULT hr = d3d->CheckDeviceFormat(static_cast<UINT>(iAdapter),
                                             deviceType,
                                             dpFmt,
                                             D3DUSAGE_DEPTHSTENCIL,
                                             D3DRTYPE_SURFACE,
-                                            dsFmtVec[iFmt]);
+                                            fmtDesc.fmt_);
 
         if (FAILED(hr))continue;
 
@@ -83,7 +102,7 @@ D3DFORMAT D3D9HL_FindApprDepthFormat(LPDIRECT3D9 d3d,
                                          deviceType,
                                          dpFmt,
                                          bbFmt,
-                                         dsFmtVec[iFmt]);
+                                         fmtDesc.fmt_);
 
         if (FAILED(hr))continue;
 
@@ -92,24 +111,18 @@ D3DFORMAT D3D9HL_FindApprDepthFormat(LPDIRECT3D9 d3d,
         if (multiSampleType != D3DMULTISAMPLE_NONE) {
             hr = d3d->CheckDeviceMultiSampleType(static_cast<UINT>(iAdapter),
                                              deviceType,
-                                             dsFmtVec[iFmt],
+                                             fmtDesc.fmt_,
                                              fWindowed ? TRUE : FALSE,
                                              multiSampleType,
                                              &dsQualityLevels);
             if (FAILED(hr)) continue;
         }
-        iFmtFound = iFmt;
         if (multiSampleType != D3DMULTISAMPLE_NONE && qualityLevels != 0 && *qualityLevels > dsQualityLevels)
             *qualityLevels = dsQualityLevels;
-        break;
+        return fmtDesc.fmt_;
     }
 
-    D3DFORMAT dsFmt = D3DFMT_UNKNOWN;
-    if (iFmtFound == Z3D_D3D9HL_NOINDEX)
-        return dsFmt;
-
-    dsFmt = dsFmtVec[iFmtFound];
-    return dsFmt;
+    return D3DFMT_UNKNOWN;
 }
 
 } // end of z3D_priv
@@ -137,49 +150,36 @@ z3DD3D9HL_ErrCodes D3D9HL_FindVideoModes(z3DD3D9HL_VideoMode* videoModes,
     if (!(bpp == 16 || bpp == 32))
         return Z3D_D3D9HL_INVALIDCALL;
 
-    // Доступные форматы пикселей заднего буфера для выбора согласно справки DX SDK
-    std::vector<D3DFORMAT> bbFmtVec;
-    bbFmtVec.reserve(6);
+    // Доступные форматы пикселей заднего буфера и дисплея для выбора согласно справки DX SDK
+    const z3D_priv::D3D9HL_BackBufferFmtDesc* fmtTable = 0;
+    size_t numFmts = 0;
     if (bpp == 32){
-        bbFmtVec.push_back(D3DFMT_A8R8G8B8);        // 0
-        if (!fAlphaInBBOnly)
-            bbFmtVec.push_back(D3DFMT_X8R8G8B8);    // 1
+        fmtTable = z3D_priv::s_bbFmtTable32;
+        numFmts = sizeof(z3D_priv::s_bbFmtTable32) / sizeof(z3D_priv::s_bbFmtTable32[0]);
     }
     else if (bpp == 16){
-        bbFmtVec.push_back(D3DFMT_A1R5G5B5);        // 2
-        if (!fAlphaInBBOnly) {
-            bbFmtVec.push_back(D3DFMT_X1R5G5B5);    // 3
-            bbFmtVec.push_back(D3DFMT_R5G6B5);      // 4
-        }
+        fmtTable = z3D_priv::s_bbFmtTable16;
+        numFmts = sizeof(z3D_priv::s_bbFmtTable16) / sizeof(z3D_priv::s_bbFmtTable16[0]);
     }
     else {
         Z3D_ERROR1( Z3D_ERROR_PERMISSIBLE, 0, "unacceptable value passed for bpp: %d", bpp, false);
         return Z3D_D3D9HL_INVALIDCALL;
     }
-    bbFmtVec.push_back(D3DFMT_UNKNOWN);
-
-    // Доступные форматы пикселей дисплея для выбора согласно справки DX SDK
-    std::vector<D3DFORMAT> dpFmtVec = bbFmtVec;
-    for (size_t iFmt = 0; iFmt < dpFmtVec.size(); ++iFmt){
-        if (dpFmtVec[iFmt] == D3DFMT_A8R8G8B8)
-            dpFmtVec[iFmt] = D3DFMT_X8R8G8B8;
-        else if (dpFmtVec[iFmt] == D3DFMT_A1R5G5B5)
-            dpFmtVec[iFmt] = D3DFMT_X1R5G5B5;
-    }
 
     // Перебор форматов с целью выбора наилучшего из поддерживаемых
-    size_t iFmtFound = Z3D_D3D9HL_NOINDEX;
+    const z3D_priv::D3D9HL_BackBufferFmtDesc* fmtFound = 0;
     D3DFORMAT dsFmt = D3DFMT_UNKNOWN;
-    for (size_t iFmt = 0; iFmt < dpFmtVec.size(); ++iFmt) {
-        if (dpFmtVec[iFmt] == D3DFMT_UNKNOWN)
-            break;
+    for (size_t iFmt = 0; iFmt < numFmts; ++iFmt) {
+        const z3D_priv::D3D9HL_BackBufferFmtDesc& fmtDesc = fmtTable[iFmt];
+        if (fAlphaInBBOnly && !fmtDesc.fAlpha_)
+            continue;
 
         // Проверяем возможность работы устройства на адаптере при заданном формате
         // дисплея и заднего буфера
         HRESULT hr = d3d->CheckDeviceType(static_cast<UINT>(iAdapter),
                                      deviceType,
-                                     dpFmtVec[iFmt],
-                                     bbFmtVec[iFmt],
+                                     fmtDesc.dpFmt_,
+                                     fmtDesc.bbFmt_,
                                      fWindowed ? TRUE : FALSE);
         if (FAILED(hr)) continue;
 
@@ -187,7 +187,7 @@ z3DD3D9HL_ErrCodes D3D9HL_FindVideoModes(z3DD3D9HL_VideoMode* videoModes,
         if (multiSampleType != D3DMULTISAMPLE_NONE) {
             hr = d3d->CheckDeviceMultiSampleType(static_cast<UINT>(iAdapter),
                                              deviceType,
-                                             bbFmtVec[iFmt],
+                                             fmtDesc.bbFmt_,
                                              fWindowed ? TRUE : FALSE,
                                              multiSampleType,
                                              qualityLevels);
@@ -197,8 +197,8 @@ z3DD3D9HL_ErrCodes D3D9HL_FindVideoModes(z3DD3D9HL_VideoMode* videoModes,
         // Поиск подходящего формата глубины
         dsFmt = z3D_priv::D3D9HL_FindApprDepthFormat(d3d,
                                                  bpp,
-                                                 dpFmtVec[iFmt],
-                                                 bbFmtVec[iFmt],
+                                                 fmtDesc.dpFmt_,
+                                                 fmtDesc.bbFmt_,
                                                  multiSampleType,
                                                  qualityLevels,
                                                  fWindowed,
@@ -207,32 +207,38 @@ z3DD3D9HL_ErrCodes D3D9HL_FindVideoModes(z3DD3D9HL_VideoMode* videoModes,
                                                  deviceType);
         if (dsFmt == D3DFMT_UNKNOWN) continue;
 
-        iFmtFound = iFmt;
+        fmtFound = &fmtDesc;
         break;
     }
-    if (iFmtFound == Z3D_D3D9HL_NOINDEX)
+    if (fmtFound == 0)
         return Z3D_D3D9HL_NOTFOUND;
 
     // Форматы заднего буфера, дисплея и шлубины найдены,
     // производим поиск видеорежимов
-    uint32_t nModes = static_cast<UINT>(d3d->GetAdapterModeCount(static_cast<UINT>(iAdapter), dpFmtVec[iFmtFound]));
-
-    std::vector<z3DD3D9HL_VideoMode> modesFound;
-    modesFound.reserve(nModes);
+    uint32_t nModes = static_cast<UINT>(d3d->GetAdapterModeCount(static_cast<UINT>(iAdapter), fmtFound->dpFmt_));
+
+    // Временный массив выделяется через распределитель библиотеки ( @see D3D9HL_SetAllocator )
+    z3DD3D9HL_VideoMode* modesFound = 0;
+    if (nModes > 0){
+        modesFound = static_cast<z3DD3D9HL_VideoMode*>(
+            z3D_priv::D3D9HL_Alloc(sizeof(z3DD3D9HL_VideoMode) * nModes, Z3D_D3D9HL_DEFAULT_ALIGN));
+        if (modesFound == 0)
+            return Z3D_D3D9HL_OUTOFMEMORY;
+    }
+    uint32_t nModesFound = 0;
     for (uint32_t iMode = 0; iMode < nModes; iMode++){
         D3DDISPLAYMODE dm;
         HRESULT hr = d3d->EnumAdapterModes(static_cast<UINT>(iAdapter),
-                                           dpFmtVec[iFmtFound],
+                                           fmtFound->dpFmt_,
                                            static_cast<UINT>(iMode),
                                            &dm);
         if (FAILED(hr)) continue;
-        z3DD3D9HL_VideoMode mode;
+        z3DD3D9HL_VideoMode& mode = modesFound[nModesFound++];
         mode.bpp_ = bpp;
         mode.d3ddm_ = dm;
         mode.depthStencilFmt_ = dsFmt;
         mode.fAlphaInBB_ = z3D_priv::D3DFormatHasAlpha(dm.Format);
         mode.fStencil_ = z3D_priv::D3DFormatHasStencil(dsFmt);
-        modesFound.push_back(mode);
     }
 
     // Определяем режимы дисплея с равной или наиболее близкой большей частотой развертки
@@ -243,17 +249,364 @@ z3DD3D9HL_ErrCodes D3D9HL_FindVideoModes(z3DD3D9HL_VideoMode* videoModes,
     int curRefresh = ::GetDeviceCaps(hDCScreen, VREFRESH);
     ::ReleaseDC(0, hDCScreen);
 
-    z3D_priv::LeaveVideoModeWithClosestRefreshRates(modesFound, static_cast<uint32_t>(curRefresh));
+    nModesFound = static_cast<uint32_t>(
+        z3D_priv::LeaveVideoModeWithClosestRefreshRates(modesFound, nModesFound, static_cast<uint32_t>(curRefresh)));
 
-    *numVideoModes = modesFound.size();
-    if (videoModes == 0){
-        return Z3D_D3D9HL_NONE;
+    *numVideoModes = static_cast<uint16_t>(nModesFound);
+    if (videoModes != 0){
+        for (uint32_t iMode = 0; iMode < nModesFound; ++iMode){
+            videoModes[iMode] = modesFound[iMode];
+        }
+    }
+    z3D_priv::D3D9HL_Free(modesFound);
+    return Z3D_D3D9HL_NONE;
+
+}
+
+} // end of z3D
+
+namespace z3D_priv
+{
+// Флаги, определяющие тип обработки вершин
+static const DWORD s_vertexProcessingMask = D3DCREATE_HARDWARE_VERTEXPROCESSING |
+                                            D3DCREATE_MIXED_VERTEXPROCESSING |
+                                            D3DCREATE_SOFTWARE_VERTEXPROCESSING;
+
+// Результаты создания устройства для каждого адаптера
+static z3DD3D9HL_DeviceCreationOutcome s_creationOutcomes[Z3D_D3D9HL_MAX_ADAPTERS];
+
+/* Заполнить идентификацию адаптера и версии его драйвера в результате создания устройства.
+    @return false, если идентификатор адаптера получить не удалось.
+*/
+bool D3D9HL_GetAdapterOutcomeKey(z3DD3D9HL_DeviceCreationOutcome* key,
+                                 LPDIRECT3D9 d3d,
+                                 uint32_t iAdapter,
+                                 D3DDEVTYPE deviceType){
+    D3DADAPTER_IDENTIFIER9 adapterId;
+    HRESULT hr = d3d->GetAdapterIdentifier(static_cast<UINT>(iAdapter), 0, &adapterId);
+    if (FAILED(hr)) return false;
+    key->vendorId_ = static_cast<uint32_t>(adapterId.VendorId);
+    key->deviceId_ = static_cast<uint32_t>(adapterId.DeviceId);
+    key->subSysId_ = static_cast<uint32_t>(adapterId.SubSysId);
+    key->driverVersionHigh_ = static_cast<uint32_t>(adapterId.DriverVersion.HighPart);
+    key->driverVersionLow_ = static_cast<uint32_t>(adapterId.DriverVersion.LowPart);
+    key->deviceType_ = deviceType;
+    key->behaviorFlags_ = 0;
+    return true;
+}
+
+/* Проверить, относятся ли результаты создания устройства к одному адаптеру, драйверу и типу устройства.
+*/
+bool D3D9HL_SameAdapterOutcomeKey(const z3DD3D9HL_DeviceCreationOutcome& o1,
+                                  const z3DD3D9HL_DeviceCreationOutcome& o2){
+    return o1.vendorId_ == o2.vendorId_ &&
+           o1.deviceId_ == o2.deviceId_ &&
+           o1.subSysId_ == o2.subSysId_ &&
+           o1.driverVersionHigh_ == o2.driverVersionHigh_ &&
+           o1.driverVersionLow_ == o2.driverVersionLow_ &&
+           o1.deviceType_ == o2.deviceType_;
+}
+
+/* Получить флаги создания устройства по запомненному результату или 0, если результата для адаптера нет.
+
+Из запомненной комбинации берутся только тип обработки вершин и D3DCREATE_PUREDEVICE. Остальные флаги
+(D3DCREATE_MULTITHREADED, D3DCREATE_FPU_PRESERVE) берутся из флагов, выбранных по текущей политике.
+*/
+DWORD D3D9HL_GetCachedCreationFlags(const z3DD3D9HL_DeviceCreationOutcome& outcomeKey,
+                                    uint32_t iAdapter,
+                                    DWORD chosenFlags,
+                                    const z3DD3D9HL_DeviceCreationPolicy& policy){
+    const z3DD3D9HL_DeviceCreationOutcome& cached = s_creationOutcomes[iAdapter];
+    if (cached.behaviorFlags_ == 0 || !D3D9HL_SameAdapterOutcomeKey(cached, outcomeKey))
+        return 0;
+    DWORD flags = cached.behaviorFlags_ & (s_vertexProcessingMask | D3DCREATE_PUREDEVICE);
+    // Политика могла запретить устройство без проверки состояний после сохранения результата
+    if (!policy.fAllowPureDevice_)
+        flags &= ~D3DCREATE_PUREDEVICE;
+    if ((flags & s_vertexProcessingMask) == 0)
+        return 0;
+    return flags | (chosenFlags & ~(s_vertexProcessingMask | D3DCREATE_PUREDEVICE));
+}
+
+/* Добавить комбинацию флагов в список кандидатов, если ее там еще нет.
+*/
+void D3D9HL_AddCreationCandidate(DWORD* candidates, uint32_t* numCandidates, DWORD flags){
+    for (uint32_t i = 0; i < *numCandidates; ++i){
+        if (candidates[i] == flags)
+            return;
+    }
+    candidates[(*numCandidates)++] = flags;
+}
+
+/* Составить упорядоченный список комбинаций флагов для попыток создания устройства.
+
+Первой идет запомненная успешная комбинация (если есть), затем выбранная по возможностям адаптера,
+затем все более консервативные: без D3DCREATE_PUREDEVICE, смешанная и программная обработка вершин.
+    @param [out] candidates массив не менее чем из 6 элементов.
+    @return число комбинаций в списке.
+*/
+uint32_t D3D9HL_BuildCreationCandidates(DWORD* candidates, DWORD chosenFlags, DWORD cachedFlags){
+    uint32_t numCandidates = 0;
+    if (cachedFlags != 0)
+        D3D9HL_AddCreationCandidate(candidates, &numCandidates, cachedFlags);
+    D3D9HL_AddCreationCandidate(candidates, &numCandidates, chosenFlags);
+
+    DWORD extraFlags = chosenFlags & ~(s_vertexProcessingMask | D3DCREATE_PUREDEVICE);
+    if (chosenFlags & D3DCREATE_HARDWARE_VERTEXPROCESSING)
+        D3D9HL_AddCreationCandidate(candidates, &numCandidates, extraFlags | D3DCREATE_HARDWARE_VERTEXPROCESSING);
+    if (chosenFlags & (D3DCREATE_HARDWARE_VERTEXPROCESSING | D3DCREATE_MIXED_VERTEXPROCESSING))
+        D3D9HL_AddCreationCandidate(candidates, &numCandidates, extraFlags | D3DCREATE_MIXED_VERTEXPROCESSING);
+    D3D9HL_AddCreationCandidate(candidates, &numCandidates, extraFlags | D3DCREATE_SOFTWARE_VERTEXPROCESSING);
+    return numCandidates;
+}
+
+/* Создать устройство, перебирая комбинации флагов из D3D9HL_BuildCreationCandidates(), и запомнить
+успешную комбинацию для адаптера.
+    @param groupFlags флаги, добавляемые к каждой комбинации (D3DCREATE_ADAPTERGROUP_DEVICE). В запомненный
+    результат не попадают.
+    @param d3dpp параметры презентации: одна структура или по одной на каждую голову группы.
+    @param policy политика создания; если нуль, D3DCREATE_PUREDEVICE не используется, чтобы Get-методы
+    устройства оставались доступны.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_CreateDeviceWithCandidates(LPDIRECT3DDEVICE9* device,
+                                                     uint32_t* pVertexProcessingType,
+                                                     LPDIRECT3D9 d3d,
+                                                     uint32_t iAdapter,
+                                                     D3DDEVTYPE deviceType,
+                                                     HWND hFocusWindow,
+                                                     DWORD groupFlags,
+                                                     D3DPRESENT_PARAMETERS* d3dpp,
+                                                     const z3DD3D9HL_DeviceCreationPolicy* policy){
+    z3DD3D9HL_DeviceCreationPolicy defaultPolicy;
+    if (policy == 0){
+        defaultPolicy.fAllowPureDevice_ = false;
+        policy = &defaultPolicy;
     }
-    for (uint32_t iMode = 0; iMode < modesFound.size(); ++iMode){
-        videoModes[iMode] = modesFound[iMode];
+    DWORD chosenFlags = 0;
+    z3DD3D9HL_ErrCodes err = ::z3D::D3D9HL_ChooseDeviceCreationFlags(&chosenFlags, d3d, *policy, iAdapter, deviceType);
+    if (err != Z3D_D3D9HL_NONE)
+        return err;
+
+    // Запомненная успешная комбинация флагов применяется, только если адаптер и драйвер не изменились
+    z3DD3D9HL_DeviceCreationOutcome outcomeKey;
+    bool fOutcomeKey = iAdapter < Z3D_D3D9HL_MAX_ADAPTERS &&
+                       D3D9HL_GetAdapterOutcomeKey(&outcomeKey, d3d, iAdapter, deviceType);
+    DWORD cachedFlags = 0;
+    if (fOutcomeKey && policy->fUseCachedOutcome_)
+        cachedFlags = D3D9HL_GetCachedCreationFlags(outcomeKey, iAdapter, chosenFlags, *policy);
+
+    DWORD candidates[6];
+    uint32_t numCandidates = D3D9HL_BuildCreationCandidates(candidates, chosenFlags, cachedFlags);
+    DWORD behaviorFlags = 0;
+    for (uint32_t iCandidate = 0; iCandidate < numCandidates; ++iCandidate){
+        HRESULT hr = d3d->CreateDevice(static_cast<UINT>(iAdapter),
+                                       deviceType,
+                                       hFocusWindow,
+                                       candidates[iCandidate] | groupFlags,
+                                       d3dpp,
+                                       device);
+        if (SUCCEEDED(hr)){
+            behaviorFlags = candidates[iCandidate];
+            break;
+        }
+    }
+    if (behaviorFlags == 0)
+        return Z3D_D3D9HL_NOTAVAILABLE;
+
+    if (fOutcomeKey){
+        outcomeKey.behaviorFlags_ = behaviorFlags;
+        s_creationOutcomes[iAdapter] = outcomeKey;
     }
+    if (pVertexProcessingType != 0)
+        *pVertexProcessingType = behaviorFlags & s_vertexProcessingMask;
     return Z3D_D3D9HL_NONE;
+}
+
+/* Заполнить параметры презентации для видеорежима.
+*/
+void D3D9HL_FillPresentParams(D3DPRESENT_PARAMETERS* d3dpp,
+                              const z3DD3D9HL_VideoMode& videoMode,
+                              D3DMULTISAMPLE_TYPE multiSampleType,
+                              DWORD qualityLevel,
+                              bool fWindowed,
+                              bool fVSync,
+                              HWND hWnd){
+    ZeroMemory(d3dpp, sizeof(D3DPRESENT_PARAMETERS));
+
+    if (!fWindowed) {
+        d3dpp->BackBufferWidth = static_cast<UINT>(videoMode.Width());
+        d3dpp->BackBufferHeight = static_cast<UINT>(videoMode.Height());
+    }
+    d3dpp->BackBufferFormat = videoMode.d3ddm_.Format;
+    d3dpp->BackBufferCount = 1;
+    d3dpp->MultiSampleType = multiSampleType;
+    d3dpp->MultiSampleQuality = qualityLevel;
+    d3dpp->SwapEffect = D3DSWAPEFFECT_DISCARD;
+    d3dpp->hDeviceWindow = hWnd;
+    d3dpp->Windowed = fWindowed ? TRUE : FALSE;
+    d3dpp->EnableAutoDepthStencil = TRUE;
+    d3dpp->AutoDepthStencilFormat = videoMode.depthStencilFmt_;
+    d3dpp->Flags = 0;
+    d3dpp->FullScreen_RefreshRateInHz = fWindowed ? 0 : static_cast<UINT>(videoMode.RefreshRate());
+    d3dpp->PresentationInterval = fVSync ? D3DPRESENT_INTERVAL_ONE : D3DPRESENT_INTERVAL_IMMEDIATE;
+}
+
+/* Получить текущее значение счетчика времени в микросекундах.
+*/
+uint64_t D3D9HL_GetTimeUs(){
+    LARGE_INTEGER freq, counter;
+    if (!::QueryPerformanceFrequency(&freq) || freq.QuadPart == 0)
+        return 0;
+    ::QueryPerformanceCounter(&counter);
+    return static_cast<uint64_t>(counter.QuadPart / freq.QuadPart) * 1000000 +
+           static_cast<uint64_t>(counter.QuadPart % freq.QuadPart) * 1000000 / static_cast<uint64_t>(freq.QuadPart);
+}
+
+// Слушатели событий устройства
+static z3DD3D9HL_DeviceListener s_deviceListeners[Z3D_D3D9HL_MAX_DEVICE_LISTENERS];
+static uint32_t s_numDeviceListeners = 0;
+
+bool D3D9HL_SameDeviceListener(const z3DD3D9HL_DeviceListener& l1, const z3DD3D9HL_DeviceListener& l2){
+    return l1.onRelease_ == l2.onRelease_ &&
+           l1.onReset_ == l2.onReset_ &&
+           l1.onEndRender_ == l2.onEndRender_ &&
+           l1.userData_ == l2.userData_;
+}
+
+/* Слушатель получает события устройства: свои или, при нулевом device_, любого.
+*/
+bool D3D9HL_ListensToDevice(const z3DD3D9HL_DeviceListener& listener, LPDIRECT3DDEVICE9 device){
+    return listener.device_ == 0 || listener.device_ == device;
+}
+
+/* Передать новому устройству слушателей пересозданного устройства.
+*/
+void D3D9HL_RetargetDeviceListeners(LPDIRECT3DDEVICE9 oldDevice, LPDIRECT3DDEVICE9 newDevice){
+    for (uint32_t i = 0; i < s_numDeviceListeners; ++i){
+        if (s_deviceListeners[i].device_ == oldDevice)
+            s_deviceListeners[i].device_ = newDevice;
+    }
+}
 
+/* Сообщить слушателям об освобождении ресурсов устройства (в порядке, обратном регистрации).
+*/
+void D3D9HL_NotifyDeviceRelease(LPDIRECT3DDEVICE9 device){
+    for (uint32_t i = s_numDeviceListeners; i > 0; --i){
+        const z3DD3D9HL_DeviceListener& listener = s_deviceListeners[i - 1];
+        if (listener.onRelease_ != 0 && D3D9HL_ListensToDevice(listener, device))
+            listener.onRelease_(device, listener.userData_);
+    }
+}
+
+/* Сообщить слушателям о восстановлении устройства.
+*/
+void D3D9HL_NotifyDeviceReset(LPDIRECT3DDEVICE9 device){
+    for (uint32_t i = 0; i < s_numDeviceListeners; ++i){
+        const z3DD3D9HL_DeviceListener& listener = s_deviceListeners[i];
+        if (listener.onReset_ != 0 && D3D9HL_ListensToDevice(listener, device))
+            listener.onReset_(device, listener.userData_);
+    }
+}
+
+/* Сообщить слушателям о завершении рендера кадра.
+*/
+void D3D9HL_NotifyDeviceEndRender(LPDIRECT3DDEVICE9 device){
+    for (uint32_t i = 0; i < s_numDeviceListeners; ++i){
+        const z3DD3D9HL_DeviceListener& listener = s_deviceListeners[i];
+        if (listener.onEndRender_ != 0 && D3D9HL_ListensToDevice(listener, device))
+            listener.onEndRender_(device, listener.userData_);
+    }
+}
+} // end of z3D_priv
+
+namespace z3D
+{
+
+z3DD3D9HL_ErrCodes D3D9HL_ChooseDeviceCreationFlags(DWORD* behaviorFlags,
+                                                    LPDIRECT3D9 d3d,
+                                                    const z3DD3D9HL_DeviceCreationPolicy& policy,
+                                                    uint32_t iAdapter,
+                                                    D3DDEVTYPE deviceType){
+    Z3D_ASSERT_HIGH(behaviorFlags != 0, "null passed", true);
+    if (behaviorFlags == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(d3d != 0, "null pointer to main Direct3D object passed", true);
+    if (d3d == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    D3DCAPS9 devCaps;
+    HRESULT hr = d3d->GetDeviceCaps(static_cast<UINT>(iAdapter), deviceType, &devCaps);
+    if (FAILED(hr))
+        return Z3D_D3D9HL_NOTAVAILABLE;
+
+    DWORD flags = 0;
+    // Драйверы без поддержки потоков вершин (MaxStreams == 0) - уровня DX7, аппаратную обработку вершин не используем
+    if (!(devCaps.DevCaps & D3DDEVCAPS_HWTRANSFORMANDLIGHT) || devCaps.MaxStreams == 0){
+        flags = D3DCREATE_SOFTWARE_VERTEXPROCESSING;
+    }
+    // Аппаратные T&L есть, но вершинные шейдеры нужной версии придется выполнять программно
+    else if (devCaps.VertexShaderVersion < D3DVS_VERSION(policy.minVSMajor_, policy.minVSMinor_)){
+        flags = D3DCREATE_MIXED_VERTEXPROCESSING;
+    }
+    else {
+        flags = D3DCREATE_HARDWARE_VERTEXPROCESSING;
+        // Устройство без проверки и отслеживания состояний на стороне runtime
+        if (policy.fAllowPureDevice_ && (devCaps.DevCaps & D3DDEVCAPS_PUREDEVICE))
+            flags |= D3DCREATE_PUREDEVICE;
+    }
+    if (policy.fMultithreaded_)
+        flags |= D3DCREATE_MULTITHREADED;
+    if (policy.fFpuPreserve_)
+        flags |= D3DCREATE_FPU_PRESERVE;
+
+    *behaviorFlags = flags;
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_GetDeviceCreationOutcome(z3DD3D9HL_DeviceCreationOutcome* outcome,
+                                                   uint32_t iAdapter){
+    Z3D_ASSERT_HIGH(outcome != 0, "null passed", true);
+    if (outcome == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (iAdapter >= Z3D_D3D9HL_MAX_ADAPTERS)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (z3D_priv::s_creationOutcomes[iAdapter].behaviorFlags_ == 0)
+        return Z3D_D3D9HL_NOTFOUND;
+    *outcome = z3D_priv::s_creationOutcomes[iAdapter];
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_SetDeviceCreationOutcome(const z3DD3D9HL_DeviceCreationOutcome& outcome,
+                                                   uint32_t iAdapter){
+    if (iAdapter >= Z3D_D3D9HL_MAX_ADAPTERS)
+        return Z3D_D3D9HL_INVALIDCALL;
+    z3D_priv::s_creationOutcomes[iAdapter] = outcome;
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_AddDeviceListener(const z3DD3D9HL_DeviceListener& listener){
+    for (uint32_t i = 0; i < z3D_priv::s_numDeviceListeners; ++i){
+        if (z3D_priv::D3D9HL_SameDeviceListener(z3D_priv::s_deviceListeners[i], listener))
+            return Z3D_D3D9HL_NONE;
+    }
+    Z3D_ASSERT(z3D_priv::s_numDeviceListeners < Z3D_D3D9HL_MAX_DEVICE_LISTENERS, "too many device listeners", true);
+    if (z3D_priv::s_numDeviceListeners >= Z3D_D3D9HL_MAX_DEVICE_LISTENERS)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    z3D_priv::s_deviceListeners[z3D_priv::s_numDeviceListeners++] = listener;
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_RemoveDeviceListener(const z3DD3D9HL_DeviceListener& listener){
+    for (uint32_t i = 0; i < z3D_priv::s_numDeviceListeners; ++i){
+        if (z3D_priv::D3D9HL_SameDeviceListener(z3D_priv::s_deviceListeners[i], listener)){
+            // порядок оставшихся слушателей сохраняется
+            for (uint32_t j = i + 1; j < z3D_priv::s_numDeviceListeners; ++j)
+                z3D_priv::s_deviceListeners[j - 1] = z3D_priv::s_deviceListeners[j];
+            z3D_priv::s_numDeviceListeners--;
+            return Z3D_D3D9HL_NONE;
+        }
+    }
+    return Z3D_D3D9HL_NOTFOUND;
 }
 
 z3DD3D9HL_ErrCodes D3D9HL_CreateDevice(LPDIRECT3DDEVICE9* device,
@@ -267,89 +620,169 @@ z3DD3D9HL_ErrCodes D3D9HL_CreateDevice(LPDIRECT3DDEVICE9* device,
                                        bool fVSync,
                                        HWND hWnd,
                                        uint32_t iAdapter,
-                                       D3DDEVTYPE deviceType){
+                                       D3DDEVTYPE deviceType,
+                                       const z3DD3D9HL_DeviceCreationPolicy* policy){
     if (hWnd == 0) hWnd = ::GetActiveWindow();
     if (hWnd == 0) {
         Z3D_ERROR(Z3D_ERROR_PERMISSIBLE, hWnd == 0, "No active window", false);
         return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
     }
     D3DPRESENT_PARAMETERS d3dpp;
-    ZeroMemory(&d3dpp, sizeof(D3DPRESENT_PARAMETERS));
+    z3D_priv::D3D9HL_FillPresentParams(&d3dpp, videoMode, multiSampleType, qualityLevel, fWindowed, fVSync, hWnd);
 
-    if (!fWindowed) {
-        d3dpp.BackBufferWidth = static_cast<UINT>(videoMode.Width());
-        d3dpp.BackBufferHeight = static_cast<UINT>(videoMode.Height());
-    }
-    d3dpp.BackBufferFormat = videoMode.d3ddm_.Format;
-    d3dpp.BackBufferCount = 1;
-    d3dpp.MultiSampleType = multiSampleType;
-    d3dpp.MultiSampleQuality = qualityLevel;
-    d3dpp.SwapEffect = D3DSWAPEFFECT_DISCARD;
-    d3dpp.hDeviceWindow = hWnd;
-    d3dpp.Windowed = fWindowed ? TRUE : FALSE;
-    d3dpp.EnableAutoDepthStencil = TRUE;
-    d3dpp.AutoDepthStencilFormat = videoMode.depthStencilFmt_;
-    d3dpp.Flags = 0;
-    d3dpp.FullScreen_RefreshRateInHz = fWindowed ? 0 : static_cast<UINT>(videoMode.RefreshRate());
-    d3dpp.PresentationInterval = fVSync ? D3DPRESENT_INTERVAL_ONE : D3DPRESENT_INTERVAL_IMMEDIATE;
+    z3DD3D9HL_ErrCodes err = z3D_priv::D3D9HL_CreateDeviceWithCandidates(device, pVertexProcessingType, d3d, iAdapter,
+                                                                         deviceType, hWnd, 0, &d3dpp, policy);
+    if (err != Z3D_D3D9HL_NONE)
+        return err;
+    if (presentParams != 0)
+        *presentParams = d3dpp;
+    return Z3D_D3D9HL_NONE;
+}
 
-    D3DCAPS9 devCaps;
-    DWORD  vertexProcessingType = 0;
-	d3d->GetDeviceCaps( static_cast<UINT>(iAdapter), deviceType, &devCaps );
-	if ( devCaps.DevCaps & D3DDEVCAPS_HWTRANSFORMANDLIGHT ){
-        vertexProcessingType = D3DCREATE_HARDWARE_VERTEXPROCESSING;
-        HRESULT hr = d3d->CreateDevice(static_cast<UINT>(iAdapter),
-                                     deviceType,
-                                     hWnd,
-                                     vertexProcessingType,
-                                     &d3dpp,
-                                     device);
-        if (FAILED(hr)){
-            vertexProcessingType = D3DCREATE_MIXED_VERTEXPROCESSING;
-            hr = d3d->CreateDevice(static_cast<UINT>(iAdapter),
-                                     deviceType,
-                                     hWnd,
-                                     vertexProcessingType,
-                                     &d3dpp,
-                                     device);
-            if (FAILED(hr)){
-                vertexProcessingType = D3DCREATE_SOFTWARE_VERTEXPROCESSING;
-                hr = d3d->CreateDevice(static_cast<UINT>(iAdapter),
-                                         deviceType,
-                                         hWnd,
-                                         vertexProcessingType,
-                                         &d3dpp,
-                                         device);
-                if (FAILED(hr)) return Z3D_D3D9HL_NOTAVAILABLE;
-            }
+z3DD3D9HL_ErrCodes D3D9HL_GetAdapterGroup(z3DD3D9HL_AdapterGroup* group,
+                                          LPDIRECT3D9 d3d,
+                                          uint32_t iAdapter,
+                                          D3DDEVTYPE deviceType){
+    Z3D_ASSERT_HIGH(group != 0, "null passed", true);
+    if (group == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(d3d != 0, "null pointer to main Direct3D object passed", true);
+    if (d3d == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    D3DCAPS9 caps;
+    HRESULT hr = d3d->GetDeviceCaps(static_cast<UINT>(iAdapter), deviceType, &caps);
+    if (FAILED(hr))
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    // Число голов известно только из возможностей главного адаптера
+    UINT masterAdapter = caps.MasterAdapterOrdinal;
+    if (masterAdapter != static_cast<UINT>(iAdapter)){
+        hr = d3d->GetDeviceCaps(masterAdapter, deviceType, &caps);
+        if (FAILED(hr))
+            return Z3D_D3D9HL_NOTAVAILABLE;
+    }
+    uint32_t numHeads = static_cast<uint32_t>(caps.NumberOfAdaptersInGroup);
+    if (numHeads == 0)
+        numHeads = 1;
+    if (numHeads > Z3D_D3D9HL_MAX_HEADS){
+        Z3D_ERROR1(Z3D_ERROR_PERMISSIBLE, 0, "too many heads in adapter group: %d", numHeads, false);
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    }
+
+    group->masterAdapter_ = static_cast<uint32_t>(masterAdapter);
+    group->numHeads_ = numHeads;
+    for (uint32_t iHead = 0; iHead < Z3D_D3D9HL_MAX_HEADS; ++iHead)
+        group->adapters_[iHead] = Z3D_D3D9HL_NOINDEX;
+    UINT numAdapters = d3d->GetAdapterCount();
+    for (UINT i = 0; i < numAdapters; ++i){
+        hr = d3d->GetDeviceCaps(i, deviceType, &caps);
+        if (FAILED(hr) || caps.MasterAdapterOrdinal != masterAdapter)
+            continue;
+        if (caps.AdapterOrdinalInGroup < numHeads)
+            group->adapters_[caps.AdapterOrdinalInGroup] = static_cast<uint32_t>(i);
+    }
+    for (uint32_t iHead = 0; iHead < numHeads; ++iHead){
+        if (group->adapters_[iHead] == Z3D_D3D9HL_NOINDEX){
+            Z3D_ERROR1(Z3D_ERROR_PERMISSIBLE, 0, "adapter of head %d not found", iHead, false);
+            return Z3D_D3D9HL_NOTFOUND;
         }
     }
-	else {
-		vertexProcessingType |= D3DCREATE_SOFTWARE_VERTEXPROCESSING;
-		HRESULT hr = d3d->CreateDevice(static_cast<UINT>(iAdapter),
-                                deviceType,
-                                hWnd,
-                                vertexProcessingType,
-                                &d3dpp,
-                                device);
-        if (FAILED(hr)) return Z3D_D3D9HL_NOTAVAILABLE;
-	}
-	if (pVertexProcessingType != 0)
-        *pVertexProcessingType = vertexProcessingType;
-	if (presentParams != 0)
-        *presentParams = d3dpp;
     return Z3D_D3D9HL_NONE;
 }
 
+z3DD3D9HL_ErrCodes D3D9HL_CreateGroupDevice(LPDIRECT3DDEVICE9* device,
+                                            D3DPRESENT_PARAMETERS* presentParams,
+                                            uint32_t* pVertexProcessingType,
+                                            LPDIRECT3D9 d3d,
+                                            const z3DD3D9HL_AdapterGroup& group,
+                                            const z3DD3D9HL_VideoMode* videoModes,
+                                            const HWND* hWnds,
+                                            D3DMULTISAMPLE_TYPE multiSampleType,
+                                            DWORD qualityLevel,
+                                            bool fVSync,
+                                            D3DDEVTYPE deviceType,
+                                            const z3DD3D9HL_DeviceCreationPolicy* policy){
+    Z3D_ASSERT_HIGH(device != 0 && presentParams != 0, "null passed", true);
+    if (device == 0 || presentParams == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(d3d != 0, "null pointer to main Direct3D object passed", true);
+    if (d3d == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(videoModes != 0 && hWnds != 0, "no per-head video modes or windows passed", true);
+    if (videoModes == 0 || hWnds == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(group.numHeads_ > 0 && group.numHeads_ <= Z3D_D3D9HL_MAX_HEADS, "invalid adapter group passed", true);
+    if (group.numHeads_ == 0 || group.numHeads_ > Z3D_D3D9HL_MAX_HEADS)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    // Параметры презентации голов в порядке AdapterOrdinalInGroup; устройство группы только полноэкранное
+    D3DPRESENT_PARAMETERS d3dpp[Z3D_D3D9HL_MAX_HEADS];
+    for (uint32_t iHead = 0; iHead < group.numHeads_; ++iHead){
+        Z3D_ASSERT_HIGH(hWnds[iHead] != 0, "no head window passed", true);
+        if (hWnds[iHead] == 0)
+            return Z3D_D3D9HL_INVALIDCALL;
+        z3D_priv::D3D9HL_FillPresentParams(&d3dpp[iHead], videoModes[iHead], multiSampleType, qualityLevel, false, fVSync, hWnds[iHead]);
+    }
+
+    // Устройство создается на главном адаптере; результат запоминается для него без флага группы
+    z3DD3D9HL_ErrCodes err = z3D_priv::D3D9HL_CreateDeviceWithCandidates(device, pVertexProcessingType, d3d, group.masterAdapter_,
+                                                                         deviceType, hWnds[0],
+                                                                         (group.numHeads_ > 1) ? D3DCREATE_ADAPTERGROUP_DEVICE : 0,
+                                                                         d3dpp, policy);
+    if (err != Z3D_D3D9HL_NONE)
+        return err;
+    for (uint32_t iHead = 0; iHead < group.numHeads_; ++iHead)
+        presentParams[iHead] = d3dpp[iHead];
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_SetHeadRenderTarget(LPDIRECT3DDEVICE9 device, uint32_t iHead){
+    Z3D_ASSERT(device != 0, "null device passed", true);
+    if (device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(iHead < device->GetNumberOfSwapChains(), "head index out of range", true);
+    if (iHead >= device->GetNumberOfSwapChains())
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    LPDIRECT3DSWAPCHAIN9 swapChain = 0;
+    HRESULT hr = device->GetSwapChain(static_cast<UINT>(iHead), &swapChain);
+    if (FAILED(hr))
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    LPDIRECT3DSURFACE9 backBuffer = 0;
+    hr = swapChain->GetBackBuffer(0, D3DBACKBUFFER_TYPE_MONO, &backBuffer);
+    swapChain->Release();
+    if (FAILED(hr))
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    hr = device->SetRenderTarget(0, backBuffer);
+    backBuffer->Release();
+    return FAILED(hr) ? Z3D_D3D9HL_INVALIDCALL : Z3D_D3D9HL_NONE;
+}
+
 namespace z3D_priv
 {
 struct D3D9HL_RenderState{
     bool fBegin_;
+    bool fResourcesReleased_;       // ресурсы освобождены, устройство ждет Reset()
+    uint64_t beginTimeUs_;          // время начала текущего кадра
+    uint64_t lastPresentTimeUs_;    // время возврата из последнего Present(), 0 - кадр не учитывается
+    z3DD3D9HL_FrameTiming timing_;
     D3D9HL_RenderState() :
-        fBegin_(false){
+        fBegin_(false),
+        fResourcesReleased_(false),
+        beginTimeUs_(0),
+        lastPresentTimeUs_(0){
+        timing_.frameTimeUs_ = 0;
+        timing_.renderTimeUs_ = 0;
+        timing_.numFrames_ = 0;
     }
 };
 static D3D9HL_RenderState s_renderState;
+
+/* Проверить, вызвана ли D3D9HL_BeginDeviceRender() без парного вызова D3D9HL_EndDeviceRender().
+*/
+bool D3D9HL_IsDeviceRenderBegun(){
+    return s_renderState.fBegin_;
+}
 } // end of z3D_priv
 z3DD3D9HL_ErrCodes D3D9HL_BeginDeviceRender(LPDIRECT3DDEVICE9 device,
                                             D3DPRESENT_PARAMETERS* presentParams,
@@ -365,16 +798,26 @@ z3DD3D9HL_ErrCodes D3D9HL_BeginDeviceRender(LPDIRECT3DDEVICE9 device,
     HRESULT hr = device->TestCooperativeLevel();
     if (hr != D3D_OK){
         Z3D_INFO("Direct3D device lost");
+        // Время простоя потерянного устройства не должно попасть во время кадра
+        z3D_priv::s_renderState.lastPresentTimeUs_ = 0;
         // Устройство потеряно - не рендерим ничего. Ждем, когда его можно будет перезагрузить
         if (hr == D3DERR_DEVICELOST){
             return Z3D_D3D9HL_DEVICE_LOST;
         }
         // Устройство потеряно, но может быть перезагружено - не рендерим в этом фрейме
         else if (hr == D3DERR_DEVICENOTRESET){
-            releaseFunc();
+            // Ресурсы могли быть уже освобождены в D3D9HL_SwitchVideoMode() или прошлой неудачной попыткой
+            if (!z3D_priv::s_renderState.fResourcesReleased_){
+                releaseFunc();
+                ::z3D_priv::D3D9HL_NotifyDeviceRelease(device);
+                z3D_priv::s_renderState.fResourcesReleased_ = true;
+            }
             hr = device->Reset( presentParams );
-			if (hr == D3D_OK)
+			if (hr == D3D_OK){
                 resetFunc();
+                ::z3D_priv::D3D9HL_NotifyDeviceReset(device);
+                z3D_priv::s_renderState.fResourcesReleased_ = false;
+            }
             return Z3D_D3D9HL_DEVICE_NOT_RESET;
         }
     }
@@ -384,6 +827,7 @@ z3DD3D9HL_ErrCodes D3D9HL_BeginDeviceRender(LPDIRECT3DDEVICE9 device,
         return Z3D_D3D9HL_INVALIDCALL;
     }
     z3D_priv::s_renderState.fBegin_ = true;
+    z3D_priv::s_renderState.beginTimeUs_ = ::z3D_priv::D3D9HL_GetTimeUs();
     return Z3D_D3D9HL_NONE;
 }
 
@@ -394,9 +838,163 @@ z3DD3D9HL_ErrCodes D3D9HL_EndDeviceRender(LPDIRECT3DDEVICE9 device, HWND hDestWi
         return Z3D_D3D9HL_INVALIDCALL;
     }
     Z3D_ASSERT(device != 0, "null device passed", true);
+    ::z3D_priv::D3D9HL_NotifyDeviceEndRender(device);
     device->EndScene();
+    z3D_priv::D3D9HL_RenderState& state = z3D_priv::s_renderState;
+    // Время рендера измеряется до Present(): ожидание вертикальной синхронизации не должно в него попадать
+    state.timing_.renderTimeUs_ = static_cast<uint32_t>(::z3D_priv::D3D9HL_GetTimeUs() - state.beginTimeUs_);
     device->Present(0, 0, hDestWindow, 0);
-    z3D_priv::s_renderState.fBegin_ = false;
+    state.fBegin_ = false;
+
+    uint64_t presentTime = ::z3D_priv::D3D9HL_GetTimeUs();
+    if (state.lastPresentTimeUs_ != 0)
+        state.timing_.frameTimeUs_ = static_cast<uint32_t>(presentTime - state.lastPresentTimeUs_);
+    state.lastPresentTimeUs_ = presentTime;
+    state.timing_.numFrames_++;
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_GetFrameTiming(z3DD3D9HL_FrameTiming* timing){
+    Z3D_ASSERT_HIGH(timing != 0, "null passed", true);
+    *timing = z3D_priv::s_renderState.timing_;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_SwitchVideoMode(LPDIRECT3DDEVICE9* device,
+                                          D3DPRESENT_PARAMETERS* presentParams,
+                                          uint32_t* pVertexProcessingType,
+                                          z3DD3D9HL_ModeSwitchStats* stats,
+                                          LPDIRECT3D9 d3d,
+                                          const z3DD3D9HL_VideoMode& videoMode,
+                                          Z3D_D3D9HL_ReleaseDeviceResourcesFunc releaseFunc,
+                                          Z3D_D3D9HL_ResetDeviceResourcesFunc resetFunc,
+                                          D3DMULTISAMPLE_TYPE multiSampleType,
+                                          DWORD qualityLevel,
+                                          bool fWindowed,
+                                          bool fVSync,
+                                          uint32_t iAdapter,
+                                          D3DDEVTYPE deviceType,
+                                          const z3DD3D9HL_DeviceCreationPolicy* policy){
+    Z3D_ASSERT(device != 0 && *device != 0, "null device passed", true);
+    if (device == 0 || *device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT(presentParams != 0, "no present parameters passed", true);
+    if (presentParams == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT(d3d != 0, "null pointer to main Direct3D object passed", true);
+    if (d3d == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT(!z3D_priv::s_renderState.fBegin_, "video mode switch between BeginDeviceRender and EndDeviceRender", true);
+    if (z3D_priv::s_renderState.fBegin_)
+        return Z3D_D3D9HL_INVALIDCALL;
+    // Параметры презентации строятся для одной головы: Reset() устройства группы с ними невозможен
+    Z3D_ASSERT((*device)->GetNumberOfSwapChains() == 1, "video mode switch of adapter group device", true);
+    if ((*device)->GetNumberOfSwapChains() > 1)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    uint64_t startTime = ::z3D_priv::D3D9HL_GetTimeUs();
+    z3D_priv::s_renderState.lastPresentTimeUs_ = 0;
+    if (stats != 0){
+        stats->fRecreated_ = false;
+        stats->timeUs_ = 0;
+    }
+
+    D3DDEVICE_CREATION_PARAMETERS creationParams;
+    HRESULT hr = (*device)->GetCreationParameters(&creationParams);
+    if (FAILED(hr))
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    bool fRecreate = creationParams.AdapterOrdinal != static_cast<UINT>(iAdapter) ||
+                     creationParams.DeviceType != deviceType;
+    if (!fRecreate){
+        // Тип обработки вершин, с которым устройство было бы создано на том же адаптере. Без сохраненного
+        // результата остается тип живого устройства: он уже проверен на этом адаптере.
+        DWORD targetFlags = creationParams.BehaviorFlags;
+        z3DD3D9HL_DeviceCreationOutcome cached, outcomeKey;
+        if ((policy == 0 || policy->fUseCachedOutcome_) &&
+            D3D9HL_GetDeviceCreationOutcome(&cached, iAdapter) == Z3D_D3D9HL_NONE &&
+            ::z3D_priv::D3D9HL_GetAdapterOutcomeKey(&outcomeKey, d3d, iAdapter, deviceType) &&
+            ::z3D_priv::D3D9HL_SameAdapterOutcomeKey(cached, outcomeKey)){
+            targetFlags = cached.behaviorFlags_;
+        }
+        fRecreate = (targetFlags & ::z3D_priv::s_vertexProcessingMask) !=
+                    (creationParams.BehaviorFlags & ::z3D_priv::s_vertexProcessingMask);
+    }
+
+    HWND hWnd = presentParams->hDeviceWindow;
+    if (hWnd == 0)
+        hWnd = creationParams.hFocusWindow;
+
+    z3D_priv::D3D9HL_RenderState& state = z3D_priv::s_renderState;
+    if (!state.fResourcesReleased_){
+        if (releaseFunc != 0)
+            releaseFunc();
+        ::z3D_priv::D3D9HL_NotifyDeviceRelease(*device);
+        state.fResourcesReleased_ = true;
+    }
+
+    if (fRecreate){
+        // Ресурсы D3DPOOL_MANAGED при пересоздании устройства теряются и должны быть загружены приложением заново
+        LPDIRECT3DDEVICE9 oldDevice = *device;
+        (*device)->Release();
+        *device = 0;
+        z3DD3D9HL_ErrCodes err = D3D9HL_CreateDevice(device,
+                                                     presentParams,
+                                                     pVertexProcessingType,
+                                                     d3d,
+                                                     videoMode,
+                                                     multiSampleType,
+                                                     qualityLevel,
+                                                     fWindowed,
+                                                     fVSync,
+                                                     hWnd,
+                                                     iAdapter,
+                                                     deviceType,
+                                                     policy);
+        // Без устройства ждать Reset() нечему: ресурсы нового устройства создает приложение
+        state.fResourcesReleased_ = false;
+        if (err != Z3D_D3D9HL_NONE)
+            return err;
+        ::z3D_priv::D3D9HL_RetargetDeviceListeners(oldDevice, *device);
+        if (resetFunc != 0)
+            resetFunc();
+        ::z3D_priv::D3D9HL_NotifyDeviceReset(*device);
+        if (stats != 0){
+            stats->fRecreated_ = true;
+            stats->timeUs_ = static_cast<uint32_t>(::z3D_priv::D3D9HL_GetTimeUs() - startTime);
+        }
+        return Z3D_D3D9HL_NONE;
+    }
+
+    D3DPRESENT_PARAMETERS d3dpp;
+    ::z3D_priv::D3D9HL_FillPresentParams(&d3dpp, videoMode, multiSampleType, qualityLevel, fWindowed, fVSync, hWnd);
+    hr = (*device)->Reset(&d3dpp);
+    if (FAILED(hr)){
+        // Устройство потеряно: новые параметры будут применены при восстановлении в D3D9HL_BeginDeviceRender(),
+        // ресурсы там повторно не освобождаются
+        if (hr == D3DERR_DEVICELOST){
+            *presentParams = d3dpp;
+            return Z3D_D3D9HL_DEVICE_LOST;
+        }
+        // Режим не принят устройством - возвращаемся к прежним параметрам
+        Z3D_ERROR(Z3D_ERROR_PERMISSIBLE, FAILED(hr), "Reset with new video mode failed", false);
+        hr = (*device)->Reset(presentParams);
+        if (SUCCEEDED(hr)){
+            if (resetFunc != 0)
+                resetFunc();
+            ::z3D_priv::D3D9HL_NotifyDeviceReset(*device);
+            state.fResourcesReleased_ = false;
+        }
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    }
+    *presentParams = d3dpp;
+    if (resetFunc != 0)
+        resetFunc();
+    ::z3D_priv::D3D9HL_NotifyDeviceReset(*device);
+    state.fResourcesReleased_ = false;
+    if (pVertexProcessingType != 0)
+        *pVertexProcessingType = creationParams.BehaviorFlags & ::z3D_priv::s_vertexProcessingMask;
+    if (stats != 0)
+        stats->timeUs_ = static_cast<uint32_t>(::z3D_priv::D3D9HL_GetTimeUs() - startTime);
     return Z3D_D3D9HL_NONE;
 }
 
@@ -0,0 +1,377 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация регулятора динамического разрешения и мультисэмплинга.
+*/
+
+#include "z3DD3D9HL.h"
+#include "z3DDebugSystem.h"
+
+namespace z3D_priv
+{
+static const float s_defaultScales[] = { 0.5f, 0.625f, 0.75f, 0.875f, 1.0f };
+
+static const D3DMULTISAMPLE_TYPE s_ladderMultiSampleTypes[] = {
+    D3DMULTISAMPLE_NONE,
+    D3DMULTISAMPLE_2_SAMPLES,
+    D3DMULTISAMPLE_4_SAMPLES,
+    D3DMULTISAMPLE_8_SAMPLES
+};
+
+uint32_t D3D9HL_NumSamples(D3DMULTISAMPLE_TYPE multiSampleType){
+    return (multiSampleType >= D3DMULTISAMPLE_2_SAMPLES) ? static_cast<uint32_t>(multiSampleType) : 1;
+}
+
+/* Число уровней качества мультисэмплинга, общее для форматов заднего буфера и буфера глубины видеорежима.
+Проверка повторяет D3D9HL_FindVideoModes(). 0 - тип мультисэмплинга не поддерживается.
+*/
+DWORD D3D9HL_LadderQualityLevels(LPDIRECT3D9 d3d,
+                                 const z3DD3D9HL_VideoMode& videoMode,
+                                 D3DMULTISAMPLE_TYPE multiSampleType,
+                                 bool fWindowed,
+                                 uint32_t iAdapter,
+                                 D3DDEVTYPE deviceType){
+    DWORD qualityLevels = 0, dsQualityLevels = 0;
+    if (FAILED(d3d->CheckDeviceMultiSampleType(static_cast<UINT>(iAdapter), deviceType, videoMode.d3ddm_.Format,
+                                               fWindowed ? TRUE : FALSE, multiSampleType, &qualityLevels)))
+        return 0;
+    if (FAILED(d3d->CheckDeviceMultiSampleType(static_cast<UINT>(iAdapter), deviceType, videoMode.depthStencilFmt_,
+                                               fWindowed ? TRUE : FALSE, multiSampleType, &dsQualityLevels)))
+        return 0;
+    return (dsQualityLevels < qualityLevels) ? dsQualityLevels : qualityLevels;
+}
+
+void D3D9HL_DynResResetCounters(z3DD3D9HL_DynResController* dynRes){
+    dynRes->numFramesOver_ = 0;
+    dynRes->numFramesUnder_ = 0;
+    dynRes->settleCounter_ = dynRes->params_.settleFrames_;
+}
+
+void D3D9HL_ReleaseQuery(LPDIRECT3DQUERY9& query){
+    if (query != 0)
+        query->Release();
+    query = 0;
+}
+
+void D3D9HL_ReleaseGpuTimerQueries(z3DD3D9HL_GpuTimer* timer){
+    for (uint32_t i = 0; i < Z3D_D3D9HL_GPU_TIMER_FRAMES; ++i){
+        z3DD3D9HL_GpuTimerFrame& frame = timer->frames_[i];
+        D3D9HL_ReleaseQuery(frame.disjoint_);
+        D3D9HL_ReleaseQuery(frame.freq_);
+        D3D9HL_ReleaseQuery(frame.begin_);
+        D3D9HL_ReleaseQuery(frame.end_);
+    }
+    timer->iFirst_ = 0;
+    timer->numPending_ = 0;
+    timer->fBegun_ = false;
+    timer->fCreated_ = false;
+}
+
+/* Создать запросы всех кадров. Если хотя бы один запрос создать не удалось, измеритель остается без запросов.
+*/
+bool D3D9HL_CreateGpuTimerQueries(z3DD3D9HL_GpuTimer* timer, LPDIRECT3DDEVICE9 device){
+    bool fOk = true;
+    for (uint32_t i = 0; i < Z3D_D3D9HL_GPU_TIMER_FRAMES && fOk; ++i){
+        z3DD3D9HL_GpuTimerFrame& frame = timer->frames_[i];
+        fOk = SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMPDISJOINT, &frame.disjoint_)) &&
+              SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMPFREQ, &frame.freq_)) &&
+              SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &frame.begin_)) &&
+              SUCCEEDED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, &frame.end_));
+    }
+    if (!fOk){
+        D3D9HL_ReleaseGpuTimerQueries(timer);
+        return false;
+    }
+    timer->fCreated_ = true;
+    return true;
+}
+
+/* Прочитать результаты самых старых кадров без ожидания.
+*/
+void D3D9HL_PollGpuTimer(z3DD3D9HL_GpuTimer* timer){
+    while (timer->numPending_ > 0){
+        z3DD3D9HL_GpuTimerFrame& frame = timer->frames_[timer->iFirst_];
+        BOOL fDisjoint = TRUE;
+        uint64_t freq = 0, begin = 0, end = 0;
+        HRESULT hr = frame.disjoint_->GetData(&fDisjoint, sizeof(BOOL), 0);
+        if (hr == S_OK)
+            hr = frame.freq_->GetData(&freq, sizeof(uint64_t), 0);
+        if (hr == S_OK)
+            hr = frame.begin_->GetData(&begin, sizeof(uint64_t), 0);
+        if (hr == S_OK)
+            hr = frame.end_->GetData(&end, sizeof(uint64_t), 0);
+        if (hr == S_FALSE)
+            break;
+        // Ошибка (например, потеря устройства) - кадр пропускается
+        if (hr == S_OK && !fDisjoint && freq != 0 && end >= begin){
+            uint64_t timeUs = (end - begin) * 1000000 / freq;
+            timer->timeUs_ = (timeUs == 0) ? 1 : static_cast<uint32_t>(timeUs);
+            timer->numFrames_++;
+        }
+        timer->iFirst_ = (timer->iFirst_ + 1) % Z3D_D3D9HL_GPU_TIMER_FRAMES;
+        timer->numPending_--;
+    }
+}
+
+/* Слушатель событий устройства: запросы создаются заново после Reset(), конец кадра отмечается перед EndScene().
+*/
+void D3D9HL_GpuTimerOnRelease(LPDIRECT3DDEVICE9 /*device*/, void* userData){
+    D3D9HL_ReleaseGpuTimerQueries(static_cast<z3DD3D9HL_GpuTimer*>(userData));
+}
+
+void D3D9HL_GpuTimerOnReset(LPDIRECT3DDEVICE9 device, void* userData){
+    z3DD3D9HL_GpuTimer* timer = static_cast<z3DD3D9HL_GpuTimer*>(userData);
+    timer->device_ = device;
+    D3D9HL_CreateGpuTimerQueries(timer, device);
+}
+
+void D3D9HL_GpuTimerOnEndRender(LPDIRECT3DDEVICE9 /*device*/, void* userData){
+    z3DD3D9HL_GpuTimer* timer = static_cast<z3DD3D9HL_GpuTimer*>(userData);
+    if (timer->fBegun_){
+        z3DD3D9HL_GpuTimerFrame& frame = timer->frames_[(timer->iFirst_ + timer->numPending_) % Z3D_D3D9HL_GPU_TIMER_FRAMES];
+        frame.end_->Issue(D3DISSUE_END);
+        frame.disjoint_->Issue(D3DISSUE_END);
+        frame.freq_->Issue(D3DISSUE_END);
+        timer->numPending_++;
+        timer->fBegun_ = false;
+    }
+    D3D9HL_PollGpuTimer(timer);
+}
+
+z3DD3D9HL_DeviceListener D3D9HL_GpuTimerListener(z3DD3D9HL_GpuTimer* timer){
+    z3DD3D9HL_DeviceListener listener;
+    listener.onRelease_ = D3D9HL_GpuTimerOnRelease;
+    listener.onReset_ = D3D9HL_GpuTimerOnReset;
+    listener.onEndRender_ = D3D9HL_GpuTimerOnEndRender;
+    listener.userData_ = timer;
+    listener.device_ = timer->device_;
+    return listener;
+}
+} // end of z3D_priv
+
+namespace z3D
+{
+
+z3DD3D9HL_ErrCodes D3D9HL_DynResBuildLadder(z3DD3D9HL_QualityLevel* levels,
+                                            uint32_t* numLevels,
+                                            LPDIRECT3D9 d3d,
+                                            const z3DD3D9HL_VideoMode& videoMode,
+                                            const float* scales,
+                                            uint32_t numScales,
+                                            bool fWindowed,
+                                            uint32_t iAdapter,
+                                            D3DDEVTYPE deviceType){
+    Z3D_ASSERT_HIGH(levels != 0 && numLevels != 0, "null passed", true);
+    if (levels == 0 || numLevels == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(d3d != 0, "null pointer to main Direct3D object passed", true);
+    if (d3d == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (scales == 0){
+        scales = z3D_priv::s_defaultScales;
+        numScales = sizeof(z3D_priv::s_defaultScales) / sizeof(z3D_priv::s_defaultScales[0]);
+    }
+    Z3D_ASSERT_HIGH(numScales > 0, "no resolution scales passed", true);
+    if (numScales == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    // Все сочетания масштаба и поддерживаемого мультисэмплинга
+    z3DD3D9HL_QualityLevel candidates[Z3D_D3D9HL_MAX_QUALITY_LEVELS];
+    uint32_t numCandidates = 0;
+    const uint32_t numTypes = sizeof(z3D_priv::s_ladderMultiSampleTypes) / sizeof(z3D_priv::s_ladderMultiSampleTypes[0]);
+    for (uint32_t iType = 0; iType < numTypes; ++iType){
+        D3DMULTISAMPLE_TYPE multiSampleType = z3D_priv::s_ladderMultiSampleTypes[iType];
+        if (multiSampleType != D3DMULTISAMPLE_NONE &&
+            z3D_priv::D3D9HL_LadderQualityLevels(d3d, videoMode, multiSampleType, fWindowed, iAdapter, deviceType) == 0)
+            continue;
+        for (uint32_t iScale = 0; iScale < numScales && numCandidates < Z3D_D3D9HL_MAX_QUALITY_LEVELS; ++iScale){
+            Z3D_ASSERT_HIGH(scales[iScale] > 0.0f && scales[iScale] <= 1.0f, "resolution scale out of range", true);
+            z3DD3D9HL_QualityLevel& level = candidates[numCandidates++];
+            level.scale_ = scales[iScale];
+            level.multiSampleType_ = multiSampleType;
+            // Смысл старших уровней качества задает драйвер, и в стоимости их не учесть
+            level.multiSampleQuality_ = 0;
+            level.cost_ = level.scale_ * level.scale_ * static_cast<float>(z3D_priv::D3D9HL_NumSamples(multiSampleType));
+        }
+    }
+
+    // Цепочка от самого дешевого уровня: следующий - самый дешевый из уровней не ниже текущего
+    // ни по масштабу, ни по числу отсчетов; при равной стоимости предпочитается больший масштаб
+    uint32_t n = 0;
+    const z3DD3D9HL_QualityLevel* current = 0;
+    for (;;){
+        const z3DD3D9HL_QualityLevel* next = 0;
+        for (uint32_t i = 0; i < numCandidates; ++i){
+            const z3DD3D9HL_QualityLevel& level = candidates[i];
+            if (current != 0){
+                if (level.cost_ <= current->cost_ ||
+                    level.scale_ < current->scale_ ||
+                    z3D_priv::D3D9HL_NumSamples(level.multiSampleType_) < z3D_priv::D3D9HL_NumSamples(current->multiSampleType_))
+                    continue;
+            }
+            if (next == 0 ||
+                level.cost_ < next->cost_ ||
+                (level.cost_ == next->cost_ && level.scale_ > next->scale_))
+                next = &level;
+        }
+        if (next == 0)
+            break;
+        levels[n++] = *next;
+        current = next;
+    }
+    *numLevels = n;
+    return (n > 0) ? Z3D_D3D9HL_NONE : Z3D_D3D9HL_NOTFOUND;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_DynResInit(z3DD3D9HL_DynResController* dynRes,
+                                     const z3DD3D9HL_QualityLevel* levels,
+                                     uint32_t numLevels,
+                                     const z3DD3D9HL_DynResParams& params,
+                                     uint32_t iStartLevel){
+    Z3D_ASSERT_HIGH(dynRes != 0 && levels != 0, "null passed", true);
+    if (dynRes == 0 || levels == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(numLevels > 0 && numLevels <= Z3D_D3D9HL_MAX_QUALITY_LEVELS, "unacceptable number of quality levels", true);
+    if (numLevels == 0 || numLevels > Z3D_D3D9HL_MAX_QUALITY_LEVELS)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(params.targetFrameTimeUs_ > 0 && params.smoothing_ > 0.0f && params.smoothing_ <= 1.0f,
+                    "unacceptable dynamic resolution parameters", true);
+    if (params.targetFrameTimeUs_ == 0 || params.smoothing_ <= 0.0f || params.smoothing_ > 1.0f)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    for (uint32_t i = 0; i < numLevels; ++i)
+        dynRes->levels_[i] = levels[i];
+    dynRes->numLevels_ = numLevels;
+    dynRes->iLevel_ = (iStartLevel < numLevels) ? iStartLevel : numLevels - 1;
+    dynRes->params_ = params;
+    dynRes->avgFrameTimeUs_ = 0.0f;
+    dynRes->numChanges_ = 0;
+    z3D_priv::D3D9HL_DynResResetCounters(dynRes);
+    dynRes->settleCounter_ = 0;
+    return Z3D_D3D9HL_NONE;
+}
+
+bool D3D9HL_DynResUpdate(z3DD3D9HL_DynResController* dynRes, uint32_t frameTimeUs){
+    Z3D_ASSERT_HIGH(dynRes != 0 && dynRes->numLevels_ > 0, "dynamic resolution controller is not initialized", true);
+    if (frameTimeUs == 0)
+        return false;
+    const z3DD3D9HL_DynResParams& params = dynRes->params_;
+    if (dynRes->avgFrameTimeUs_ == 0.0f)
+        dynRes->avgFrameTimeUs_ = static_cast<float>(frameTimeUs);
+    else
+        dynRes->avgFrameTimeUs_ += (static_cast<float>(frameTimeUs) - dynRes->avgFrameTimeUs_) * params.smoothing_;
+
+    // После смены уровня среднее должно успеть отразить новую нагрузку
+    if (dynRes->settleCounter_ > 0){
+        dynRes->settleCounter_--;
+        return false;
+    }
+
+    float target = static_cast<float>(params.targetFrameTimeUs_);
+    const z3DD3D9HL_QualityLevel& level = dynRes->levels_[dynRes->iLevel_];
+    if (dynRes->avgFrameTimeUs_ > target * params.downThreshold_)
+        dynRes->numFramesOver_++;
+    else
+        dynRes->numFramesOver_ = 0;
+
+    // Повышение допускается, только если время кадра на следующем уровне, оцененное пропорционально
+    // стоимости, уложится в порог: иначе регулятор колебался бы между соседними уровнями
+    bool fUnder = false;
+    if (dynRes->iLevel_ + 1 < dynRes->numLevels_){
+        const z3DD3D9HL_QualityLevel& nextLevel = dynRes->levels_[dynRes->iLevel_ + 1];
+        float predicted = dynRes->avgFrameTimeUs_ * nextLevel.cost_ / level.cost_;
+        fUnder = predicted < target * params.upThreshold_;
+    }
+    if (fUnder)
+        dynRes->numFramesUnder_++;
+    else
+        dynRes->numFramesUnder_ = 0;
+
+    if (dynRes->numFramesOver_ >= params.downFrames_ && dynRes->iLevel_ > 0){
+        dynRes->iLevel_--;
+        // Ожидаемое время кадра на новом уровне, чтобы не дожидаться схождения среднего
+        dynRes->avgFrameTimeUs_ *= dynRes->levels_[dynRes->iLevel_].cost_ / level.cost_;
+        dynRes->numChanges_++;
+        z3D_priv::D3D9HL_DynResResetCounters(dynRes);
+        return true;
+    }
+    if (dynRes->numFramesUnder_ >= params.upFrames_){
+        dynRes->iLevel_++;
+        dynRes->avgFrameTimeUs_ *= dynRes->levels_[dynRes->iLevel_].cost_ / level.cost_;
+        dynRes->numChanges_++;
+        z3D_priv::D3D9HL_DynResResetCounters(dynRes);
+        return true;
+    }
+    return false;
+}
+
+const z3DD3D9HL_QualityLevel& D3D9HL_DynResGetLevel(const z3DD3D9HL_DynResController* dynRes){
+    Z3D_ASSERT_HIGH(dynRes != 0 && dynRes->numLevels_ > 0, "dynamic resolution controller is not initialized", true);
+    return dynRes->levels_[dynRes->iLevel_];
+}
+
+void D3D9HL_DynResGetRTDesc(z3DD3D9HL_RTDesc* desc,
+                            const z3DD3D9HL_DynResController* dynRes,
+                            const z3DD3D9HL_RTPool* pool,
+                            bool fDepth){
+    Z3D_ASSERT_HIGH(desc != 0 && dynRes != 0 && pool != 0, "null passed", true);
+    const z3DD3D9HL_QualityLevel& level = D3D9HL_DynResGetLevel(dynRes);
+    D3D9HL_RTPoolMakeDesc(desc, pool, fDepth);
+    // Размеры округляются до четных, чтобы поверхность можно было уменьшать вдвое
+    desc->width_ = (static_cast<uint32_t>(static_cast<float>(pool->width_) * level.scale_ + 1.0f)) & ~1u;
+    desc->height_ = (static_cast<uint32_t>(static_cast<float>(pool->height_) * level.scale_ + 1.0f)) & ~1u;
+    if (desc->width_ == 0)
+        desc->width_ = 2;
+    if (desc->height_ == 0)
+        desc->height_ = 2;
+    desc->multiSampleType_ = level.multiSampleType_;
+    desc->multiSampleQuality_ = level.multiSampleQuality_;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_GpuTimerInit(z3DD3D9HL_GpuTimer* timer, LPDIRECT3DDEVICE9 device){
+    Z3D_ASSERT_HIGH(timer != 0, "null passed", true);
+    if (timer == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(device != 0, "null device passed", true);
+    if (device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    ZeroMemory(timer, sizeof(z3DD3D9HL_GpuTimer));
+
+    // Нулевой указатель в CreateQuery() - проверка поддержки типа запросов
+    if (FAILED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMP, 0)) ||
+        FAILED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMPDISJOINT, 0)) ||
+        FAILED(device->CreateQuery(D3DQUERYTYPE_TIMESTAMPFREQ, 0)))
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    if (!z3D_priv::D3D9HL_CreateGpuTimerQueries(timer, device))
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    timer->device_ = device;
+    z3DD3D9HL_ErrCodes err = D3D9HL_AddDeviceListener(z3D_priv::D3D9HL_GpuTimerListener(timer));
+    if (err != Z3D_D3D9HL_NONE){
+        z3D_priv::D3D9HL_ReleaseGpuTimerQueries(timer);
+        timer->device_ = 0;
+        return err;
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_GpuTimerShutdown(z3DD3D9HL_GpuTimer* timer){
+    Z3D_ASSERT_HIGH(timer != 0, "null passed", true);
+    if (timer == 0 || timer->device_ == 0)
+        return;
+    D3D9HL_RemoveDeviceListener(z3D_priv::D3D9HL_GpuTimerListener(timer));
+    z3D_priv::D3D9HL_ReleaseGpuTimerQueries(timer);
+    timer->device_ = 0;
+}
+
+void D3D9HL_GpuTimerBeginFrame(z3DD3D9HL_GpuTimer* timer){
+    Z3D_ASSERT_HIGH(timer != 0, "null passed", true);
+    // Без запросов (устройство потеряно) и при занятых запросах всех кадров кадр не измеряется
+    if (timer == 0 || !timer->fCreated_ || timer->fBegun_ || timer->numPending_ == Z3D_D3D9HL_GPU_TIMER_FRAMES)
+        return;
+    z3DD3D9HL_GpuTimerFrame& frame = timer->frames_[(timer->iFirst_ + timer->numPending_) % Z3D_D3D9HL_GPU_TIMER_FRAMES];
+    frame.disjoint_->Issue(D3DISSUE_BEGIN);
+    frame.begin_->Issue(D3DISSUE_END);
+    timer->fBegun_ = true;
+}
+
+} // end of z3D
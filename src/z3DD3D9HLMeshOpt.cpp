@@ -0,0 +1,890 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация оптимизации индексных буферов.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "z3DD3D9HL.h"
+#include "z3DDebugSystem.h"
+#include "z3DD3D9HLPrivPlatform.h"
+
+namespace z3D_priv
+{
+void* D3D9HL_ScratchAlloc(z3DD3D9HL_Arena* arena, size_t size);
+void D3D9HL_ScratchFree(z3DD3D9HL_Arena* arena, void* mem, size_t marker);
+
+// Параметры функции оценки вершин (Т. Форсайт, "Linear-Speed Vertex Cache Optimisation")
+static const float s_cacheDecayPower = 1.5f;
+static const float s_lastTriScore = 0.75f;
+static const float s_valenceBoostScale = 2.0f;
+static const float s_valenceBoostPower = 0.5f;
+static const uint32_t s_valenceTableSize = 32;
+
+// Таблицы оценок вершин по позиции в кэше и числу неиспользованных треугольников
+struct D3D9HL_VCacheScoreTable{
+    float cacheScore_[Z3D_D3D9HL_MAX_VCACHE_SIZE];
+    float valenceScore_[s_valenceTableSize];
+
+    explicit D3D9HL_VCacheScoreTable(uint32_t cacheSize){
+        for (uint32_t iPos = 0; iPos < cacheSize; ++iPos){
+            // Вершины последнего треугольника получают фиксированную оценку, чтобы не рисовать его соседей подряд
+            if (iPos < 3)
+                cacheScore_[iPos] = s_lastTriScore;
+            else
+                cacheScore_[iPos] = powf(1.0f - static_cast<float>(iPos - 3) / static_cast<float>(cacheSize - 3),
+                                         s_cacheDecayPower);
+        }
+        valenceScore_[0] = 0.0f;
+        for (uint32_t iValence = 1; iValence < s_valenceTableSize; ++iValence)
+            valenceScore_[iValence] = s_valenceBoostScale * powf(static_cast<float>(iValence), -s_valenceBoostPower);
+    }
+
+    float VertexScore(int32_t cachePos, uint32_t numActiveTris) const{
+        if (numActiveTris == 0)
+            return -1.0f;
+        float score = cachePos >= 0 ? cacheScore_[cachePos] : 0.0f;
+        if (numActiveTris < s_valenceTableSize)
+            score += valenceScore_[numActiveTris];
+        else
+            score += s_valenceBoostScale * powf(static_cast<float>(numActiveTris), -s_valenceBoostPower);
+        return score;
+    }
+};
+
+// Рабочая память оптимизации одного диапазона треугольников
+struct D3D9HL_VCacheWorkspace{
+    float* vertexScore_;            // numVertices
+    uint32_t* numActiveTris_;       // numVertices
+    uint32_t* adjOffset_;           // numVertices
+    int32_t* cachePos_;             // numVertices
+    uint32_t* triAdj_;              // maxFaces * 3
+    float* triScore_;               // maxFaces
+    uint8_t* triEmitted_;           // maxFaces
+};
+
+size_t D3D9HL_VCacheWorkspaceSize(uint32_t numVertices, uint32_t maxFaces){
+    return static_cast<size_t>(numVertices) * (sizeof(float) + sizeof(uint32_t) * 2 + sizeof(int32_t)) +
+           static_cast<size_t>(maxFaces) * (sizeof(uint32_t) * 3 + sizeof(float) + sizeof(uint8_t));
+}
+
+void D3D9HL_VCacheWorkspaceInit(D3D9HL_VCacheWorkspace* ws, void* mem, uint32_t numVertices, uint32_t maxFaces){
+    uint8_t* cur = static_cast<uint8_t*>(mem);
+    ws->vertexScore_ = reinterpret_cast<float*>(cur);           cur += sizeof(float) * numVertices;
+    ws->numActiveTris_ = reinterpret_cast<uint32_t*>(cur);      cur += sizeof(uint32_t) * numVertices;
+    ws->adjOffset_ = reinterpret_cast<uint32_t*>(cur);          cur += sizeof(uint32_t) * numVertices;
+    ws->cachePos_ = reinterpret_cast<int32_t*>(cur);            cur += sizeof(int32_t) * numVertices;
+    ws->triAdj_ = reinterpret_cast<uint32_t*>(cur);             cur += sizeof(uint32_t) * 3 * maxFaces;
+    ws->triScore_ = reinterpret_cast<float*>(cur);              cur += sizeof(float) * maxFaces;
+    ws->triEmitted_ = cur;
+}
+
+/* Переупорядочить диапазон треугольников для кэша вершин.
+    @param [out] faceRemap faceCount элементов, заполняются глобальными номерами треугольников.
+*/
+template <typename I>
+void D3D9HL_ForsythOptimize(uint32_t* faceRemap,
+                            const I* indices,
+                            uint32_t faceStart,
+                            uint32_t faceCount,
+                            uint32_t cacheSize,
+                            const D3D9HL_VCacheWorkspace& ws){
+    const I* tris = indices + static_cast<size_t>(faceStart) * 3;
+    const uint32_t numCorners = faceCount * 3;
+    const D3D9HL_VCacheScoreTable scoreTable(cacheSize);
+
+    // Данные вершин инициализируются только для вершин, на которые ссылается диапазон
+    for (uint32_t iCorner = 0; iCorner < numCorners; ++iCorner){
+        uint32_t v = static_cast<uint32_t>(tris[iCorner]);
+        ws.numActiveTris_[v] = 0;
+        ws.adjOffset_[v] = Z3D_D3D9HL_NOINDEX;
+        ws.cachePos_[v] = -1;
+    }
+    for (uint32_t iCorner = 0; iCorner < numCorners; ++iCorner)
+        ws.numActiveTris_[tris[iCorner]]++;
+
+    // Списки смежных треугольников для каждой вершины
+    uint32_t adjSize = 0;
+    for (uint32_t iCorner = 0; iCorner < numCorners; ++iCorner){
+        uint32_t v = static_cast<uint32_t>(tris[iCorner]);
+        if (ws.adjOffset_[v] == Z3D_D3D9HL_NOINDEX){
+            ws.adjOffset_[v] = adjSize;
+            adjSize += ws.numActiveTris_[v];
+            ws.numActiveTris_[v] = 0;
+        }
+    }
+    for (uint32_t iCorner = 0; iCorner < numCorners; ++iCorner){
+        uint32_t v = static_cast<uint32_t>(tris[iCorner]);
+        ws.triAdj_[ws.adjOffset_[v] + ws.numActiveTris_[v]++] = iCorner / 3;
+    }
+    for (uint32_t iCorner = 0; iCorner < numCorners; ++iCorner){
+        uint32_t v = static_cast<uint32_t>(tris[iCorner]);
+        ws.vertexScore_[v] = scoreTable.VertexScore(-1, ws.numActiveTris_[v]);
+    }
+
+    uint32_t bestTri = Z3D_D3D9HL_NOINDEX;
+    float bestScore = -1.0f;
+    for (uint32_t iTri = 0; iTri < faceCount; ++iTri){
+        const I* tri = tris + iTri * 3;
+        ws.triScore_[iTri] = ws.vertexScore_[tri[0]] + ws.vertexScore_[tri[1]] + ws.vertexScore_[tri[2]];
+        ws.triEmitted_[iTri] = 0;
+        if (ws.triScore_[iTri] > bestScore){
+            bestScore = ws.triScore_[iTri];
+            bestTri = iTri;
+        }
+    }
+
+    uint32_t cache[Z3D_D3D9HL_MAX_VCACHE_SIZE + 3];
+    uint32_t newCache[Z3D_D3D9HL_MAX_VCACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+    uint32_t scanPos = 0;
+    for (uint32_t iOut = 0; iOut < faceCount; ++iOut){
+        // Среди треугольников вершин кэша ничего не осталось - берем первый не выведенный
+        if (bestTri == Z3D_D3D9HL_NOINDEX){
+            while (ws.triEmitted_[scanPos])
+                ++scanPos;
+            bestTri = scanPos;
+        }
+        faceRemap[iOut] = faceStart + bestTri;
+        ws.triEmitted_[bestTri] = 1;
+
+        const I* tri = tris + bestTri * 3;
+        uint32_t newCount = 0;
+        for (uint32_t k = 0; k < 3; ++k){
+            uint32_t v = static_cast<uint32_t>(tri[k]);
+            // Убираем треугольник из списка смежных треугольников вершины
+            uint32_t* adj = ws.triAdj_ + ws.adjOffset_[v];
+            uint32_t numActive = ws.numActiveTris_[v];
+            for (uint32_t j = 0; j < numActive; ++j){
+                if (adj[j] == bestTri){
+                    adj[j] = adj[numActive - 1];
+                    break;
+                }
+            }
+            ws.numActiveTris_[v] = numActive - 1;
+
+            bool fPresent = false;
+            for (uint32_t j = 0; j < newCount; ++j)
+                fPresent = fPresent || newCache[j] == v;
+            if (!fPresent)
+                newCache[newCount++] = v;
+        }
+        // Вершины выведенного треугольника становятся в начало кэша, остальные сдвигаются
+        for (uint32_t j = 0; j < cacheCount; ++j){
+            uint32_t v = cache[j];
+            if (v != static_cast<uint32_t>(tri[0]) && v != static_cast<uint32_t>(tri[1]) && v != static_cast<uint32_t>(tri[2]))
+                newCache[newCount++] = v;
+        }
+        for (uint32_t j = 0; j < newCount; ++j){
+            uint32_t v = newCache[j];
+            ws.cachePos_[v] = j < cacheSize ? static_cast<int32_t>(j) : -1;
+            ws.vertexScore_[v] = scoreTable.VertexScore(ws.cachePos_[v], ws.numActiveTris_[v]);
+        }
+        cacheCount = newCount < cacheSize ? newCount : cacheSize;
+        memcpy(cache, newCache, sizeof(uint32_t) * cacheCount);
+
+        // Пересчитываем оценки треугольников, смежных с вершинами кэша (включая вытесненные), и выбираем лучший
+        bestTri = Z3D_D3D9HL_NOINDEX;
+        bestScore = -1.0f;
+        for (uint32_t j = 0; j < newCount; ++j){
+            uint32_t v = newCache[j];
+            const uint32_t* adj = ws.triAdj_ + ws.adjOffset_[v];
+            for (uint32_t a = 0; a < ws.numActiveTris_[v]; ++a){
+                uint32_t iTri = adj[a];
+                const I* adjTri = tris + iTri * 3;
+                float score = ws.vertexScore_[adjTri[0]] + ws.vertexScore_[adjTri[1]] + ws.vertexScore_[adjTri[2]];
+                ws.triScore_[iTri] = score;
+                if (score > bestScore){
+                    bestScore = score;
+                    bestTri = iTri;
+                }
+            }
+        }
+    }
+}
+
+/* Смоделировать кэш вершин FIFO для треугольника.
+    @param cacheTime время попадания вершин в кэш, Z3D_D3D9HL_NOINDEX - вершина еще не встречалась.
+    @param [in,out] timestamp число промахов с начала моделирования.
+    @param [in,out] numUsed число различных встреченных вершин.
+    @return число промахов кэша для треугольника.
+*/
+template <typename I>
+uint32_t D3D9HL_FifoCacheFace(const I* tri, uint32_t* cacheTime, uint32_t cacheSize, uint32_t* timestamp, uint32_t* numUsed){
+    uint32_t numMisses = 0;
+    for (uint32_t k = 0; k < 3; ++k){
+        uint32_t v = static_cast<uint32_t>(tri[k]);
+        if (cacheTime[v] == Z3D_D3D9HL_NOINDEX)
+            (*numUsed)++;
+        if (cacheTime[v] == Z3D_D3D9HL_NOINDEX || *timestamp - cacheTime[v] > cacheSize){
+            cacheTime[v] = (*timestamp)++;
+            numMisses++;
+        }
+    }
+    return numMisses;
+}
+
+template <typename I>
+void D3D9HL_ComputeVertexCacheStatsImpl(z3DD3D9HL_VertexCacheStats* stats,
+                                        const I* indices,
+                                        uint32_t numFaces,
+                                        uint32_t numVertices,
+                                        uint32_t cacheSize,
+                                        uint32_t* cacheTime){
+    memset(cacheTime, 0xFF, sizeof(uint32_t) * numVertices);
+    uint32_t timestamp = 0, numUsed = 0, numMisses = 0;
+    for (uint32_t iFace = 0; iFace < numFaces; ++iFace)
+        numMisses += D3D9HL_FifoCacheFace(indices + static_cast<size_t>(iFace) * 3, cacheTime, cacheSize, &timestamp, &numUsed);
+    stats->numTransformed_ = numMisses;
+    stats->numUsedVertices_ = numUsed;
+    stats->acmr_ = numFaces > 0 ? static_cast<float>(numMisses) / static_cast<float>(numFaces) : 0.0f;
+    stats->atvr_ = numUsed > 0 ? static_cast<float>(numMisses) / static_cast<float>(numUsed) : 0.0f;
+}
+
+// Группа треугольников при упорядочивании для уменьшения перерисовки
+struct D3D9HL_FaceCluster{
+    uint32_t start_;
+    uint32_t count_;
+    float sortKey_;
+};
+
+// Группы, обращенные наружу, рисуются первыми; при равенстве сохраняется исходный порядок
+struct D3D9HL_FaceClusterPred{
+    bool operator() (const D3D9HL_FaceCluster& c1, const D3D9HL_FaceCluster& c2) const{
+        if (c1.sortKey_ != c2.sortKey_)
+            return c1.sortKey_ > c2.sortKey_;
+        return c1.start_ < c2.start_;
+    }
+};
+
+inline const float* D3D9HL_Position(const float* positions, uint32_t positionStride, uint32_t v){
+    return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + static_cast<size_t>(v) * positionStride);
+}
+
+template <typename I>
+void D3D9HL_OptimizeOverdrawImpl(uint32_t* faceRemap,
+                                 const I* indices,
+                                 uint32_t numFaces,
+                                 const float* positions,
+                                 uint32_t positionStride,
+                                 uint32_t numVertices,
+                                 uint32_t cacheSize,
+                                 float threshold,
+                                 uint32_t* cacheTime,
+                                 D3D9HL_FaceCluster* clusters,
+                                 uint32_t* newRemap){
+    // ACMR сетки в текущем порядке
+    memset(cacheTime, 0xFF, sizeof(uint32_t) * numVertices);
+    uint32_t timestamp = 0, numUsed = 0, numMisses = 0;
+    for (uint32_t iFace = 0; iFace < numFaces; ++iFace)
+        numMisses += D3D9HL_FifoCacheFace(indices + static_cast<size_t>(faceRemap[iFace]) * 3, cacheTime, cacheSize, &timestamp, &numUsed);
+    float acmrLimit = threshold * static_cast<float>(numMisses) / static_cast<float>(numFaces);
+
+    // Разбиение на группы. Промахи группы считаются с пустого кэша (второй массив cacheTime): группа
+    // заканчивается, только когда ее ACMR с учетом заполнения кэша не превышает acmrLimit, поэтому
+    // после перестановки групп ACMR растет не более чем в threshold раз.
+    uint32_t* clusterCacheTime = cacheTime + numVertices;
+    memset(cacheTime, 0xFF, sizeof(uint32_t) * numVertices * 2);
+    timestamp = 0;
+    numUsed = 0;
+    uint32_t clusterTimestamp = 0, clusterUsed = 0;
+    uint32_t numClusters = 0;
+    uint32_t clusterMisses = 0;
+    clusters[0].start_ = 0;
+    clusters[0].count_ = 0;
+    for (uint32_t iFace = 0; iFace < numFaces; ++iFace){
+        const I* tri = indices + static_cast<size_t>(faceRemap[iFace]) * 3;
+        uint32_t faceMisses = D3D9HL_FifoCacheFace(tri, cacheTime, cacheSize, &timestamp, &numUsed);
+        D3D9HL_FaceCluster* cluster = &clusters[numClusters];
+        // Все три вершины не в кэше - кэш заполняется заново, здесь начинается новая группа
+        if (faceMisses == 3 && cluster->count_ > 0){
+            cluster = &clusters[++numClusters];
+            cluster->start_ = iFace;
+            cluster->count_ = 0;
+            clusterMisses = 0;
+        }
+        // Новая группа начинается с пустого кэша: все прежние вершины вытеснены
+        if (cluster->count_ == 0)
+            clusterTimestamp += cacheSize + 1;
+        cluster->count_++;
+        clusterMisses += D3D9HL_FifoCacheFace(tri, clusterCacheTime, cacheSize, &clusterTimestamp, &clusterUsed);
+        if (static_cast<float>(clusterMisses) <= acmrLimit * static_cast<float>(cluster->count_) && iFace + 1 < numFaces){
+            cluster = &clusters[++numClusters];
+            cluster->start_ = iFace + 1;
+            cluster->count_ = 0;
+            clusterMisses = 0;
+        }
+    }
+    if (clusters[numClusters].count_ > 0)
+        numClusters++;
+
+    // Центр сетки (поднабора)
+    float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t iFace = 0; iFace < numFaces; ++iFace){
+        const I* tri = indices + static_cast<size_t>(faceRemap[iFace]) * 3;
+        for (uint32_t k = 0; k < 3; ++k){
+            const float* p = D3D9HL_Position(positions, positionStride, static_cast<uint32_t>(tri[k]));
+            meshCenter[0] += p[0];
+            meshCenter[1] += p[1];
+            meshCenter[2] += p[2];
+        }
+    }
+    for (uint32_t c = 0; c < 3; ++c)
+        meshCenter[c] /= static_cast<float>(numFaces * 3);
+
+    // Ключ группы - проекция смещения ее центра от центра сетки на ее суммарную нормаль
+    for (uint32_t iCluster = 0; iCluster < numClusters; ++iCluster){
+        D3D9HL_FaceCluster& cluster = clusters[iCluster];
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        for (uint32_t iFace = cluster.start_; iFace < cluster.start_ + cluster.count_; ++iFace){
+            const I* tri = indices + static_cast<size_t>(faceRemap[iFace]) * 3;
+            const float* p0 = D3D9HL_Position(positions, positionStride, static_cast<uint32_t>(tri[0]));
+            const float* p1 = D3D9HL_Position(positions, positionStride, static_cast<uint32_t>(tri[1]));
+            const float* p2 = D3D9HL_Position(positions, positionStride, static_cast<uint32_t>(tri[2]));
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            normal[0] += e1[1] * e2[2] - e1[2] * e2[1];
+            normal[1] += e1[2] * e2[0] - e1[0] * e2[2];
+            normal[2] += e1[0] * e2[1] - e1[1] * e2[0];
+            for (uint32_t c = 0; c < 3; ++c)
+                center[c] += p0[c] + p1[c] + p2[c];
+        }
+        float sortKey = 0.0f;
+        for (uint32_t c = 0; c < 3; ++c)
+            sortKey += (center[c] / static_cast<float>(cluster.count_ * 3) - meshCenter[c]) * normal[c];
+        cluster.sortKey_ = sortKey;
+    }
+    std::sort(clusters, clusters + numClusters, D3D9HL_FaceClusterPred());
+
+    uint32_t iOut = 0;
+    for (uint32_t iCluster = 0; iCluster < numClusters; ++iCluster){
+        for (uint32_t iFace = clusters[iCluster].start_; iFace < clusters[iCluster].start_ + clusters[iCluster].count_; ++iFace)
+            newRemap[iOut++] = faceRemap[iFace];
+    }
+    memcpy(faceRemap, newRemap, sizeof(uint32_t) * numFaces);
+}
+
+template <typename I>
+void D3D9HL_OptimizeVerticesImpl(uint32_t* vertexRemap,
+                                 const I* indices,
+                                 uint32_t numFaces,
+                                 uint32_t numVertices,
+                                 uint32_t* oldToNew){
+    memset(oldToNew, 0xFF, sizeof(uint32_t) * numVertices);
+    uint32_t numNew = 0;
+    for (size_t iCorner = 0; iCorner < static_cast<size_t>(numFaces) * 3; ++iCorner){
+        uint32_t v = static_cast<uint32_t>(indices[iCorner]);
+        if (oldToNew[v] == Z3D_D3D9HL_NOINDEX){
+            oldToNew[v] = numNew;
+            vertexRemap[numNew++] = v;
+        }
+    }
+    for (uint32_t v = 0; v < numVertices; ++v){
+        if (oldToNew[v] == Z3D_D3D9HL_NOINDEX)
+            vertexRemap[numNew++] = v;
+    }
+}
+
+template <typename I>
+bool D3D9HL_IndicesInRange(const I* indices, uint32_t numFaces, uint32_t numVertices){
+    for (size_t iCorner = 0; iCorner < static_cast<size_t>(numFaces) * 3; ++iCorner){
+        if (static_cast<uint32_t>(indices[iCorner]) >= numVertices)
+            return false;
+    }
+    return true;
+}
+
+bool D3D9HL_IndicesInRange(const void* indices, uint32_t numFaces, uint32_t numVertices, bool f32BitIndices){
+    if (f32BitIndices)
+        return D3D9HL_IndicesInRange(static_cast<const uint32_t*>(indices), numFaces, numVertices);
+    return D3D9HL_IndicesInRange(static_cast<const uint16_t*>(indices), numFaces, numVertices);
+}
+
+struct D3D9HL_SubsetStartLess{
+    bool operator()(const z3DD3D9HL_MeshSubset& a, const z3DD3D9HL_MeshSubset& b) const{
+        return a.faceStart_ < b.faceStart_;
+    }
+};
+
+/* Проверить, что поднаборы лежат в пределах сетки и не пересекаются.
+    @param [out] maxSubsetFaces число треугольников в наибольшем поднаборе.
+    @return Z3D_D3D9HL_INVALIDCALL, если поднабор выходит за сетку или пересекается с другим.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_CheckSubsets(uint32_t* maxSubsetFaces,
+                                       const z3DD3D9HL_MeshSubset* subsets,
+                                       uint32_t numSubsets,
+                                       uint32_t numFaces,
+                                       z3DD3D9HL_Arena* scratch){
+    *maxSubsetFaces = 0;
+    for (uint32_t iSubset = 0; iSubset < numSubsets; ++iSubset){
+        const z3DD3D9HL_MeshSubset& subset = subsets[iSubset];
+        if (subset.faceStart_ > numFaces || numFaces - subset.faceStart_ < subset.faceCount_)
+            return Z3D_D3D9HL_INVALIDCALL;
+        if (*maxSubsetFaces < subset.faceCount_)
+            *maxSubsetFaces = subset.faceCount_;
+    }
+    if (numSubsets < 2)
+        return Z3D_D3D9HL_NONE;
+
+    size_t marker = scratch != 0 ? z3D::D3D9HL_ArenaGetMarker(scratch) : 0;
+    z3DD3D9HL_MeshSubset* sorted = static_cast<z3DD3D9HL_MeshSubset*>(D3D9HL_ScratchAlloc(scratch, sizeof(z3DD3D9HL_MeshSubset) * numSubsets));
+    if (sorted == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    memcpy(sorted, subsets, sizeof(z3DD3D9HL_MeshSubset) * numSubsets);
+    std::sort(sorted, sorted + numSubsets, D3D9HL_SubsetStartLess());
+    z3DD3D9HL_ErrCodes err = Z3D_D3D9HL_NONE;
+    uint32_t prevEnd = 0;
+    for (uint32_t iSubset = 0; iSubset < numSubsets; ++iSubset){
+        // Пустой поднабор не занимает треугольников и ни с чем не пересекается
+        if (sorted[iSubset].faceCount_ == 0)
+            continue;
+        if (sorted[iSubset].faceStart_ < prevEnd){
+            err = Z3D_D3D9HL_INVALIDCALL;
+            break;
+        }
+        prevEnd = sorted[iSubset].faceStart_ + sorted[iSubset].faceCount_;
+    }
+    D3D9HL_ScratchFree(scratch, sorted, marker);
+    return err;
+}
+
+/* Проверить, что перестановка в пределах каждого поднабора ссылается только на треугольники этого
+поднабора и ни на один не ссылается дважды. Поднаборы должны быть проверены D3D9HL_CheckSubsets().
+*/
+z3DD3D9HL_ErrCodes D3D9HL_CheckFaceRemap(const uint32_t* faceRemap,
+                                         uint32_t numFaces,
+                                         const z3DD3D9HL_MeshSubset* subsets,
+                                         uint32_t numSubsets,
+                                         z3DD3D9HL_Arena* scratch){
+    if (numFaces == 0)
+        return Z3D_D3D9HL_NONE;
+    size_t numWords = (static_cast<size_t>(numFaces) + 31) / 32;
+    size_t marker = scratch != 0 ? z3D::D3D9HL_ArenaGetMarker(scratch) : 0;
+    uint32_t* seen = static_cast<uint32_t*>(D3D9HL_ScratchAlloc(scratch, sizeof(uint32_t) * numWords));
+    if (seen == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    memset(seen, 0, sizeof(uint32_t) * numWords);
+    z3DD3D9HL_ErrCodes err = Z3D_D3D9HL_NONE;
+    for (uint32_t iSubset = 0; iSubset < numSubsets && err == Z3D_D3D9HL_NONE; ++iSubset){
+        uint32_t faceStart = subsets[iSubset].faceStart_;
+        uint32_t faceCount = subsets[iSubset].faceCount_;
+        for (uint32_t iFace = faceStart; iFace < faceStart + faceCount; ++iFace){
+            uint32_t face = faceRemap[iFace];
+            if (face < faceStart || face - faceStart >= faceCount || (seen[face / 32] & (1u << (face % 32))) != 0){
+                err = Z3D_D3D9HL_INVALIDCALL;
+                break;
+            }
+            seen[face / 32] |= 1u << (face % 32);
+        }
+    }
+    D3D9HL_ScratchFree(scratch, seen, marker);
+    return err;
+}
+
+/* Выделить временную память для D3D9HL_OptimizeOverdrawImpl() на диапазон из не более чем maxFaces треугольников.
+    cacheTime получает два массива по numVertices элементов.
+*/
+uint8_t* D3D9HL_OverdrawScratchAlloc(z3DD3D9HL_Arena* scratch,
+                                     uint32_t numVertices,
+                                     uint32_t maxFaces,
+                                     uint32_t** cacheTime,
+                                     D3D9HL_FaceCluster** clusters,
+                                     uint32_t** newRemap){
+    size_t cacheTimeSize = (sizeof(uint32_t) * numVertices * 2 + Z3D_D3D9HL_DEFAULT_ALIGN - 1) &
+                           ~static_cast<size_t>(Z3D_D3D9HL_DEFAULT_ALIGN - 1);
+    size_t clustersSize = sizeof(D3D9HL_FaceCluster) * maxFaces;
+    uint8_t* mem = static_cast<uint8_t*>(D3D9HL_ScratchAlloc(scratch, cacheTimeSize + clustersSize + sizeof(uint32_t) * maxFaces));
+    if (mem == 0)
+        return 0;
+    *cacheTime = reinterpret_cast<uint32_t*>(mem);
+    *clusters = reinterpret_cast<D3D9HL_FaceCluster*>(mem + cacheTimeSize);
+    *newRemap = reinterpret_cast<uint32_t*>(mem + cacheTimeSize + clustersSize);
+    return mem;
+}
+
+void D3D9HL_OptimizeOverdrawRange(uint32_t* faceRemap,
+                                  const void* indices,
+                                  uint32_t numFaces,
+                                  const float* positions,
+                                  uint32_t positionStride,
+                                  uint32_t numVertices,
+                                  bool f32BitIndices,
+                                  uint32_t cacheSize,
+                                  float threshold,
+                                  uint32_t* cacheTime,
+                                  D3D9HL_FaceCluster* clusters,
+                                  uint32_t* newRemap){
+    if (numFaces == 0)
+        return;
+    if (f32BitIndices)
+        D3D9HL_OptimizeOverdrawImpl(faceRemap, static_cast<const uint32_t*>(indices), numFaces, positions,
+                                    positionStride, numVertices, cacheSize, threshold, cacheTime, clusters, newRemap);
+    else
+        D3D9HL_OptimizeOverdrawImpl(faceRemap, static_cast<const uint16_t*>(indices), numFaces, positions,
+                                    positionStride, numVertices, cacheSize, threshold, cacheTime, clusters, newRemap);
+}
+
+// Общие данные потоков, оптимизирующих поднаборы сетки
+struct D3D9HL_SubsetJob{
+    uint32_t* faceRemap_;
+    const void* indices_;
+    bool f32BitIndices_;
+    const z3DD3D9HL_MeshSubset* subsets_;
+    uint32_t numSubsets_;
+    uint32_t cacheSize_;
+    volatile int32_t nextSubset_;
+};
+
+struct D3D9HL_SubsetWorker{
+    D3D9HL_SubsetJob* job_;
+    D3D9HL_VCacheWorkspace ws_;
+};
+
+/* Поток оптимизации поднаборов. Поднаборы разбираются потоками по одному, результат не зависит от распределения.
+*/
+void D3D9HL_SubsetWorkerProc(void* param){
+    D3D9HL_SubsetWorker* worker = static_cast<D3D9HL_SubsetWorker*>(param);
+    D3D9HL_SubsetJob* job = worker->job_;
+    for (;;){
+        int32_t iSubset = D3D9HL_AtomicAdd(&job->nextSubset_, 1) - 1;
+        if (iSubset >= static_cast<int32_t>(job->numSubsets_))
+            break;
+        const z3DD3D9HL_MeshSubset& subset = job->subsets_[iSubset];
+        if (subset.faceCount_ == 0)
+            continue;
+        if (job->f32BitIndices_)
+            D3D9HL_ForsythOptimize(job->faceRemap_ + subset.faceStart_,
+                                   static_cast<const uint32_t*>(job->indices_),
+                                   subset.faceStart_,
+                                   subset.faceCount_,
+                                   job->cacheSize_,
+                                   worker->ws_);
+        else
+            D3D9HL_ForsythOptimize(job->faceRemap_ + subset.faceStart_,
+                                   static_cast<const uint16_t*>(job->indices_),
+                                   subset.faceStart_,
+                                   subset.faceCount_,
+                                   job->cacheSize_,
+                                   worker->ws_);
+    }
+}
+} // end of z3D_priv
+
+namespace z3D
+{
+
+z3DD3D9HL_ErrCodes D3D9HL_ComputeVertexCacheStats(z3DD3D9HL_VertexCacheStats* stats,
+                                                  const void* indices,
+                                                  uint32_t numFaces,
+                                                  uint32_t numVertices,
+                                                  bool f32BitIndices,
+                                                  uint32_t cacheSize,
+                                                  z3DD3D9HL_Arena* scratch){
+    Z3D_ASSERT_HIGH(stats != 0 && indices != 0, "null passed", true);
+    if (stats == 0 || indices == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (cacheSize == 0 || !z3D_priv::D3D9HL_IndicesInRange(indices, numFaces, numVertices, f32BitIndices))
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    size_t marker = scratch != 0 ? D3D9HL_ArenaGetMarker(scratch) : 0;
+    uint32_t* cacheTime = static_cast<uint32_t*>(z3D_priv::D3D9HL_ScratchAlloc(scratch, sizeof(uint32_t) * numVertices));
+    if (cacheTime == 0 && numVertices > 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    if (f32BitIndices)
+        z3D_priv::D3D9HL_ComputeVertexCacheStatsImpl(stats, static_cast<const uint32_t*>(indices), numFaces, numVertices, cacheSize, cacheTime);
+    else
+        z3D_priv::D3D9HL_ComputeVertexCacheStatsImpl(stats, static_cast<const uint16_t*>(indices), numFaces, numVertices, cacheSize, cacheTime);
+    z3D_priv::D3D9HL_ScratchFree(scratch, cacheTime, marker);
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeFaces(uint32_t* faceRemap,
+                                        const void* indices,
+                                        uint32_t numFaces,
+                                        uint32_t numVertices,
+                                        bool f32BitIndices,
+                                        uint32_t cacheSize,
+                                        z3DD3D9HL_Arena* scratch){
+    z3DD3D9HL_MeshSubset subset;
+    subset.faceStart_ = 0;
+    subset.faceCount_ = numFaces;
+    return D3D9HL_OptimizeFacesSubsets(faceRemap, indices, numFaces, numVertices, f32BitIndices, &subset, 1, cacheSize, 1, scratch);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeFacesSubsets(uint32_t* faceRemap,
+                                               const void* indices,
+                                               uint32_t numFaces,
+                                               uint32_t numVertices,
+                                               bool f32BitIndices,
+                                               const z3DD3D9HL_MeshSubset* subsets,
+                                               uint32_t numSubsets,
+                                               uint32_t cacheSize,
+                                               uint32_t numThreads,
+                                               z3DD3D9HL_Arena* scratch){
+    Z3D_ASSERT_HIGH(faceRemap != 0 && indices != 0, "null passed", true);
+    if (faceRemap == 0 || indices == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(subsets != 0 || numSubsets == 0, "null passed", true);
+    if (subsets == 0 && numSubsets != 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(cacheSize >= 4 && cacheSize <= Z3D_D3D9HL_MAX_VCACHE_SIZE, "unacceptable vertex cache size", true);
+    if (cacheSize < 4 || cacheSize > Z3D_D3D9HL_MAX_VCACHE_SIZE)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (!z3D_priv::D3D9HL_IndicesInRange(indices, numFaces, numVertices, f32BitIndices))
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    // Пересекающиеся поднаборы разные потоки переставляли бы одновременно
+    uint32_t maxSubsetFaces = 0;
+    z3DD3D9HL_ErrCodes err = z3D_priv::D3D9HL_CheckSubsets(&maxSubsetFaces, subsets, numSubsets, numFaces, scratch);
+    if (err != Z3D_D3D9HL_NONE)
+        return err;
+    if (numThreads == 0)
+        numThreads = 1;
+    if (numThreads > Z3D_D3D9HL_MAX_WORKER_THREADS)
+        numThreads = Z3D_D3D9HL_MAX_WORKER_THREADS;
+    if (numThreads > numSubsets)
+        numThreads = numSubsets > 0 ? numSubsets : 1;
+
+    // Треугольники вне поднаборов остаются на месте
+    for (uint32_t iFace = 0; iFace < numFaces; ++iFace)
+        faceRemap[iFace] = iFace;
+
+    // Каждый поток получает собственную рабочую память
+    size_t wsSize = (z3D_priv::D3D9HL_VCacheWorkspaceSize(numVertices, maxSubsetFaces) + Z3D_D3D9HL_DEFAULT_ALIGN - 1) &
+                    ~static_cast<size_t>(Z3D_D3D9HL_DEFAULT_ALIGN - 1);
+    size_t marker = scratch != 0 ? D3D9HL_ArenaGetMarker(scratch) : 0;
+    uint8_t* mem = static_cast<uint8_t*>(z3D_priv::D3D9HL_ScratchAlloc(scratch, wsSize * numThreads));
+    if (mem == 0 && wsSize > 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+
+    z3D_priv::D3D9HL_SubsetJob job;
+    job.faceRemap_ = faceRemap;
+    job.indices_ = indices;
+    job.f32BitIndices_ = f32BitIndices;
+    job.subsets_ = subsets;
+    job.numSubsets_ = numSubsets;
+    job.cacheSize_ = cacheSize;
+    job.nextSubset_ = 0;
+
+    z3D_priv::D3D9HL_SubsetWorker workers[Z3D_D3D9HL_MAX_WORKER_THREADS];
+    void* threads[Z3D_D3D9HL_MAX_WORKER_THREADS];
+    uint32_t numStarted = 0;
+    for (uint32_t iThread = 0; iThread < numThreads; ++iThread){
+        workers[iThread].job_ = &job;
+        z3D_priv::D3D9HL_VCacheWorkspaceInit(&workers[iThread].ws_, mem + wsSize * iThread, numVertices, maxSubsetFaces);
+    }
+    // Вызывающий поток работает наравне с остальными; если поток не создался, его долю разберут другие
+    for (uint32_t iThread = 1; iThread < numThreads; ++iThread){
+        void* thread = z3D_priv::D3D9HL_CreateThread(z3D_priv::D3D9HL_SubsetWorkerProc, &workers[iThread]);
+        if (thread != 0)
+            threads[numStarted++] = thread;
+    }
+    z3D_priv::D3D9HL_SubsetWorkerProc(&workers[0]);
+    for (uint32_t iThread = 0; iThread < numStarted; ++iThread)
+        z3D_priv::D3D9HL_JoinThread(threads[iThread]);
+
+    z3D_priv::D3D9HL_ScratchFree(scratch, mem, marker);
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeOverdraw(uint32_t* faceRemap,
+                                           const void* indices,
+                                           uint32_t numFaces,
+                                           const float* positions,
+                                           uint32_t positionStride,
+                                           uint32_t numVertices,
+                                           bool f32BitIndices,
+                                           uint32_t cacheSize,
+                                           float threshold,
+                                           z3DD3D9HL_Arena* scratch){
+    Z3D_ASSERT_HIGH(faceRemap != 0 && indices != 0 && positions != 0, "null passed", true);
+    if (faceRemap == 0 || indices == 0 || positions == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(positionStride >= 3 * sizeof(float), "position stride is too small", true);
+    if (positionStride < 3 * sizeof(float) || cacheSize == 0 || threshold < 1.0f)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (!z3D_priv::D3D9HL_IndicesInRange(indices, numFaces, numVertices, f32BitIndices))
+        return Z3D_D3D9HL_INVALIDCALL;
+    z3DD3D9HL_MeshSubset subset;
+    subset.faceStart_ = 0;
+    subset.faceCount_ = numFaces;
+    z3DD3D9HL_ErrCodes err = z3D_priv::D3D9HL_CheckFaceRemap(faceRemap, numFaces, &subset, 1, scratch);
+    if (err != Z3D_D3D9HL_NONE)
+        return err;
+    if (numFaces == 0)
+        return Z3D_D3D9HL_NONE;
+
+    size_t marker = scratch != 0 ? D3D9HL_ArenaGetMarker(scratch) : 0;
+    uint32_t* cacheTime;
+    z3D_priv::D3D9HL_FaceCluster* clusters;
+    uint32_t* newRemap;
+    uint8_t* mem = z3D_priv::D3D9HL_OverdrawScratchAlloc(scratch, numVertices, numFaces, &cacheTime, &clusters, &newRemap);
+    if (mem == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    z3D_priv::D3D9HL_OptimizeOverdrawRange(faceRemap, indices, numFaces, positions, positionStride, numVertices,
+                                           f32BitIndices, cacheSize, threshold, cacheTime, clusters, newRemap);
+    z3D_priv::D3D9HL_ScratchFree(scratch, mem, marker);
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeOverdrawSubsets(uint32_t* faceRemap,
+                                                  const void* indices,
+                                                  uint32_t numFaces,
+                                                  const float* positions,
+                                                  uint32_t positionStride,
+                                                  uint32_t numVertices,
+                                                  bool f32BitIndices,
+                                                  const z3DD3D9HL_MeshSubset* subsets,
+                                                  uint32_t numSubsets,
+                                                  uint32_t cacheSize,
+                                                  float threshold,
+                                                  z3DD3D9HL_Arena* scratch){
+    Z3D_ASSERT_HIGH(faceRemap != 0 && indices != 0 && positions != 0, "null passed", true);
+    if (faceRemap == 0 || indices == 0 || positions == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(subsets != 0 || numSubsets == 0, "null passed", true);
+    if (subsets == 0 && numSubsets != 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(positionStride >= 3 * sizeof(float), "position stride is too small", true);
+    if (positionStride < 3 * sizeof(float) || cacheSize == 0 || threshold < 1.0f)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (!z3D_priv::D3D9HL_IndicesInRange(indices, numFaces, numVertices, f32BitIndices))
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    uint32_t maxSubsetFaces = 0;
+    z3DD3D9HL_ErrCodes err = z3D_priv::D3D9HL_CheckSubsets(&maxSubsetFaces, subsets, numSubsets, numFaces, scratch);
+    if (err == Z3D_D3D9HL_NONE)
+        err = z3D_priv::D3D9HL_CheckFaceRemap(faceRemap, numFaces, subsets, numSubsets, scratch);
+    if (err != Z3D_D3D9HL_NONE)
+        return err;
+    if (maxSubsetFaces == 0)
+        return Z3D_D3D9HL_NONE;
+
+    size_t marker = scratch != 0 ? D3D9HL_ArenaGetMarker(scratch) : 0;
+    uint32_t* cacheTime;
+    z3D_priv::D3D9HL_FaceCluster* clusters;
+    uint32_t* newRemap;
+    uint8_t* mem = z3D_priv::D3D9HL_OverdrawScratchAlloc(scratch, numVertices, maxSubsetFaces, &cacheTime, &clusters, &newRemap);
+    if (mem == 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    for (uint32_t iSubset = 0; iSubset < numSubsets; ++iSubset)
+        z3D_priv::D3D9HL_OptimizeOverdrawRange(faceRemap + subsets[iSubset].faceStart_, indices, subsets[iSubset].faceCount_,
+                                               positions, positionStride, numVertices, f32BitIndices, cacheSize, threshold,
+                                               cacheTime, clusters, newRemap);
+    z3D_priv::D3D9HL_ScratchFree(scratch, mem, marker);
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_OptimizeVertices(uint32_t* vertexRemap,
+                                           const void* indices,
+                                           uint32_t numFaces,
+                                           uint32_t numVertices,
+                                           bool f32BitIndices,
+                                           z3DD3D9HL_Arena* scratch){
+    Z3D_ASSERT_HIGH(vertexRemap != 0 && indices != 0, "null passed", true);
+    if (vertexRemap == 0 || indices == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (!z3D_priv::D3D9HL_IndicesInRange(indices, numFaces, numVertices, f32BitIndices))
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    size_t marker = scratch != 0 ? D3D9HL_ArenaGetMarker(scratch) : 0;
+    uint32_t* oldToNew = static_cast<uint32_t*>(z3D_priv::D3D9HL_ScratchAlloc(scratch, sizeof(uint32_t) * numVertices));
+    if (oldToNew == 0 && numVertices > 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    if (f32BitIndices)
+        z3D_priv::D3D9HL_OptimizeVerticesImpl(vertexRemap, static_cast<const uint32_t*>(indices), numFaces, numVertices, oldToNew);
+    else
+        z3D_priv::D3D9HL_OptimizeVerticesImpl(vertexRemap, static_cast<const uint16_t*>(indices), numFaces, numVertices, oldToNew);
+    z3D_priv::D3D9HL_ScratchFree(scratch, oldToNew, marker);
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_RemapFaces(void* dstIndices,
+                                     const void* srcIndices,
+                                     const uint32_t* faceRemap,
+                                     uint32_t numFaces,
+                                     bool f32BitIndices){
+    Z3D_ASSERT_HIGH(dstIndices != 0 && srcIndices != 0 && faceRemap != 0, "null passed", true);
+    if (dstIndices == 0 || srcIndices == 0 || faceRemap == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(dstIndices != srcIndices, "in-place face remap is not supported", true);
+    if (dstIndices == srcIndices)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    size_t faceSize = f32BitIndices ? sizeof(uint32_t) * 3 : sizeof(uint16_t) * 3;
+    for (uint32_t iFace = 0; iFace < numFaces; ++iFace){
+        if (faceRemap[iFace] >= numFaces)
+            return Z3D_D3D9HL_INVALIDCALL;
+        memcpy(static_cast<uint8_t*>(dstIndices) + faceSize * iFace,
+               static_cast<const uint8_t*>(srcIndices) + faceSize * faceRemap[iFace],
+               faceSize);
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_RemapIndices(void* indices,
+                                       uint32_t numFaces,
+                                       const uint32_t* vertexRemap,
+                                       uint32_t numVertices,
+                                       bool f32BitIndices,
+                                       z3DD3D9HL_Arena* scratch){
+    Z3D_ASSERT_HIGH(indices != 0 && vertexRemap != 0, "null passed", true);
+    if (indices == 0 || vertexRemap == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    if (!z3D_priv::D3D9HL_IndicesInRange(indices, numFaces, numVertices, f32BitIndices))
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    size_t marker = scratch != 0 ? D3D9HL_ArenaGetMarker(scratch) : 0;
+    uint32_t* oldToNew = static_cast<uint32_t*>(z3D_priv::D3D9HL_ScratchAlloc(scratch, sizeof(uint32_t) * numVertices));
+    if (oldToNew == 0 && numVertices > 0)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    // vertexRemap должен быть перестановкой: индексы меняются, только если он проверен целиком
+    memset(oldToNew, 0xFF, sizeof(uint32_t) * numVertices);
+    for (uint32_t v = 0; v < numVertices; ++v){
+        if (vertexRemap[v] >= numVertices || oldToNew[vertexRemap[v]] != Z3D_D3D9HL_NOINDEX){
+            z3D_priv::D3D9HL_ScratchFree(scratch, oldToNew, marker);
+            return Z3D_D3D9HL_INVALIDCALL;
+        }
+        oldToNew[vertexRemap[v]] = v;
+    }
+    size_t numCorners = static_cast<size_t>(numFaces) * 3;
+    if (f32BitIndices){
+        uint32_t* idx = static_cast<uint32_t*>(indices);
+        for (size_t iCorner = 0; iCorner < numCorners; ++iCorner)
+            idx[iCorner] = oldToNew[idx[iCorner]];
+    }
+    else {
+        uint16_t* idx = static_cast<uint16_t*>(indices);
+        for (size_t iCorner = 0; iCorner < numCorners; ++iCorner)
+            idx[iCorner] = static_cast<uint16_t>(oldToNew[idx[iCorner]]);
+    }
+    z3D_priv::D3D9HL_ScratchFree(scratch, oldToNew, marker);
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_RemapVertices(void* dstVertices,
+                                        const void* srcVertices,
+                                        uint32_t vertexStride,
+                                        const uint32_t* vertexRemap,
+                                        uint32_t numVertices){
+    Z3D_ASSERT_HIGH(dstVertices != 0 && srcVertices != 0 && vertexRemap != 0, "null passed", true);
+    if (dstVertices == 0 || srcVertices == 0 || vertexRemap == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(dstVertices != srcVertices, "in-place vertex remap is not supported", true);
+    if (dstVertices == srcVertices)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    for (uint32_t v = 0; v < numVertices; ++v){
+        if (vertexRemap[v] >= numVertices)
+            return Z3D_D3D9HL_INVALIDCALL;
+        memcpy(static_cast<uint8_t*>(dstVertices) + static_cast<size_t>(vertexStride) * v,
+               static_cast<const uint8_t*>(srcVertices) + static_cast<size_t>(vertexStride) * vertexRemap[v],
+               vertexStride);
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+} // end of z3D
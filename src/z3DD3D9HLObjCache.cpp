@@ -0,0 +1,437 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация кэша объявлений вершин и шейдеров.
+*/
+
+#include <string.h>
+#include "z3DD3D9HL.h"
+#include "z3DDebugSystem.h"
+#include "z3DD3D9HLPrivPlatform.h"
+
+/* Запись кэша. Поля ключа записываются один раз до публикации записи (перехода из состояния WRITING)
+и далее только читаются.
+*/
+struct z3DD3D9HL_ObjCacheEntry{
+    volatile int32_t state_;        // состояние записи ( @see D3D9HL_ObjCacheEntryState )
+    volatile int32_t refCount_;     // число ссылок на запись
+    uint32_t hash_;
+    uint32_t type_;
+    const uint8_t* key_;
+    uint32_t keySize_;
+    IUnknown* object_;              // изменяется только в потоке устройства
+};
+
+namespace z3D_priv
+{
+// Состояния записи кэша
+enum D3D9HL_ObjCacheEntryState{
+    D3D9HL_OBJENTRY_EMPTY,          // запись свободна
+    D3D9HL_OBJENTRY_WRITING,        // поток загрузки заполняет ключ записи
+    D3D9HL_OBJENTRY_PENDING,        // объект ожидает создания в потоке устройства
+    D3D9HL_OBJENTRY_CREATED,        // объект создан
+    D3D9HL_OBJENTRY_FAILED,         // объект создать не удалось
+    D3D9HL_OBJENTRY_EVICTED         // объект освобожден за отсутствием ссылок
+};
+
+// Типы объектов кэша
+enum D3D9HL_ObjCacheType{
+    D3D9HL_OBJTYPE_VERTEXDECL,
+    D3D9HL_OBJTYPE_VERTEXSHADER,
+    D3D9HL_OBJTYPE_PIXELSHADER
+};
+
+/* Хэш FNV-1a ключа с учетом типа объекта.
+*/
+uint32_t D3D9HL_ObjCacheHash(uint32_t type, const uint8_t* key, uint32_t keySize){
+    uint32_t hash = 2166136261u ^ type;
+    hash *= 16777619u;
+    for (uint32_t i = 0; i < keySize; ++i){
+        hash ^= key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Дождаться окончания заполнения записи другим потоком.
+*/
+int32_t D3D9HL_ObjCacheWaitPublished(z3DD3D9HL_ObjCacheEntry* entry){
+    int32_t state = entry->state_;
+    while (state == D3D9HL_OBJENTRY_WRITING){
+        D3D9HL_SpinPause();
+        state = entry->state_;
+    }
+    D3D9HL_MemoryBarrier();
+    return state;
+}
+
+/* Выделить память для копии ключа. Смещение продвигается только при успешном выделении, поэтому
+поток, которому памяти не хватило, не может вернуть место, уже занятое другим потоком.
+    @return указатель на память или 0, если места нет.
+*/
+uint8_t* D3D9HL_ObjCacheAllocKey(z3DD3D9HL_ObjCache* objCache, uint32_t keySize){
+    uint32_t capacity = objCache->keyMemCapacity_;
+    uint32_t alignedSize = (keySize + Z3D_D3D9HL_DEFAULT_ALIGN - 1) & ~static_cast<uint32_t>(Z3D_D3D9HL_DEFAULT_ALIGN - 1);
+    int32_t offset = objCache->keyMemOffset_;
+    for (;;){
+        if (keySize > capacity - static_cast<uint32_t>(offset))
+            return 0;
+        // Выравнивание последнего ключа не должно выводить смещение за пределы памяти
+        uint32_t newOffset = (alignedSize > capacity - static_cast<uint32_t>(offset)) ? capacity : static_cast<uint32_t>(offset) + alignedSize;
+        int32_t prevOffset = D3D9HL_AtomicCompareExchange(&objCache->keyMemOffset_, static_cast<int32_t>(newOffset), offset);
+        if (prevOffset == offset)
+            return objCache->keyMem_ + offset;
+        offset = prevOffset;
+    }
+}
+
+/* Найти запись с заданным ключом или добавить новую. Не использует блокировок.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheRequest(z3DD3D9HL_ObjCache* objCache,
+                                          uint32_t type,
+                                          const uint8_t* key,
+                                          uint32_t keySize,
+                                          uint32_t* handle){
+    Z3D_ASSERT_HIGH(objCache != 0 && objCache->entries_ != 0, "object cache is not initialized", true);
+    if (objCache == 0 || objCache->entries_ == 0)
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+    Z3D_ASSERT_HIGH(handle != 0, "null passed", true);
+    if (handle == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    D3D9HL_AtomicAdd(&objCache->numLookups_, 1);
+    uint32_t hash = D3D9HL_ObjCacheHash(type, key, keySize);
+    uint32_t mask = objCache->capacity_ - 1;
+    uint32_t iEntry = hash & mask;
+    uint32_t numProbes = 0;
+    while (numProbes < objCache->capacity_){
+        z3DD3D9HL_ObjCacheEntry* entry = &objCache->entries_[iEntry];
+        int32_t state = entry->state_;
+        if (state == D3D9HL_OBJENTRY_EMPTY){
+            // Занимаем свободную запись. Все потоки проходят записи в одном порядке,
+            // поэтому одинаковый ключ не может попасть в две записи.
+            if (D3D9HL_AtomicCompareExchange(&entry->state_, D3D9HL_OBJENTRY_WRITING, D3D9HL_OBJENTRY_EMPTY) != D3D9HL_OBJENTRY_EMPTY)
+                continue;
+            uint8_t* keyCopy = D3D9HL_ObjCacheAllocKey(objCache, keySize);
+            if (keyCopy == 0){
+                D3D9HL_AtomicExchange(&entry->state_, D3D9HL_OBJENTRY_EMPTY);
+                return Z3D_D3D9HL_OUTOFMEMORY;
+            }
+            memcpy(keyCopy, key, keySize);
+            entry->hash_ = hash;
+            entry->type_ = type;
+            entry->key_ = keyCopy;
+            entry->keySize_ = keySize;
+            entry->refCount_ = 1;
+            entry->object_ = 0;
+            D3D9HL_AtomicExchange(&entry->state_, D3D9HL_OBJENTRY_PENDING);
+            D3D9HL_AtomicAdd(&objCache->numEntries_, 1);
+            D3D9HL_AtomicExchange(&objCache->fDirty_, 1);
+            *handle = iEntry;
+            return Z3D_D3D9HL_NONE;
+        }
+        state = D3D9HL_ObjCacheWaitPublished(entry);
+        // Запись освобождена потоком, которому не хватило памяти для ключа - пробуем занять ее снова
+        if (state == D3D9HL_OBJENTRY_EMPTY)
+            continue;
+        if (entry->hash_ == hash &&
+            entry->type_ == type &&
+            entry->keySize_ == keySize &&
+            memcmp(entry->key_, key, keySize) == 0){
+            D3D9HL_AtomicAdd(&entry->refCount_, 1);
+            D3D9HL_AtomicAdd(&objCache->numHits_, 1);
+            // Объект был освобожден за отсутствием ссылок - его нужно создать снова
+            if (entry->state_ == D3D9HL_OBJENTRY_EVICTED)
+                D3D9HL_AtomicExchange(&objCache->fDirty_, 1);
+            *handle = iEntry;
+            return Z3D_D3D9HL_NONE;
+        }
+        iEntry = (iEntry + 1) & mask;
+        numProbes++;
+    }
+    return Z3D_D3D9HL_OUTOFMEMORY;
+}
+
+/* Получить объект записи заданного типа в потоке устройства.
+*/
+IUnknown* D3D9HL_ObjCacheGet(const z3DD3D9HL_ObjCache* objCache, uint32_t handle, uint32_t type){
+    Z3D_ASSERT_HIGH(objCache != 0 && handle < objCache->capacity_, "invalid object cache handle", true);
+    if (objCache == 0 || handle >= objCache->capacity_)
+        return 0;
+    const z3DD3D9HL_ObjCacheEntry& entry = objCache->entries_[handle];
+    if (entry.state_ != D3D9HL_OBJENTRY_CREATED)
+        return 0;
+    Z3D_ASSERT_HIGH(entry.type_ == type, "object cache handle of another object type", true);
+    if (entry.type_ != type)
+        return 0;
+    return entry.object_;
+}
+
+/* Освободить объекты, созданные на прежнем устройстве. Записи с объектами и записи, объект для
+которых создать не удалось, снова ожидают создания; освобожденные за отсутствием ссылок остаются такими.
+*/
+void D3D9HL_ObjCacheDropObjects(z3DD3D9HL_ObjCache* objCache){
+    for (uint32_t iEntry = 0; iEntry < objCache->capacity_; ++iEntry){
+        z3DD3D9HL_ObjCacheEntry& entry = objCache->entries_[iEntry];
+        int32_t state = entry.state_;
+        if (state != D3D9HL_OBJENTRY_CREATED && state != D3D9HL_OBJENTRY_FAILED)
+            continue;
+        D3D9HL_AtomicExchange(&entry.state_, D3D9HL_OBJENTRY_PENDING);
+        if (entry.object_ != 0){
+            entry.object_->Release();
+            entry.object_ = 0;
+        }
+    }
+    D3D9HL_AtomicExchange(&objCache->fDirty_, 1);
+    objCache->device_ = 0;
+}
+
+/* Слушатель событий устройства: объявления и шейдеры переживают Reset(), но не пересоздание устройства.
+*/
+void D3D9HL_ObjCacheOnReset(LPDIRECT3DDEVICE9 device, void* userData){
+    z3DD3D9HL_ObjCache* objCache = static_cast<z3DD3D9HL_ObjCache*>(userData);
+    if (objCache->device_ != 0 && objCache->device_ != device)
+        D3D9HL_ObjCacheDropObjects(objCache);
+}
+
+z3DD3D9HL_DeviceListener D3D9HL_ObjCacheListener(z3DD3D9HL_ObjCache* objCache){
+    z3DD3D9HL_DeviceListener listener;
+    listener.onRelease_ = 0;
+    listener.onReset_ = D3D9HL_ObjCacheOnReset;
+    listener.onEndRender_ = 0;
+    listener.userData_ = objCache;
+    listener.device_ = objCache->device_;
+    return listener;
+}
+} // end of z3D_priv
+
+namespace z3D
+{
+
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheInit(z3DD3D9HL_ObjCache* objCache,
+                                       z3DD3D9HL_Arena* arena,
+                                       uint32_t capacity,
+                                       uint32_t keyMemSize){
+    Z3D_ASSERT_HIGH(objCache != 0 && arena != 0, "null passed", true);
+    if (objCache == 0 || arena == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(capacity > 0 && capacity <= 0x80000000, "unacceptable object cache capacity", true);
+    if (capacity == 0 || capacity > 0x80000000)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    uint32_t pow2Capacity = 1;
+    while (pow2Capacity < capacity)
+        pow2Capacity <<= 1;
+
+    ZeroMemory(objCache, sizeof(z3DD3D9HL_ObjCache));
+    size_t marker = D3D9HL_ArenaGetMarker(arena);
+    objCache->entries_ = static_cast<z3DD3D9HL_ObjCacheEntry*>(
+        D3D9HL_ArenaAlloc(arena, sizeof(z3DD3D9HL_ObjCacheEntry) * pow2Capacity));
+    objCache->keyMem_ = static_cast<uint8_t*>(D3D9HL_ArenaAlloc(arena, keyMemSize));
+    if (objCache->entries_ == 0 || (objCache->keyMem_ == 0 && keyMemSize > 0)){
+        D3D9HL_ArenaRewind(arena, marker);
+        objCache->entries_ = 0;
+        objCache->keyMem_ = 0;
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    }
+    ZeroMemory(objCache->entries_, sizeof(z3DD3D9HL_ObjCacheEntry) * pow2Capacity);
+    objCache->capacity_ = pow2Capacity;
+    objCache->keyMemCapacity_ = keyMemSize;
+    z3DD3D9HL_ErrCodes err = D3D9HL_AddDeviceListener(z3D_priv::D3D9HL_ObjCacheListener(objCache));
+    if (err != Z3D_D3D9HL_NONE){
+        D3D9HL_ArenaRewind(arena, marker);
+        ZeroMemory(objCache, sizeof(z3DD3D9HL_ObjCache));
+        return err;
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_ObjCacheShutdown(z3DD3D9HL_ObjCache* objCache){
+    Z3D_ASSERT_HIGH(objCache != 0, "null passed", true);
+    if (objCache == 0 || objCache->entries_ == 0)
+        return;
+    D3D9HL_RemoveDeviceListener(z3D_priv::D3D9HL_ObjCacheListener(objCache));
+    for (uint32_t iEntry = 0; iEntry < objCache->capacity_; ++iEntry){
+        z3DD3D9HL_ObjCacheEntry& entry = objCache->entries_[iEntry];
+        if (entry.object_ != 0){
+            entry.object_->Release();
+            entry.object_ = 0;
+        }
+    }
+    objCache->entries_ = 0;
+    objCache->capacity_ = 0;
+    objCache->device_ = 0;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheRequestVertexDecl(z3DD3D9HL_ObjCache* objCache,
+                                                    const D3DVERTEXELEMENT9* elements,
+                                                    uint32_t* handle){
+    Z3D_ASSERT_HIGH(elements != 0, "null passed", true);
+    if (elements == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    // Элементы объявления вместе с завершающим D3DDECL_END()
+    uint32_t numElements = 1;
+    while (elements[numElements - 1].Stream != 0xFF)
+        numElements++;
+    return z3D_priv::D3D9HL_ObjCacheRequest(objCache,
+                                            z3D_priv::D3D9HL_OBJTYPE_VERTEXDECL,
+                                            reinterpret_cast<const uint8_t*>(elements),
+                                            static_cast<uint32_t>(sizeof(D3DVERTEXELEMENT9) * numElements),
+                                            handle);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheRequestVertexShader(z3DD3D9HL_ObjCache* objCache,
+                                                      const DWORD* function,
+                                                      uint32_t* handle){
+    Z3D_ASSERT_HIGH(function != 0, "null passed", true);
+    if (function == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    return z3D_priv::D3D9HL_ObjCacheRequest(objCache,
+                                            z3D_priv::D3D9HL_OBJTYPE_VERTEXSHADER,
+                                            reinterpret_cast<const uint8_t*>(function),
+                                            static_cast<uint32_t>(D3DXGetShaderSize(function)),
+                                            handle);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheRequestPixelShader(z3DD3D9HL_ObjCache* objCache,
+                                                     const DWORD* function,
+                                                     uint32_t* handle){
+    Z3D_ASSERT_HIGH(function != 0, "null passed", true);
+    if (function == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    return z3D_priv::D3D9HL_ObjCacheRequest(objCache,
+                                            z3D_priv::D3D9HL_OBJTYPE_PIXELSHADER,
+                                            reinterpret_cast<const uint8_t*>(function),
+                                            static_cast<uint32_t>(D3DXGetShaderSize(function)),
+                                            handle);
+}
+
+void D3D9HL_ObjCacheRelease(z3DD3D9HL_ObjCache* objCache, uint32_t handle){
+    Z3D_ASSERT_HIGH(objCache != 0 && handle < objCache->capacity_, "invalid object cache handle", true);
+    if (objCache == 0 || handle >= objCache->capacity_)
+        return;
+    int32_t refCount = z3D_priv::D3D9HL_AtomicAdd(&objCache->entries_[handle].refCount_, -1);
+    Z3D_ASSERT_HIGH(refCount >= 0, "object cache entry released more times than requested", true);
+    (void)refCount;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_ObjCacheCreatePending(z3DD3D9HL_ObjCache* objCache,
+                                                LPDIRECT3DDEVICE9 device,
+                                                uint32_t* pNumCreated){
+    Z3D_ASSERT_HIGH(objCache != 0 && objCache->entries_ != 0, "object cache is not initialized", true);
+    if (objCache == 0 || objCache->entries_ == 0)
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+    Z3D_ASSERT(device != 0, "null device passed", true);
+    if (device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    // Объекты другого устройства, если его смена прошла мимо слушателя. Слушатель переходит к новому устройству.
+    if (objCache->device_ != device){
+        if (objCache->device_ != 0)
+            z3D_priv::D3D9HL_ObjCacheDropObjects(objCache);
+        D3D9HL_RemoveDeviceListener(z3D_priv::D3D9HL_ObjCacheListener(objCache));
+        objCache->device_ = device;
+        D3D9HL_AddDeviceListener(z3D_priv::D3D9HL_ObjCacheListener(objCache));
+    }
+
+    uint32_t numCreated = 0;
+    // Флаг сбрасывается до просмотра, поэтому запись, опубликованная во время просмотра, не будет пропущена
+    if (z3D_priv::D3D9HL_AtomicExchange(&objCache->fDirty_, 0) != 0){
+        for (uint32_t iEntry = 0; iEntry < objCache->capacity_; ++iEntry){
+            z3DD3D9HL_ObjCacheEntry& entry = objCache->entries_[iEntry];
+            int32_t state = entry.state_;
+            if (state != z3D_priv::D3D9HL_OBJENTRY_PENDING &&
+                !(state == z3D_priv::D3D9HL_OBJENTRY_EVICTED && entry.refCount_ > 0))
+                continue;
+            z3D_priv::D3D9HL_MemoryBarrier();
+            HRESULT hr = D3DERR_INVALIDCALL;
+            switch (entry.type_){
+            case z3D_priv::D3D9HL_OBJTYPE_VERTEXDECL:{
+                LPDIRECT3DVERTEXDECLARATION9 decl = 0;
+                hr = device->CreateVertexDeclaration(reinterpret_cast<const D3DVERTEXELEMENT9*>(entry.key_), &decl);
+                entry.object_ = decl;
+                break;
+            }
+            case z3D_priv::D3D9HL_OBJTYPE_VERTEXSHADER:{
+                LPDIRECT3DVERTEXSHADER9 shader = 0;
+                hr = device->CreateVertexShader(reinterpret_cast<const DWORD*>(entry.key_), &shader);
+                entry.object_ = shader;
+                break;
+            }
+            case z3D_priv::D3D9HL_OBJTYPE_PIXELSHADER:{
+                LPDIRECT3DPIXELSHADER9 shader = 0;
+                hr = device->CreatePixelShader(reinterpret_cast<const DWORD*>(entry.key_), &shader);
+                entry.object_ = shader;
+                break;
+            }
+            default:
+                break;
+            }
+            if (FAILED(hr)){
+                entry.object_ = 0;
+                Z3D_ERROR(Z3D_ERROR_PERMISSIBLE, FAILED(hr), "Direct3D object creation for cache entry failed", false);
+                z3D_priv::D3D9HL_AtomicExchange(&entry.state_, z3D_priv::D3D9HL_OBJENTRY_FAILED);
+                continue;
+            }
+            z3D_priv::D3D9HL_AtomicExchange(&entry.state_, z3D_priv::D3D9HL_OBJENTRY_CREATED);
+            numCreated++;
+        }
+    }
+    if (pNumCreated != 0)
+        *pNumCreated = numCreated;
+    return Z3D_D3D9HL_NONE;
+}
+
+uint32_t D3D9HL_ObjCacheTrim(z3DD3D9HL_ObjCache* objCache){
+    Z3D_ASSERT_HIGH(objCache != 0, "null passed", true);
+    if (objCache == 0 || objCache->entries_ == 0)
+        return 0;
+    uint32_t numReleased = 0;
+    for (uint32_t iEntry = 0; iEntry < objCache->capacity_; ++iEntry){
+        z3DD3D9HL_ObjCacheEntry& entry = objCache->entries_[iEntry];
+        if (entry.state_ != z3D_priv::D3D9HL_OBJENTRY_CREATED || entry.refCount_ > 0)
+            continue;
+        z3D_priv::D3D9HL_AtomicExchange(&entry.state_, z3D_priv::D3D9HL_OBJENTRY_EVICTED);
+        entry.object_->Release();
+        entry.object_ = 0;
+        numReleased++;
+        // Ссылка могла появиться одновременно с освобождением - объект будет создан снова
+        if (entry.refCount_ > 0)
+            z3D_priv::D3D9HL_AtomicExchange(&objCache->fDirty_, 1);
+    }
+    return numReleased;
+}
+
+LPDIRECT3DVERTEXDECLARATION9 D3D9HL_ObjCacheGetVertexDecl(const z3DD3D9HL_ObjCache* objCache, uint32_t handle){
+    return static_cast<LPDIRECT3DVERTEXDECLARATION9>(
+        z3D_priv::D3D9HL_ObjCacheGet(objCache, handle, z3D_priv::D3D9HL_OBJTYPE_VERTEXDECL));
+}
+
+LPDIRECT3DVERTEXSHADER9 D3D9HL_ObjCacheGetVertexShader(const z3DD3D9HL_ObjCache* objCache, uint32_t handle){
+    return static_cast<LPDIRECT3DVERTEXSHADER9>(
+        z3D_priv::D3D9HL_ObjCacheGet(objCache, handle, z3D_priv::D3D9HL_OBJTYPE_VERTEXSHADER));
+}
+
+LPDIRECT3DPIXELSHADER9 D3D9HL_ObjCacheGetPixelShader(const z3DD3D9HL_ObjCache* objCache, uint32_t handle){
+    return static_cast<LPDIRECT3DPIXELSHADER9>(
+        z3D_priv::D3D9HL_ObjCacheGet(objCache, handle, z3D_priv::D3D9HL_OBJTYPE_PIXELSHADER));
+}
+
+void D3D9HL_ObjCacheGetStats(z3DD3D9HL_ObjCacheStats* stats, const z3DD3D9HL_ObjCache* objCache){
+    Z3D_ASSERT_HIGH(stats != 0 && objCache != 0, "null passed", true);
+    ZeroMemory(stats, sizeof(z3DD3D9HL_ObjCacheStats));
+    stats->numLookups_ = static_cast<uint32_t>(objCache->numLookups_);
+    stats->numHits_ = static_cast<uint32_t>(objCache->numHits_);
+    stats->numEntries_ = static_cast<uint32_t>(objCache->numEntries_);
+    stats->keyBytes_ = static_cast<uint32_t>(objCache->keyMemOffset_);
+    for (uint32_t iEntry = 0; iEntry < objCache->capacity_; ++iEntry){
+        switch (objCache->entries_[iEntry].state_){
+        case z3D_priv::D3D9HL_OBJENTRY_PENDING:     stats->numPending_++; break;
+        case z3D_priv::D3D9HL_OBJENTRY_CREATED:     stats->numObjects_++; break;
+        case z3D_priv::D3D9HL_OBJENTRY_FAILED:      stats->numFailed_++; break;
+        default:                                    break;
+        }
+    }
+}
+
+} // end of z3D
@@ -0,0 +1,322 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация отсечения невидимых объектов запросами перекрытия.
+*/
+
+#include "z3DD3D9HL.h"
+#include "z3DDebugSystem.h"
+
+namespace z3D_priv
+{
+uint32_t D3D9HL_AllocOcclusionQuery(z3DD3D9HL_Occlusion* occlusion){
+    if (occlusion->numFreeQueries_ == 0)
+        return Z3D_D3D9HL_NOINDEX;
+    return occlusion->freeQueries_[--occlusion->numFreeQueries_];
+}
+
+void D3D9HL_FreeOcclusionQuery(z3DD3D9HL_Occlusion* occlusion, uint32_t iQuery){
+    z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[iQuery];
+    query.iObject_ = Z3D_D3D9HL_NOINDEX;
+    query.fIssued_ = false;
+    // Запросы без объектов Direct3D9 остаются вне стека до их создания
+    if (query.query_ != 0 || occlusion->device_ == 0)
+        occlusion->freeQueries_[occlusion->numFreeQueries_++] = iQuery;
+}
+
+/* Отменить запрос без результата: объект считается видимым и проверяется снова при первой возможности.
+*/
+void D3D9HL_AbandonOcclusionQuery(z3DD3D9HL_Occlusion* occlusion, uint32_t iQuery){
+    z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[iQuery];
+    z3DD3D9HL_OcclusionObject& object = occlusion->objects_[query.iObject_];
+    object.iQuery_ = Z3D_D3D9HL_NOINDEX;
+    object.fVisible_ = true;
+    object.nextQueryFrame_ = occlusion->frame_;
+    occlusion->frameStats_.numAbandoned_++;
+    D3D9HL_FreeOcclusionQuery(occlusion, iQuery);
+}
+
+void D3D9HL_ReleaseOcclusionQueries(z3DD3D9HL_Occlusion* occlusion){
+    for (uint32_t i = 0; i < occlusion->numQueries_; ++i){
+        z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[i];
+        if (query.iObject_ != Z3D_D3D9HL_NOINDEX)
+            D3D9HL_AbandonOcclusionQuery(occlusion, i);
+        if (query.query_ != 0)
+            query.query_->Release();
+        query.query_ = 0;
+    }
+    occlusion->numFreeQueries_ = 0;
+}
+
+/* Создать объекты запросов. Запросы, которые создать не удалось, в стек свободных не попадают.
+*/
+void D3D9HL_CreateOcclusionQueries(z3DD3D9HL_Occlusion* occlusion, LPDIRECT3DDEVICE9 device){
+    occlusion->numFreeQueries_ = 0;
+    for (uint32_t i = occlusion->numQueries_; i > 0; --i){
+        z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[i - 1];
+        if (FAILED(device->CreateQuery(D3DQUERYTYPE_OCCLUSION, &query.query_))){
+            query.query_ = 0;
+            continue;
+        }
+        occlusion->freeQueries_[occlusion->numFreeQueries_++] = i - 1;
+    }
+}
+
+/* Слушатель событий устройства: результаты запросов после Reset() недоступны.
+*/
+void D3D9HL_OcclusionOnRelease(LPDIRECT3DDEVICE9 /*device*/, void* userData){
+    D3D9HL_ReleaseOcclusionQueries(static_cast<z3DD3D9HL_Occlusion*>(userData));
+}
+
+void D3D9HL_OcclusionOnReset(LPDIRECT3DDEVICE9 device, void* userData){
+    z3DD3D9HL_Occlusion* occlusion = static_cast<z3DD3D9HL_Occlusion*>(userData);
+    occlusion->device_ = device;
+    D3D9HL_CreateOcclusionQueries(occlusion, device);
+}
+
+z3DD3D9HL_DeviceListener D3D9HL_OcclusionListener(z3DD3D9HL_Occlusion* occlusion){
+    z3DD3D9HL_DeviceListener listener;
+    listener.onRelease_ = D3D9HL_OcclusionOnRelease;
+    listener.onReset_ = D3D9HL_OcclusionOnReset;
+    listener.onEndRender_ = 0;
+    listener.userData_ = occlusion;
+    listener.device_ = occlusion->device_;
+    return listener;
+}
+} // end of z3D_priv
+
+namespace z3D
+{
+
+z3DD3D9HL_ErrCodes D3D9HL_OcclusionInit(z3DD3D9HL_Occlusion* occlusion,
+                                        z3DD3D9HL_Arena* arena,
+                                        uint32_t numObjects,
+                                        uint32_t numQueries,
+                                        const z3DD3D9HL_OcclusionParams& params){
+    Z3D_ASSERT_HIGH(occlusion != 0 && arena != 0, "null passed", true);
+    if (occlusion == 0 || arena == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(numObjects > 0 && numQueries > 0, "unacceptable occlusion pool capacity", true);
+    if (numObjects == 0 || numQueries == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    size_t marker = D3D9HL_ArenaGetMarker(arena);
+    occlusion->objects_ = static_cast<z3DD3D9HL_OcclusionObject*>(
+        D3D9HL_ArenaAlloc(arena, sizeof(z3DD3D9HL_OcclusionObject) * numObjects));
+    occlusion->queries_ = static_cast<z3DD3D9HL_OcclusionQuery*>(
+        D3D9HL_ArenaAlloc(arena, sizeof(z3DD3D9HL_OcclusionQuery) * numQueries));
+    occlusion->freeQueries_ = static_cast<uint32_t*>(D3D9HL_ArenaAlloc(arena, sizeof(uint32_t) * numQueries));
+    if (occlusion->objects_ == 0 || occlusion->queries_ == 0 || occlusion->freeQueries_ == 0){
+        D3D9HL_ArenaRewind(arena, marker);
+        occlusion->objects_ = 0;
+        occlusion->queries_ = 0;
+        occlusion->freeQueries_ = 0;
+        occlusion->numObjects_ = 0;
+        occlusion->numQueries_ = 0;
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    }
+    for (uint32_t i = 0; i < numObjects; ++i){
+        z3DD3D9HL_OcclusionObject& object = occlusion->objects_[i];
+        object.iQuery_ = Z3D_D3D9HL_NOINDEX;
+        object.nextQueryFrame_ = 0;
+        object.lastPixels_ = 0;
+        object.fVisible_ = true;
+    }
+    for (uint32_t i = 0; i < numQueries; ++i){
+        z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[i];
+        query.query_ = 0;
+        query.iObject_ = Z3D_D3D9HL_NOINDEX;
+        query.issueFrame_ = 0;
+        query.fIssued_ = false;
+        // Первыми выдаются запросы с меньшими номерами
+        occlusion->freeQueries_[i] = numQueries - 1 - i;
+    }
+    occlusion->numObjects_ = numObjects;
+    occlusion->numQueries_ = numQueries;
+    occlusion->numFreeQueries_ = numQueries;
+    occlusion->frame_ = 0;
+    occlusion->params_ = params;
+    occlusion->device_ = 0;
+    ZeroMemory(&occlusion->frameStats_, sizeof(z3DD3D9HL_OcclusionStats));
+    ZeroMemory(&occlusion->lastFrameStats_, sizeof(z3DD3D9HL_OcclusionStats));
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_OcclusionCreateQueries(z3DD3D9HL_Occlusion* occlusion, LPDIRECT3DDEVICE9 device){
+    Z3D_ASSERT_HIGH(occlusion != 0 && occlusion->numQueries_ > 0, "occlusion pool is not initialized", true);
+    if (occlusion == 0 || occlusion->numQueries_ == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(device != 0, "null device passed", true);
+    if (device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(occlusion->device_ == 0, "occlusion queries are already created", true);
+    if (occlusion->device_ != 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    // Нулевой указатель в CreateQuery() - проверка поддержки типа запросов
+    if (FAILED(device->CreateQuery(D3DQUERYTYPE_OCCLUSION, 0)))
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    // Запросы, выделенные при моделировании, отменяются
+    for (uint32_t i = 0; i < occlusion->numQueries_; ++i){
+        if (occlusion->queries_[i].iObject_ != Z3D_D3D9HL_NOINDEX)
+            z3D_priv::D3D9HL_AbandonOcclusionQuery(occlusion, i);
+    }
+    occlusion->device_ = device;
+    z3D_priv::D3D9HL_CreateOcclusionQueries(occlusion, device);
+    if (occlusion->numFreeQueries_ == 0){
+        occlusion->device_ = 0;
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    }
+    z3DD3D9HL_ErrCodes err = D3D9HL_AddDeviceListener(z3D_priv::D3D9HL_OcclusionListener(occlusion));
+    if (err != Z3D_D3D9HL_NONE){
+        z3D_priv::D3D9HL_ReleaseOcclusionQueries(occlusion);
+        occlusion->device_ = 0;
+        return err;
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_OcclusionShutdown(z3DD3D9HL_Occlusion* occlusion){
+    Z3D_ASSERT_HIGH(occlusion != 0, "null passed", true);
+    if (occlusion == 0 || occlusion->device_ == 0)
+        return;
+    D3D9HL_RemoveDeviceListener(z3D_priv::D3D9HL_OcclusionListener(occlusion));
+    z3D_priv::D3D9HL_ReleaseOcclusionQueries(occlusion);
+    occlusion->device_ = 0;
+}
+
+void D3D9HL_OcclusionBeginFrame(z3DD3D9HL_Occlusion* occlusion){
+    Z3D_ASSERT_HIGH(occlusion != 0 && occlusion->numQueries_ > 0, "occlusion pool is not initialized", true);
+    occlusion->lastFrameStats_ = occlusion->frameStats_;
+    ZeroMemory(&occlusion->frameStats_, sizeof(z3DD3D9HL_OcclusionStats));
+    occlusion->frame_++;
+    for (uint32_t i = 0; i < occlusion->numQueries_; ++i){
+        const z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[i];
+        if (query.iObject_ == Z3D_D3D9HL_NOINDEX)
+            continue;
+        // Запрос, не выданный в своем кадре, результата не даст
+        if (!query.fIssued_ || occlusion->frame_ - query.issueFrame_ > occlusion->params_.maxLatencyFrames_)
+            z3D_priv::D3D9HL_AbandonOcclusionQuery(occlusion, i);
+    }
+}
+
+uint32_t D3D9HL_OcclusionPoll(z3DD3D9HL_Occlusion* occlusion){
+    Z3D_ASSERT_HIGH(occlusion != 0 && occlusion->numQueries_ > 0, "occlusion pool is not initialized", true);
+    uint32_t numResults = 0;
+    for (uint32_t i = 0; i < occlusion->numQueries_; ++i){
+        const z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[i];
+        if (query.iObject_ == Z3D_D3D9HL_NOINDEX || !query.fIssued_ || query.query_ == 0 ||
+            query.issueFrame_ >= occlusion->frame_)
+            continue;
+        // Без D3DGETDATA_FLUSH: команды отправляются драйвером в обычном порядке, а не по требованию запроса
+        DWORD numPixels = 0;
+        HRESULT hr = query.query_->GetData(&numPixels, sizeof(DWORD), 0);
+        if (hr == S_OK){
+            D3D9HL_OcclusionSetResult(occlusion, query.iObject_, static_cast<uint32_t>(numPixels));
+            numResults++;
+        }
+        else if (hr == S_FALSE){
+            occlusion->frameStats_.numStallsAvoided_++;
+        }
+        else {
+            z3D_priv::D3D9HL_AbandonOcclusionQuery(occlusion, i);
+        }
+    }
+    return numResults;
+}
+
+z3DD3D9HL_OcclusionAction D3D9HL_OcclusionTest(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject){
+    Z3D_ASSERT_HIGH(occlusion != 0 && occlusion->numQueries_ > 0, "occlusion pool is not initialized", true);
+    Z3D_ASSERT_HIGH(iObject < occlusion->numObjects_, "object index out of range", true);
+    if (iObject >= occlusion->numObjects_)
+        return Z3D_D3D9HL_OCCLUSION_DRAW;
+    z3DD3D9HL_OcclusionObject& object = occlusion->objects_[iObject];
+    z3DD3D9HL_OcclusionStats& stats = occlusion->frameStats_;
+    stats.numTests_++;
+
+    // Результат еще не получен - действуем по прошлому
+    if (object.iQuery_ != Z3D_D3D9HL_NOINDEX){
+        if (object.fVisible_)
+            return Z3D_D3D9HL_OCCLUSION_DRAW;
+        stats.numCulled_++;
+        return Z3D_D3D9HL_OCCLUSION_SKIP;
+    }
+    if (object.fVisible_ && occlusion->frame_ < object.nextQueryFrame_){
+        stats.numQueriesSaved_++;
+        return Z3D_D3D9HL_OCCLUSION_DRAW;
+    }
+    uint32_t iQuery = z3D_priv::D3D9HL_AllocOcclusionQuery(occlusion);
+    if (iQuery == Z3D_D3D9HL_NOINDEX){
+        stats.numPoolExhausted_++;
+        return Z3D_D3D9HL_OCCLUSION_DRAW;
+    }
+    z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[iQuery];
+    query.iObject_ = iObject;
+    query.issueFrame_ = occlusion->frame_;
+    query.fIssued_ = false;
+    object.iQuery_ = iQuery;
+    if (object.fVisible_)
+        return Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED;
+    stats.numCulled_++;
+    return Z3D_D3D9HL_OCCLUSION_QUERY_BOX;
+}
+
+void D3D9HL_OcclusionSetResult(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject, uint32_t numPixels){
+    Z3D_ASSERT_HIGH(occlusion != 0 && iObject < occlusion->numObjects_, "object index out of range", true);
+    z3DD3D9HL_OcclusionObject& object = occlusion->objects_[iObject];
+    Z3D_ASSERT_HIGH(object.iQuery_ != Z3D_D3D9HL_NOINDEX, "object has no query", true);
+    if (object.iQuery_ == Z3D_D3D9HL_NOINDEX)
+        return;
+    const z3DD3D9HL_OcclusionParams& params = occlusion->params_;
+    object.lastPixels_ = numPixels;
+    object.fVisible_ = numPixels >= params.visiblePixels_;
+    if (object.fVisible_){
+        // Сдвиг по номеру объекта распределяет повторные проверки одновременно ставших видимыми объектов по кадрам
+        object.nextQueryFrame_ = occlusion->frame_ + params.visibleFrames_ + iObject % (params.visibleFrames_ / 2 + 1);
+    }
+    z3D_priv::D3D9HL_FreeOcclusionQuery(occlusion, object.iQuery_);
+    object.iQuery_ = Z3D_D3D9HL_NOINDEX;
+    occlusion->frameStats_.numResults_++;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_OcclusionBeginQuery(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject){
+    Z3D_ASSERT_HIGH(occlusion != 0 && iObject < occlusion->numObjects_, "object index out of range", true);
+    if (occlusion == 0 || iObject >= occlusion->numObjects_)
+        return Z3D_D3D9HL_INVALIDCALL;
+    uint32_t iQuery = occlusion->objects_[iObject].iQuery_;
+    Z3D_ASSERT_HIGH(iQuery != Z3D_D3D9HL_NOINDEX, "object has no query", true);
+    if (iQuery == Z3D_D3D9HL_NOINDEX)
+        return Z3D_D3D9HL_INVALIDCALL;
+    // Без устройства (при моделировании) запрос только отмечается
+    LPDIRECT3DQUERY9 query = occlusion->queries_[iQuery].query_;
+    if (query != 0)
+        query->Issue(D3DISSUE_BEGIN);
+    else if (occlusion->device_ != 0)
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_OcclusionEndQuery(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject){
+    Z3D_ASSERT_HIGH(occlusion != 0 && iObject < occlusion->numObjects_, "object index out of range", true);
+    if (occlusion == 0 || iObject >= occlusion->numObjects_)
+        return Z3D_D3D9HL_INVALIDCALL;
+    uint32_t iQuery = occlusion->objects_[iObject].iQuery_;
+    Z3D_ASSERT_HIGH(iQuery != Z3D_D3D9HL_NOINDEX, "object has no query", true);
+    if (iQuery == Z3D_D3D9HL_NOINDEX)
+        return Z3D_D3D9HL_INVALIDCALL;
+    z3DD3D9HL_OcclusionQuery& query = occlusion->queries_[iQuery];
+    if (query.query_ != 0)
+        query.query_->Issue(D3DISSUE_END);
+    else if (occlusion->device_ != 0)
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+    query.fIssued_ = true;
+    occlusion->frameStats_.numQueries_++;
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_OcclusionGetStats(z3DD3D9HL_OcclusionStats* stats, const z3DD3D9HL_Occlusion* occlusion){
+    Z3D_ASSERT_HIGH(stats != 0 && occlusion != 0, "null passed", true);
+    *stats = occlusion->lastFrameStats_;
+}
+
+} // end of z3D
@@ -0,0 +1,259 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация слоя платформы для POSIX.
+
+Объекты синхронизации, как и объекты ядра Win32, не берут память у распределителя библиотеки:
+они живут дольше кадра и освобождаются не в порядке LIFO.
+*/
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "z3DD3D9HLPrivPlatform.h"
+
+namespace z3D_priv
+{
+bool D3D9HL_MapFile(D3D9HL_MappedFile* file, const char* path){
+    memset(file, 0, sizeof(D3D9HL_MappedFile));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || static_cast<uint64_t>(st.st_size) > 0xFFFFFFFFu){
+        close(fd);
+        return false;
+    }
+    void* view = mmap(0, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // отображение остается действительным после закрытия файла и его подмены через rename()
+    close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    file->data_ = view;
+    file->size_ = static_cast<uint32_t>(st.st_size);
+    file->handle_ = view;
+    return true;
+}
+
+void D3D9HL_UnmapFile(D3D9HL_MappedFile* file){
+    if (file->handle_ == 0)
+        return;
+    munmap(file->handle_, file->size_);
+    memset(file, 0, sizeof(D3D9HL_MappedFile));
+}
+
+/* Записать все байты, повторяя write() после частичной записи и прерывания сигналом.
+*/
+bool D3D9HL_WriteAll(int fd, const void* data, uint32_t size){
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0){
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        bytes += written;
+        size -= static_cast<uint32_t>(written);
+    }
+    return true;
+}
+
+bool D3D9HL_WriteFileAtomic(const char* path, const void* header, uint32_t headerSize, const void* data, uint32_t dataSize){
+    // mkstemp() создает уникальный файл, поэтому потоки и процессы пишут в разные временные файлы
+    char tempPath[4096];
+    int len = snprintf(tempPath, sizeof(tempPath), "%s.XXXXXX", path);
+    if (len < 0 || static_cast<size_t>(len) >= sizeof(tempPath))
+        return false;
+    int fd = mkstemp(tempPath);
+    if (fd < 0)
+        return false;
+    bool fOk = D3D9HL_WriteAll(fd, header, headerSize) && D3D9HL_WriteAll(fd, data, dataSize);
+    fOk = fOk && fsync(fd) == 0;
+    fOk = (close(fd) == 0) && fOk;
+    if (fOk)
+        fOk = (rename(tempPath, path) == 0);
+    if (!fOk)
+        unlink(tempPath);
+    return fOk;
+}
+
+int32_t D3D9HL_AtomicAdd(volatile int32_t* value, int32_t add){
+    return __sync_add_and_fetch(value, add);
+}
+
+int32_t D3D9HL_AtomicExchange(volatile int32_t* value, int32_t exchange){
+    // __sync_lock_test_and_set() - только барьер захвата
+    __sync_synchronize();
+    return __sync_lock_test_and_set(value, exchange);
+}
+
+int32_t D3D9HL_AtomicCompareExchange(volatile int32_t* value, int32_t exchange, int32_t comparand){
+    return __sync_val_compare_and_swap(value, comparand, exchange);
+}
+
+void D3D9HL_MemoryBarrier(){
+    __sync_synchronize();
+}
+
+void D3D9HL_SpinPause(){
+    sched_yield();
+}
+
+// Функция и параметр потока, передаваемые в D3D9HL_PosixThreadProc
+struct D3D9HL_PosixThread{
+    pthread_t thread_;
+    D3D9HL_ThreadFunc func_;
+    void* param_;
+};
+
+void* D3D9HL_PosixThreadProc(void* param){
+    D3D9HL_PosixThread* thread = static_cast<D3D9HL_PosixThread*>(param);
+    thread->func_(thread->param_);
+    return 0;
+}
+
+void* D3D9HL_CreateThread(D3D9HL_ThreadFunc func, void* param){
+    D3D9HL_PosixThread* thread = static_cast<D3D9HL_PosixThread*>(malloc(sizeof(D3D9HL_PosixThread)));
+    if (thread == 0)
+        return 0;
+    thread->func_ = func;
+    thread->param_ = param;
+    if (pthread_create(&thread->thread_, 0, D3D9HL_PosixThreadProc, thread) != 0){
+        free(thread);
+        return 0;
+    }
+    return thread;
+}
+
+void D3D9HL_JoinThread(void* thread){
+    if (thread == 0)
+        return;
+    pthread_join(static_cast<D3D9HL_PosixThread*>(thread)->thread_, 0);
+    free(thread);
+}
+
+void* D3D9HL_CreateMutex(){
+    pthread_mutex_t* mutex = static_cast<pthread_mutex_t*>(malloc(sizeof(pthread_mutex_t)));
+    if (mutex != 0 && pthread_mutex_init(mutex, 0) != 0){
+        free(mutex);
+        mutex = 0;
+    }
+    return mutex;
+}
+
+void D3D9HL_DestroyMutex(void* mutex){
+    if (mutex == 0)
+        return;
+    pthread_mutex_destroy(static_cast<pthread_mutex_t*>(mutex));
+    free(mutex);
+}
+
+void D3D9HL_LockMutex(void* mutex){
+    pthread_mutex_lock(static_cast<pthread_mutex_t*>(mutex));
+}
+
+void D3D9HL_UnlockMutex(void* mutex){
+    pthread_mutex_unlock(static_cast<pthread_mutex_t*>(mutex));
+}
+
+/* Семафор и событие - счетчик под мьютексом с условной переменной.
+Для семафора count_ - число разрешений, для события - признак установки.
+*/
+struct D3D9HL_PosixCounter{
+    pthread_mutex_t mutex_;
+    pthread_cond_t cond_;
+    uint32_t count_;
+};
+
+void* D3D9HL_CreateCounter(){
+    D3D9HL_PosixCounter* counter = static_cast<D3D9HL_PosixCounter*>(malloc(sizeof(D3D9HL_PosixCounter)));
+    if (counter == 0)
+        return 0;
+    if (pthread_mutex_init(&counter->mutex_, 0) != 0){
+        free(counter);
+        return 0;
+    }
+    if (pthread_cond_init(&counter->cond_, 0) != 0){
+        pthread_mutex_destroy(&counter->mutex_);
+        free(counter);
+        return 0;
+    }
+    counter->count_ = 0;
+    return counter;
+}
+
+void D3D9HL_DestroyCounter(void* handle){
+    if (handle == 0)
+        return;
+    D3D9HL_PosixCounter* counter = static_cast<D3D9HL_PosixCounter*>(handle);
+    pthread_cond_destroy(&counter->cond_);
+    pthread_mutex_destroy(&counter->mutex_);
+    free(counter);
+}
+
+void* D3D9HL_CreateSemaphore(){
+    return D3D9HL_CreateCounter();
+}
+
+void D3D9HL_DestroySemaphore(void* semaphore){
+    D3D9HL_DestroyCounter(semaphore);
+}
+
+void D3D9HL_PostSemaphore(void* semaphore, uint32_t count){
+    D3D9HL_PosixCounter* counter = static_cast<D3D9HL_PosixCounter*>(semaphore);
+    pthread_mutex_lock(&counter->mutex_);
+    counter->count_ += count;
+    if (count == 1)
+        pthread_cond_signal(&counter->cond_);
+    else
+        pthread_cond_broadcast(&counter->cond_);
+    pthread_mutex_unlock(&counter->mutex_);
+}
+
+void D3D9HL_WaitSemaphore(void* semaphore){
+    D3D9HL_PosixCounter* counter = static_cast<D3D9HL_PosixCounter*>(semaphore);
+    pthread_mutex_lock(&counter->mutex_);
+    while (counter->count_ == 0)
+        pthread_cond_wait(&counter->cond_, &counter->mutex_);
+    counter->count_--;
+    pthread_mutex_unlock(&counter->mutex_);
+}
+
+void* D3D9HL_CreateEvent(){
+    return D3D9HL_CreateCounter();
+}
+
+void D3D9HL_DestroyEvent(void* event){
+    D3D9HL_DestroyCounter(event);
+}
+
+/* Оповещение выполняется под мьютексом: ожидающий поток выходит из D3D9HL_WaitEvent(), только
+захватив мьютекс после того, как этот поток его отпустил, и может сразу уничтожить событие.
+*/
+void D3D9HL_SetEvent(void* event){
+    D3D9HL_PosixCounter* counter = static_cast<D3D9HL_PosixCounter*>(event);
+    pthread_mutex_lock(&counter->mutex_);
+    counter->count_ = 1;
+    pthread_cond_broadcast(&counter->cond_);
+    pthread_mutex_unlock(&counter->mutex_);
+}
+
+void D3D9HL_WaitEvent(void* event){
+    D3D9HL_PosixCounter* counter = static_cast<D3D9HL_PosixCounter*>(event);
+    pthread_mutex_lock(&counter->mutex_);
+    while (counter->count_ == 0)
+        pthread_cond_wait(&counter->cond_, &counter->mutex_);
+    pthread_mutex_unlock(&counter->mutex_);
+}
+} // end of z3D_priv
+
+#endif // _WIN32
@@ -0,0 +1,197 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация слоя платформы для Win32.
+*/
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "z3DD3D9HLPrivPlatform.h"
+
+namespace z3D_priv
+{
+// Описатели файла и отображения, закрываемые вместе с представлением
+struct D3D9HL_Win32Mapping{
+    HANDLE file_;
+    HANDLE mapping_;
+};
+
+bool D3D9HL_MapFile(D3D9HL_MappedFile* file, const char* path){
+    ZeroMemory(file, sizeof(D3D9HL_MappedFile));
+    // FILE_SHARE_DELETE позволяет другим потокам подменять файл, пока он отображен
+    HANDLE handle = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    DWORD fileSize = ::GetFileSize(handle, 0);
+    if (fileSize == 0 || fileSize == INVALID_FILE_SIZE){
+        ::CloseHandle(handle);
+        return false;
+    }
+    HANDLE mapping = ::CreateFileMappingA(handle, 0, PAGE_READONLY, 0, 0, 0);
+    if (mapping == 0){
+        ::CloseHandle(handle);
+        return false;
+    }
+    const void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    D3D9HL_Win32Mapping* impl = static_cast<D3D9HL_Win32Mapping*>(malloc(sizeof(D3D9HL_Win32Mapping)));
+    if (view == 0 || impl == 0){
+        if (view != 0)
+            ::UnmapViewOfFile(view);
+        free(impl);
+        ::CloseHandle(mapping);
+        ::CloseHandle(handle);
+        return false;
+    }
+    impl->file_ = handle;
+    impl->mapping_ = mapping;
+    file->data_ = view;
+    file->size_ = fileSize;
+    file->handle_ = impl;
+    return true;
+}
+
+void D3D9HL_UnmapFile(D3D9HL_MappedFile* file){
+    if (file->handle_ == 0)
+        return;
+    D3D9HL_Win32Mapping* impl = static_cast<D3D9HL_Win32Mapping*>(file->handle_);
+    ::UnmapViewOfFile(file->data_);
+    ::CloseHandle(impl->mapping_);
+    ::CloseHandle(impl->file_);
+    free(impl);
+    ZeroMemory(file, sizeof(D3D9HL_MappedFile));
+}
+
+bool D3D9HL_WriteFileAtomic(const char* path, const void* header, uint32_t headerSize, const void* data, uint32_t dataSize){
+    // идентификатор потока уникален в системе, поэтому временные файлы потоков и процессов не совпадают
+    char tempPath[MAX_PATH];
+    int len = snprintf(tempPath, MAX_PATH, "%s.%08lX.tmp", path, static_cast<unsigned long>(::GetCurrentThreadId()));
+    if (len < 0 || len >= MAX_PATH)
+        return false;
+    HANDLE file = ::CreateFileA(tempPath, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    DWORD written = 0;
+    bool fOk = ::WriteFile(file, header, headerSize, &written, 0) && written == headerSize;
+    fOk = fOk && ::WriteFile(file, data, dataSize, &written, 0) && written == dataSize;
+    fOk = fOk && ::FlushFileBuffers(file);
+    ::CloseHandle(file);
+    if (fOk)
+        fOk = (::MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE);
+    if (!fOk)
+        ::DeleteFileA(tempPath);
+    return fOk;
+}
+
+int32_t D3D9HL_AtomicAdd(volatile int32_t* value, int32_t add){
+    return static_cast<int32_t>(::InterlockedExchangeAdd(reinterpret_cast<volatile LONG*>(value), add)) + add;
+}
+
+int32_t D3D9HL_AtomicExchange(volatile int32_t* value, int32_t exchange){
+    return static_cast<int32_t>(::InterlockedExchange(reinterpret_cast<volatile LONG*>(value), exchange));
+}
+
+int32_t D3D9HL_AtomicCompareExchange(volatile int32_t* value, int32_t exchange, int32_t comparand){
+    return static_cast<int32_t>(::InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(value), exchange, comparand));
+}
+
+void D3D9HL_MemoryBarrier(){
+    ::MemoryBarrier();
+}
+
+void D3D9HL_SpinPause(){
+    ::YieldProcessor();
+}
+
+// Функция и параметр потока, передаваемые в D3D9HL_Win32ThreadProc
+struct D3D9HL_Win32ThreadStart{
+    D3D9HL_ThreadFunc func_;
+    void* param_;
+};
+
+DWORD WINAPI D3D9HL_Win32ThreadProc(LPVOID param){
+    D3D9HL_Win32ThreadStart start = *static_cast<D3D9HL_Win32ThreadStart*>(param);
+    free(param);
+    start.func_(start.param_);
+    return 0;
+}
+
+void* D3D9HL_CreateThread(D3D9HL_ThreadFunc func, void* param){
+    D3D9HL_Win32ThreadStart* start = static_cast<D3D9HL_Win32ThreadStart*>(malloc(sizeof(D3D9HL_Win32ThreadStart)));
+    if (start == 0)
+        return 0;
+    start->func_ = func;
+    start->param_ = param;
+    HANDLE thread = ::CreateThread(0, 0, D3D9HL_Win32ThreadProc, start, 0, 0);
+    if (thread == 0)
+        free(start);
+    return thread;
+}
+
+void D3D9HL_JoinThread(void* thread){
+    if (thread == 0)
+        return;
+    ::WaitForSingleObject(thread, INFINITE);
+    ::CloseHandle(thread);
+}
+
+void* D3D9HL_CreateMutex(){
+    CRITICAL_SECTION* lock = static_cast<CRITICAL_SECTION*>(malloc(sizeof(CRITICAL_SECTION)));
+    if (lock != 0)
+        ::InitializeCriticalSection(lock);
+    return lock;
+}
+
+void D3D9HL_DestroyMutex(void* mutex){
+    if (mutex == 0)
+        return;
+    ::DeleteCriticalSection(static_cast<CRITICAL_SECTION*>(mutex));
+    free(mutex);
+}
+
+void D3D9HL_LockMutex(void* mutex){
+    ::EnterCriticalSection(static_cast<CRITICAL_SECTION*>(mutex));
+}
+
+void D3D9HL_UnlockMutex(void* mutex){
+    ::LeaveCriticalSection(static_cast<CRITICAL_SECTION*>(mutex));
+}
+
+void* D3D9HL_CreateSemaphore(){
+    return ::CreateSemaphoreA(0, 0, 0x7FFFFFFF, 0);
+}
+
+void D3D9HL_DestroySemaphore(void* semaphore){
+    if (semaphore != 0)
+        ::CloseHandle(semaphore);
+}
+
+void D3D9HL_PostSemaphore(void* semaphore, uint32_t count){
+    ::ReleaseSemaphore(semaphore, static_cast<LONG>(count), 0);
+}
+
+void D3D9HL_WaitSemaphore(void* semaphore){
+    ::WaitForSingleObject(semaphore, INFINITE);
+}
+
+void* D3D9HL_CreateEvent(){
+    return ::CreateEventA(0, TRUE, FALSE, 0);
+}
+
+void D3D9HL_DestroyEvent(void* event){
+    if (event != 0)
+        ::CloseHandle(event);
+}
+
+void D3D9HL_SetEvent(void* event){
+    ::SetEvent(event);
+}
+
+void D3D9HL_WaitEvent(void* event){
+    ::WaitForSingleObject(event, INFINITE);
+}
+} // end of z3D_priv
+
+#endif // _WIN32
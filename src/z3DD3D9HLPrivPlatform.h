@@ -0,0 +1,85 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+#ifndef Z3DD3D9HL_PRIVPLATFORM_H
+#define Z3DD3D9HL_PRIVPLATFORM_H
+
+/* Тонкий слой платформы: файлы, потоки, атомарные операции и синхронизация. Через него работают
+все модули библиотеки, запускающие потоки или обменивающиеся данными между ними.
+
+Реализации - z3DD3D9HLPlatformWin32.cpp (_WIN32) и z3DD3D9HLPlatformPosix.cpp (остальные системы).
+Описатели непрозрачны; нулевой описатель означает, что объект не создан. Функции уничтожения
+принимают нулевой описатель.
+*/
+
+#include "z3DD3D9HLDef.h"
+
+namespace z3D_priv
+{
+
+/* Файл, отображенный в память только для чтения.
+*/
+struct D3D9HL_MappedFile{
+    const void* data_;              // содержимое файла
+    uint32_t size_;                 // размер файла в байтах
+    void* handle_;                  // данные реализации
+};
+
+/* Отобразить существующий файл в память. Пока файл отображен, его можно подменить
+функцией D3D9HL_WriteFileAtomic(): отображение продолжает видеть прежнее содержимое.
+*/
+bool D3D9HL_MapFile(D3D9HL_MappedFile* file, const char* path);
+
+void D3D9HL_UnmapFile(D3D9HL_MappedFile* file);
+
+/* Записать файл из двух частей во временный файл рядом с path и атомарно подменить им path.
+Одновременная запись одного пути из разных потоков или процессов идет в разные временные файлы.
+*/
+bool D3D9HL_WriteFileAtomic(const char* path, const void* header, uint32_t headerSize, const void* data, uint32_t dataSize);
+
+/* Атомарные операции. Возвращают новое значение (Add) или прежнее (Exchange, CompareExchange).
+Все являются полными барьерами памяти. CompareExchange записывает exchange, только если
+прежнее значение равно comparand.
+*/
+int32_t D3D9HL_AtomicAdd(volatile int32_t* value, int32_t add);
+int32_t D3D9HL_AtomicExchange(volatile int32_t* value, int32_t exchange);
+int32_t D3D9HL_AtomicCompareExchange(volatile int32_t* value, int32_t exchange, int32_t comparand);
+
+/* Полный барьер памяти.
+*/
+void D3D9HL_MemoryBarrier();
+
+/* Уступить процессор в цикле ожидания другого потока.
+*/
+void D3D9HL_SpinPause();
+
+typedef void (*D3D9HL_ThreadFunc)(void* param);
+
+void* D3D9HL_CreateThread(D3D9HL_ThreadFunc func, void* param);
+/* Дождаться завершения потока и закрыть его описатель.
+*/
+void D3D9HL_JoinThread(void* thread);
+
+void* D3D9HL_CreateMutex();
+void D3D9HL_DestroyMutex(void* mutex);
+void D3D9HL_LockMutex(void* mutex);
+void D3D9HL_UnlockMutex(void* mutex);
+
+/* Семафор со счетчиком, начальное значение - нуль.
+*/
+void* D3D9HL_CreateSemaphore();
+void D3D9HL_DestroySemaphore(void* semaphore);
+void D3D9HL_PostSemaphore(void* semaphore, uint32_t count);
+void D3D9HL_WaitSemaphore(void* semaphore);
+
+/* Событие с ручным сбросом: после D3D9HL_SetEvent() остается установленным, и
+D3D9HL_WaitEvent() возвращается сразу во всех ожидающих потоках. Событие можно уничтожить,
+как только D3D9HL_WaitEvent() вернулся.
+*/
+void* D3D9HL_CreateEvent();
+void D3D9HL_DestroyEvent(void* event);
+void D3D9HL_SetEvent(void* event);
+void D3D9HL_WaitEvent(void* event);
+
+} // end of z3D_priv
+#endif // Z3DD3D9HL_PRIVPLATFORM_H
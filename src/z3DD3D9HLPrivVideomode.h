@@ -4,7 +4,6 @@ It's licensed unser the MIT license (see "License.txt" for details).*/
 #ifndef Z3DD3D9HL_PRIVVIDEOMODE_H
 #define Z3DD3D9HL_PRIVVIDEOMODE_H
 
-#include <vector>
 #include <string>
 #include <algorithm>
 
@@ -94,14 +93,16 @@ R тип, описывающий частоту развертки. Целое 
  -  возвращения значения частоты развертки R RefreshRate().
 
 @param videoModes массив с видеорежимами, который нужно "проредить".
+@param numVideoModes число видеорежимов в массиве.
 @param refreshRate текущая или желаемая частота обновления экрана.
+@return число видеорежимов, оставшихся в начале массива.
 */
 template <typename V, typename R>
-void LeaveVideoModeWithClosestRefreshRates(std::vector<V>& videoModes, R refreshRate){
-
-    std::sort(videoModes.begin(), videoModes.end(), VideoModeSortPred<V, R>(refreshRate));
-    videoModes.erase(std::unique(videoModes.begin(), videoModes.end(), VideoModeUniqPred<V, R>(refreshRate)),
-                     videoModes.end());
+size_t LeaveVideoModeWithClosestRefreshRates(V* videoModes, size_t numVideoModes, R refreshRate){
+    if (numVideoModes == 0)
+        return 0;
+    std::sort(videoModes, videoModes + numVideoModes, VideoModeSortPred<V, R>(refreshRate));
+    return std::unique(videoModes, videoModes + numVideoModes, VideoModeUniqPred<V, R>(refreshRate)) - videoModes;
 }
 } // end of z3D_priv
 #endif // Z3DD3D9HL_PRIVVIDEOMODE_H
@@ -0,0 +1,294 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация пула временных поверхностей рендера и буферов глубины.
+*/
+
+#include "z3DD3D9HL.h"
+#include "z3DDebugSystem.h"
+
+namespace z3D_priv
+{
+uint32_t D3DFormat2Bpp( D3DFORMAT d3dfmt );
+
+bool D3D9HL_SameRTDesc(const z3DD3D9HL_RTDesc& d1, const z3DD3D9HL_RTDesc& d2){
+    return d1.width_ == d2.width_ &&
+           d1.height_ == d2.height_ &&
+           d1.format_ == d2.format_ &&
+           d1.multiSampleType_ == d2.multiSampleType_ &&
+           d1.multiSampleQuality_ == d2.multiSampleQuality_ &&
+           d1.fDepth_ == d2.fDepth_;
+}
+
+/* Оценить объем видеопамяти поверхности. Форматы, неизвестные D3DFormat2Bpp(), считаются 32-битными.
+*/
+uint32_t D3D9HL_RTBytes(const z3DD3D9HL_RTDesc& desc){
+    uint32_t bpp = D3DFormat2Bpp(desc.format_);
+    if (bpp == Z3D_D3D9HL_NOINDEX)
+        bpp = 32;
+    uint32_t numSamples = (desc.multiSampleType_ >= D3DMULTISAMPLE_2_SAMPLES) ? static_cast<uint32_t>(desc.multiSampleType_) : 1;
+    return desc.width_ * desc.height_ * (bpp / 8) * numSamples;
+}
+
+void D3D9HL_ReleasePooledSurface(z3DD3D9HL_PooledSurface& pooled){
+    if (pooled.surface_ != 0)
+        pooled.surface_->Release();
+    if (pooled.texture_ != 0)
+        pooled.texture_->Release();
+    pooled.surface_ = 0;
+    pooled.texture_ = 0;
+}
+
+/* Слушатель событий устройства: поверхности D3DPOOL_DEFAULT освобождаются перед Reset().
+*/
+void D3D9HL_RTPoolOnRelease(LPDIRECT3DDEVICE9 /*device*/, void* userData){
+    z3D::D3D9HL_RTPoolRelease(static_cast<z3DD3D9HL_RTPool*>(userData));
+}
+
+/* Взять параметры по умолчанию из заднего буфера первой цепочки обмена и текущего буфера глубины.
+В оконном режиме размеры заднего буфера задает окно, а не видеорежим. Если буфера глубины нет,
+формат глубины сбрасывается в D3DFMT_UNKNOWN.
+    @return false, если задний буфер недоступен.
+*/
+bool D3D9HL_RTPoolReadDeviceParams(z3DD3D9HL_RTPool* pool, LPDIRECT3DDEVICE9 device){
+    LPDIRECT3DSURFACE9 backBuffer = 0;
+    if (FAILED(device->GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, &backBuffer)))
+        return false;
+    D3DSURFACE_DESC desc;
+    HRESULT hr = backBuffer->GetDesc(&desc);
+    backBuffer->Release();
+    if (FAILED(hr))
+        return false;
+    pool->width_ = desc.Width;
+    pool->height_ = desc.Height;
+    pool->colorFmt_ = desc.Format;
+    pool->multiSampleType_ = desc.MultiSampleType;
+    pool->multiSampleQuality_ = desc.MultiSampleQuality;
+
+    pool->depthFmt_ = D3DFMT_UNKNOWN;
+    LPDIRECT3DSURFACE9 depthStencil = 0;
+    if (SUCCEEDED(device->GetDepthStencilSurface(&depthStencil))){
+        if (SUCCEEDED(depthStencil->GetDesc(&desc)))
+            pool->depthFmt_ = desc.Format;
+        depthStencil->Release();
+    }
+    return true;
+}
+
+/* Слушатель событий устройства: параметры по умолчанию берутся из нового заднего буфера и
+буфера глубины, поскольку Reset() мог сменить видеорежим, размер окна или формат глубины.
+*/
+void D3D9HL_RTPoolOnReset(LPDIRECT3DDEVICE9 device, void* userData){
+    D3D9HL_RTPoolReadDeviceParams(static_cast<z3DD3D9HL_RTPool*>(userData), device);
+}
+
+z3DD3D9HL_DeviceListener D3D9HL_RTPoolListener(z3DD3D9HL_RTPool* pool, LPDIRECT3DDEVICE9 device){
+    z3DD3D9HL_DeviceListener listener;
+    listener.onRelease_ = D3D9HL_RTPoolOnRelease;
+    listener.onReset_ = D3D9HL_RTPoolOnReset;
+    listener.onEndRender_ = 0;
+    listener.userData_ = pool;
+    listener.device_ = device;
+    return listener;
+}
+
+/* Создать объекты Direct3D9 поверхности пула.
+*/
+HRESULT D3D9HL_CreatePooledSurface(z3DD3D9HL_PooledSurface& pooled, LPDIRECT3DDEVICE9 device){
+    const z3DD3D9HL_RTDesc& desc = pooled.desc_;
+    pooled.surface_ = 0;
+    pooled.texture_ = 0;
+    if (desc.fDepth_){
+        // Содержимое временного буфера глубины не сохраняется между запросами
+        return device->CreateDepthStencilSurface(desc.width_, desc.height_, desc.format_,
+                                                 desc.multiSampleType_, desc.multiSampleQuality_,
+                                                 TRUE, &pooled.surface_, 0);
+    }
+    if (desc.multiSampleType_ != D3DMULTISAMPLE_NONE){
+        return device->CreateRenderTarget(desc.width_, desc.height_, desc.format_,
+                                          desc.multiSampleType_, desc.multiSampleQuality_,
+                                          FALSE, &pooled.surface_, 0);
+    }
+    HRESULT hr = device->CreateTexture(desc.width_, desc.height_, 1, D3DUSAGE_RENDERTARGET,
+                                       desc.format_, D3DPOOL_DEFAULT, &pooled.texture_, 0);
+    if (FAILED(hr))
+        return hr;
+    hr = pooled.texture_->GetSurfaceLevel(0, &pooled.surface_);
+    if (FAILED(hr)){
+        pooled.texture_->Release();
+        pooled.texture_ = 0;
+    }
+    return hr;
+}
+} // end of z3D_priv
+
+namespace z3D
+{
+
+z3DD3D9HL_ErrCodes D3D9HL_RTPoolInit(z3DD3D9HL_RTPool* pool,
+                                     LPDIRECT3DDEVICE9 device,
+                                     uint32_t maxIdleFrames){
+    Z3D_ASSERT_HIGH(pool != 0, "null passed", true);
+    if (pool == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT(device != 0, "null device passed", true);
+    if (device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    ZeroMemory(pool, sizeof(z3DD3D9HL_RTPool));
+    pool->maxIdleFrames_ = maxIdleFrames;
+    pool->depthFmt_ = D3DFMT_UNKNOWN;
+    bool fRead = z3D_priv::D3D9HL_RTPoolReadDeviceParams(pool, device);
+    Z3D_ERROR(Z3D_ERROR_PERMISSIBLE, !fRead, "back buffer is not available", false);
+    if (!fRead)
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    return D3D9HL_AddDeviceListener(z3D_priv::D3D9HL_RTPoolListener(pool, device));
+}
+
+void D3D9HL_RTPoolShutdown(z3DD3D9HL_RTPool* pool){
+    Z3D_ASSERT_HIGH(pool != 0, "null passed", true);
+    if (pool == 0)
+        return;
+    D3D9HL_RTPoolRelease(pool);
+    D3D9HL_RemoveDeviceListener(z3D_priv::D3D9HL_RTPoolListener(pool, 0));
+}
+
+void D3D9HL_RTPoolRelease(z3DD3D9HL_RTPool* pool){
+    Z3D_ASSERT_HIGH(pool != 0, "null passed", true);
+    if (pool == 0)
+        return;
+    for (uint32_t i = 0; i < pool->numSurfaces_; ++i)
+        z3D_priv::D3D9HL_ReleasePooledSurface(pool->surfaces_[i]);
+    pool->numSurfaces_ = 0;
+    pool->frameBytesUsed_ = 0;
+    pool->frameBytesRequested_ = 0;
+}
+
+void D3D9HL_RTPoolMakeDesc(z3DD3D9HL_RTDesc* desc, const z3DD3D9HL_RTPool* pool, bool fDepth, uint32_t divisor){
+    Z3D_ASSERT_HIGH(desc != 0 && pool != 0, "null passed", true);
+    Z3D_ASSERT_HIGH(divisor > 0, "zero divisor passed", true);
+    if (divisor == 0)
+        divisor = 1;
+    desc->width_ = (pool->width_ + divisor - 1) / divisor;
+    desc->height_ = (pool->height_ + divisor - 1) / divisor;
+    desc->format_ = fDepth ? pool->depthFmt_ : pool->colorFmt_;
+    desc->multiSampleType_ = pool->multiSampleType_;
+    desc->multiSampleQuality_ = pool->multiSampleQuality_;
+    desc->fDepth_ = fDepth;
+}
+
+void D3D9HL_RTPoolBeginFrame(z3DD3D9HL_RTPool* pool){
+    Z3D_ASSERT_HIGH(pool != 0, "null passed", true);
+    if (pool == 0)
+        return;
+    pool->frame_++;
+    pool->frameBytesRequested_ = 0;
+    pool->frameBytesUsed_ = 0;
+    uint32_t numKept = 0;
+    for (uint32_t i = 0; i < pool->numSurfaces_; ++i){
+        z3DD3D9HL_PooledSurface& pooled = pool->surfaces_[i];
+        if (pool->frame_ - pooled.lastUsedFrame_ > pool->maxIdleFrames_){
+            z3D_priv::D3D9HL_ReleasePooledSurface(pooled);
+            pool->numReleased_++;
+            continue;
+        }
+        pooled.numUses_ = 0;
+        if (numKept != i)
+            pool->surfaces_[numKept] = pooled;
+        numKept++;
+    }
+    pool->numSurfaces_ = numKept;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_RTPoolAcquire(LPDIRECT3DSURFACE9* surface,
+                                        LPDIRECT3DTEXTURE9* texture,
+                                        z3DD3D9HL_RTPool* pool,
+                                        LPDIRECT3DDEVICE9 device,
+                                        const z3DD3D9HL_RTDesc& desc,
+                                        uint32_t firstPass,
+                                        uint32_t lastPass){
+    Z3D_ASSERT_HIGH(surface != 0 && pool != 0, "null passed", true);
+    if (surface == 0 || pool == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT(device != 0, "null device passed", true);
+    if (device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(firstPass <= lastPass, "pass range is empty", true);
+    if (firstPass > lastPass)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    z3DD3D9HL_RTDesc key = desc;
+    if (key.width_ == 0)
+        key.width_ = pool->width_;
+    if (key.height_ == 0)
+        key.height_ = pool->height_;
+    if (key.format_ == D3DFMT_UNKNOWN)
+        key.format_ = key.fDepth_ ? pool->depthFmt_ : pool->colorFmt_;
+    Z3D_ASSERT_HIGH(key.format_ != D3DFMT_UNKNOWN, "device has no depth buffer, depth format must be set explicitly", true);
+    if (key.format_ == D3DFMT_UNKNOWN)
+        return Z3D_D3D9HL_INVALIDCALL;
+    uint32_t bytes = z3D_priv::D3D9HL_RTBytes(key);
+    pool->numAcquires_++;
+    pool->frameBytesRequested_ += bytes;
+
+    // Поверхность с тем же описанием, не занятая в запрошенных проходах
+    for (uint32_t i = 0; i < pool->numSurfaces_; ++i){
+        z3DD3D9HL_PooledSurface& pooled = pool->surfaces_[i];
+        if (!z3D_priv::D3D9HL_SameRTDesc(pooled.desc_, key) || pooled.numUses_ >= Z3D_D3D9HL_MAX_SURFACE_ALIASES)
+            continue;
+        bool fOverlap = false;
+        for (uint32_t iUse = 0; iUse < pooled.numUses_ && !fOverlap; ++iUse)
+            fOverlap = (firstPass <= pooled.lastPass_[iUse] && pooled.firstPass_[iUse] <= lastPass);
+        if (fOverlap)
+            continue;
+        if (pooled.numUses_ == 0)
+            pool->frameBytesUsed_ += pooled.bytes_;
+        pooled.firstPass_[pooled.numUses_] = firstPass;
+        pooled.lastPass_[pooled.numUses_] = lastPass;
+        pooled.numUses_++;
+        pooled.lastUsedFrame_ = pool->frame_;
+        pool->numCreationsAvoided_++;
+        *surface = pooled.surface_;
+        if (texture != 0)
+            *texture = pooled.texture_;
+        return Z3D_D3D9HL_NONE;
+    }
+
+    Z3D_ASSERT(pool->numSurfaces_ < Z3D_D3D9HL_MAX_POOLED_SURFACES, "render target pool is full", true);
+    if (pool->numSurfaces_ >= Z3D_D3D9HL_MAX_POOLED_SURFACES)
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    z3DD3D9HL_PooledSurface& pooled = pool->surfaces_[pool->numSurfaces_];
+    pooled.desc_ = key;
+    HRESULT hr = z3D_priv::D3D9HL_CreatePooledSurface(pooled, device);
+    if (FAILED(hr)){
+        Z3D_ERROR(Z3D_ERROR_PERMISSIBLE, FAILED(hr), "pooled surface creation failed", false);
+        return (hr == D3DERR_INVALIDCALL) ? Z3D_D3D9HL_INVALIDCALL : Z3D_D3D9HL_NOTAVAILABLE;
+    }
+    pooled.bytes_ = bytes;
+    pooled.lastUsedFrame_ = pool->frame_;
+    pooled.firstPass_[0] = firstPass;
+    pooled.lastPass_[0] = lastPass;
+    pooled.numUses_ = 1;
+    pool->numSurfaces_++;
+    pool->numCreated_++;
+    pool->frameBytesUsed_ += bytes;
+    *surface = pooled.surface_;
+    if (texture != 0)
+        *texture = pooled.texture_;
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_RTPoolGetStats(z3DD3D9HL_RTPoolStats* stats, const z3DD3D9HL_RTPool* pool){
+    Z3D_ASSERT_HIGH(stats != 0 && pool != 0, "null passed", true);
+    stats->numAcquires_ = pool->numAcquires_;
+    stats->numCreated_ = pool->numCreated_;
+    stats->numCreationsAvoided_ = pool->numCreationsAvoided_;
+    stats->numReleased_ = pool->numReleased_;
+    stats->numSurfaces_ = pool->numSurfaces_;
+    stats->bytesAllocated_ = 0;
+    for (uint32_t i = 0; i < pool->numSurfaces_; ++i)
+        stats->bytesAllocated_ += pool->surfaces_[i].bytes_;
+    stats->frameBytesRequested_ = pool->frameBytesRequested_;
+    stats->frameBytesSaved_ = pool->frameBytesRequested_ - pool->frameBytesUsed_;
+}
+
+} // end of z3D
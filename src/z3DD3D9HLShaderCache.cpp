@@ -0,0 +1,547 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация дискового кэша скомпилированных шейдеров.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "z3DD3D9HL.h"
+#include "z3DD3D9HLPrivPlatform.h"
+#include "z3DDebugSystem.h"
+
+namespace z3D_priv
+{
+uint64_t D3D9HL_GetTimeUs();
+
+// Заголовок файла записи кэша. За ним следует байт-код.
+struct D3D9HL_ShaderFileHeader{
+    uint32_t magic_;
+    uint32_t version_;
+    uint32_t keyLow_;
+    uint32_t keyHigh_;
+    uint32_t codeSize_;
+    uint32_t checksum_;             // FNV-1a байт-кода
+};
+
+static const uint32_t s_shaderFileMagic = 0x4353335A; // "Z3SC"
+static const uint32_t s_shaderFileVersion = 1;
+
+// Наибольшая глубина вложенности включаемых файлов при вычислении ключа
+static const uint32_t s_maxIncludeDepth = 16;
+
+/* Добавить байты к 64-битному хэшу FNV-1a.
+*/
+void D3D9HL_HashBytes(uint64_t& hash, const void* data, uint32_t size){
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (uint32_t i = 0; i < size; ++i){
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+void D3D9HL_HashUInt(uint64_t& hash, uint32_t value){
+    D3D9HL_HashBytes(hash, &value, sizeof(value));
+}
+
+/* Добавить к хэшу строку вместе с ее длиной, чтобы соседние строки не сливались.
+*/
+void D3D9HL_HashString(uint64_t& hash, const char* str){
+    uint32_t len = (str != 0) ? static_cast<uint32_t>(strlen(str)) : 0xFFFFFFFF;
+    D3D9HL_HashUInt(hash, len);
+    if (str != 0)
+        D3D9HL_HashBytes(hash, str, len);
+}
+
+uint32_t D3D9HL_Checksum(const void* data, uint32_t size){
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < size; ++i){
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Множество уже учтенных включаемых файлов
+struct D3D9HL_IncludeSet{
+    uint64_t names_[Z3D_D3D9HL_MAX_SHADER_INCLUDES];
+    uint32_t numNames_;
+};
+
+/* Добавить к хэшу тексты всех файлов, включаемых директивами #include, рекурсивно.
+
+    Условная компиляция не учитывается, поэтому в ключ могут попасть лишние файлы. Это приводит
+    лишь к лишним промахам при их изменении, но не к использованию устаревшего байт-кода.
+*/
+void D3D9HL_HashIncludes(uint64_t& hash,
+                         const char* text,
+                         uint32_t size,
+                         const z3DD3D9HL_ShaderIncludeHandler& include,
+                         D3D9HL_IncludeSet& visited,
+                         uint32_t depth){
+    uint32_t pos = 0;
+    while (pos < size){
+        // начало строки
+        while (pos < size && (text[pos] == ' ' || text[pos] == '\t'))
+            pos++;
+        bool fDirective = false;
+        if (pos < size && text[pos] == '#'){
+            pos++;
+            while (pos < size && (text[pos] == ' ' || text[pos] == '\t'))
+                pos++;
+            fDirective = (size - pos > 7 && strncmp(text + pos, "include", 7) == 0);
+        }
+        if (fDirective){
+            pos += 7;
+            while (pos < size && (text[pos] == ' ' || text[pos] == '\t'))
+                pos++;
+            char closing = 0;
+            if (pos < size && text[pos] == '"')
+                closing = '"';
+            else if (pos < size && text[pos] == '<')
+                closing = '>';
+            uint32_t nameStart = pos + 1;
+            uint32_t nameEnd = nameStart;
+            while (closing != 0 && nameEnd < size && text[nameEnd] != closing && text[nameEnd] != '\n')
+                nameEnd++;
+            if (closing != 0 && nameEnd < size && text[nameEnd] == closing && nameEnd - nameStart < Z3D_D3D9HL_MAX_SHADER_PATH){
+                char name[Z3D_D3D9HL_MAX_SHADER_PATH];
+                memcpy(name, text + nameStart, nameEnd - nameStart);
+                name[nameEnd - nameStart] = 0;
+                D3D9HL_HashString(hash, name);
+
+                uint64_t nameHash = 14695981039346656037ULL;
+                D3D9HL_HashString(nameHash, name);
+                bool fVisited = false;
+                for (uint32_t i = 0; i < visited.numNames_ && !fVisited; ++i)
+                    fVisited = (visited.names_[i] == nameHash);
+                if (!fVisited && visited.numNames_ < Z3D_D3D9HL_MAX_SHADER_INCLUDES && depth < s_maxIncludeDepth){
+                    visited.names_[visited.numNames_++] = nameHash;
+                    const void* data = 0;
+                    uint32_t dataSize = 0;
+                    if (include.open_(closing == '>', name, &data, &dataSize, include.userData_)){
+                        D3D9HL_HashUInt(hash, dataSize);
+                        D3D9HL_HashBytes(hash, data, dataSize);
+                        D3D9HL_HashIncludes(hash, static_cast<const char*>(data), dataSize, include, visited, depth + 1);
+                        if (include.close_ != 0)
+                            include.close_(data, include.userData_);
+                    }
+                    else
+                        D3D9HL_HashUInt(hash, 0xFFFFFFFF);
+                }
+            }
+        }
+        // следующая строка
+        while (pos < size && text[pos] != '\n')
+            pos++;
+        pos++;
+    }
+}
+
+/* Адаптер обработчика включаемых файлов для D3DX.
+*/
+class D3D9HL_D3DXInclude : public ID3DXInclude{
+public:
+    explicit D3D9HL_D3DXInclude(const z3DD3D9HL_ShaderIncludeHandler* include) : include_(include) {}
+
+    STDMETHOD(Open)(THIS_ D3DXINCLUDE_TYPE includeType, LPCSTR fileName, LPCVOID /*parentData*/, LPCVOID* data, UINT* bytes){
+        const void* includeData = 0;
+        uint32_t includeSize = 0;
+        if (!include_->open_(includeType == D3DXINC_SYSTEM, fileName, &includeData, &includeSize, include_->userData_))
+            return E_FAIL;
+        *data = includeData;
+        *bytes = includeSize;
+        return S_OK;
+    }
+
+    STDMETHOD(Close)(THIS_ LPCVOID data){
+        if (include_->close_ != 0)
+            include_->close_(data, include_->userData_);
+        return S_OK;
+    }
+
+private:
+    const z3DD3D9HL_ShaderIncludeHandler* include_;
+};
+
+/* Компилятор по умолчанию - D3DXCompileShader().
+*/
+bool D3D9HL_D3DXCompile(z3DD3D9HL_ShaderBlob* code,
+                        z3DD3D9HL_ShaderBlob* errors,
+                        const z3DD3D9HL_ShaderDesc* desc,
+                        const z3DD3D9HL_ShaderIncludeHandler* include,
+                        void* /*userData*/){
+    D3D9HL_D3DXInclude d3dxInclude(include);
+    LPD3DXBUFFER codeBuffer = 0;
+    LPD3DXBUFFER errorsBuffer = 0;
+    // z3DD3D9HL_ShaderDefine совпадает по раскладке с D3DXMACRO
+    HRESULT hr = D3DXCompileShader(desc->source_,
+                                   desc->sourceSize_,
+                                   reinterpret_cast<const D3DXMACRO*>(desc->defines_),
+                                   (include != 0) ? &d3dxInclude : 0,
+                                   desc->entry_,
+                                   desc->profile_,
+                                   desc->flags_,
+                                   &codeBuffer,
+                                   &errorsBuffer,
+                                   0);
+    if (errorsBuffer != 0){
+        errors->data_ = errorsBuffer->GetBufferPointer();
+        errors->size_ = static_cast<uint32_t>(errorsBuffer->GetBufferSize());
+        errors->handle_ = errorsBuffer;
+    }
+    if (FAILED(hr)){
+        if (codeBuffer != 0)
+            codeBuffer->Release();
+        return false;
+    }
+    code->data_ = codeBuffer->GetBufferPointer();
+    code->size_ = static_cast<uint32_t>(codeBuffer->GetBufferSize());
+    code->handle_ = codeBuffer;
+    return true;
+}
+
+void D3D9HL_D3DXReleaseBlob(z3DD3D9HL_ShaderBlob* blob, void* /*userData*/){
+    if (blob->handle_ != 0)
+        static_cast<LPD3DXBUFFER>(blob->handle_)->Release();
+}
+
+/* Путь к файлу записи. Прямая косая черта - разделитель и в Win32, и в POSIX.
+    @return false, если путь не помещается в буфер.
+*/
+bool D3D9HL_ShaderFilePath(char* path, const z3DD3D9HL_ShaderCache& cache, uint64_t key){
+    int len = snprintf(path, Z3D_D3D9HL_MAX_SHADER_PATH, "%s/%08X%08X.z3dsc", cache.dir_,
+                       static_cast<unsigned int>(key >> 32), static_cast<unsigned int>(key & 0xFFFFFFFF));
+    return len > 0 && len < Z3D_D3D9HL_MAX_SHADER_PATH;
+}
+
+/* Загрузить байт-код из файла записи, отобразив файл в память.
+*/
+bool D3D9HL_ShaderCacheLoad(const z3DD3D9HL_ShaderCache& cache, z3DD3D9HL_ShaderJob* job){
+    char path[Z3D_D3D9HL_MAX_SHADER_PATH];
+    if (!D3D9HL_ShaderFilePath(path, cache, job->key_))
+        return false;
+    D3D9HL_MappedFile file;
+    if (!D3D9HL_MapFile(&file, path))
+        return false;
+    if (file.size_ <= sizeof(D3D9HL_ShaderFileHeader)){
+        D3D9HL_UnmapFile(&file);
+        return false;
+    }
+    const D3D9HL_ShaderFileHeader* header = static_cast<const D3D9HL_ShaderFileHeader*>(file.data_);
+    const void* code = header + 1;
+    if (header->magic_ != s_shaderFileMagic ||
+        header->version_ != s_shaderFileVersion ||
+        header->keyLow_ != static_cast<uint32_t>(job->key_ & 0xFFFFFFFF) ||
+        header->keyHigh_ != static_cast<uint32_t>(job->key_ >> 32) ||
+        header->codeSize_ != file.size_ - sizeof(D3D9HL_ShaderFileHeader) ||
+        (header->codeSize_ & 3) != 0 ||
+        header->checksum_ != D3D9HL_Checksum(code, header->codeSize_)){
+        Z3D_INFO("shader cache entry is corrupted and will be rewritten");
+        D3D9HL_UnmapFile(&file);
+        return false;
+    }
+    job->view_ = file.data_;
+    job->viewSize_ = file.size_;
+    job->mapping_ = file.handle_;
+    job->code_ = static_cast<const DWORD*>(code);
+    job->codeSize_ = header->codeSize_;
+    job->fFromCache_ = true;
+    return true;
+}
+
+/* Сохранить байт-код в файл записи. Запись пишется во временный файл и затем подменяет прежнюю.
+Одинаковые шейдеры, скомпилированные одновременно, пишутся в разные временные файлы;
+какой из них подменит запись последним - неважно, их содержимое совпадает.
+*/
+bool D3D9HL_ShaderCacheStore(const z3DD3D9HL_ShaderCache& cache, uint64_t key, const void* code, uint32_t codeSize){
+    char path[Z3D_D3D9HL_MAX_SHADER_PATH];
+    if (!D3D9HL_ShaderFilePath(path, cache, key))
+        return false;
+    D3D9HL_ShaderFileHeader header;
+    header.magic_ = s_shaderFileMagic;
+    header.version_ = s_shaderFileVersion;
+    header.keyLow_ = static_cast<uint32_t>(key & 0xFFFFFFFF);
+    header.keyHigh_ = static_cast<uint32_t>(key >> 32);
+    header.codeSize_ = codeSize;
+    header.checksum_ = D3D9HL_Checksum(code, codeSize);
+    return D3D9HL_WriteFileAtomic(path, &header, sizeof(header), code, codeSize);
+}
+
+/* Выполнить задание: вычислить ключ, загрузить запись или скомпилировать шейдер и сохранить запись.
+*/
+void D3D9HL_ShaderCacheProcess(z3DD3D9HL_ShaderCache* cache, z3DD3D9HL_ShaderJob* job){
+    uint64_t startTime = D3D9HL_GetTimeUs();
+    z3D::D3D9HL_ShaderCacheComputeKey(&job->key_, cache, &job->desc_);
+    uint64_t hashTime = D3D9HL_GetTimeUs();
+    D3D9HL_AtomicAdd(&cache->hashTimeUs_, static_cast<int32_t>(hashTime - startTime));
+
+    if (D3D9HL_ShaderCacheLoad(*cache, job)){
+        D3D9HL_AtomicAdd(&cache->numHits_, 1);
+        D3D9HL_AtomicExchange(&job->state_, Z3D_D3D9HL_SHADERJOB_DONE);
+        return;
+    }
+
+    bool fCompiled = cache->compiler_.compile_(&job->codeBlob_,
+                                               &job->errorsBlob_,
+                                               &job->desc_,
+                                               cache->fInclude_ ? &cache->include_ : 0,
+                                               cache->compiler_.userData_);
+    D3D9HL_AtomicAdd(&cache->compileTimeUs_, static_cast<int32_t>(D3D9HL_GetTimeUs() - hashTime));
+    if (job->errorsBlob_.data_ != 0){
+        job->errors_ = static_cast<const char*>(job->errorsBlob_.data_);
+        job->errorsSize_ = job->errorsBlob_.size_;
+    }
+    if (!fCompiled || job->codeBlob_.data_ == 0 || job->codeBlob_.size_ == 0){
+        D3D9HL_AtomicAdd(&cache->numFailed_, 1);
+        D3D9HL_AtomicExchange(&job->state_, Z3D_D3D9HL_SHADERJOB_FAILED);
+        return;
+    }
+    job->code_ = static_cast<const DWORD*>(job->codeBlob_.data_);
+    job->codeSize_ = job->codeBlob_.size_;
+    D3D9HL_AtomicAdd(&cache->numCompiled_, 1);
+    if (!D3D9HL_ShaderCacheStore(*cache, job->key_, job->code_, job->codeSize_))
+        D3D9HL_AtomicAdd(&cache->numWriteFailures_, 1);
+    D3D9HL_AtomicExchange(&job->state_, Z3D_D3D9HL_SHADERJOB_DONE);
+}
+
+/* Поток компиляции. Каждое разрешение семафора соответствует одному заданию в очереди или,
+при остановке кэша, одному потоку, который должен завершиться. Очередь при остановке только
+убывает, поэтому все отправленные задания будут выполнены до выхода последнего потока.
+
+Событие задания устанавливается после записи состояния и больше не используется потоком,
+поэтому его можно уничтожить, дождавшись его.
+*/
+void D3D9HL_ShaderWorkerProc(void* param){
+    z3DD3D9HL_ShaderCache* cache = static_cast<z3DD3D9HL_ShaderCache*>(param);
+    for (;;){
+        D3D9HL_WaitSemaphore(cache->semaphore_);
+        D3D9HL_LockMutex(cache->lock_);
+        z3DD3D9HL_ShaderJob* job = cache->head_;
+        if (job != 0){
+            cache->head_ = job->next_;
+            if (cache->head_ == 0)
+                cache->tail_ = 0;
+        }
+        D3D9HL_UnlockMutex(cache->lock_);
+        if (job == 0)
+            break;
+        void* doneEvent = job->doneEvent_;
+        D3D9HL_ShaderCacheProcess(cache, job);
+        D3D9HL_SetEvent(doneEvent);
+    }
+}
+} // end of z3D_priv
+
+namespace z3D
+{
+
+z3DD3D9HL_ErrCodes D3D9HL_ShaderCacheInit(z3DD3D9HL_ShaderCache* cache,
+                                          const char* dir,
+                                          uint32_t numThreads,
+                                          const z3DD3D9HL_ShaderCompiler* compiler,
+                                          const z3DD3D9HL_ShaderIncludeHandler* include){
+    Z3D_ASSERT_HIGH(cache != 0 && dir != 0, "null passed", true);
+    if (cache == 0 || dir == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    // в каталоге остается место для имени файла записи ( @see D3D9HL_ShaderCacheStore )
+    Z3D_ASSERT_HIGH(strlen(dir) + 40 < Z3D_D3D9HL_MAX_SHADER_PATH, "shader cache directory path is too long", true);
+    if (strlen(dir) + 40 >= Z3D_D3D9HL_MAX_SHADER_PATH)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(numThreads <= Z3D_D3D9HL_MAX_SHADER_THREADS, "too many shader compilation threads", true);
+    if (numThreads > Z3D_D3D9HL_MAX_SHADER_THREADS)
+        numThreads = Z3D_D3D9HL_MAX_SHADER_THREADS;
+    Z3D_ASSERT_HIGH(compiler == 0 || (compiler->compile_ != 0 && compiler->release_ != 0), "incomplete shader compiler passed", true);
+    if (compiler != 0 && (compiler->compile_ == 0 || compiler->release_ == 0))
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(include == 0 || include->open_ != 0, "incomplete include handler passed", true);
+    if (include != 0 && include->open_ == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    ZeroMemory(cache, sizeof(z3DD3D9HL_ShaderCache));
+    strcpy(cache->dir_, dir);
+    if (compiler != 0)
+        cache->compiler_ = *compiler;
+    else{
+        cache->compiler_.compile_ = z3D_priv::D3D9HL_D3DXCompile;
+        cache->compiler_.release_ = z3D_priv::D3D9HL_D3DXReleaseBlob;
+        cache->compiler_.version_ = D3DX_SDK_VERSION;
+    }
+    if (include != 0){
+        cache->include_ = *include;
+        cache->fInclude_ = true;
+    }
+
+    if (numThreads > 0){
+        cache->lock_ = z3D_priv::D3D9HL_CreateMutex();
+        cache->semaphore_ = z3D_priv::D3D9HL_CreateSemaphore();
+        if (cache->lock_ == 0 || cache->semaphore_ == 0)
+            numThreads = 0;
+    }
+    // если потоки не создались, задания выполняются в вызывающем потоке
+    for (uint32_t iThread = 0; iThread < numThreads; ++iThread){
+        void* thread = z3D_priv::D3D9HL_CreateThread(z3D_priv::D3D9HL_ShaderWorkerProc, cache);
+        if (thread != 0)
+            cache->threads_[cache->numThreads_++] = thread;
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_ShaderCacheShutdown(z3DD3D9HL_ShaderCache* cache){
+    Z3D_ASSERT_HIGH(cache != 0, "null passed", true);
+    if (cache == 0)
+        return;
+    z3D_priv::D3D9HL_AtomicExchange(&cache->fShutdown_, 1);
+    if (cache->numThreads_ > 0){
+        z3D_priv::D3D9HL_PostSemaphore(cache->semaphore_, cache->numThreads_);
+        for (uint32_t iThread = 0; iThread < cache->numThreads_; ++iThread)
+            z3D_priv::D3D9HL_JoinThread(cache->threads_[iThread]);
+        cache->numThreads_ = 0;
+    }
+    z3D_priv::D3D9HL_DestroySemaphore(cache->semaphore_);
+    z3D_priv::D3D9HL_DestroyMutex(cache->lock_);
+    cache->semaphore_ = 0;
+    cache->lock_ = 0;
+}
+
+void D3D9HL_ShaderJobInit(z3DD3D9HL_ShaderJob* job,
+                          const char* source,
+                          uint32_t sourceSize,
+                          const z3DD3D9HL_ShaderDefine* defines,
+                          const char* entry,
+                          const char* profile,
+                          DWORD flags){
+    Z3D_ASSERT_HIGH(job != 0, "null passed", true);
+    ZeroMemory(job, sizeof(z3DD3D9HL_ShaderJob));
+    job->desc_.source_ = source;
+    job->desc_.sourceSize_ = sourceSize;
+    job->desc_.defines_ = defines;
+    job->desc_.entry_ = entry;
+    job->desc_.profile_ = profile;
+    job->desc_.flags_ = flags;
+    job->state_ = Z3D_D3D9HL_SHADERJOB_IDLE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_ShaderCacheSubmit(z3DD3D9HL_ShaderCache* cache, z3DD3D9HL_ShaderJob* job){
+    Z3D_ASSERT_HIGH(cache != 0 && job != 0, "null passed", true);
+    if (cache == 0 || job == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(job->desc_.source_ != 0 && job->desc_.entry_ != 0 && job->desc_.profile_ != 0, "incomplete shader description", true);
+    if (job->desc_.source_ == 0 || job->desc_.entry_ == 0 || job->desc_.profile_ == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(job->state_ == Z3D_D3D9HL_SHADERJOB_IDLE, "shader job is already submitted or was not released", true);
+    if (job->state_ != Z3D_D3D9HL_SHADERJOB_IDLE)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(cache->fShutdown_ == 0, "shader cache is shut down", true);
+    if (cache->fShutdown_ != 0)
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+
+    z3D_priv::D3D9HL_AtomicAdd(&cache->numRequests_, 1);
+    job->state_ = Z3D_D3D9HL_SHADERJOB_QUEUED;
+    job->next_ = 0;
+    // без события задание выполняется в вызывающем потоке и завершается до возврата
+    job->doneEvent_ = (cache->numThreads_ > 0) ? z3D_priv::D3D9HL_CreateEvent() : 0;
+    if (job->doneEvent_ == 0){
+        z3D_priv::D3D9HL_ShaderCacheProcess(cache, job);
+        return Z3D_D3D9HL_NONE;
+    }
+    z3D_priv::D3D9HL_LockMutex(cache->lock_);
+    if (cache->tail_ != 0)
+        cache->tail_->next_ = job;
+    else
+        cache->head_ = job;
+    cache->tail_ = job;
+    z3D_priv::D3D9HL_UnlockMutex(cache->lock_);
+    z3D_priv::D3D9HL_PostSemaphore(cache->semaphore_, 1);
+    return Z3D_D3D9HL_NONE;
+}
+
+bool D3D9HL_ShaderJobIsDone(const z3DD3D9HL_ShaderJob* job){
+    Z3D_ASSERT_HIGH(job != 0, "null passed", true);
+    int32_t state = job->state_;
+    return state == Z3D_D3D9HL_SHADERJOB_DONE || state == Z3D_D3D9HL_SHADERJOB_FAILED;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_ShaderCacheWait(z3DD3D9HL_ShaderCache* cache, z3DD3D9HL_ShaderJob* job){
+    Z3D_ASSERT_HIGH(cache != 0 && job != 0, "null passed", true);
+    if (cache == 0 || job == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(job->state_ != Z3D_D3D9HL_SHADERJOB_IDLE, "shader job is not submitted", true);
+    if (job->state_ == Z3D_D3D9HL_SHADERJOB_IDLE)
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+    // событие устанавливается после записи результата и служит барьером памяти
+    if (job->doneEvent_ != 0)
+        z3D_priv::D3D9HL_WaitEvent(job->doneEvent_);
+    return (job->state_ == Z3D_D3D9HL_SHADERJOB_DONE) ? Z3D_D3D9HL_NONE : Z3D_D3D9HL_NOTAVAILABLE;
+}
+
+void D3D9HL_ShaderCacheReleaseJob(z3DD3D9HL_ShaderCache* cache, z3DD3D9HL_ShaderJob* job){
+    Z3D_ASSERT_HIGH(cache != 0 && job != 0, "null passed", true);
+    if (cache == 0 || job == 0)
+        return;
+    Z3D_ASSERT_HIGH(job->state_ != Z3D_D3D9HL_SHADERJOB_QUEUED, "shader job is still running", true);
+    if (job->state_ == Z3D_D3D9HL_SHADERJOB_QUEUED)
+        return;
+    // состояние записывается до установки события: поток компиляции может еще держать событие
+    if (job->doneEvent_ != 0){
+        z3D_priv::D3D9HL_WaitEvent(job->doneEvent_);
+        z3D_priv::D3D9HL_DestroyEvent(job->doneEvent_);
+    }
+    if (job->view_ != 0){
+        z3D_priv::D3D9HL_MappedFile file;
+        file.data_ = job->view_;
+        file.size_ = job->viewSize_;
+        file.handle_ = job->mapping_;
+        z3D_priv::D3D9HL_UnmapFile(&file);
+    }
+    if (job->codeBlob_.handle_ != 0)
+        cache->compiler_.release_(&job->codeBlob_, cache->compiler_.userData_);
+    if (job->errorsBlob_.handle_ != 0)
+        cache->compiler_.release_(&job->errorsBlob_, cache->compiler_.userData_);
+    z3DD3D9HL_ShaderDesc desc = job->desc_;
+    ZeroMemory(job, sizeof(z3DD3D9HL_ShaderJob));
+    job->desc_ = desc;
+    job->state_ = Z3D_D3D9HL_SHADERJOB_IDLE;
+}
+
+void D3D9HL_ShaderCacheComputeKey(uint64_t* key, const z3DD3D9HL_ShaderCache* cache, const z3DD3D9HL_ShaderDesc* desc){
+    Z3D_ASSERT_HIGH(key != 0 && cache != 0 && desc != 0, "null passed", true);
+    uint64_t hash = 14695981039346656037ULL;
+    z3D_priv::D3D9HL_HashUInt(hash, z3D_priv::s_shaderFileVersion);
+    z3D_priv::D3D9HL_HashUInt(hash, cache->compiler_.version_);
+    z3D_priv::D3D9HL_HashUInt(hash, desc->sourceSize_);
+    z3D_priv::D3D9HL_HashBytes(hash, desc->source_, desc->sourceSize_);
+    if (cache->fInclude_){
+        z3D_priv::D3D9HL_IncludeSet visited;
+        visited.numNames_ = 0;
+        z3D_priv::D3D9HL_HashIncludes(hash, desc->source_, desc->sourceSize_, cache->include_, visited, 0);
+    }
+    uint32_t numDefines = 0;
+    if (desc->defines_ != 0){
+        for (const z3DD3D9HL_ShaderDefine* define = desc->defines_; define->name_ != 0; ++define){
+            z3D_priv::D3D9HL_HashString(hash, define->name_);
+            z3D_priv::D3D9HL_HashString(hash, define->definition_);
+            numDefines++;
+        }
+    }
+    z3D_priv::D3D9HL_HashUInt(hash, numDefines);
+    z3D_priv::D3D9HL_HashString(hash, desc->entry_);
+    z3D_priv::D3D9HL_HashString(hash, desc->profile_);
+    z3D_priv::D3D9HL_HashUInt(hash, static_cast<uint32_t>(desc->flags_));
+    *key = hash;
+}
+
+void D3D9HL_ShaderCacheGetStats(z3DD3D9HL_ShaderCacheStats* stats, const z3DD3D9HL_ShaderCache* cache){
+    Z3D_ASSERT_HIGH(stats != 0 && cache != 0, "null passed", true);
+    stats->numRequests_ = static_cast<uint32_t>(cache->numRequests_);
+    stats->numHits_ = static_cast<uint32_t>(cache->numHits_);
+    stats->numCompiled_ = static_cast<uint32_t>(cache->numCompiled_);
+    stats->numFailed_ = static_cast<uint32_t>(cache->numFailed_);
+    stats->numMisses_ = stats->numCompiled_ + stats->numFailed_;
+    stats->numWriteFailures_ = static_cast<uint32_t>(cache->numWriteFailures_);
+    stats->hashTimeUs_ = static_cast<uint32_t>(cache->hashTimeUs_);
+    stats->compileTimeUs_ = static_cast<uint32_t>(cache->compileTimeUs_);
+}
+
+} // end of z3D
@@ -0,0 +1,739 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация пакетного вывода спрайтов и текста.
+*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "z3DD3D9HL.h"
+#include "z3DDebugSystem.h"
+
+// Ключ упорядочивания спрайта
+struct z3DD3D9HL_SpriteKey{
+    uint32_t order_;                    // слой в старших 16 битах, 0 - непрозрачный спрайт, 1 - со смешиванием
+    z3DD3D9HL_SpriteBlend blend_;
+    LPDIRECT3DTEXTURE9 texture_;
+    uint32_t iSprite_;                  // номер спрайта в порядке добавления
+};
+
+// Символ раскладки текста
+struct z3DD3D9HL_LayoutGlyph{
+    float x_, y_;                       // левый верхний угол относительно начала текста
+    uint8_t ch_;
+};
+
+// Запись кэша раскладок текста
+struct z3DD3D9HL_TextLayout{
+    uint32_t hash_;
+    uint32_t atlasId_;                  // 0 - запись свободна
+    float maxWidth_;
+    uint32_t length_;                   // длина строки
+    char* text_;                        // копия строки, maxTextLength_ символов
+    z3DD3D9HL_LayoutGlyph* glyphs_;     // видимые символы, maxTextLength_ элементов
+    uint32_t numGlyphs_;
+    float width_, height_;
+    uint32_t lastUsedFrame_;
+};
+
+namespace z3D
+{
+namespace z3D_priv
+{
+bool D3D9HL_IsDeviceRenderBegun();
+
+// Число записей кэша раскладок, просматриваемых при поиске
+static const uint32_t s_layoutProbes = 4;
+
+// Последний выданный номер атласа
+static uint32_t s_lastAtlasId = 0;
+
+/* В слое сначала идут непрозрачные спрайты, упорядоченные по текстуре, затем спрайты со смешиванием
+в порядке добавления: результат смешивания зависит от порядка вывода.
+*/
+struct D3D9HL_SpriteKeyPred{
+    bool operator() (const z3DD3D9HL_SpriteKey& k1, const z3DD3D9HL_SpriteKey& k2) const{
+        if (k1.order_ != k2.order_)
+            return k1.order_ < k2.order_;
+        if (k1.blend_ == Z3D_D3D9HL_SPRITE_OPAQUE && k1.texture_ != k2.texture_)
+            return k1.texture_ < k2.texture_;
+        return k1.iSprite_ < k2.iSprite_;
+    }
+};
+
+/* Хэш FNV-1a строки и параметров раскладки.
+*/
+uint32_t D3D9HL_TextLayoutHash(const char* text, uint32_t length, uint32_t atlasId, float maxWidth){
+    uint32_t hash = 2166136261u;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text);
+    for (uint32_t i = 0; i < length; ++i){
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    uint32_t params[2] = { atlasId, 0 };
+    memcpy(&params[1], &maxWidth, sizeof(float));
+    bytes = reinterpret_cast<const uint8_t*>(params);
+    for (uint32_t i = 0; i < sizeof(params); ++i){
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Разложить строку на символы. Слово, выходящее за maxWidth, переносится на новую строку целиком,
+если оно в строке не первое.
+*/
+void D3D9HL_LayoutText(z3DD3D9HL_TextLayout* layout, const z3DD3D9HL_GlyphAtlas* atlas, const char* text, uint32_t length, float maxWidth){
+    float penX = 0.0f, penY = 0.0f, width = 0.0f;
+    uint32_t numGlyphs = 0;
+    uint32_t iLineStart = 0;            // первый символ раскладки в текущей строке
+    uint32_t iWordStart = 0;            // первый символ раскладки в текущем слове
+    float wordStartX = 0.0f;
+    for (uint32_t i = 0; i < length; ++i){
+        uint8_t ch = static_cast<uint8_t>(text[i]);
+        if (ch == '\n'){
+            width = std::max(width, penX);
+            penX = 0.0f;
+            penY += atlas->lineHeight_;
+            iLineStart = iWordStart = numGlyphs;
+            wordStartX = 0.0f;
+            continue;
+        }
+        const z3DD3D9HL_Glyph& glyph = atlas->glyphs_[ch];
+        if (ch == ' '){
+            penX += glyph.advance_;
+            iWordStart = numGlyphs;
+            wordStartX = penX;
+            continue;
+        }
+        if (maxWidth > 0.0f && penX + glyph.xOffset_ + glyph.width_ > maxWidth && iWordStart > iLineStart){
+            // Перенос слова: его символы сдвигаются в начало следующей строки
+            width = std::max(width, wordStartX);
+            for (uint32_t j = iWordStart; j < numGlyphs; ++j){
+                layout->glyphs_[j].x_ -= wordStartX;
+                layout->glyphs_[j].y_ += atlas->lineHeight_;
+            }
+            penX -= wordStartX;
+            penY += atlas->lineHeight_;
+            iLineStart = iWordStart;
+            wordStartX = 0.0f;
+        }
+        if (glyph.width_ > 0.0f && glyph.height_ > 0.0f){
+            z3DD3D9HL_LayoutGlyph& out = layout->glyphs_[numGlyphs++];
+            out.x_ = penX + glyph.xOffset_;
+            out.y_ = penY + glyph.yOffset_;
+            out.ch_ = ch;
+        }
+        penX += glyph.advance_;
+    }
+    layout->numGlyphs_ = numGlyphs;
+    layout->width_ = std::max(width, penX);
+    layout->height_ = penY + atlas->lineHeight_;
+}
+
+/* Найти раскладку строки в кэше или построить ее на месте самой давно использованной записи.
+*/
+const z3DD3D9HL_TextLayout* D3D9HL_GetTextLayout(z3DD3D9HL_SpriteBatch* batch,
+                                                 const z3DD3D9HL_GlyphAtlas* atlas,
+                                                 const char* text,
+                                                 float maxWidth){
+    uint32_t length = static_cast<uint32_t>(strlen(text));
+    Z3D_ASSERT_HIGH(length <= batch->maxTextLength_, "text is too long and will be truncated", true);
+    if (length > batch->maxTextLength_)
+        length = batch->maxTextLength_;
+    uint32_t hash = D3D9HL_TextLayoutHash(text, length, atlas->id_, maxWidth);
+    uint32_t mask = batch->numLayouts_ - 1;
+    z3DD3D9HL_TextLayout* victim = 0;
+    for (uint32_t iProbe = 0; iProbe < s_layoutProbes && iProbe < batch->numLayouts_; ++iProbe){
+        z3DD3D9HL_TextLayout& layout = batch->layouts_[(hash + iProbe) & mask];
+        if (layout.atlasId_ == atlas->id_ &&
+            layout.hash_ == hash &&
+            layout.maxWidth_ == maxWidth &&
+            layout.length_ == length &&
+            memcmp(layout.text_, text, length) == 0){
+            layout.lastUsedFrame_ = batch->frame_;
+            batch->frameStats_.numLayoutHits_++;
+            return &layout;
+        }
+        if (victim == 0 || (layout.atlasId_ == 0 && victim->atlasId_ != 0) ||
+            (victim->atlasId_ != 0 && layout.lastUsedFrame_ < victim->lastUsedFrame_))
+            victim = &layout;
+    }
+    victim->hash_ = hash;
+    victim->atlasId_ = atlas->id_;
+    victim->maxWidth_ = maxWidth;
+    victim->length_ = length;
+    memcpy(victim->text_, text, length);
+    victim->lastUsedFrame_ = batch->frame_;
+    D3D9HL_LayoutText(victim, atlas, text, length, maxWidth);
+    batch->frameStats_.numLayoutMisses_++;
+    return victim;
+}
+
+/* Добавить четырехугольник. При переполнении накопленные спрайты выводятся.
+*/
+z3DD3D9HL_ErrCodes D3D9HL_AddSprite(z3DD3D9HL_SpriteBatch* batch,
+                                    LPDIRECT3DTEXTURE9 texture,
+                                    float x0, float y0, float x1, float y1,
+                                    float u0, float v0, float u1, float v1,
+                                    D3DCOLOR color,
+                                    z3DD3D9HL_SpriteBlend blend,
+                                    uint32_t layer){
+    if (!D3D9HL_IsDeviceRenderBegun()){
+        batch->frameStats_.numDropped_++;
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+    }
+    if (batch->numSprites_ == batch->maxSprites_){
+        z3DD3D9HL_ErrCodes err = D3D9HL_SpriteFlush(batch);
+        if (err != Z3D_D3D9HL_NONE)
+            return err;
+    }
+    uint32_t iSprite = batch->numSprites_++;
+    z3DD3D9HL_SpriteKey& key = batch->keys_[iSprite];
+    key.order_ = (layer << 16) | ((blend == Z3D_D3D9HL_SPRITE_OPAQUE) ? 0 : 1);
+    key.blend_ = blend;
+    key.texture_ = texture;
+    key.iSprite_ = iSprite;
+
+    // Смещение на полпикселя совмещает центры текселей с центрами пикселей
+    x0 -= 0.5f; y0 -= 0.5f;
+    x1 -= 0.5f; y1 -= 0.5f;
+    z3DD3D9HL_SpriteVertex* v = batch->vertices_ + iSprite * 4;
+    v[0].x_ = x0; v[0].y_ = y0; v[0].u_ = u0; v[0].v_ = v0;
+    v[1].x_ = x1; v[1].y_ = y0; v[1].u_ = u1; v[1].v_ = v0;
+    v[2].x_ = x1; v[2].y_ = y1; v[2].u_ = u1; v[2].v_ = v1;
+    v[3].x_ = x0; v[3].y_ = y1; v[3].u_ = u0; v[3].v_ = v1;
+    for (uint32_t i = 0; i < 4; ++i){
+        v[i].z_ = 0.0f;
+        v[i].rhw_ = 1.0f;
+        v[i].color_ = color;
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_SetSpriteBlend(LPDIRECT3DDEVICE9 device, z3DD3D9HL_SpriteBlend blend){
+    switch (blend){
+    case Z3D_D3D9HL_SPRITE_OPAQUE:
+        device->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+        break;
+    case Z3D_D3D9HL_SPRITE_ALPHA:
+        device->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+        device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+        device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+        break;
+    case Z3D_D3D9HL_SPRITE_ADDITIVE:
+        device->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+        device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+        device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_ONE);
+        break;
+    case Z3D_D3D9HL_SPRITE_PREMULTIPLIED:
+        device->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+        device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_ONE);
+        device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+        break;
+    }
+}
+
+/* Установить текстуру. Без текстуры цвет берется только из вершин.
+*/
+void D3D9HL_SetSpriteTexture(LPDIRECT3DDEVICE9 device, LPDIRECT3DTEXTURE9 texture){
+    device->SetTexture(0, texture);
+    DWORD op = (texture != 0) ? D3DTOP_MODULATE : D3DTOP_SELECTARG2;
+    device->SetTextureStageState(0, D3DTSS_COLOROP, op);
+    device->SetTextureStageState(0, D3DTSS_ALPHAOP, op);
+}
+
+void D3D9HL_SetSpriteStates(LPDIRECT3DDEVICE9 device, z3DD3D9HL_SpriteBatch* batch){
+    device->SetVertexShader(0);
+    device->SetPixelShader(0);
+    device->SetFVF(Z3D_D3D9HL_SPRITE_FVF);
+    device->SetStreamSource(0, batch->vertexBuffer_, 0, sizeof(z3DD3D9HL_SpriteVertex));
+    device->SetIndices(batch->indexBuffer_);
+    device->SetRenderState(D3DRS_ZENABLE, FALSE);
+    device->SetRenderState(D3DRS_ZWRITEENABLE, FALSE);
+    device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+    device->SetRenderState(D3DRS_LIGHTING, FALSE);
+    device->SetRenderState(D3DRS_FOGENABLE, FALSE);
+    device->SetRenderState(D3DRS_ALPHATESTENABLE, FALSE);
+    device->SetRenderState(D3DRS_STENCILENABLE, FALSE);
+    device->SetTextureStageState(0, D3DTSS_COLORARG1, D3DTA_TEXTURE);
+    device->SetTextureStageState(0, D3DTSS_COLORARG2, D3DTA_DIFFUSE);
+    device->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+    device->SetTextureStageState(0, D3DTSS_ALPHAARG2, D3DTA_DIFFUSE);
+    device->SetTextureStageState(1, D3DTSS_COLOROP, D3DTOP_DISABLE);
+    device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+    device->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+    device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_NONE);
+}
+
+/* Создать буфер индексов: четырехугольники из двух треугольников с общими вершинами.
+*/
+bool D3D9HL_CreateSpriteIndexBuffer(z3DD3D9HL_SpriteBatch* batch, LPDIRECT3DDEVICE9 device){
+    uint32_t numIndices = batch->bufferSprites_ * 6;
+    HRESULT hr = device->CreateIndexBuffer(numIndices * sizeof(uint16_t), D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+                                           D3DPOOL_MANAGED, &batch->indexBuffer_, 0);
+    if (FAILED(hr)){
+        batch->indexBuffer_ = 0;
+        return false;
+    }
+    void* data = 0;
+    hr = batch->indexBuffer_->Lock(0, 0, &data, 0);
+    if (FAILED(hr)){
+        batch->indexBuffer_->Release();
+        batch->indexBuffer_ = 0;
+        return false;
+    }
+    uint16_t* indices = static_cast<uint16_t*>(data);
+    for (uint32_t i = 0; i < batch->bufferSprites_; ++i){
+        uint16_t v = static_cast<uint16_t>(i * 4);
+        indices[0] = v;
+        indices[1] = static_cast<uint16_t>(v + 1);
+        indices[2] = static_cast<uint16_t>(v + 2);
+        indices[3] = v;
+        indices[4] = static_cast<uint16_t>(v + 2);
+        indices[5] = static_cast<uint16_t>(v + 3);
+        indices += 6;
+    }
+    batch->indexBuffer_->Unlock();
+    return true;
+}
+
+bool D3D9HL_CreateSpriteVertexBuffer(z3DD3D9HL_SpriteBatch* batch, LPDIRECT3DDEVICE9 device){
+    HRESULT hr = device->CreateVertexBuffer(batch->bufferSprites_ * 4 * sizeof(z3DD3D9HL_SpriteVertex),
+                                            D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, Z3D_D3D9HL_SPRITE_FVF,
+                                            D3DPOOL_DEFAULT, &batch->vertexBuffer_, 0);
+    batch->bufferOffset_ = 0;
+    if (FAILED(hr)){
+        batch->vertexBuffer_ = 0;
+        return false;
+    }
+    return true;
+}
+
+void D3D9HL_ReleaseSpriteBuffers(z3DD3D9HL_SpriteBatch* batch, bool fIndexBuffer){
+    if (batch->vertexBuffer_ != 0)
+        batch->vertexBuffer_->Release();
+    batch->vertexBuffer_ = 0;
+    batch->bufferOffset_ = 0;
+    if (fIndexBuffer){
+        if (batch->indexBuffer_ != 0)
+            batch->indexBuffer_->Release();
+        batch->indexBuffer_ = 0;
+    }
+}
+
+/* Слушатель событий устройства: буфер вершин D3DPOOL_DEFAULT освобождается перед Reset(),
+накопленные спрайты отбрасываются.
+*/
+void D3D9HL_SpriteBatchOnRelease(LPDIRECT3DDEVICE9 /*device*/, void* userData){
+    z3DD3D9HL_SpriteBatch* batch = static_cast<z3DD3D9HL_SpriteBatch*>(userData);
+    batch->frameStats_.numDropped_ += batch->numSprites_;
+    batch->numSprites_ = 0;
+    D3D9HL_ReleaseSpriteBuffers(batch, false);
+}
+
+/* Слушатель событий устройства: буфер индексов D3DPOOL_MANAGED создается заново только для нового устройства.
+*/
+void D3D9HL_SpriteBatchOnReset(LPDIRECT3DDEVICE9 device, void* userData){
+    z3DD3D9HL_SpriteBatch* batch = static_cast<z3DD3D9HL_SpriteBatch*>(userData);
+    if (device != batch->device_ || batch->indexBuffer_ == 0){
+        D3D9HL_ReleaseSpriteBuffers(batch, true);
+        batch->device_ = device;
+        D3D9HL_CreateSpriteIndexBuffer(batch, device);
+    }
+    if (batch->vertexBuffer_ == 0)
+        D3D9HL_CreateSpriteVertexBuffer(batch, device);
+}
+
+/* Слушатель событий устройства: вывод накопленных спрайтов перед EndScene() и завершение кадра.
+*/
+void D3D9HL_SpriteBatchOnEndRender(LPDIRECT3DDEVICE9 /*device*/, void* userData){
+    z3DD3D9HL_SpriteBatch* batch = static_cast<z3DD3D9HL_SpriteBatch*>(userData);
+    D3D9HL_SpriteFlush(batch);
+    batch->lastFrameStats_ = batch->frameStats_;
+    ZeroMemory(&batch->frameStats_, sizeof(z3DD3D9HL_SpriteStats));
+    batch->frame_++;
+}
+
+z3DD3D9HL_DeviceListener D3D9HL_SpriteBatchListener(z3DD3D9HL_SpriteBatch* batch){
+    z3DD3D9HL_DeviceListener listener;
+    listener.onRelease_ = D3D9HL_SpriteBatchOnRelease;
+    listener.onReset_ = D3D9HL_SpriteBatchOnReset;
+    listener.onEndRender_ = D3D9HL_SpriteBatchOnEndRender;
+    listener.userData_ = batch;
+    listener.device_ = batch->device_;
+    return listener;
+}
+} // end of z3D_priv
+
+z3DD3D9HL_ErrCodes D3D9HL_SpriteBatchInit(z3DD3D9HL_SpriteBatch* batch,
+                                          z3DD3D9HL_Arena* arena,
+                                          LPDIRECT3DDEVICE9 device,
+                                          uint32_t maxSprites,
+                                          uint32_t numLayouts,
+                                          uint32_t maxTextLength){
+    Z3D_ASSERT_HIGH(batch != 0 && arena != 0, "null passed", true);
+    if (batch == 0 || arena == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(device != 0, "null device passed", true);
+    if (device == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(maxSprites > 0 && numLayouts > 0 && numLayouts <= 0x80000000 && maxTextLength > 0,
+                    "unacceptable sprite batch capacity", true);
+    if (maxSprites == 0 || numLayouts == 0 || numLayouts > 0x80000000 || maxTextLength == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    uint32_t pow2Layouts = 1;
+    while (pow2Layouts < numLayouts)
+        pow2Layouts <<= 1;
+
+    ZeroMemory(batch, sizeof(z3DD3D9HL_SpriteBatch));
+    size_t marker = D3D9HL_ArenaGetMarker(arena);
+    batch->vertices_ = static_cast<z3DD3D9HL_SpriteVertex*>(
+        D3D9HL_ArenaAlloc(arena, sizeof(z3DD3D9HL_SpriteVertex) * 4 * maxSprites));
+    batch->keys_ = static_cast<z3DD3D9HL_SpriteKey*>(D3D9HL_ArenaAlloc(arena, sizeof(z3DD3D9HL_SpriteKey) * maxSprites));
+    batch->layouts_ = static_cast<z3DD3D9HL_TextLayout*>(D3D9HL_ArenaAlloc(arena, sizeof(z3DD3D9HL_TextLayout) * pow2Layouts));
+    char* text = static_cast<char*>(D3D9HL_ArenaAlloc(arena, maxTextLength * pow2Layouts));
+    z3DD3D9HL_LayoutGlyph* glyphs = static_cast<z3DD3D9HL_LayoutGlyph*>(
+        D3D9HL_ArenaAlloc(arena, sizeof(z3DD3D9HL_LayoutGlyph) * maxTextLength * pow2Layouts));
+    if (batch->vertices_ == 0 || batch->keys_ == 0 || batch->layouts_ == 0 || text == 0 || glyphs == 0){
+        D3D9HL_ArenaRewind(arena, marker);
+        ZeroMemory(batch, sizeof(z3DD3D9HL_SpriteBatch));
+        return Z3D_D3D9HL_OUTOFMEMORY;
+    }
+    ZeroMemory(batch->layouts_, sizeof(z3DD3D9HL_TextLayout) * pow2Layouts);
+    for (uint32_t i = 0; i < pow2Layouts; ++i){
+        batch->layouts_[i].text_ = text + i * maxTextLength;
+        batch->layouts_[i].glyphs_ = glyphs + i * maxTextLength;
+    }
+    batch->maxSprites_ = maxSprites;
+    batch->numLayouts_ = pow2Layouts;
+    batch->maxTextLength_ = maxTextLength;
+    batch->bufferSprites_ = std::min(maxSprites, static_cast<uint32_t>(Z3D_D3D9HL_MAX_SPRITES_PER_BUFFER));
+    batch->device_ = device;
+    if (!z3D_priv::D3D9HL_CreateSpriteIndexBuffer(batch, device) ||
+        !z3D_priv::D3D9HL_CreateSpriteVertexBuffer(batch, device)){
+        z3D_priv::D3D9HL_ReleaseSpriteBuffers(batch, true);
+        D3D9HL_ArenaRewind(arena, marker);
+        ZeroMemory(batch, sizeof(z3DD3D9HL_SpriteBatch));
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    }
+    z3DD3D9HL_ErrCodes err = D3D9HL_AddDeviceListener(z3D_priv::D3D9HL_SpriteBatchListener(batch));
+    if (err != Z3D_D3D9HL_NONE){
+        z3D_priv::D3D9HL_ReleaseSpriteBuffers(batch, true);
+        D3D9HL_ArenaRewind(arena, marker);
+        ZeroMemory(batch, sizeof(z3DD3D9HL_SpriteBatch));
+        return err;
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_SpriteBatchShutdown(z3DD3D9HL_SpriteBatch* batch){
+    Z3D_ASSERT_HIGH(batch != 0, "null passed", true);
+    if (batch == 0)
+        return;
+    D3D9HL_RemoveDeviceListener(z3D_priv::D3D9HL_SpriteBatchListener(batch));
+    z3D_priv::D3D9HL_ReleaseSpriteBuffers(batch, true);
+    batch->numSprites_ = 0;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_SpriteDraw(z3DD3D9HL_SpriteBatch* batch,
+                                     LPDIRECT3DTEXTURE9 texture,
+                                     float x,
+                                     float y,
+                                     float width,
+                                     float height,
+                                     D3DCOLOR color,
+                                     const float* uvRect,
+                                     z3DD3D9HL_SpriteBlend blend,
+                                     uint32_t layer){
+    Z3D_ASSERT_HIGH(batch != 0 && batch->maxSprites_ > 0, "sprite batch is not initialized", true);
+    Z3D_ASSERT_HIGH(layer <= 0xFFFF, "sprite layer out of range", true);
+    static const float s_fullRect[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+    if (uvRect == 0)
+        uvRect = s_fullRect;
+    return z3D_priv::D3D9HL_AddSprite(batch, texture, x, y, x + width, y + height,
+                                      uvRect[0], uvRect[1], uvRect[2], uvRect[3], color, blend, layer & 0xFFFF);
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_SpriteDrawText(z3DD3D9HL_SpriteBatch* batch,
+                                         const z3DD3D9HL_GlyphAtlas* atlas,
+                                         const char* text,
+                                         float x,
+                                         float y,
+                                         D3DCOLOR color,
+                                         float maxWidth,
+                                         uint32_t layer){
+    Z3D_ASSERT_HIGH(batch != 0 && batch->maxSprites_ > 0, "sprite batch is not initialized", true);
+    Z3D_ASSERT_HIGH(atlas != 0 && atlas->id_ != 0 && text != 0, "null passed", true);
+    if (atlas == 0 || atlas->id_ == 0 || text == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(layer <= 0xFFFF, "sprite layer out of range", true);
+    if (!z3D_priv::D3D9HL_IsDeviceRenderBegun()){
+        batch->frameStats_.numDropped_++;
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+    }
+    const z3DD3D9HL_TextLayout* layout = z3D_priv::D3D9HL_GetTextLayout(batch, atlas, text, maxWidth);
+    for (uint32_t i = 0; i < layout->numGlyphs_; ++i){
+        const z3DD3D9HL_LayoutGlyph& placed = layout->glyphs_[i];
+        const z3DD3D9HL_Glyph& glyph = atlas->glyphs_[placed.ch_];
+        float x0 = x + placed.x_, y0 = y + placed.y_;
+        z3DD3D9HL_ErrCodes err = z3D_priv::D3D9HL_AddSprite(batch, atlas->texture_, x0, y0, x0 + glyph.width_, y0 + glyph.height_,
+                                                            glyph.u0_, glyph.v0_, glyph.u1_, glyph.v1_,
+                                                            color, Z3D_D3D9HL_SPRITE_ALPHA, layer & 0xFFFF);
+        if (err != Z3D_D3D9HL_NONE)
+            return err;
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_SpriteMeasureText(float* width,
+                              float* height,
+                              z3DD3D9HL_SpriteBatch* batch,
+                              const z3DD3D9HL_GlyphAtlas* atlas,
+                              const char* text,
+                              float maxWidth){
+    Z3D_ASSERT_HIGH(width != 0 && height != 0, "null passed", true);
+    Z3D_ASSERT_HIGH(batch != 0 && batch->maxSprites_ > 0, "sprite batch is not initialized", true);
+    Z3D_ASSERT_HIGH(atlas != 0 && atlas->id_ != 0 && text != 0, "null passed", true);
+    const z3DD3D9HL_TextLayout* layout = z3D_priv::D3D9HL_GetTextLayout(batch, atlas, text, maxWidth);
+    *width = layout->width_;
+    *height = layout->height_;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_SpriteFlush(z3DD3D9HL_SpriteBatch* batch){
+    Z3D_ASSERT_HIGH(batch != 0 && batch->maxSprites_ > 0, "sprite batch is not initialized", true);
+    uint32_t numSprites = batch->numSprites_;
+    if (numSprites == 0)
+        return Z3D_D3D9HL_NONE;
+    batch->numSprites_ = 0;
+    if (!z3D_priv::D3D9HL_IsDeviceRenderBegun()){
+        batch->frameStats_.numDropped_ += numSprites;
+        return Z3D_D3D9HL_NO_PRELIMINARY_DONE;
+    }
+    if (batch->vertexBuffer_ == 0 || batch->indexBuffer_ == 0){
+        batch->frameStats_.numDropped_ += numSprites;
+        return Z3D_D3D9HL_DEVICE_LOST;
+    }
+
+    LPDIRECT3DDEVICE9 device = batch->device_;
+    std::sort(batch->keys_, batch->keys_ + numSprites, z3D_priv::D3D9HL_SpriteKeyPred());
+    z3D_priv::D3D9HL_SetSpriteStates(device, batch);
+    batch->frameStats_.numFlushes_++;
+
+    bool fFirst = true;
+    z3DD3D9HL_SpriteBlend blend = Z3D_D3D9HL_SPRITE_OPAQUE;
+    LPDIRECT3DTEXTURE9 texture = 0;
+    for (uint32_t iFirst = 0; iFirst < numSprites; ){
+        // Порция спрайтов, умещающаяся в буфере вершин. Занятая часть буфера не перезаписывается,
+        // пока он не заполнится до конца: тогда драйвер выделяет новую память по D3DLOCK_DISCARD
+        uint32_t n = std::min(numSprites - iFirst, batch->bufferSprites_);
+        DWORD lockFlags = D3DLOCK_NOOVERWRITE;
+        if (batch->bufferOffset_ + n > batch->bufferSprites_){
+            batch->bufferOffset_ = 0;
+            lockFlags = D3DLOCK_DISCARD;
+            batch->frameStats_.numDiscards_++;
+        }
+        const UINT spriteSize = 4 * sizeof(z3DD3D9HL_SpriteVertex);
+        void* data = 0;
+        HRESULT hr = batch->vertexBuffer_->Lock(batch->bufferOffset_ * spriteSize, n * spriteSize, &data, lockFlags);
+        if (FAILED(hr)){
+            batch->frameStats_.numDropped_ += numSprites - iFirst;
+            return Z3D_D3D9HL_INVALIDCALL;
+        }
+        z3DD3D9HL_SpriteVertex* dest = static_cast<z3DD3D9HL_SpriteVertex*>(data);
+        for (uint32_t i = 0; i < n; ++i)
+            memcpy(dest + i * 4, batch->vertices_ + batch->keys_[iFirst + i].iSprite_ * 4, spriteSize);
+        batch->vertexBuffer_->Unlock();
+
+        // Группы подряд идущих спрайтов с одинаковыми состояниями выводятся одним вызовом
+        for (uint32_t iRun = 0; iRun < n; ){
+            const z3DD3D9HL_SpriteKey& key = batch->keys_[iFirst + iRun];
+            z3DD3D9HL_SpriteBlend runBlend = key.blend_;
+            uint32_t runLength = 1;
+            while (iRun + runLength < n){
+                const z3DD3D9HL_SpriteKey& next = batch->keys_[iFirst + iRun + runLength];
+                if (next.blend_ != key.blend_ || next.texture_ != key.texture_)
+                    break;
+                runLength++;
+            }
+            if (fFirst || runBlend != blend){
+                z3D_priv::D3D9HL_SetSpriteBlend(device, runBlend);
+                blend = runBlend;
+            }
+            if (fFirst || key.texture_ != texture){
+                z3D_priv::D3D9HL_SetSpriteTexture(device, key.texture_);
+                texture = key.texture_;
+            }
+            fFirst = false;
+            device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST,
+                                         static_cast<INT>((batch->bufferOffset_ + iRun) * 4),
+                                         0,
+                                         runLength * 4,
+                                         0,
+                                         runLength * 2);
+            batch->frameStats_.numDrawCalls_++;
+            iRun += runLength;
+        }
+        batch->bufferOffset_ += n;
+        batch->frameStats_.numSprites_ += n;
+        iFirst += n;
+    }
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_SpriteBatchGetStats(z3DD3D9HL_SpriteStats* stats, const z3DD3D9HL_SpriteBatch* batch){
+    Z3D_ASSERT_HIGH(stats != 0 && batch != 0, "null passed", true);
+    *stats = batch->lastFrameStats_;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_GlyphAtlasInit(z3DD3D9HL_GlyphAtlas* atlas,
+                                         LPDIRECT3DTEXTURE9 texture,
+                                         const z3DD3D9HL_Glyph* glyphs,
+                                         uint32_t firstChar,
+                                         uint32_t numChars,
+                                         float lineHeight){
+    Z3D_ASSERT_HIGH(atlas != 0 && texture != 0 && glyphs != 0, "null passed", true);
+    if (atlas == 0 || texture == 0 || glyphs == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(firstChar + numChars <= Z3D_D3D9HL_NUM_GLYPHS, "glyph codes out of range", true);
+    if (firstChar + numChars > Z3D_D3D9HL_NUM_GLYPHS)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    ZeroMemory(atlas, sizeof(z3DD3D9HL_GlyphAtlas));
+    for (uint32_t i = 0; i < numChars; ++i)
+        atlas->glyphs_[firstChar + i] = glyphs[i];
+    atlas->texture_ = texture;
+    atlas->lineHeight_ = lineHeight;
+    atlas->id_ = ++z3D_priv::s_lastAtlasId;
+    atlas->fOwnTexture_ = false;
+    return Z3D_D3D9HL_NONE;
+}
+
+z3DD3D9HL_ErrCodes D3D9HL_GlyphAtlasCreate(z3DD3D9HL_GlyphAtlas* atlas,
+                                           LPDIRECT3DDEVICE9 device,
+                                           HFONT font,
+                                           uint32_t textureSize,
+                                           uint32_t firstChar,
+                                           uint32_t numChars){
+    Z3D_ASSERT_HIGH(atlas != 0 && device != 0 && font != 0, "null passed", true);
+    if (atlas == 0 || device == 0 || font == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+    Z3D_ASSERT_HIGH(firstChar + numChars <= Z3D_D3D9HL_NUM_GLYPHS && textureSize > 0, "unacceptable glyph atlas parameters", true);
+    if (firstChar + numChars > Z3D_D3D9HL_NUM_GLYPHS || textureSize == 0)
+        return Z3D_D3D9HL_INVALIDCALL;
+
+    ZeroMemory(atlas, sizeof(z3DD3D9HL_GlyphAtlas));
+    HDC dc = ::CreateCompatibleDC(0);
+    if (dc == 0)
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    BITMAPINFO bmi;
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = static_cast<LONG>(textureSize);
+    bmi.bmiHeader.biHeight = -static_cast<LONG>(textureSize);    // строки сверху вниз
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    void* bits = 0;
+    HBITMAP bitmap = ::CreateDIBSection(dc, &bmi, DIB_RGB_COLORS, &bits, 0, 0);
+    if (bitmap == 0 || bits == 0){
+        ::DeleteDC(dc);
+        return Z3D_D3D9HL_NOTAVAILABLE;
+    }
+    ZeroMemory(bits, textureSize * textureSize * 4);
+    HGDIOBJ oldBitmap = ::SelectObject(dc, bitmap);
+    HGDIOBJ oldFont = ::SelectObject(dc, font);
+    ::SetTextColor(dc, RGB(255, 255, 255));
+    ::SetBkMode(dc, TRANSPARENT);
+    TEXTMETRICA tm;
+    ::GetTextMetricsA(dc, &tm);
+    uint32_t cellHeight = static_cast<uint32_t>(tm.tmHeight);
+    atlas->lineHeight_ = static_cast<float>(tm.tmHeight + tm.tmExternalLeading);
+
+    // Символы укладываются рядами с промежутком в пиксель, чтобы при фильтрации не захватывать соседние
+    const float texelSize = 1.0f / static_cast<float>(textureSize);
+    uint32_t x = 1, y = 1;
+    bool fFit = cellHeight + 2 <= textureSize;
+    for (uint32_t ch = firstChar; ch < firstChar + numChars && fFit; ++ch){
+        char c = static_cast<char>(ch);
+        SIZE extent;
+        if (!::GetTextExtentPoint32A(dc, &c, 1, &extent))
+            continue;
+        z3DD3D9HL_Glyph& glyph = atlas->glyphs_[ch];
+        glyph.advance_ = static_cast<float>(extent.cx);
+        if (ch == ' ' || extent.cx <= 0)
+            continue;
+        uint32_t width = static_cast<uint32_t>(extent.cx);
+        if (x + width + 1 > textureSize){
+            x = 1;
+            y += cellHeight + 1;
+            if (y + cellHeight + 1 > textureSize || width + 2 > textureSize){
+                fFit = false;
+                break;
+            }
+        }
+        ::TextOutA(dc, static_cast<int>(x), static_cast<int>(y), &c, 1);
+        glyph.u0_ = static_cast<float>(x) * texelSize;
+        glyph.v0_ = static_cast<float>(y) * texelSize;
+        glyph.u1_ = static_cast<float>(x + width) * texelSize;
+        glyph.v1_ = static_cast<float>(y + cellHeight) * texelSize;
+        glyph.width_ = static_cast<float>(width);
+        glyph.height_ = static_cast<float>(cellHeight);
+        x += width + 1;
+    }
+    ::GdiFlush();
+
+    z3DD3D9HL_ErrCodes err = Z3D_D3D9HL_NONE;
+    if (!fFit){
+        Z3D_ERROR(Z3D_ERROR_PERMISSIBLE, !fFit, "glyphs do not fit into atlas texture", false);
+        err = Z3D_D3D9HL_OUTOFMEMORY;
+    }
+    else {
+        HRESULT hr = device->CreateTexture(textureSize, textureSize, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &atlas->texture_, 0);
+        D3DLOCKED_RECT locked;
+        if (SUCCEEDED(hr))
+            hr = atlas->texture_->LockRect(0, &locked, 0, 0);
+        if (FAILED(hr)){
+            err = Z3D_D3D9HL_NOTAVAILABLE;
+        }
+        else {
+            // Яркость символа становится альфа-каналом белого цвета
+            const uint8_t* src = static_cast<const uint8_t*>(bits);
+            for (uint32_t row = 0; row < textureSize; ++row){
+                uint32_t* dest = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(locked.pBits) + row * locked.Pitch);
+                for (uint32_t col = 0; col < textureSize; ++col, src += 4)
+                    dest[col] = (static_cast<uint32_t>(src[1]) << 24) | 0x00FFFFFF;
+            }
+            atlas->texture_->UnlockRect(0);
+        }
+    }
+
+    ::SelectObject(dc, oldFont);
+    ::SelectObject(dc, oldBitmap);
+    ::DeleteObject(bitmap);
+    ::DeleteDC(dc);
+    if (err != Z3D_D3D9HL_NONE){
+        if (atlas->texture_ != 0)
+            atlas->texture_->Release();
+        ZeroMemory(atlas, sizeof(z3DD3D9HL_GlyphAtlas));
+        return err;
+    }
+    atlas->id_ = ++z3D_priv::s_lastAtlasId;
+    atlas->fOwnTexture_ = true;
+    return Z3D_D3D9HL_NONE;
+}
+
+void D3D9HL_GlyphAtlasRelease(z3DD3D9HL_GlyphAtlas* atlas){
+    Z3D_ASSERT_HIGH(atlas != 0, "null passed", true);
+    if (atlas == 0)
+        return;
+    if (atlas->fOwnTexture_ && atlas->texture_ != 0)
+        atlas->texture_->Release();
+    atlas->texture_ = 0;
+    atlas->id_ = 0;
+    atlas->fOwnTexture_ = false;
+}
+
+} // end of z3D
@@ -0,0 +1,121 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Распределитель арены: порядок LIFO и отсутствие обращений к куче при повторном поиске
+видеорежимов и в кадрах рендера.
+*/
+
+#include <stdlib.h>
+#include <new>
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+int s_numGlobalNews = 0;
+}
+
+// Замещающие operator new и operator delete работают с malloc() и free()
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size){
+    s_numGlobalNews++;
+    void* mem = malloc(size != 0 ? size : 1);
+    if (mem == 0)
+        throw std::bad_alloc();
+    return mem;
+}
+
+void* operator new[](size_t size){
+    return operator new(size);
+}
+
+void operator delete(void* mem) noexcept { free(mem); }
+void operator delete[](void* mem) noexcept { free(mem); }
+void operator delete(void* mem, size_t) noexcept { free(mem); }
+void operator delete[](void* mem, size_t) noexcept { free(mem); }
+
+namespace
+{
+bool ReleaseResources() { return true; }
+bool ResetResources() { return true; }
+
+/* Блоки освобождаются, только если выделены последними.
+*/
+void TestLifo(z3DD3D9HL_Arena* arena){
+    z3DD3D9HL_Allocator allocator;
+    z3D::D3D9HL_ArenaAllocator(&allocator, arena);
+    size_t start = z3D::D3D9HL_ArenaGetMarker(arena);
+    void* a = allocator.alloc_(100, 16, allocator.userData_);
+    size_t afterA = z3D::D3D9HL_ArenaGetMarker(arena);
+    void* b = allocator.alloc_(40, 64, allocator.userData_);
+    Z3D_TEST_CHECK(a != 0 && b != 0);
+    Z3D_TEST_CHECK((reinterpret_cast<size_t>(a) & 15) == 0 && (reinterpret_cast<size_t>(b) & 63) == 0);
+    Z3D_TEST_CHECK(static_cast<uint8_t*>(a) + 100 <= static_cast<uint8_t*>(b));
+
+    // a не последний: освобождение откладывается до сброса арены
+    allocator.free_(a, allocator.userData_);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaGetMarker(arena) > afterA);
+    allocator.free_(b, allocator.userData_);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaGetMarker(arena) == afterA);
+    allocator.free_(a, allocator.userData_);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaGetMarker(arena) == start);
+}
+} // end of namespace
+
+int main(){
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D;
+    // Каждый поиск берет из арены больше ее половины: без освобождения память кончилась бы на втором
+    static uint8_t s_mem[16 * 1024];
+    size_t capacity = sizeof(z3DD3D9HL_VideoMode) * d3d->adapters_[0].modes_.size() * 3 / 2;
+    Z3D_TEST_CHECK(capacity <= sizeof(s_mem));
+    z3DD3D9HL_Arena arena;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaInit(&arena, s_mem, capacity) == Z3D_D3D9HL_NONE);
+    TestLifo(&arena);
+
+    z3DD3D9HL_Allocator allocator;
+    z3D::D3D9HL_ArenaAllocator(&allocator, &arena);
+    Z3D_TEST_CHECK(z3D::D3D9HL_SetAllocator(&allocator) == Z3D_D3D9HL_NONE);
+
+    uint16_t numModes = 0;
+    Z3D_TEST_CHECK(z3D::D3D9HL_FindVideoModes(0, &numModes, d3d, 32) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(numModes > 0);
+    z3DD3D9HL_VideoMode videoModes[16];
+    Z3D_TEST_CHECK(numModes <= sizeof(videoModes) / sizeof(videoModes[0]));
+
+    // Повторный поиск видеорежимов: подсчет и заполнение
+    int numNews = s_numGlobalNews;
+    for (uint32_t i = 0; i < 1000; ++i){
+        uint16_t n = 0;
+        Z3D_TEST_CHECK(z3D::D3D9HL_FindVideoModes(0, &n, d3d, 32) == Z3D_D3D9HL_NONE);
+        Z3D_TEST_CHECK(z3D::D3D9HL_FindVideoModes(videoModes, &n, d3d, 32) == Z3D_D3D9HL_NONE);
+        Z3D_TEST_CHECK(n == numModes);
+    }
+    int numEnumNews = s_numGlobalNews - numNews;
+    Z3D_TEST_CHECK(numEnumNews == 0);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaGetMarker(&arena) == 0);
+
+    // Кадры рендера
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, videoModes[0]) == Z3D_D3D9HL_NONE);
+    numNews = s_numGlobalNews;
+    for (uint32_t iFrame = 0; iFrame < 1000; ++iFrame){
+        Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+        Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+    }
+    int numFrameNews = s_numGlobalNews - numNews;
+    Z3D_TEST_CHECK(numFrameNews == 0);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaGetMarker(&arena) == 0);
+    printf("global operator new calls: %d in 2000 enumerations, %d in 1000 frames\n", numEnumNews, numFrameNews);
+
+    z3D::D3D9HL_SetAllocator(0);
+    device->Release();
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("AllocTest");
+}
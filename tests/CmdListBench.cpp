@@ -0,0 +1,197 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Замер записи списков команд в нескольких потоках и их воспроизведения на модели устройства.
+
+Каждый поток записывает в свой список объекты сцены: текстуру, поток вершин, четыре вектора
+констант и рисование. Время воспроизведения сравнивается с прямыми вызовами тех же методов устройства.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+const uint32_t s_numThreads = 8;
+const uint32_t s_numObjectsPerThread = 20000;
+const uint32_t s_numCmdsPerObject = 4;
+const uint32_t s_numFrames = 20;
+const uint32_t s_cmdListCapacity = 4 * 1024 * 1024;
+
+struct RecordTask{
+    z3DD3D9HL_CmdList* cmdList_;
+    uint32_t iThread_;
+    LPDIRECT3DVERTEXBUFFER9 vertexBuffer_;
+    uint64_t timeUs_;
+    uint32_t numErrors_;
+};
+
+void RecordObjects(RecordTask* task){
+    float constants[16];
+    for (uint32_t i = 0; i < 16; ++i)
+        constants[i] = static_cast<float>(i);
+    for (uint32_t iObject = 0; iObject < s_numObjectsPerThread; ++iObject){
+        constants[0] = static_cast<float>(iObject);
+        if (z3D::D3D9HL_CmdSetVertexShaderConstantF(task->cmdList_, 0, constants, 4) != Z3D_D3D9HL_NONE ||
+            z3D::D3D9HL_CmdSetStreamSource(task->cmdList_, 0, task->vertexBuffer_, 0, 32) != Z3D_D3D9HL_NONE ||
+            z3D::D3D9HL_CmdSetRenderState(task->cmdList_, D3DRS_CULLMODE, iObject & 1) != Z3D_D3D9HL_NONE ||
+            z3D::D3D9HL_CmdDrawIndexedPrimitive(task->cmdList_, D3DPT_TRIANGLELIST, 0, 0, 24, 0, 12) != Z3D_D3D9HL_NONE)
+            task->numErrors_++;
+    }
+}
+
+void* RecordThreadProc(void* param){
+    RecordTask* task = static_cast<RecordTask*>(param);
+    uint64_t startTime = z3DTest::TimeUs();
+    z3D::D3D9HL_CmdListReset(task->cmdList_, task->iThread_);
+    RecordObjects(task);
+    task->timeUs_ = z3DTest::TimeUs() - startTime;
+    return 0;
+}
+
+bool ReleaseResources() { return true; }
+bool ResetResources() { return true; }
+
+/* Те же вызовы, что записываются в список, напрямую в устройство.
+*/
+void DrawDirect(LPDIRECT3DDEVICE9 device, LPDIRECT3DVERTEXBUFFER9 vertexBuffer){
+    float constants[16];
+    for (uint32_t i = 0; i < 16; ++i)
+        constants[i] = static_cast<float>(i);
+    for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread){
+        for (uint32_t iObject = 0; iObject < s_numObjectsPerThread; ++iObject){
+            constants[0] = static_cast<float>(iObject);
+            device->SetVertexShaderConstantF(0, constants, 4);
+            device->SetStreamSource(0, vertexBuffer, 0, 32);
+            device->SetRenderState(D3DRS_CULLMODE, iObject & 1);
+            device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, 24, 0, 12);
+        }
+    }
+}
+
+/* Переполненный список не воспроизводится, остальные воспроизводятся полностью.
+Неверные аргументы команды не считаются переполнением.
+*/
+void TestOverflow(z3DTest::MockDevice* device, D3DPRESENT_PARAMETERS* presentParams){
+    uint64_t smallMem[8];
+    uint64_t mem[64];
+    z3DD3D9HL_CmdList small, normal;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CmdListInit(&small, smallMem, sizeof(smallMem), 0) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_CmdListInit(&normal, mem, sizeof(mem), 1) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_CmdSetRenderState(&small, D3DRS_ZENABLE, TRUE) == Z3D_D3D9HL_NONE);
+    z3DD3D9HL_ErrCodes err = Z3D_D3D9HL_NONE;
+    for (uint32_t i = 0; i < 8 && err == Z3D_D3D9HL_NONE; ++i)
+        err = z3D::D3D9HL_CmdDrawPrimitive(&small, D3DPT_TRIANGLELIST, 0, 1);
+    Z3D_TEST_CHECK(err == Z3D_D3D9HL_OUTOFMEMORY && small.fOverflow_);
+    Z3D_TEST_CHECK(z3D::D3D9HL_CmdDrawPrimitive(&normal, D3DPT_TRIANGLELIST, 0, 1) == Z3D_D3D9HL_NONE);
+    // Неверные константы отклоняются без записи и без признака переполнения
+    float constant[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    uint32_t size = normal.size_;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CmdSetVertexShaderConstantF(&normal, 0, 0, 1) == Z3D_D3D9HL_INVALIDCALL);
+    Z3D_TEST_CHECK(z3D::D3D9HL_CmdSetPixelShaderConstantF(&normal, 0, constant, 0x40000000) == Z3D_D3D9HL_INVALIDCALL);
+    Z3D_TEST_CHECK(normal.size_ == size && !normal.fOverflow_);
+
+    z3DD3D9HL_CmdList* cmdLists[2] = { &small, &normal };
+    int numDraws = device->calls_.numDraws_;
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    uint32_t numReplayed = 0;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ReplayCmdLists(device, cmdLists, 2, &numReplayed) == Z3D_D3D9HL_OUTOFMEMORY);
+    Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(numReplayed == 1);
+    Z3D_TEST_CHECK(device->calls_.numDraws_ == numDraws + 1);
+}
+} // end of namespace
+
+int main(){
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D;
+    z3DD3D9HL_VideoMode videoMode;
+    ZeroMemory(&videoMode, sizeof(videoMode));
+    videoMode.d3ddm_.Width = 1280;
+    videoMode.d3ddm_.Height = 720;
+    videoMode.d3ddm_.Format = D3DFMT_X8R8G8B8;
+    videoMode.depthStencilFmt_ = D3DFMT_D24S8;
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, videoMode) == Z3D_D3D9HL_NONE);
+    z3DTest::MockDevice* mockDevice = static_cast<z3DTest::MockDevice*>(device);
+    LPDIRECT3DVERTEXBUFFER9 vertexBuffer = 0;
+    device->CreateVertexBuffer(1024, 0, 0, D3DPOOL_MANAGED, &vertexBuffer, 0);
+
+    std::vector<void*> mem(s_numThreads);
+    std::vector<z3DD3D9HL_CmdList> cmdLists(s_numThreads);
+    std::vector<z3DD3D9HL_CmdList*> cmdListPtrs(s_numThreads);
+    std::vector<RecordTask> tasks(s_numThreads);
+    for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread){
+        Z3D_TEST_CHECK(posix_memalign(&mem[iThread], Z3D_D3D9HL_CMDLIST_ALIGN, s_cmdListCapacity) == 0);
+        Z3D_TEST_CHECK(z3D::D3D9HL_CmdListInit(&cmdLists[iThread], mem[iThread], s_cmdListCapacity, iThread) == Z3D_D3D9HL_NONE);
+        tasks[iThread].cmdList_ = &cmdLists[iThread];
+        tasks[iThread].iThread_ = iThread;
+        tasks[iThread].vertexBuffer_ = vertexBuffer;
+        tasks[iThread].numErrors_ = 0;
+    }
+
+    const uint32_t numCmdsPerFrame = s_numThreads * s_numObjectsPerThread * s_numCmdsPerObject;
+    uint64_t recordTimeUs = 0;
+    uint64_t recordThreadTimeUs = 0;
+    uint64_t replayTimeUs = 0;
+    uint64_t directTimeUs = 0;
+    uint32_t numErrors = 0;
+    for (uint32_t iFrame = 0; iFrame < s_numFrames; ++iFrame){
+        // запись: все потоки одновременно
+        uint64_t startTime = z3DTest::TimeUs();
+        std::vector<pthread_t> threads(s_numThreads);
+        for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread)
+            pthread_create(&threads[iThread], 0, RecordThreadProc, &tasks[iThread]);
+        for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread)
+            pthread_join(threads[iThread], 0);
+        recordTimeUs += z3DTest::TimeUs() - startTime;
+        for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread){
+            recordThreadTimeUs += tasks[iThread].timeUs_;
+            numErrors += tasks[iThread].numErrors_;
+        }
+
+        // воспроизведение в обратном порядке массива: порядок задается ключами
+        for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread)
+            cmdListPtrs[iThread] = &cmdLists[s_numThreads - 1 - iThread];
+        int numDraws = mockDevice->calls_.numDraws_;
+        Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+        uint32_t numReplayed = 0;
+        startTime = z3DTest::TimeUs();
+        Z3D_TEST_CHECK(z3D::D3D9HL_ReplayCmdLists(device, &cmdListPtrs[0], s_numThreads, &numReplayed) == Z3D_D3D9HL_NONE);
+        replayTimeUs += z3DTest::TimeUs() - startTime;
+        Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+        Z3D_TEST_CHECK(numReplayed == numCmdsPerFrame);
+        Z3D_TEST_CHECK(mockDevice->calls_.numDraws_ - numDraws == static_cast<int>(s_numThreads * s_numObjectsPerThread));
+        for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread)
+            Z3D_TEST_CHECK(cmdListPtrs[iThread]->order_ == iThread);
+
+        startTime = z3DTest::TimeUs();
+        DrawDirect(device, vertexBuffer);
+        directTimeUs += z3DTest::TimeUs() - startTime;
+        mockDevice->drawTextures_.clear();
+        mockDevice->drawPrimitives_.clear();
+    }
+    Z3D_TEST_CHECK(numErrors == 0);
+
+    double numCmds = static_cast<double>(numCmdsPerFrame) * s_numFrames;
+    printf("commands per frame: %u (%u threads)\n", numCmdsPerFrame, s_numThreads);
+    printf("recording: %.1f ns/command per thread, %.1f Mcommands/s over all threads\n",
+           recordThreadTimeUs * 1000.0 / numCmds, numCmds / recordTimeUs);
+    printf("replay: %.1f ns/command, direct calls: %.1f ns/command\n",
+           replayTimeUs * 1000.0 / numCmds, directTimeUs * 1000.0 / numCmds);
+
+    TestOverflow(mockDevice, &presentParams);
+
+    for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread)
+        free(mem[iThread]);
+    vertexBuffer->Release();
+    device->Release();
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("CmdListBench");
+}
@@ -0,0 +1,159 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Регулятор динамического разрешения при вертикальной синхронизации: время между вызовами Present()
+кратно периоду обновления экрана, а время выполнения кадра видеоадаптером меняется с нагрузкой.
+*/
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+const uint32_t s_vsyncPeriodUs = 16667;
+const uint32_t s_numFrames = 600;
+
+bool ReleaseResources() { return true; }
+bool ResetResources() { return true; }
+
+z3DD3D9HL_VideoMode MakeVideoMode(UINT width, UINT height){
+    z3DD3D9HL_VideoMode videoMode;
+    ZeroMemory(&videoMode, sizeof(videoMode));
+    videoMode.d3ddm_.Width = width;
+    videoMode.d3ddm_.Height = height;
+    videoMode.d3ddm_.RefreshRate = 60;
+    videoMode.d3ddm_.Format = D3DFMT_X8R8G8B8;
+    videoMode.bpp_ = 32;
+    videoMode.depthStencilFmt_ = D3DFMT_D24S8;
+    return videoMode;
+}
+
+// Уровни только по разрешению: стоимость 0.25, 0.39, 0.56, 0.77, 1
+void InitController(z3DD3D9HL_DynResController* dynRes, uint32_t iStartLevel){
+    static const float s_scales[] = { 0.5f, 0.625f, 0.75f, 0.875f, 1.0f };
+    z3DD3D9HL_QualityLevel levels[5];
+    for (uint32_t i = 0; i < 5; ++i){
+        levels[i].scale_ = s_scales[i];
+        levels[i].multiSampleType_ = D3DMULTISAMPLE_NONE;
+        levels[i].multiSampleQuality_ = 0;
+        levels[i].cost_ = s_scales[i] * s_scales[i];
+    }
+    z3DD3D9HL_DynResParams params;
+    params.targetFrameTimeUs_ = s_vsyncPeriodUs;
+    Z3D_TEST_CHECK(z3D::D3D9HL_DynResInit(dynRes, levels, 5, params, iStartLevel) == Z3D_D3D9HL_NONE);
+}
+
+// Время выполнения кадра видеоадаптером на текущем уровне при заданном времени кадра полного разрешения
+uint32_t GpuTimeUs(const z3DD3D9HL_DynResController* dynRes, uint32_t fullResTimeUs){
+    return static_cast<uint32_t>(static_cast<float>(fullResTimeUs) * z3D::D3D9HL_DynResGetLevel(dynRes).cost_);
+}
+
+// Время между вызовами Present() с вертикальной синхронизацией
+uint32_t VSyncFrameTimeUs(uint32_t gpuTimeUs){
+    return (gpuTimeUs + s_vsyncPeriodUs - 1) / s_vsyncPeriodUs * s_vsyncPeriodUs;
+}
+
+/* Регулятор, получающий время между вызовами Present(), не видит запаса времени и не повышает
+качество, а при перегрузке понижает его сильнее необходимого. Время видеоадаптера дает верные уровни.
+*/
+void TestVSyncSimulation(){
+    z3DD3D9HL_DynResController vsyncFed, gpuFed;
+
+    // Легкая сцена: полное разрешение укладывается в 10 мс
+    InitController(&vsyncFed, 0);
+    InitController(&gpuFed, 0);
+    for (uint32_t i = 0; i < s_numFrames; ++i){
+        z3D::D3D9HL_DynResUpdate(&vsyncFed, VSyncFrameTimeUs(GpuTimeUs(&vsyncFed, 10000)));
+        z3D::D3D9HL_DynResUpdate(&gpuFed, GpuTimeUs(&gpuFed, 10000));
+    }
+    Z3D_TEST_CHECK(vsyncFed.iLevel_ == 0);
+    Z3D_TEST_CHECK(gpuFed.iLevel_ == 4);
+
+    // Тяжелая сцена: полное разрешение - 30 мс; уровень 0.75 (16.9 мс) еще в пределах порога понижения
+    InitController(&vsyncFed, 4);
+    InitController(&gpuFed, 4);
+    uint32_t numChanges = 0;
+    for (uint32_t i = 0; i < s_numFrames; ++i){
+        z3D::D3D9HL_DynResUpdate(&vsyncFed, VSyncFrameTimeUs(GpuTimeUs(&vsyncFed, 30000)));
+        z3D::D3D9HL_DynResUpdate(&gpuFed, GpuTimeUs(&gpuFed, 30000));
+        if (i == s_numFrames / 2)
+            numChanges = gpuFed.numChanges_;
+    }
+    Z3D_TEST_CHECK(gpuFed.iLevel_ == 2);
+    Z3D_TEST_CHECK(gpuFed.numChanges_ == numChanges);
+    Z3D_TEST_CHECK(vsyncFed.iLevel_ < gpuFed.iLevel_);
+}
+
+/* Измеритель на модели устройства: ожидание в Present() в измерение не попадает, запросы пересоздаются
+при смене видеорежима, а регулятор по измеренному времени выходит на наивысший уровень.
+*/
+void TestGpuTimer(z3DTest::MockDirect3D* d3d){
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, MakeVideoMode(1024, 768)) == Z3D_D3D9HL_NONE);
+    z3DTest::MockDevice* mockDevice = static_cast<z3DTest::MockDevice*>(device);
+
+    z3DD3D9HL_GpuTimer timer;
+    Z3D_TEST_CHECK(z3D::D3D9HL_GpuTimerInit(&timer, device) == Z3D_D3D9HL_NONE);
+    z3DD3D9HL_DynResController dynRes;
+    InitController(&dynRes, 0);
+    for (uint32_t i = 0; i < s_numFrames; ++i){
+        Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+        z3D::D3D9HL_GpuTimerBeginFrame(&timer);
+        // Рендер кадра занимает видеоадаптер, остаток периода он ждет синхронизации в Present()
+        uint32_t gpuTimeUs = GpuTimeUs(&dynRes, 10000);
+        mockDevice->gpuTimeUs_ += gpuTimeUs;
+        mockDevice->gpuFrameTimeUs_ = VSyncFrameTimeUs(gpuTimeUs) - gpuTimeUs;
+        Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+        Z3D_TEST_CHECK(timer.timeUs_ == gpuTimeUs);
+
+        z3DD3D9HL_FrameTiming timing;
+        z3D::D3D9HL_GetFrameTiming(&timing);
+        z3D::D3D9HL_DynResUpdate(&dynRes, (timer.timeUs_ > timing.renderTimeUs_) ? timer.timeUs_ : timing.renderTimeUs_);
+    }
+    Z3D_TEST_CHECK(dynRes.iLevel_ == 4);
+    Z3D_TEST_CHECK(timer.numFrames_ == s_numFrames && timer.numPending_ == 0);
+
+    // Результаты запаздывают: кадры без результата копятся не больше Z3D_D3D9HL_GPU_TIMER_FRAMES
+    for (uint32_t i = 0; i < Z3D_D3D9HL_GPU_TIMER_FRAMES; ++i){
+        static_cast<z3DTest::MockQuery*>(timer.frames_[i].disjoint_)->readyDelay_ = 100;
+    }
+    uint32_t numFrames = timer.numFrames_;
+    for (uint32_t i = 0; i < 2 * Z3D_D3D9HL_GPU_TIMER_FRAMES; ++i){
+        Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+        z3D::D3D9HL_GpuTimerBeginFrame(&timer);
+        mockDevice->gpuTimeUs_ += 5000;
+        Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+    }
+    Z3D_TEST_CHECK(timer.numPending_ == Z3D_D3D9HL_GPU_TIMER_FRAMES && timer.numFrames_ == numFrames);
+
+    // Смена видеорежима: кадры без результата отбрасываются, запросы создаются заново
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(800, 600),
+                                               ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(timer.fCreated_ && timer.numPending_ == 0);
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    z3D::D3D9HL_GpuTimerBeginFrame(&timer);
+    mockDevice->gpuTimeUs_ += 5000;
+    Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(timer.timeUs_ == 5000 && timer.numFrames_ == numFrames + 1);
+
+    z3D::D3D9HL_GpuTimerShutdown(&timer);
+    Z3D_TEST_CHECK(timer.device_ == 0);
+
+    // Устройство без меток времени
+    mockDevice->fQueriesSupported_ = false;
+    Z3D_TEST_CHECK(z3D::D3D9HL_GpuTimerInit(&timer, device) == Z3D_D3D9HL_NOTAVAILABLE);
+    z3D::D3D9HL_GpuTimerShutdown(&timer);
+    device->Release();
+}
+} // end of namespace
+
+int main(){
+    TestVSyncSimulation();
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D;
+    TestGpuTimer(d3d);
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("DynResTest");
+}
@@ -0,0 +1,212 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Оптимизация большой сетки: ACMR и ATVR до и после, время каждого шага и проверка перестановок.
+
+Сетка - сфера из сегментов с треугольниками в случайном порядке, разбитая на четыре поднабора.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "z3DD3D9HL.h"
+#include "Test.h"
+
+namespace
+{
+const uint32_t s_numRings = 512;
+const uint32_t s_numSegments = 1024;
+const uint32_t s_numSubsets = 4;
+const uint32_t s_cacheSize = 16;
+
+struct Mesh{
+    std::vector<float> positions_;
+    std::vector<uint32_t> indices_;
+    uint32_t NumFaces() const { return static_cast<uint32_t>(indices_.size() / 3); }
+    uint32_t NumVertices() const { return static_cast<uint32_t>(positions_.size() / 3); }
+};
+
+uint32_t s_random = 12345;
+uint32_t Random(){
+    s_random = s_random * 1664525 + 1013904223;
+    return s_random >> 8;
+}
+
+/* Сфера, треугольники которой перемешаны внутри каждого поднабора.
+*/
+void MakeSphere(Mesh* mesh){
+    for (uint32_t iRing = 0; iRing <= s_numRings; ++iRing){
+        float theta = 3.14159265f * static_cast<float>(iRing) / static_cast<float>(s_numRings);
+        for (uint32_t iSegment = 0; iSegment <= s_numSegments; ++iSegment){
+            float phi = 2.0f * 3.14159265f * static_cast<float>(iSegment) / static_cast<float>(s_numSegments);
+            mesh->positions_.push_back(sinf(theta) * cosf(phi));
+            mesh->positions_.push_back(cosf(theta));
+            mesh->positions_.push_back(sinf(theta) * sinf(phi));
+        }
+    }
+    for (uint32_t iRing = 0; iRing < s_numRings; ++iRing){
+        for (uint32_t iSegment = 0; iSegment < s_numSegments; ++iSegment){
+            uint32_t a = iRing * (s_numSegments + 1) + iSegment;
+            uint32_t b = a + 1;
+            uint32_t c = a + s_numSegments + 1;
+            uint32_t d = c + 1;
+            uint32_t tris[6] = { a, c, b, b, c, d };
+            mesh->indices_.insert(mesh->indices_.end(), tris, tris + 6);
+        }
+    }
+    uint32_t numFaces = mesh->NumFaces();
+    uint32_t subsetFaces = numFaces / s_numSubsets;
+    for (uint32_t iSubset = 0; iSubset < s_numSubsets; ++iSubset){
+        uint32_t start = iSubset * subsetFaces;
+        for (uint32_t i = subsetFaces - 1; i > 0; --i){
+            uint32_t j = Random() % (i + 1);
+            for (uint32_t k = 0; k < 3; ++k)
+                std::swap(mesh->indices_[(start + i) * 3 + k], mesh->indices_[(start + j) * 3 + k]);
+        }
+    }
+}
+
+bool IsPermutation(const std::vector<uint32_t>& remap){
+    std::vector<uint32_t> sorted(remap);
+    std::sort(sorted.begin(), sorted.end());
+    for (uint32_t i = 0; i < sorted.size(); ++i){
+        if (sorted[i] != i)
+            return false;
+    }
+    return true;
+}
+
+bool RemapKeepsSubsets(const std::vector<uint32_t>& remap, const z3DD3D9HL_MeshSubset* subsets){
+    for (uint32_t iSubset = 0; iSubset < s_numSubsets; ++iSubset){
+        for (uint32_t iFace = subsets[iSubset].faceStart_; iFace < subsets[iSubset].faceStart_ + subsets[iSubset].faceCount_; ++iFace){
+            if (remap[iFace] < subsets[iSubset].faceStart_ || remap[iFace] >= subsets[iSubset].faceStart_ + subsets[iSubset].faceCount_)
+                return false;
+        }
+    }
+    return true;
+}
+
+void PrintStats(const char* step, const Mesh& mesh, const std::vector<uint32_t>& indices, uint64_t timeUs){
+    z3DD3D9HL_VertexCacheStats stats;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ComputeVertexCacheStats(&stats, &indices[0], mesh.NumFaces(), mesh.NumVertices(),
+                                                       true, s_cacheSize) == Z3D_D3D9HL_NONE);
+    printf("%-28s ACMR %.3f  ATVR %.3f  %8.1f ms\n", step, stats.acmr_, stats.atvr_, timeUs / 1000.0);
+}
+
+float Acmr(const Mesh& mesh, const std::vector<uint32_t>& indices){
+    z3DD3D9HL_VertexCacheStats stats;
+    z3D::D3D9HL_ComputeVertexCacheStats(&stats, &indices[0], mesh.NumFaces(), mesh.NumVertices(), true, s_cacheSize);
+    return stats.acmr_;
+}
+
+/* Перестановка вершин с повтором или выходом за границу отвергается без изменения индексов.
+Перестановки треугольников с повтором и пересекающиеся поднаборы также отвергаются.
+*/
+void TestRemapIndicesValidation(){
+    uint32_t indices[6] = { 0, 1, 2, 2, 1, 3 };
+    uint32_t original[6];
+    memcpy(original, indices, sizeof(indices));
+    uint32_t outOfRange[4] = { 3, 2, 1, 4 };
+    Z3D_TEST_CHECK(z3D::D3D9HL_RemapIndices(indices, 2, outOfRange, 4, true) == Z3D_D3D9HL_INVALIDCALL);
+    Z3D_TEST_CHECK(memcmp(indices, original, sizeof(indices)) == 0);
+    uint32_t duplicate[4] = { 3, 2, 2, 0 };
+    Z3D_TEST_CHECK(z3D::D3D9HL_RemapIndices(indices, 2, duplicate, 4, true) == Z3D_D3D9HL_INVALIDCALL);
+    Z3D_TEST_CHECK(memcmp(indices, original, sizeof(indices)) == 0);
+    uint32_t reverse[4] = { 3, 2, 1, 0 };
+    Z3D_TEST_CHECK(z3D::D3D9HL_RemapIndices(indices, 2, reverse, 4, true) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(indices[0] == 3 && indices[5] == 0);
+
+    // Перестановка треугольников, переносящая треугольник между поднаборами
+    float positions[12] = { 0 };
+    uint32_t faceRemap[2] = { 1, 0 };
+    z3DD3D9HL_MeshSubset subsets[2] = { { 0, 1 }, { 1, 1 } };
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeOverdrawSubsets(faceRemap, original, 2, positions, 12, 4, true, subsets, 2) == Z3D_D3D9HL_INVALIDCALL);
+    // Перестановка с повтором треугольника
+    uint32_t duplicateFaces[2] = { 0, 0 };
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeOverdraw(duplicateFaces, original, 2, positions, 12, 4, true) == Z3D_D3D9HL_INVALIDCALL);
+    z3DD3D9HL_MeshSubset wholeMesh = { 0, 2 };
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeOverdrawSubsets(duplicateFaces, original, 2, positions, 12, 4, true, &wholeMesh, 1) == Z3D_D3D9HL_INVALIDCALL);
+
+    // Пересекающиеся поднаборы, заданные не по порядку; пустой поднабор внутри другого допустим
+    z3DD3D9HL_MeshSubset overlapping[3] = { { 1, 1 }, { 2, 0 }, { 0, 2 } };
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeFacesSubsets(faceRemap, original, 2, 4, true, overlapping, 3, 16, 2) == Z3D_D3D9HL_INVALIDCALL);
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeOverdrawSubsets(faceRemap, original, 2, positions, 12, 4, true, overlapping, 3) == Z3D_D3D9HL_INVALIDCALL);
+    z3DD3D9HL_MeshSubset disjoint[3] = { { 1, 1 }, { 1, 0 }, { 0, 1 } };
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeFacesSubsets(faceRemap, original, 2, 4, true, disjoint, 3, 16, 2) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(faceRemap[0] == 0 && faceRemap[1] == 1);
+}
+} // end of namespace
+
+int main(){
+    Mesh mesh;
+    MakeSphere(&mesh);
+    uint32_t numFaces = mesh.NumFaces();
+    uint32_t numVertices = mesh.NumVertices();
+    printf("mesh: %u faces, %u vertices, %u subsets, cache %u, %ld CPU(s)\n",
+           numFaces, numVertices, s_numSubsets, s_cacheSize, sysconf(_SC_NPROCESSORS_ONLN));
+    z3DD3D9HL_MeshSubset subsets[s_numSubsets];
+    for (uint32_t iSubset = 0; iSubset < s_numSubsets; ++iSubset){
+        subsets[iSubset].faceStart_ = iSubset * (numFaces / s_numSubsets);
+        subsets[iSubset].faceCount_ = numFaces / s_numSubsets;
+    }
+    PrintStats("original", mesh, mesh.indices_, 0);
+    float acmrBefore = Acmr(mesh, mesh.indices_);
+
+    std::vector<uint32_t> faceRemap(numFaces);
+    std::vector<uint32_t> indices(mesh.indices_.size());
+    uint64_t startTime = z3DTest::TimeUs();
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeFaces(&faceRemap[0], &mesh.indices_[0], numFaces, numVertices, true, s_cacheSize) == Z3D_D3D9HL_NONE);
+    uint64_t timeUs = z3DTest::TimeUs() - startTime;
+    Z3D_TEST_CHECK(IsPermutation(faceRemap));
+    Z3D_TEST_CHECK(z3D::D3D9HL_RemapFaces(&indices[0], &mesh.indices_[0], &faceRemap[0], numFaces, true) == Z3D_D3D9HL_NONE);
+    PrintStats("OptimizeFaces", mesh, indices, timeUs);
+    float acmrFaces = Acmr(mesh, indices);
+    Z3D_TEST_CHECK(acmrFaces < 0.5f * acmrBefore && acmrFaces < 0.8f);
+
+    for (uint32_t numThreads = 1; numThreads <= s_numSubsets; numThreads *= 2){
+        startTime = z3DTest::TimeUs();
+        Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeFacesSubsets(&faceRemap[0], &mesh.indices_[0], numFaces, numVertices, true,
+                                                        subsets, s_numSubsets, s_cacheSize, numThreads) == Z3D_D3D9HL_NONE);
+        timeUs = z3DTest::TimeUs() - startTime;
+        Z3D_TEST_CHECK(IsPermutation(faceRemap) && RemapKeepsSubsets(faceRemap, subsets));
+        Z3D_TEST_CHECK(z3D::D3D9HL_RemapFaces(&indices[0], &mesh.indices_[0], &faceRemap[0], numFaces, true) == Z3D_D3D9HL_NONE);
+        char step[64];
+        snprintf(step, sizeof(step), "OptimizeFacesSubsets x%u", numThreads);
+        PrintStats(step, mesh, indices, timeUs);
+    }
+
+    startTime = z3DTest::TimeUs();
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeOverdrawSubsets(&faceRemap[0], &mesh.indices_[0], numFaces, &mesh.positions_[0],
+                                                       3 * sizeof(float), numVertices, true, subsets, s_numSubsets,
+                                                       s_cacheSize) == Z3D_D3D9HL_NONE);
+    timeUs = z3DTest::TimeUs() - startTime;
+    Z3D_TEST_CHECK(IsPermutation(faceRemap) && RemapKeepsSubsets(faceRemap, subsets));
+    Z3D_TEST_CHECK(z3D::D3D9HL_RemapFaces(&indices[0], &mesh.indices_[0], &faceRemap[0], numFaces, true) == Z3D_D3D9HL_NONE);
+    PrintStats("OptimizeOverdrawSubsets", mesh, indices, timeUs);
+    // Рост ACMR ограничен порогом 1.05
+    Z3D_TEST_CHECK(Acmr(mesh, indices) < 1.06f * acmrFaces);
+
+    std::vector<uint32_t> vertexRemap(numVertices);
+    startTime = z3DTest::TimeUs();
+    Z3D_TEST_CHECK(z3D::D3D9HL_OptimizeVertices(&vertexRemap[0], &indices[0], numFaces, numVertices, true) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_RemapIndices(&indices[0], numFaces, &vertexRemap[0], numVertices, true) == Z3D_D3D9HL_NONE);
+    timeUs = z3DTest::TimeUs() - startTime;
+    Z3D_TEST_CHECK(IsPermutation(vertexRemap));
+    PrintStats("OptimizeVertices+Remap", mesh, indices, timeUs);
+    // Вершины пронумерованы в порядке первого обращения
+    Z3D_TEST_CHECK(indices[0] == 0);
+    uint32_t maxIndex = 0;
+    bool fOrdered = true;
+    for (size_t iCorner = 0; iCorner < indices.size(); ++iCorner){
+        if (indices[iCorner] > maxIndex + 1)
+            fOrdered = false;
+        maxIndex = std::max(maxIndex, indices[iCorner]);
+    }
+    Z3D_TEST_CHECK(fOrdered);
+
+    TestRemapIndicesValidation();
+    return z3DTest::Report("MeshOptBench");
+}
@@ -0,0 +1,517 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Модель главного объекта и устройства Direct3D9 для тестов без видеоадаптера.
+
+Модель считает вызовы устройства, хранит созданные буферы в памяти и позволяет задать
+возможности адаптеров, группы адаптеров, результат TestCooperativeLevel() и Reset(),
+а также флаги создания, при которых CreateDevice() завершается неудачей.
+*/
+
+#ifndef Z3D_TEST_MOCKDEVICE_H
+#define Z3D_TEST_MOCKDEVICE_H
+
+#include <vector>
+#include <d3d9.h>
+
+#include "z3DD3D9HLDef.h"
+
+namespace z3DTest
+{
+
+/// Число существующих объектов модели; после освобождения всех объектов должно быть нулевым
+inline int& MockNumLiveObjects(){
+    static int numLiveObjects = 0;
+    return numLiveObjects;
+}
+
+/// Счетчик ссылок объекта модели
+template <typename I>
+class MockObject : public I{
+public:
+    MockObject() : refs_(1) { MockNumLiveObjects()++; }
+    virtual ~MockObject() { MockNumLiveObjects()--; }
+    ULONG AddRef() { return ++refs_; }
+    ULONG Release(){
+        ULONG refs = --refs_;
+        if (refs == 0)
+            delete this;
+        return refs;
+    }
+private:
+    ULONG refs_;
+};
+
+class MockSurface : public MockObject<IDirect3DSurface9>{
+public:
+    explicit MockSurface(const D3DSURFACE_DESC& desc) : desc_(desc) {}
+    HRESULT GetDesc(D3DSURFACE_DESC* desc) { *desc = desc_; return D3D_OK; }
+    D3DSURFACE_DESC desc_;
+};
+
+class MockVertexBuffer : public MockObject<IDirect3DVertexBuffer9>{
+public:
+    explicit MockVertexBuffer(UINT size) : mem_(size), numLocks_(0), numDiscards_(0) {}
+    HRESULT Lock(UINT offset, UINT, void** data, DWORD flags){
+        numLocks_++;
+        if (flags & D3DLOCK_DISCARD)
+            numDiscards_++;
+        *data = &mem_[offset];
+        return D3D_OK;
+    }
+    HRESULT Unlock() { return D3D_OK; }
+    std::vector<char> mem_;
+    int numLocks_;
+    int numDiscards_;
+};
+
+class MockIndexBuffer : public MockObject<IDirect3DIndexBuffer9>{
+public:
+    explicit MockIndexBuffer(UINT size) : mem_(size) {}
+    HRESULT Lock(UINT offset, UINT, void** data, DWORD) { *data = &mem_[offset]; return D3D_OK; }
+    HRESULT Unlock() { return D3D_OK; }
+    std::vector<char> mem_;
+};
+
+class MockTexture : public MockObject<IDirect3DTexture9>{
+public:
+    MockTexture(UINT width, UINT height, D3DFORMAT format = D3DFMT_A8R8G8B8, DWORD usage = 0) :
+        width_(width), height_(height), format_(format), usage_(usage), mem_(width * height * 4) {}
+    HRESULT GetSurfaceLevel(UINT level, IDirect3DSurface9** surface){
+        if (level != 0)
+            return D3DERR_INVALIDCALL;
+        D3DSURFACE_DESC desc;
+        ZeroMemory(&desc, sizeof(desc));
+        desc.Format = format_;
+        desc.Type = D3DRTYPE_SURFACE;
+        desc.Usage = usage_;
+        desc.Width = width_;
+        desc.Height = height_;
+        *surface = new MockSurface(desc);
+        return D3D_OK;
+    }
+    HRESULT LockRect(UINT, D3DLOCKED_RECT* lockedRect, const RECT*, DWORD){
+        lockedRect->Pitch = static_cast<INT>(width_ * 4);
+        lockedRect->pBits = &mem_[0];
+        return D3D_OK;
+    }
+    HRESULT UnlockRect(UINT) { return D3D_OK; }
+    UINT width_;
+    UINT height_;
+    D3DFORMAT format_;
+    DWORD usage_;
+    std::vector<char> mem_;
+};
+
+/// Объект, удерживающий ссылку на создавшее его устройство, как в Direct3D9
+template <typename I>
+class MockDeviceChild : public MockObject<I>{
+public:
+    explicit MockDeviceChild(IUnknown* device) : device_(device) { device_->AddRef(); }
+    ~MockDeviceChild() { device_->Release(); }
+private:
+    IUnknown* device_;
+};
+
+typedef MockDeviceChild<IDirect3DVertexDeclaration9> MockVertexDeclaration;
+
+/// Шейдер хранит копию байт-кода, из которого создан
+template <typename I>
+class MockShader : public MockDeviceChild<I>{
+public:
+    MockShader(IUnknown* device, const DWORD* function) : MockDeviceChild<I>(device){
+        do {
+            function_.push_back(*function);
+        } while (*function++ != 0x0000FFFF);
+    }
+    std::vector<DWORD> function_;
+};
+
+typedef MockShader<IDirect3DVertexShader9> MockVertexShader;
+typedef MockShader<IDirect3DPixelShader9> MockPixelShader;
+
+class MockDevice;
+
+/// Запрос. Результат готов через readyDelay_ опросов после завершения.
+class MockQuery : public MockObject<IDirect3DQuery9>{
+public:
+    MockQuery(MockDevice* device, D3DQUERYTYPE type) :
+        device_(device), type_(type), numIssued_(0), numPolls_(0), readyDelay_(0), result_(0) {}
+    HRESULT Issue(DWORD flags);
+    HRESULT GetData(void* data, DWORD size, DWORD flags);
+
+    MockDevice* device_;
+    D3DQUERYTYPE type_;
+    int numIssued_;                 // число завершений запроса
+    int numPolls_;                  // число опросов после последнего завершения
+    int readyDelay_;
+    uint64_t result_;               // результат: число пикселей или значение счетчика времени
+};
+
+class MockSwapChain : public MockObject<IDirect3DSwapChain9>{
+public:
+    explicit MockSwapChain(const D3DSURFACE_DESC& desc) : desc_(desc) {}
+    HRESULT GetBackBuffer(UINT, D3DBACKBUFFER_TYPE, IDirect3DSurface9** backBuffer){
+        *backBuffer = new MockSurface(desc_);
+        return D3D_OK;
+    }
+    D3DSURFACE_DESC desc_;
+};
+
+/// Число вызовов методов устройства
+struct MockDeviceCalls{
+    int numBeginScene_;
+    int numEndScene_;
+    int numPresents_;
+    int numResets_;
+    int numRenderStates_;
+    int numSamplerStates_;
+    int numTextures_;
+    int numStreamSources_;
+    int numConstants_;
+    int numShaders_;
+    int numDraws_;
+    int numRenderTargets_;
+    int numCreatedSurfaces_;
+    int numCreatedQueries_;
+};
+
+class MockDevice : public MockObject<IDirect3DDevice9>{
+public:
+    MockDevice(const D3DDEVICE_CREATION_PARAMETERS& creationParams, const D3DPRESENT_PARAMETERS* presentParams, UINT numHeads) :
+        creationParams_(creationParams),
+        numHeads_(numHeads),
+        cooperativeLevel_(D3D_OK),
+        resetResult_(D3D_OK),
+        fQueriesSupported_(true),
+        gpuTimeUs_(0),
+        gpuFrameTimeUs_(0),
+        texture_(0),
+        lastVertexBuffer_(0){
+        ZeroMemory(&calls_, sizeof(calls_));
+        for (UINT iHead = 0; iHead < numHeads; ++iHead)
+            presentParams_[iHead] = presentParams[iHead];
+    }
+
+    // Описание заднего буфера головы; в оконном режиме без размеров берется размер окна 640x480
+    D3DSURFACE_DESC BackBufferDesc(UINT iHead) const{
+        const D3DPRESENT_PARAMETERS& pp = presentParams_[iHead];
+        D3DSURFACE_DESC desc;
+        ZeroMemory(&desc, sizeof(desc));
+        desc.Format = pp.BackBufferFormat;
+        desc.Type = D3DRTYPE_SURFACE;
+        desc.Usage = D3DUSAGE_RENDERTARGET;
+        desc.MultiSampleType = pp.MultiSampleType;
+        desc.MultiSampleQuality = pp.MultiSampleQuality;
+        desc.Width = (pp.BackBufferWidth != 0) ? pp.BackBufferWidth : 640;
+        desc.Height = (pp.BackBufferHeight != 0) ? pp.BackBufferHeight : 480;
+        return desc;
+    }
+
+    HRESULT TestCooperativeLevel() { return cooperativeLevel_; }
+    HRESULT Reset(D3DPRESENT_PARAMETERS* presentParams){
+        calls_.numResets_++;
+        if (FAILED(resetResult_))
+            return resetResult_;
+        presentParams_[0] = *presentParams;
+        cooperativeLevel_ = D3D_OK;
+        return D3D_OK;
+    }
+    HRESULT BeginScene() { calls_.numBeginScene_++; return D3D_OK; }
+    HRESULT EndScene() { calls_.numEndScene_++; return D3D_OK; }
+    HRESULT Present(const RECT*, const RECT*, HWND, const void*){
+        calls_.numPresents_++;
+        gpuTimeUs_ += gpuFrameTimeUs_;
+        return D3D_OK;
+    }
+    HRESULT GetCreationParameters(D3DDEVICE_CREATION_PARAMETERS* params) { *params = creationParams_; return D3D_OK; }
+    UINT GetNumberOfSwapChains() { return numHeads_; }
+    HRESULT GetSwapChain(UINT iSwapChain, IDirect3DSwapChain9** swapChain){
+        if (iSwapChain >= numHeads_)
+            return D3DERR_INVALIDCALL;
+        *swapChain = new MockSwapChain(BackBufferDesc(iSwapChain));
+        return D3D_OK;
+    }
+    HRESULT GetBackBuffer(UINT iSwapChain, UINT, D3DBACKBUFFER_TYPE, IDirect3DSurface9** backBuffer){
+        if (iSwapChain >= numHeads_)
+            return D3DERR_INVALIDCALL;
+        *backBuffer = new MockSurface(BackBufferDesc(iSwapChain));
+        return D3D_OK;
+    }
+    HRESULT GetDepthStencilSurface(IDirect3DSurface9** surface){
+        if (!presentParams_[0].EnableAutoDepthStencil)
+            return D3DERR_NOTAVAILABLE;
+        D3DSURFACE_DESC desc = BackBufferDesc(0);
+        desc.Format = presentParams_[0].AutoDepthStencilFormat;
+        desc.Usage = D3DUSAGE_DEPTHSTENCIL;
+        *surface = new MockSurface(desc);
+        return D3D_OK;
+    }
+    HRESULT SetDepthStencilSurface(IDirect3DSurface9*) { return D3D_OK; }
+    HRESULT GetRenderTarget(DWORD, IDirect3DSurface9** surface) { return GetBackBuffer(0, 0, D3DBACKBUFFER_TYPE_MONO, surface); }
+    HRESULT SetRenderTarget(DWORD, IDirect3DSurface9*) { calls_.numRenderTargets_++; return D3D_OK; }
+    HRESULT SetViewport(const D3DVIEWPORT9*) { return D3D_OK; }
+    HRESULT SetRenderState(D3DRENDERSTATETYPE, DWORD) { calls_.numRenderStates_++; return D3D_OK; }
+    HRESULT SetSamplerState(DWORD, D3DSAMPLERSTATETYPE, DWORD) { calls_.numSamplerStates_++; return D3D_OK; }
+    HRESULT SetTextureStageState(DWORD, D3DTEXTURESTAGESTATETYPE, DWORD) { return D3D_OK; }
+    HRESULT SetTexture(DWORD, IDirect3DBaseTexture9* texture){
+        calls_.numTextures_++;
+        texture_ = texture;
+        return D3D_OK;
+    }
+    HRESULT SetStreamSource(UINT, IDirect3DVertexBuffer9*, UINT, UINT) { calls_.numStreamSources_++; return D3D_OK; }
+    HRESULT SetIndices(IDirect3DIndexBuffer9*) { calls_.numStreamSources_++; return D3D_OK; }
+    HRESULT SetVertexDeclaration(IDirect3DVertexDeclaration9*) { calls_.numShaders_++; return D3D_OK; }
+    HRESULT SetFVF(DWORD) { return D3D_OK; }
+    HRESULT SetVertexShader(IDirect3DVertexShader9*) { calls_.numShaders_++; return D3D_OK; }
+    HRESULT SetPixelShader(IDirect3DPixelShader9*) { calls_.numShaders_++; return D3D_OK; }
+    HRESULT SetVertexShaderConstantF(UINT, const float*, UINT) { calls_.numConstants_++; return D3D_OK; }
+    HRESULT SetPixelShaderConstantF(UINT, const float*, UINT) { calls_.numConstants_++; return D3D_OK; }
+    HRESULT DrawPrimitive(D3DPRIMITIVETYPE, UINT, UINT primitiveCount){
+        calls_.numDraws_++;
+        drawTextures_.push_back(texture_);
+        drawPrimitives_.push_back(primitiveCount);
+        return D3D_OK;
+    }
+    HRESULT DrawIndexedPrimitive(D3DPRIMITIVETYPE, INT, UINT, UINT, UINT, UINT primitiveCount){
+        calls_.numDraws_++;
+        drawTextures_.push_back(texture_);
+        drawPrimitives_.push_back(primitiveCount);
+        return D3D_OK;
+    }
+    HRESULT CreateVertexDeclaration(const D3DVERTEXELEMENT9*, IDirect3DVertexDeclaration9** decl){
+        *decl = new MockVertexDeclaration(this);
+        return D3D_OK;
+    }
+    HRESULT CreateVertexShader(const DWORD* function, IDirect3DVertexShader9** shader){
+        *shader = new MockVertexShader(this, function);
+        return D3D_OK;
+    }
+    HRESULT CreatePixelShader(const DWORD* function, IDirect3DPixelShader9** shader){
+        *shader = new MockPixelShader(this, function);
+        return D3D_OK;
+    }
+    HRESULT CreateTexture(UINT width, UINT height, UINT, DWORD usage, D3DFORMAT format, D3DPOOL, IDirect3DTexture9** texture, HANDLE*){
+        *texture = new MockTexture(width, height, format, usage);
+        return D3D_OK;
+    }
+    HRESULT CreateRenderTarget(UINT width, UINT height, D3DFORMAT format, D3DMULTISAMPLE_TYPE multiSample,
+                               DWORD multiSampleQuality, BOOL, IDirect3DSurface9** surface, HANDLE*){
+        *surface = NewSurface(width, height, format, multiSample, multiSampleQuality, D3DUSAGE_RENDERTARGET);
+        return D3D_OK;
+    }
+    HRESULT CreateDepthStencilSurface(UINT width, UINT height, D3DFORMAT format, D3DMULTISAMPLE_TYPE multiSample,
+                                      DWORD multiSampleQuality, BOOL, IDirect3DSurface9** surface, HANDLE*){
+        *surface = NewSurface(width, height, format, multiSample, multiSampleQuality, D3DUSAGE_DEPTHSTENCIL);
+        return D3D_OK;
+    }
+    HRESULT CreateVertexBuffer(UINT length, DWORD, DWORD, D3DPOOL, IDirect3DVertexBuffer9** vertexBuffer, HANDLE*){
+        lastVertexBuffer_ = new MockVertexBuffer(length);
+        *vertexBuffer = lastVertexBuffer_;
+        return D3D_OK;
+    }
+    HRESULT CreateIndexBuffer(UINT length, DWORD, D3DFORMAT, D3DPOOL, IDirect3DIndexBuffer9** indexBuffer, HANDLE*){
+        *indexBuffer = new MockIndexBuffer(length);
+        return D3D_OK;
+    }
+    // Нулевой указатель - проверка поддержки типа запроса
+    HRESULT CreateQuery(D3DQUERYTYPE type, IDirect3DQuery9** query){
+        if (!fQueriesSupported_)
+            return D3DERR_NOTAVAILABLE;
+        if (query == 0)
+            return D3D_OK;
+        calls_.numCreatedQueries_++;
+        *query = new MockQuery(this, type);
+        return D3D_OK;
+    }
+
+    D3DDEVICE_CREATION_PARAMETERS creationParams_;
+    D3DPRESENT_PARAMETERS presentParams_[Z3D_D3D9HL_MAX_HEADS];
+    UINT numHeads_;
+    HRESULT cooperativeLevel_;      ///< результат TestCooperativeLevel()
+    HRESULT resetResult_;           ///< результат Reset()
+    bool fQueriesSupported_;
+    uint64_t gpuTimeUs_;            ///< счетчик времени видеоадаптера для запросов D3DQUERYTYPE_TIMESTAMP
+    uint64_t gpuFrameTimeUs_;       ///< время, добавляемое к счетчику в Present() (ожидание синхронизации)
+    MockDeviceCalls calls_;
+    IDirect3DBaseTexture9* texture_;
+    MockVertexBuffer* lastVertexBuffer_;
+    std::vector<IDirect3DBaseTexture9*> drawTextures_;  ///< текстура каждого вызова рисования
+    std::vector<UINT> drawPrimitives_;                  ///< число примитивов каждого вызова рисования
+
+private:
+    MockSurface* NewSurface(UINT width, UINT height, D3DFORMAT format, D3DMULTISAMPLE_TYPE multiSample,
+                            DWORD multiSampleQuality, DWORD usage){
+        calls_.numCreatedSurfaces_++;
+        D3DSURFACE_DESC desc;
+        ZeroMemory(&desc, sizeof(desc));
+        desc.Format = format;
+        desc.Type = D3DRTYPE_SURFACE;
+        desc.Usage = usage;
+        desc.MultiSampleType = multiSample;
+        desc.MultiSampleQuality = multiSampleQuality;
+        desc.Width = width;
+        desc.Height = height;
+        return new MockSurface(desc);
+    }
+};
+
+inline HRESULT MockQuery::Issue(DWORD flags){
+    if (flags & D3DISSUE_END){
+        numIssued_++;
+        numPolls_ = 0;
+        if (type_ == D3DQUERYTYPE_TIMESTAMP)
+            result_ = device_->gpuTimeUs_;
+    }
+    return D3D_OK;
+}
+
+inline HRESULT MockQuery::GetData(void* data, DWORD size, DWORD){
+    if (numIssued_ == 0 || numPolls_++ < readyDelay_)
+        return S_FALSE;
+    if (data == 0)
+        return S_OK;
+    switch (type_){
+    case D3DQUERYTYPE_TIMESTAMP:
+        memcpy(data, &result_, (size < sizeof(uint64_t)) ? size : sizeof(uint64_t));
+        break;
+    case D3DQUERYTYPE_TIMESTAMPFREQ:{
+        uint64_t freq = 1000000;
+        memcpy(data, &freq, (size < sizeof(uint64_t)) ? size : sizeof(uint64_t));
+        break;
+    }
+    case D3DQUERYTYPE_TIMESTAMPDISJOINT:{
+        BOOL fDisjoint = FALSE;
+        memcpy(data, &fDisjoint, (size < sizeof(BOOL)) ? size : sizeof(BOOL));
+        break;
+    }
+    default:{
+        DWORD pixels = static_cast<DWORD>(result_);
+        memcpy(data, &pixels, (size < sizeof(DWORD)) ? size : sizeof(DWORD));
+        break;
+    }
+    }
+    return S_OK;
+}
+
+/// Видеоадаптер модели
+struct MockAdapter{
+    D3DCAPS9 caps_;
+    D3DADAPTER_IDENTIFIER9 identifier_;
+    std::vector<D3DDISPLAYMODE> modes_;     ///< режимы формата D3DFMT_X8R8G8B8
+};
+
+class MockDirect3D : public MockObject<IDirect3D9>{
+public:
+    /// Создать модель с numAdapters независимыми адаптерами с аппаратной обработкой вершин
+    explicit MockDirect3D(UINT numAdapters = 1) : failFlags_(0), numCreateAttempts_(0){
+        adapters_.resize(numAdapters);
+        for (UINT i = 0; i < numAdapters; ++i){
+            MockAdapter& adapter = adapters_[i];
+            ZeroMemory(&adapter.caps_, sizeof(D3DCAPS9));
+            adapter.caps_.DeviceType = D3DDEVTYPE_HAL;
+            adapter.caps_.AdapterOrdinal = i;
+            adapter.caps_.DevCaps = D3DDEVCAPS_HWTRANSFORMANDLIGHT | D3DDEVCAPS_PUREDEVICE;
+            adapter.caps_.MaxStreams = 16;
+            adapter.caps_.VertexShaderVersion = D3DVS_VERSION(3, 0);
+            adapter.caps_.MasterAdapterOrdinal = i;
+            adapter.caps_.AdapterOrdinalInGroup = 0;
+            adapter.caps_.NumberOfAdaptersInGroup = 1;
+            ZeroMemory(&adapter.identifier_, sizeof(D3DADAPTER_IDENTIFIER9));
+            adapter.identifier_.VendorId = 0x10DE;
+            adapter.identifier_.DeviceId = 0x1000 + i;
+            adapter.identifier_.DriverVersion.QuadPart = 0x0006000E000B0000LL;
+            static const UINT s_sizes[][2] = { {640, 480}, {800, 600}, {1024, 768}, {1280, 720}, {1920, 1080} };
+            static const UINT s_rates[] = { 60, 75 };
+            for (size_t iSize = 0; iSize < sizeof(s_sizes) / sizeof(s_sizes[0]); ++iSize){
+                for (size_t iRate = 0; iRate < sizeof(s_rates) / sizeof(s_rates[0]); ++iRate){
+                    D3DDISPLAYMODE mode = { s_sizes[iSize][0], s_sizes[iSize][1], s_rates[iRate], D3DFMT_X8R8G8B8 };
+                    adapter.modes_.push_back(mode);
+                }
+            }
+        }
+    }
+
+    /// Объединить адаптеры first..first + numHeads - 1 в группу с главным адаптером master (голова 0)
+    void MakeGroup(UINT master, UINT first, UINT numHeads){
+        UINT iHead = 1;
+        for (UINT i = first; i < first + numHeads; ++i){
+            D3DCAPS9& caps = adapters_[i].caps_;
+            caps.MasterAdapterOrdinal = master;
+            caps.AdapterOrdinalInGroup = (i == master) ? 0 : iHead++;
+            caps.NumberOfAdaptersInGroup = numHeads;
+        }
+    }
+
+    UINT GetAdapterCount() { return static_cast<UINT>(adapters_.size()); }
+    HRESULT GetAdapterIdentifier(UINT adapter, DWORD, D3DADAPTER_IDENTIFIER9* identifier){
+        if (adapter >= adapters_.size())
+            return D3DERR_INVALIDCALL;
+        *identifier = adapters_[adapter].identifier_;
+        return D3D_OK;
+    }
+    UINT GetAdapterModeCount(UINT adapter, D3DFORMAT format){
+        if (adapter >= adapters_.size() || format != D3DFMT_X8R8G8B8)
+            return 0;
+        return static_cast<UINT>(adapters_[adapter].modes_.size());
+    }
+    HRESULT EnumAdapterModes(UINT adapter, D3DFORMAT format, UINT iMode, D3DDISPLAYMODE* mode){
+        if (iMode >= GetAdapterModeCount(adapter, format))
+            return D3DERR_INVALIDCALL;
+        *mode = adapters_[adapter].modes_[iMode];
+        return D3D_OK;
+    }
+    HRESULT GetAdapterDisplayMode(UINT adapter, D3DDISPLAYMODE* mode){
+        if (adapter >= adapters_.size())
+            return D3DERR_INVALIDCALL;
+        *mode = adapters_[adapter].modes_.back();
+        return D3D_OK;
+    }
+    HRESULT CheckDeviceType(UINT adapter, D3DDEVTYPE, D3DFORMAT displayFormat, D3DFORMAT, BOOL){
+        return (adapter < adapters_.size() && displayFormat == D3DFMT_X8R8G8B8) ? D3D_OK : D3DERR_NOTAVAILABLE;
+    }
+    HRESULT CheckDeviceFormat(UINT, D3DDEVTYPE, D3DFORMAT, DWORD usage, D3DRESOURCETYPE, D3DFORMAT checkFormat){
+        if (usage & D3DUSAGE_DEPTHSTENCIL)
+            return (checkFormat == D3DFMT_D24S8 || checkFormat == D3DFMT_D16) ? D3D_OK : D3DERR_NOTAVAILABLE;
+        return D3D_OK;
+    }
+    HRESULT CheckDeviceMultiSampleType(UINT, D3DDEVTYPE, D3DFORMAT, BOOL, D3DMULTISAMPLE_TYPE multiSampleType, DWORD* qualityLevels){
+        if (multiSampleType > D3DMULTISAMPLE_4_SAMPLES)
+            return D3DERR_NOTAVAILABLE;
+        if (qualityLevels != 0)
+            *qualityLevels = 2;
+        return D3D_OK;
+    }
+    HRESULT CheckDepthStencilMatch(UINT, D3DDEVTYPE, D3DFORMAT, D3DFORMAT, D3DFORMAT) { return D3D_OK; }
+    HRESULT GetDeviceCaps(UINT adapter, D3DDEVTYPE, D3DCAPS9* caps){
+        if (adapter >= adapters_.size())
+            return D3DERR_INVALIDCALL;
+        *caps = adapters_[adapter].caps_;
+        return D3D_OK;
+    }
+    HRESULT CreateDevice(UINT adapter, D3DDEVTYPE devType, HWND hFocusWindow, DWORD behaviorFlags,
+                         D3DPRESENT_PARAMETERS* presentParams, IDirect3DDevice9** device){
+        numCreateAttempts_++;
+        attemptedFlags_.push_back(behaviorFlags);
+        if (adapter >= adapters_.size() || (behaviorFlags & failFlags_) != 0)
+            return D3DERR_NOTAVAILABLE;
+        UINT numHeads = 1;
+        if (behaviorFlags & D3DCREATE_ADAPTERGROUP_DEVICE)
+            numHeads = adapters_[adapter].caps_.NumberOfAdaptersInGroup;
+        D3DDEVICE_CREATION_PARAMETERS creationParams;
+        creationParams.AdapterOrdinal = adapter;
+        creationParams.DeviceType = devType;
+        creationParams.hFocusWindow = hFocusWindow;
+        creationParams.BehaviorFlags = behaviorFlags;
+        *device = new MockDevice(creationParams, presentParams, numHeads);
+        return D3D_OK;
+    }
+
+    std::vector<MockAdapter> adapters_;
+    DWORD failFlags_;                       ///< CreateDevice() завершается неудачей при любом из этих флагов
+    int numCreateAttempts_;
+    std::vector<DWORD> attemptedFlags_;     ///< флаги всех вызовов CreateDevice()
+};
+
+} // end of z3DTest
+#endif // Z3D_TEST_MOCKDEVICE_H
@@ -0,0 +1,92 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Устройство адаптерной группы на модели с двумя головами: состав группы, перебор флагов создания,
+рендер голов и отказ D3D9HL_SwitchVideoMode() переключать устройство группы.
+*/
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+bool ReleaseResources() { return true; }
+bool ResetResources() { return true; }
+
+z3DD3D9HL_VideoMode MakeVideoMode(UINT width, UINT height){
+    z3DD3D9HL_VideoMode videoMode;
+    ZeroMemory(&videoMode, sizeof(videoMode));
+    videoMode.d3ddm_.Width = width;
+    videoMode.d3ddm_.Height = height;
+    videoMode.d3ddm_.RefreshRate = 60;
+    videoMode.d3ddm_.Format = D3DFMT_X8R8G8B8;
+    videoMode.bpp_ = 32;
+    videoMode.depthStencilFmt_ = D3DFMT_D24S8;
+    return videoMode;
+}
+} // end of namespace
+
+int main(){
+    // Адаптер 0 - отдельный, адаптеры 1 (главный) и 2 - головы одной группы
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D(3);
+    d3d->MakeGroup(1, 1, 2);
+
+    z3DD3D9HL_AdapterGroup group;
+    Z3D_TEST_CHECK(z3D::D3D9HL_GetAdapterGroup(&group, d3d, 0) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(group.masterAdapter_ == 0 && group.numHeads_ == 1 && group.adapters_[0] == 0);
+    Z3D_TEST_CHECK(z3D::D3D9HL_GetAdapterGroup(&group, d3d, 2) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(group.masterAdapter_ == 1 && group.numHeads_ == 2);
+    Z3D_TEST_CHECK(group.adapters_[0] == 1 && group.adapters_[1] == 2);
+
+    // Аппаратная обработка вершин недоступна: группа создается со смешанной, флаг группы - в каждой попытке
+    d3d->failFlags_ = D3DCREATE_HARDWARE_VERTEXPROCESSING;
+    z3DD3D9HL_VideoMode videoModes[2] = { MakeVideoMode(1024, 768), MakeVideoMode(1280, 720) };
+    HWND hWnds[2] = { reinterpret_cast<HWND>(1), reinterpret_cast<HWND>(2) };
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams[2];
+    uint32_t vertexProcessingType = 0;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateGroupDevice(&device, presentParams, &vertexProcessingType, d3d, group,
+                                                 videoModes, hWnds) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(vertexProcessingType == D3DCREATE_MIXED_VERTEXPROCESSING);
+    Z3D_TEST_CHECK(d3d->numCreateAttempts_ == 2);
+    for (size_t i = 0; i < d3d->attemptedFlags_.size(); ++i)
+        Z3D_TEST_CHECK((d3d->attemptedFlags_[i] & D3DCREATE_ADAPTERGROUP_DEVICE) != 0);
+    Z3D_TEST_CHECK(device != 0 && device->GetNumberOfSwapChains() == 2);
+    Z3D_TEST_CHECK(presentParams[0].BackBufferWidth == 1024 && presentParams[1].BackBufferWidth == 1280);
+    Z3D_TEST_CHECK(presentParams[0].hDeviceWindow == hWnds[0] && presentParams[1].hDeviceWindow == hWnds[1]);
+    // Результат запоминается для главного адаптера без флага группы
+    z3DD3D9HL_DeviceCreationOutcome outcome;
+    Z3D_TEST_CHECK(z3D::D3D9HL_GetDeviceCreationOutcome(&outcome, 1) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(outcome.behaviorFlags_ == D3DCREATE_MIXED_VERTEXPROCESSING);
+    z3DTest::MockDevice* mockDevice = static_cast<z3DTest::MockDevice*>(device);
+
+    // Пул поверхностей берет параметры заднего буфера первой головы
+    z3DD3D9HL_RTPool pool;
+    Z3D_TEST_CHECK(z3D::D3D9HL_RTPoolInit(&pool, device) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(pool.width_ == 1024 && pool.height_ == 768);
+
+    // Кадр обеих голов между одной парой Begin/End
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_SetHeadRenderTarget(device, 0) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_SetHeadRenderTarget(device, 1) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_SetHeadRenderTarget(device, 2) == Z3D_D3D9HL_INVALIDCALL);
+    Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(mockDevice->calls_.numPresents_ == 1);
+
+    // Переключение видеорежима устройства группы отклоняется без Reset() и освобождения ресурсов
+    D3DPRESENT_PARAMETERS savedParams = presentParams[1];
+    LPDIRECT3DDEVICE9 groupDevice = device;
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, presentParams, 0, 0, d3d, MakeVideoMode(800, 600),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0, false, false, 1)
+                   == Z3D_D3D9HL_INVALIDCALL);
+    Z3D_TEST_CHECK(device == groupDevice && mockDevice->calls_.numResets_ == 0);
+    Z3D_TEST_CHECK(presentParams[0].BackBufferWidth == 1024 && presentParams[1].BackBufferWidth == savedParams.BackBufferWidth);
+    Z3D_TEST_CHECK(pool.width_ == 1024);
+
+    z3D::D3D9HL_RTPoolShutdown(&pool);
+    device->Release();
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("MultiHeadTest");
+}
@@ -0,0 +1,267 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Кэш объявлений вершин и шейдеров: одновременные запросы из нескольких потоков, нехватка памяти
+для ключей под нагрузкой, перезагрузка и пересоздание устройства.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+bool ReleaseResources() { return true; }
+bool ResetResources() { return true; }
+
+z3DD3D9HL_VideoMode MakeVideoMode(UINT width, UINT height){
+    z3DD3D9HL_VideoMode videoMode;
+    ZeroMemory(&videoMode, sizeof(videoMode));
+    videoMode.d3ddm_.Width = width;
+    videoMode.d3ddm_.Height = height;
+    videoMode.d3ddm_.RefreshRate = 60;
+    videoMode.d3ddm_.Format = D3DFMT_X8R8G8B8;
+    videoMode.bpp_ = 32;
+    videoMode.depthStencilFmt_ = D3DFMT_D24S8;
+    return videoMode;
+}
+
+const uint32_t s_numThreads = 8;
+const uint32_t s_numKeys = 96;
+const uint32_t s_smallKeyMemSize = 1024;
+
+typedef std::vector<std::vector<DWORD> > ShaderList;
+
+/* Байт-код вершинного шейдера с меткой tag. Каждый третий ключ больше s_smallKeyMemSize, так что при
+малой памяти для ключей его запросы всегда не удаются, а маленькие ключи разного размера еще помещаются.
+*/
+std::vector<DWORD> MakeShader(uint32_t tag){
+    uint32_t numTokens = (tag % 3 == 0) ? 300 : (tag % 4) + 1;
+    std::vector<DWORD> function(numTokens + 2, tag);
+    function[0] = 0xFFFE0200;
+    function[numTokens + 1] = 0x0000FFFF;
+    return function;
+}
+
+// Запросы одного потока: все ключи, начиная с first_
+struct RequestTask{
+    z3DD3D9HL_ObjCache* objCache_;
+    const ShaderList* shaders_;
+    uint32_t first_;
+    volatile int32_t* start_;
+    std::vector<uint32_t> handles_;     // Z3D_D3D9HL_NOINDEX, если запрос не удался
+    uint32_t numErrors_;                // число ошибок, кроме нехватки памяти
+};
+
+void* RequestThreadProc(void* param){
+    RequestTask* task = static_cast<RequestTask*>(param);
+    const ShaderList& shaders = *task->shaders_;
+    task->handles_.assign(shaders.size(), Z3D_D3D9HL_NOINDEX);
+    task->numErrors_ = 0;
+    // Потоки начинают одновременно, чтобы запросы действительно пересекались
+    while (*task->start_ == 0)
+        sched_yield();
+    for (uint32_t i = 0; i < shaders.size(); ++i){
+        uint32_t iKey = (task->first_ + i) % static_cast<uint32_t>(shaders.size());
+        uint32_t handle;
+        z3DD3D9HL_ErrCodes err = z3D::D3D9HL_ObjCacheRequestVertexShader(task->objCache_, &shaders[iKey][0], &handle);
+        if (err == Z3D_D3D9HL_NONE)
+            task->handles_[iKey] = handle;
+        else if (err != Z3D_D3D9HL_OUTOFMEMORY)
+            task->numErrors_++;
+    }
+    return 0;
+}
+
+/* Все потоки запрашивают все ключи в разном порядке.
+    @return число ключей, запрос которых удался.
+*/
+uint32_t RunRequests(z3DD3D9HL_ObjCache* objCache, const ShaderList& shaders, std::vector<RequestTask>* tasks){
+    volatile int32_t start = 0;
+    tasks->resize(s_numThreads);
+    std::vector<pthread_t> threads(s_numThreads);
+    for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread){
+        RequestTask& task = (*tasks)[iThread];
+        task.objCache_ = objCache;
+        task.shaders_ = &shaders;
+        task.first_ = iThread * 13;
+        task.start_ = &start;
+        pthread_create(&threads[iThread], 0, RequestThreadProc, &task);
+    }
+    start = 1;
+    for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread)
+        pthread_join(threads[iThread], 0);
+
+    // Каждый поток, получивший ключ, получил ту же запись
+    uint32_t numKeys = 0;
+    for (uint32_t iKey = 0; iKey < shaders.size(); ++iKey){
+        uint32_t handle = Z3D_D3D9HL_NOINDEX;
+        for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread){
+            const RequestTask& task = (*tasks)[iThread];
+            Z3D_TEST_CHECK(task.numErrors_ == 0);
+            if (task.handles_[iKey] == Z3D_D3D9HL_NOINDEX)
+                continue;
+            if (handle == Z3D_D3D9HL_NOINDEX)
+                handle = task.handles_[iKey];
+            Z3D_TEST_CHECK(task.handles_[iKey] == handle);
+        }
+        if (handle != Z3D_D3D9HL_NOINDEX)
+            numKeys++;
+    }
+    return numKeys;
+}
+
+/* Ключ записи не испорчен: повторный запрос находит ту же запись, а шейдер создан из того же байт-кода.
+*/
+void CheckEntry(z3DD3D9HL_ObjCache* objCache, const std::vector<DWORD>& function, uint32_t handle){
+    uint32_t again = Z3D_D3D9HL_NOINDEX;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheRequestVertexShader(objCache, &function[0], &again) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(again == handle);
+    z3DTest::MockVertexShader* shader = static_cast<z3DTest::MockVertexShader*>(z3D::D3D9HL_ObjCacheGetVertexShader(objCache, handle));
+    Z3D_TEST_CHECK(shader != 0 && shader->function_ == function);
+}
+
+/* Одновременные запросы одинаковых ключей: каждый ключ занимает одну запись и создается один раз.
+*/
+void TestConcurrentRequests(LPDIRECT3DDEVICE9 device){
+    static uint8_t s_mem[64 * 1024];
+    z3DD3D9HL_Arena arena;
+    z3D::D3D9HL_ArenaInit(&arena, s_mem, sizeof(s_mem));
+    z3DD3D9HL_ObjCache objCache;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheInit(&objCache, &arena, 2 * s_numKeys, 48 * 1024) == Z3D_D3D9HL_NONE);
+    ShaderList shaders;
+    for (uint32_t iKey = 0; iKey < s_numKeys; ++iKey)
+        shaders.push_back(MakeShader(iKey + 1));
+
+    std::vector<RequestTask> tasks;
+    Z3D_TEST_CHECK(RunRequests(&objCache, shaders, &tasks) == s_numKeys);
+    z3DD3D9HL_ObjCacheStats stats;
+    z3D::D3D9HL_ObjCacheGetStats(&stats, &objCache);
+    Z3D_TEST_CHECK(stats.numEntries_ == s_numKeys && stats.numPending_ == s_numKeys);
+    Z3D_TEST_CHECK(stats.numLookups_ == s_numKeys * s_numThreads && stats.numHits_ == s_numKeys * (s_numThreads - 1));
+    int numLive = z3DTest::MockNumLiveObjects();
+    uint32_t numCreated = 0;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheCreatePending(&objCache, device, &numCreated) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(numCreated == s_numKeys && z3DTest::MockNumLiveObjects() == numLive + static_cast<int>(s_numKeys));
+    for (uint32_t iKey = 0; iKey < s_numKeys; ++iKey)
+        CheckEntry(&objCache, shaders[iKey], tasks[0].handles_[iKey]);
+    z3D::D3D9HL_ObjCacheShutdown(&objCache);
+}
+
+/* Память для ключей заканчивается под нагрузкой: часть запросов получает Z3D_D3D9HL_OUTOFMEMORY,
+но ключи удавшихся запросов не перекрываются. Повторяется на разных наборах ключей.
+*/
+void TestKeyMemContention(LPDIRECT3DDEVICE9 device){
+    static uint8_t s_mem[64 * 1024];
+    const uint32_t numRounds = 200;
+    z3DD3D9HL_Arena arena;
+    z3D::D3D9HL_ArenaInit(&arena, s_mem, sizeof(s_mem));
+    for (uint32_t iRound = 0; iRound < numRounds; ++iRound){
+        z3DD3D9HL_ObjCache objCache;
+        Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheInit(&objCache, &arena, 2 * s_numKeys, s_smallKeyMemSize) == Z3D_D3D9HL_NONE);
+        ShaderList shaders;
+        for (uint32_t iKey = 0; iKey < s_numKeys; ++iKey)
+            shaders.push_back(MakeShader(iRound * s_numKeys + iKey + 1));
+
+        std::vector<RequestTask> tasks;
+        uint32_t numKeys = RunRequests(&objCache, shaders, &tasks);
+        z3DD3D9HL_ObjCacheStats stats;
+        z3D::D3D9HL_ObjCacheGetStats(&stats, &objCache);
+        Z3D_TEST_CHECK(numKeys > 0 && numKeys < s_numKeys);
+        Z3D_TEST_CHECK(stats.numEntries_ == numKeys && stats.keyBytes_ <= s_smallKeyMemSize);
+        Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheCreatePending(&objCache, device) == Z3D_D3D9HL_NONE);
+        for (uint32_t iKey = 0; iKey < s_numKeys; ++iKey){
+            for (uint32_t iThread = 0; iThread < s_numThreads; ++iThread){
+                if (tasks[iThread].handles_[iKey] != Z3D_D3D9HL_NOINDEX){
+                    CheckEntry(&objCache, shaders[iKey], tasks[iThread].handles_[iKey]);
+                    break;
+                }
+            }
+        }
+        z3D::D3D9HL_ObjCacheShutdown(&objCache);
+        z3D::D3D9HL_ArenaReset(&arena);
+    }
+}
+} // end of namespace
+
+int main(){
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D(2);
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, MakeVideoMode(800, 600)) == Z3D_D3D9HL_NONE);
+    TestConcurrentRequests(device);
+    TestKeyMemContention(device);
+
+    static uint8_t s_mem[64 * 1024];
+    z3DD3D9HL_Arena arena;
+    z3D::D3D9HL_ArenaInit(&arena, s_mem, sizeof(s_mem));
+    z3DD3D9HL_ObjCache objCache;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheInit(&objCache, &arena, 64, 4096) == Z3D_D3D9HL_NONE);
+
+    D3DVERTEXELEMENT9 elements[] = {
+        { 0, 0, D3DDECLTYPE_FLOAT3, D3DDECLMETHOD_DEFAULT, D3DDECLUSAGE_POSITION, 0 },
+        D3DDECL_END()
+    };
+    const DWORD vsFunction[] = { 0xFFFE0200, 0x0000FFFF };
+    const DWORD psFunction[] = { 0xFFFF0200, 0x0000FFFF };
+    uint32_t hDecl, hVS, hPS;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheRequestVertexDecl(&objCache, elements, &hDecl) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheRequestVertexShader(&objCache, vsFunction, &hVS) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheRequestPixelShader(&objCache, psFunction, &hPS) == Z3D_D3D9HL_NONE);
+    uint32_t numCreated = 0;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheCreatePending(&objCache, device, &numCreated) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(numCreated == 3);
+    LPDIRECT3DVERTEXDECLARATION9 decl = z3D::D3D9HL_ObjCacheGetVertexDecl(&objCache, hDecl);
+    Z3D_TEST_CHECK(decl != 0);
+    int numLive = z3DTest::MockNumLiveObjects();
+
+    // Reset(): объекты остаются
+    z3DD3D9HL_ModeSwitchStats stats;
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, &stats, d3d, MakeVideoMode(1024, 768),
+                                               ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(!stats.fRecreated_);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheGetVertexDecl(&objCache, hDecl) == decl);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheCreatePending(&objCache, device, &numCreated) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(numCreated == 0);
+
+    // Пересоздание на другом адаптере: объекты прежнего устройства освобождены, записи ждут создания
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, &stats, d3d, MakeVideoMode(1024, 768),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0,
+                                               false, false, 1) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(stats.fRecreated_);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheGetVertexDecl(&objCache, hDecl) == 0);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheGetVertexShader(&objCache, hVS) == 0);
+    // Прежнее устройство и три его объекта уничтожены, новое устройство создано
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == numLive - 3);
+    z3DD3D9HL_ObjCacheStats cacheStats;
+    z3D::D3D9HL_ObjCacheGetStats(&cacheStats, &objCache);
+    Z3D_TEST_CHECK(cacheStats.numPending_ == 3 && cacheStats.numObjects_ == 0);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheCreatePending(&objCache, device, &numCreated) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(numCreated == 3);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheGetPixelShader(&objCache, hPS) != 0);
+
+    // Устройство, пересозданное приложением без D3D9HL_SwitchVideoMode()
+    device->Release();
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, MakeVideoMode(800, 600)) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheCreatePending(&objCache, device, &numCreated) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(numCreated == 3);
+
+    // После останова слушатель удален: повторная регистрация того же кэша проходит
+    z3D::D3D9HL_ObjCacheShutdown(&objCache);
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, &stats, d3d, MakeVideoMode(800, 600),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0,
+                                               false, false, 1) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(stats.fRecreated_);
+    z3D::D3D9HL_ArenaReset(&arena);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ObjCacheInit(&objCache, &arena, 64, 4096) == Z3D_D3D9HL_NONE);
+    z3D::D3D9HL_ObjCacheShutdown(&objCache);
+
+    device->Release();
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("ObjCacheTest");
+}
@@ -0,0 +1,205 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Отсечение запросами перекрытия. Моделирование результатами D3D9HL_OcclusionSetResult(): видимый объект
+не проверяется visibleFrames_ кадров, невидимый не рисуется и проверяется параллелепипедом, запрос без
+результата отменяется через maxLatencyFrames_ кадров, при нехватке запросов объект рисуется без запроса.
+На модели устройства запросы освобождаются и создаются заново при смене видеорежима и пересоздании устройства.
+*/
+
+#include <vector>
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+static char s_mem[1 << 16];
+
+bool ReleaseResources() { return true; }
+bool ResetResources() { return true; }
+
+z3DD3D9HL_VideoMode MakeVideoMode(UINT width, UINT height){
+    z3DD3D9HL_VideoMode videoMode;
+    ZeroMemory(&videoMode, sizeof(videoMode));
+    videoMode.d3ddm_.Width = width;
+    videoMode.d3ddm_.Height = height;
+    videoMode.d3ddm_.RefreshRate = 60;
+    videoMode.d3ddm_.Format = D3DFMT_X8R8G8B8;
+    videoMode.bpp_ = 32;
+    videoMode.depthStencilFmt_ = D3DFMT_D24S8;
+    return videoMode;
+}
+
+void OnRelease(LPDIRECT3DDEVICE9, void*) {}
+
+z3DD3D9HL_OcclusionParams MakeParams(){
+    z3DD3D9HL_OcclusionParams params;
+    params.visibleFrames_ = 4;
+    params.visiblePixels_ = 1;
+    params.maxLatencyFrames_ = 2;
+    return params;
+}
+
+/* Проверить объект и выдать запрос, если он выделен.
+*/
+z3DD3D9HL_OcclusionAction TestObject(z3DD3D9HL_Occlusion* occlusion, uint32_t iObject){
+    z3DD3D9HL_OcclusionAction action = z3D::D3D9HL_OcclusionTest(occlusion, iObject);
+    if (action == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED || action == Z3D_D3D9HL_OCCLUSION_QUERY_BOX){
+        Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionBeginQuery(occlusion, iObject) == Z3D_D3D9HL_NONE);
+        Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionEndQuery(occlusion, iObject) == Z3D_D3D9HL_NONE);
+    }
+    return action;
+}
+
+/* Видимый объект, ставший невидимым, и запрос, результат которого не пришел.
+*/
+void TestVisibility(z3DD3D9HL_Arena* arena){
+    z3DD3D9HL_Occlusion occlusion;
+    Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionInit(&occlusion, arena, 1, 1, MakeParams()) == Z3D_D3D9HL_NONE);
+    z3DD3D9HL_OcclusionStats stats;
+
+    // Кадр 1: объект еще не проверялся и рисуется внутри запроса
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 0) == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED);
+
+    // Кадры 2-5: объект видим и visibleFrames_ кадров рисуется без запроса
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    z3D::D3D9HL_OcclusionSetResult(&occlusion, 0, 100);
+    for (uint32_t i = 0; i < 4; ++i){
+        if (i > 0)
+            z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+        Z3D_TEST_CHECK(TestObject(&occlusion, 0) == Z3D_D3D9HL_OCCLUSION_DRAW);
+    }
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    z3D::D3D9HL_OcclusionGetStats(&stats, &occlusion);
+    Z3D_TEST_CHECK(stats.numTests_ == 1 && stats.numQueriesSaved_ == 1 && stats.numQueries_ == 0);
+
+    // Кадр 6: повторная проверка
+    Z3D_TEST_CHECK(TestObject(&occlusion, 0) == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED);
+
+    // Кадр 7: ни одного пикселя - объект не рисуется, проверяется параллелепипед
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    z3D::D3D9HL_OcclusionSetResult(&occlusion, 0, 0);
+    Z3D_TEST_CHECK(!occlusion.objects_[0].fVisible_ && occlusion.objects_[0].lastPixels_ == 0);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 0) == Z3D_D3D9HL_OCCLUSION_QUERY_BOX);
+
+    // Кадры 8-9: результата нет, объект остается невидимым
+    for (uint32_t i = 0; i < 2; ++i){
+        z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+        Z3D_TEST_CHECK(TestObject(&occlusion, 0) == Z3D_D3D9HL_OCCLUSION_SKIP);
+    }
+    z3D::D3D9HL_OcclusionGetStats(&stats, &occlusion);
+    Z3D_TEST_CHECK(stats.numCulled_ == 1 && stats.numResults_ == 0);
+
+    // Кадр 10: запрос ждет дольше maxLatencyFrames_ кадров и отменяется, объект считается видимым
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    Z3D_TEST_CHECK(occlusion.objects_[0].iQuery_ == Z3D_D3D9HL_NOINDEX && occlusion.objects_[0].fVisible_);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 0) == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED);
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    z3D::D3D9HL_OcclusionGetStats(&stats, &occlusion);
+    Z3D_TEST_CHECK(stats.numAbandoned_ == 1 && stats.numQueries_ == 1);
+}
+
+/* Запросов меньше, чем объектов: лишние объекты рисуются без запроса.
+*/
+void TestPoolExhausted(z3DD3D9HL_Arena* arena){
+    z3DD3D9HL_Occlusion occlusion;
+    Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionInit(&occlusion, arena, 3, 2, MakeParams()) == Z3D_D3D9HL_NONE);
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 0) == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 1) == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 2) == Z3D_D3D9HL_OCCLUSION_DRAW);
+    Z3D_TEST_CHECK(occlusion.objects_[2].iQuery_ == Z3D_D3D9HL_NOINDEX);
+
+    // Освободившийся запрос достается объекту, оставшемуся без проверки
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    z3DD3D9HL_OcclusionStats stats;
+    z3D::D3D9HL_OcclusionGetStats(&stats, &occlusion);
+    Z3D_TEST_CHECK(stats.numTests_ == 3 && stats.numQueries_ == 2 && stats.numPoolExhausted_ == 1);
+    z3D::D3D9HL_OcclusionSetResult(&occlusion, 0, 100);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 2) == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED);
+}
+
+/* Таблица слушателей заполнена: запросы не создаются и не удерживаются.
+*/
+void TestCreateFailure(LPDIRECT3DDEVICE9 device, z3DD3D9HL_Arena* arena){
+    std::vector<z3DD3D9HL_DeviceListener> dummies;
+    for (uintptr_t i = 1; ; ++i){
+        z3DD3D9HL_DeviceListener listener = { OnRelease, 0, 0, reinterpret_cast<void*>(i) };
+        if (z3D::D3D9HL_AddDeviceListener(listener) != Z3D_D3D9HL_NONE)
+            break;
+        dummies.push_back(listener);
+    }
+    int numLive = z3DTest::MockNumLiveObjects();
+    z3DD3D9HL_Occlusion occlusion;
+    Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionInit(&occlusion, arena, 2, 2, MakeParams()) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionCreateQueries(&occlusion, device) == Z3D_D3D9HL_OUTOFMEMORY);
+    Z3D_TEST_CHECK(occlusion.device_ == 0 && occlusion.numFreeQueries_ == 0);
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == numLive);
+    for (size_t i = 0; i < dummies.size(); ++i)
+        z3D::D3D9HL_RemoveDeviceListener(dummies[i]);
+}
+
+/* Запросы на модели устройства: результат читается в следующем кадре, смена видеорежима отменяет
+незавершенные запросы и создает их заново, пересоздание устройства переносит пул на новое устройство.
+*/
+void TestDevice(z3DTest::MockDirect3D* d3d, z3DD3D9HL_Arena* arena){
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, MakeVideoMode(800, 600)) == Z3D_D3D9HL_NONE);
+    TestCreateFailure(device, arena);
+
+    z3DD3D9HL_Occlusion occlusion;
+    int numCreated = static_cast<z3DTest::MockDevice*>(device)->calls_.numCreatedQueries_;
+    Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionInit(&occlusion, arena, 2, 2, MakeParams()) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionCreateQueries(&occlusion, device) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(static_cast<z3DTest::MockDevice*>(device)->calls_.numCreatedQueries_ == numCreated + 2);
+
+    // Результат запроса без пикселей: в следующем кадре объект проверяется параллелепипедом
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 1) == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED);
+    Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionPoll(&occlusion) == 0);
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    Z3D_TEST_CHECK(z3D::D3D9HL_OcclusionPoll(&occlusion) == 1);
+    Z3D_TEST_CHECK(!occlusion.objects_[1].fVisible_);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 1) == Z3D_D3D9HL_OCCLUSION_QUERY_BOX);
+
+    // Смена видеорежима: запрос кадра отменяется, запросы создаются заново
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(1024, 768),
+                                               ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(static_cast<z3DTest::MockDevice*>(device)->calls_.numCreatedQueries_ == numCreated + 4);
+    Z3D_TEST_CHECK(occlusion.device_ == device && occlusion.numFreeQueries_ == 2);
+    Z3D_TEST_CHECK(occlusion.objects_[1].iQuery_ == Z3D_D3D9HL_NOINDEX && occlusion.objects_[1].fVisible_);
+    Z3D_TEST_CHECK(occlusion.frameStats_.numAbandoned_ == 1);
+
+    // Пересоздание устройства на другом адаптере: запросы создаются на новом устройстве
+    int numLive = z3DTest::MockNumLiveObjects();
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(1024, 768),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0, false, false, 1)
+                   == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == numLive);
+    Z3D_TEST_CHECK(static_cast<z3DTest::MockDevice*>(device)->calls_.numCreatedQueries_ == 2);
+    Z3D_TEST_CHECK(occlusion.device_ == device && occlusion.numFreeQueries_ == 2);
+    z3D::D3D9HL_OcclusionBeginFrame(&occlusion);
+    Z3D_TEST_CHECK(TestObject(&occlusion, 1) == Z3D_D3D9HL_OCCLUSION_DRAW_QUERIED);
+
+    z3D::D3D9HL_OcclusionShutdown(&occlusion);
+    Z3D_TEST_CHECK(occlusion.device_ == 0);
+    device->Release();
+}
+} // end of namespace
+
+int main(){
+    z3DD3D9HL_Arena arena;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaInit(&arena, s_mem, sizeof(s_mem)) == Z3D_D3D9HL_NONE);
+    TestVisibility(&arena);
+    TestPoolExhausted(&arena);
+
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D(2);
+    TestDevice(d3d, &arena);
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("OcclusionTest");
+}
@@ -0,0 +1,115 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Пул поверхностей рендера на модели устройства: параметры по умолчанию берутся из заднего буфера
+и буфера глубины, в том числе в оконном режиме, после смены видеорежима и после потери буфера глубины. Пул получает события
+только своего устройства, в том числе после его пересоздания.
+*/
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+bool ReleaseResources() { return true; }
+bool ResetResources() { return true; }
+
+z3DD3D9HL_VideoMode MakeVideoMode(UINT width, UINT height, D3DFORMAT depthStencilFmt){
+    z3DD3D9HL_VideoMode videoMode;
+    ZeroMemory(&videoMode, sizeof(videoMode));
+    videoMode.d3ddm_.Width = width;
+    videoMode.d3ddm_.Height = height;
+    videoMode.d3ddm_.RefreshRate = 60;
+    videoMode.d3ddm_.Format = D3DFMT_X8R8G8B8;
+    videoMode.bpp_ = 32;
+    videoMode.depthStencilFmt_ = depthStencilFmt;
+    return videoMode;
+}
+
+void CheckSurface(LPDIRECT3DSURFACE9 surface, UINT width, UINT height, D3DFORMAT format){
+    D3DSURFACE_DESC desc;
+    Z3D_TEST_CHECK(surface != 0 && SUCCEEDED(surface->GetDesc(&desc)));
+    if (surface != 0)
+        Z3D_TEST_CHECK(desc.Width == width && desc.Height == height && desc.Format == format);
+}
+} // end of namespace
+
+int main(){
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D(2);
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    // Оконный режим: видеорежим рабочего стола 1920x1080, окно модели 640x480
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, MakeVideoMode(1920, 1080, D3DFMT_D24S8),
+                                            D3DMULTISAMPLE_NONE, 0, true) == Z3D_D3D9HL_NONE);
+
+    z3DD3D9HL_RTPool pool;
+    Z3D_TEST_CHECK(z3D::D3D9HL_RTPoolInit(&pool, device) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(pool.width_ == 640 && pool.height_ == 480);
+    Z3D_TEST_CHECK(pool.colorFmt_ == D3DFMT_X8R8G8B8 && pool.depthFmt_ == D3DFMT_D24S8);
+
+    z3DD3D9HL_RTDesc colorDesc, depthDesc;
+    ZeroMemory(&colorDesc, sizeof(colorDesc));
+    ZeroMemory(&depthDesc, sizeof(depthDesc));
+    depthDesc.fDepth_ = true;
+    LPDIRECT3DSURFACE9 surface = 0;
+    z3D::D3D9HL_RTPoolBeginFrame(&pool);
+    Z3D_TEST_CHECK(z3D::D3D9HL_RTPoolAcquire(&surface, 0, &pool, device, colorDesc, 0, 0) == Z3D_D3D9HL_NONE);
+    CheckSurface(surface, 640, 480, D3DFMT_X8R8G8B8);
+    Z3D_TEST_CHECK(z3D::D3D9HL_RTPoolAcquire(&surface, 0, &pool, device, depthDesc, 0, 0) == Z3D_D3D9HL_NONE);
+    CheckSurface(surface, 640, 480, D3DFMT_D24S8);
+
+    // Полноэкранный режим с другим форматом глубины: пул освобождается и берет новые параметры
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(1024, 768, D3DFMT_D16),
+                                               ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(pool.numSurfaces_ == 0);
+    Z3D_TEST_CHECK(pool.width_ == 1024 && pool.height_ == 768 && pool.depthFmt_ == D3DFMT_D16);
+    z3D::D3D9HL_RTPoolBeginFrame(&pool);
+    Z3D_TEST_CHECK(z3D::D3D9HL_RTPoolAcquire(&surface, 0, &pool, device, depthDesc, 0, 0) == Z3D_D3D9HL_NONE);
+    CheckSurface(surface, 1024, 768, D3DFMT_D16);
+
+    // Снова оконный режим
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(1920, 1080, D3DFMT_D24S8),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0, true) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(pool.width_ == 640 && pool.height_ == 480 && pool.depthFmt_ == D3DFMT_D24S8);
+
+    // Восстановление потерянного устройства без буфера глубины: прежний формат глубины не остается
+    z3DTest::MockDevice* mockDevice = static_cast<z3DTest::MockDevice*>(device);
+    mockDevice->cooperativeLevel_ = D3DERR_DEVICENOTRESET;
+    presentParams.EnableAutoDepthStencil = FALSE;
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources)
+                   == Z3D_D3D9HL_DEVICE_NOT_RESET);
+    Z3D_TEST_CHECK(pool.width_ == 640 && pool.depthFmt_ == D3DFMT_UNKNOWN);
+
+    // Второе устройство со своим пулом: смена видеорежима первого устройства его не затрагивает
+    LPDIRECT3DDEVICE9 otherDevice = 0;
+    D3DPRESENT_PARAMETERS otherParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&otherDevice, &otherParams, 0, d3d, MakeVideoMode(800, 600, D3DFMT_D16))
+                   == Z3D_D3D9HL_NONE);
+    z3DD3D9HL_RTPool otherPool;
+    Z3D_TEST_CHECK(z3D::D3D9HL_RTPoolInit(&otherPool, otherDevice) == Z3D_D3D9HL_NONE);
+    z3D::D3D9HL_RTPoolBeginFrame(&otherPool);
+    Z3D_TEST_CHECK(z3D::D3D9HL_RTPoolAcquire(&surface, 0, &otherPool, otherDevice, colorDesc, 0, 0) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(1024, 768, D3DFMT_D16),
+                                               ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(pool.width_ == 1024 && otherPool.width_ == 800 && otherPool.numSurfaces_ == 1);
+
+    // Пересоздание на другом адаптере: пул первого устройства переходит к новому устройству
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(1280, 720, D3DFMT_D24S8),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0, false, false, 1)
+                   == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(pool.width_ == 1280 && pool.depthFmt_ == D3DFMT_D24S8);
+    Z3D_TEST_CHECK(otherPool.width_ == 800 && otherPool.numSurfaces_ == 1);
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&otherDevice, &otherParams, 0, 0, d3d, MakeVideoMode(1024, 768, D3DFMT_D24S8),
+                                               ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(otherPool.width_ == 1024 && otherPool.numSurfaces_ == 0);
+    Z3D_TEST_CHECK(pool.width_ == 1280);
+    z3D::D3D9HL_RTPoolShutdown(&otherPool);
+    otherDevice->Release();
+
+    z3D::D3D9HL_RTPoolShutdown(&pool);
+    device->Release();
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("RTPoolTest");
+}
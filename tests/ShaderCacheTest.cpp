@@ -0,0 +1,329 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Кэш шейдеров с подставным компилятором: ключи, попадания после перезапуска, смена версии
+компилятора и включаемых файлов, поврежденные записи и ожидание заданий из нескольких потоков.
+
+Подставной компилятор возвращает хэш текста и макросов в виде байт-кода и считает вызовы.
+Файлы кэша пишутся во временный каталог, удаляемый в конце теста.
+*/
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+#include "z3DD3D9HL.h"
+#include "Test.h"
+
+namespace
+{
+const char* s_source = "#include \"common.h\"\nfloat4 main() : COLOR { return COMMON; }\n";
+const char* s_failSource = "syntax error";
+std::string s_commonInclude = "#define COMMON float4(1, 0, 0, 1)\n";
+
+volatile int s_numCompiles = 0;
+volatile int s_numBlobs = 0;
+volatile int s_fBlock = 0;          // задание с точкой входа "blocked" ждет сброса признака
+
+bool OpenInclude(bool /*fSystem*/, const char* name, const void** data, uint32_t* size, void* /*userData*/){
+    if (strcmp(name, "common.h") != 0)
+        return false;
+    *data = s_commonInclude.c_str();
+    *size = static_cast<uint32_t>(s_commonInclude.size());
+    return true;
+}
+
+/* Байт-код - четыре слова, зависящих от текста, макросов и точки входа.
+*/
+bool Compile(z3DD3D9HL_ShaderBlob* code,
+             z3DD3D9HL_ShaderBlob* errors,
+             const z3DD3D9HL_ShaderDesc* desc,
+             const z3DD3D9HL_ShaderIncludeHandler* /*include*/,
+             void* /*userData*/){
+    __sync_add_and_fetch(&s_numCompiles, 1);
+    if (strcmp(desc->entry_, "blocked") == 0){
+        while (s_fBlock != 0)
+            usleep(1000);
+    }
+    else
+        usleep(2000);
+    if (desc->sourceSize_ == strlen(s_failSource) && memcmp(desc->source_, s_failSource, desc->sourceSize_) == 0){
+        static const char s_message[] = "error X3000: syntax error";
+        errors->data_ = s_message;
+        errors->size_ = sizeof(s_message);
+        errors->handle_ = 0;
+        return false;
+    }
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < desc->sourceSize_; ++i)
+        hash = (hash ^ static_cast<uint8_t>(desc->source_[i])) * 16777619u;
+    for (const z3DD3D9HL_ShaderDefine* define = desc->defines_; define != 0 && define->name_ != 0; ++define)
+        hash = (hash ^ static_cast<uint8_t>(define->name_[0])) * 16777619u;
+    DWORD* words = static_cast<DWORD*>(malloc(4 * sizeof(DWORD)));
+    words[0] = 0xFFFF0200;
+    words[1] = hash;
+    words[2] = static_cast<DWORD>(strlen(desc->entry_));
+    words[3] = 0x0000FFFF;
+    code->data_ = words;
+    code->size_ = 4 * sizeof(DWORD);
+    code->handle_ = words;
+    __sync_add_and_fetch(&s_numBlobs, 1);
+    return true;
+}
+
+void ReleaseBlob(z3DD3D9HL_ShaderBlob* blob, void* /*userData*/){
+    free(blob->handle_);
+    __sync_sub_and_fetch(&s_numBlobs, 1);
+}
+
+z3DD3D9HL_ShaderCompiler MakeCompiler(uint32_t version){
+    z3DD3D9HL_ShaderCompiler compiler = { Compile, ReleaseBlob, version, 0 };
+    return compiler;
+}
+
+z3DD3D9HL_ShaderIncludeHandler MakeInclude(){
+    z3DD3D9HL_ShaderIncludeHandler include = { OpenInclude, 0, 0 };
+    return include;
+}
+
+void InitJob(z3DD3D9HL_ShaderJob* job, const char* source, const z3DD3D9HL_ShaderDefine* defines, const char* entry){
+    z3D::D3D9HL_ShaderJobInit(job, source, static_cast<uint32_t>(strlen(source)), defines, entry, "ps_2_0");
+}
+
+/* Выполнить одно задание и вернуть первое слово хэша байт-кода или 0 при ошибке.
+*/
+DWORD RunJob(z3DD3D9HL_ShaderCache* cache, const char* source, const z3DD3D9HL_ShaderDefine* defines, bool* fFromCache){
+    z3DD3D9HL_ShaderJob job;
+    InitJob(&job, source, defines, "main");
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheSubmit(cache, &job) == Z3D_D3D9HL_NONE);
+    DWORD result = 0;
+    if (z3D::D3D9HL_ShaderCacheWait(cache, &job) == Z3D_D3D9HL_NONE && job.codeSize_ == 4 * sizeof(DWORD))
+        result = job.code_[1];
+    *fFromCache = job.fFromCache_;
+    z3D::D3D9HL_ShaderCacheReleaseJob(cache, &job);
+    return result;
+}
+
+uint32_t CountEntries(const char* dir){
+    uint32_t numEntries = 0;
+    DIR* d = opendir(dir);
+    for (dirent* entry = readdir(d); entry != 0; entry = readdir(d)){
+        if (strstr(entry->d_name, ".z3dsc") != 0)
+            numEntries++;
+    }
+    closedir(d);
+    return numEntries;
+}
+
+void RemoveDir(const char* dir){
+    DIR* d = opendir(dir);
+    for (dirent* entry = readdir(d); entry != 0; entry = readdir(d)){
+        if (entry->d_name[0] == '.')
+            continue;
+        std::string path = std::string(dir) + "/" + entry->d_name;
+        unlink(path.c_str());
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+/* Ключ зависит от всех частей описания, версии компилятора и текста включаемых файлов.
+*/
+void TestKeys(const char* dir){
+    z3DD3D9HL_ShaderCompiler compiler = MakeCompiler(1);
+    z3DD3D9HL_ShaderIncludeHandler include = MakeInclude();
+    z3DD3D9HL_ShaderCache cache;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheInit(&cache, dir, 0, &compiler, &include) == Z3D_D3D9HL_NONE);
+    z3DD3D9HL_ShaderDefine defines[2] = { { "FOG", "1" }, { 0, 0 } };
+    z3DD3D9HL_ShaderDesc desc = { s_source, static_cast<uint32_t>(strlen(s_source)), 0, "main", "ps_2_0", 0 };
+    uint64_t base, key;
+    z3D::D3D9HL_ShaderCacheComputeKey(&base, &cache, &desc);
+    z3D::D3D9HL_ShaderCacheComputeKey(&key, &cache, &desc);
+    Z3D_TEST_CHECK(key == base);
+    desc.defines_ = defines;
+    z3D::D3D9HL_ShaderCacheComputeKey(&key, &cache, &desc);
+    Z3D_TEST_CHECK(key != base);
+    desc.defines_ = 0;
+    desc.profile_ = "ps_3_0";
+    z3D::D3D9HL_ShaderCacheComputeKey(&key, &cache, &desc);
+    Z3D_TEST_CHECK(key != base);
+    desc.profile_ = "ps_2_0";
+    desc.flags_ = 1;
+    z3D::D3D9HL_ShaderCacheComputeKey(&key, &cache, &desc);
+    Z3D_TEST_CHECK(key != base);
+    desc.flags_ = 0;
+    std::string saved = s_commonInclude;
+    s_commonInclude = "#define COMMON float4(0, 1, 0, 1)\n";
+    z3D::D3D9HL_ShaderCacheComputeKey(&key, &cache, &desc);
+    Z3D_TEST_CHECK(key != base);
+    s_commonInclude = saved;
+    cache.compiler_.version_ = 2;
+    z3D::D3D9HL_ShaderCacheComputeKey(&key, &cache, &desc);
+    Z3D_TEST_CHECK(key != base);
+    z3D::D3D9HL_ShaderCacheShutdown(&cache);
+}
+
+/* Запись переживает перезапуск кэша; смена версии компилятора и поврежденная запись
+приводят к компиляции.
+*/
+void TestPersistence(const char* dir){
+    z3DD3D9HL_ShaderCompiler compiler = MakeCompiler(1);
+    z3DD3D9HL_ShaderIncludeHandler include = MakeInclude();
+    z3DD3D9HL_ShaderCache cache;
+    bool fFromCache = false;
+    s_numCompiles = 0;
+
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheInit(&cache, dir, 2, &compiler, &include) == Z3D_D3D9HL_NONE);
+    DWORD compiled = RunJob(&cache, s_source, 0, &fFromCache);
+    Z3D_TEST_CHECK(compiled != 0 && !fFromCache && s_numCompiles == 1);
+    Z3D_TEST_CHECK(CountEntries(dir) == 1);
+    z3D::D3D9HL_ShaderCacheShutdown(&cache);
+
+    // перезапуск: байт-код читается с диска
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheInit(&cache, dir, 2, &compiler, &include) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(RunJob(&cache, s_source, 0, &fFromCache) == compiled);
+    Z3D_TEST_CHECK(fFromCache && s_numCompiles == 1);
+    z3DD3D9HL_ShaderCacheStats stats;
+    z3D::D3D9HL_ShaderCacheGetStats(&stats, &cache);
+    Z3D_TEST_CHECK(stats.numRequests_ == 1 && stats.numHits_ == 1 && stats.numMisses_ == 0);
+    z3D::D3D9HL_ShaderCacheShutdown(&cache);
+
+    // новая версия компилятора не использует старые записи
+    compiler.version_ = 2;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheInit(&cache, dir, 2, &compiler, &include) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(RunJob(&cache, s_source, 0, &fFromCache) == compiled);
+    Z3D_TEST_CHECK(!fFromCache && s_numCompiles == 2);
+    Z3D_TEST_CHECK(CountEntries(dir) == 2);
+
+    // поврежденная запись компилируется заново и перезаписывается
+    z3DD3D9HL_ShaderDesc desc = { s_source, static_cast<uint32_t>(strlen(s_source)), 0, "main", "ps_2_0", 0 };
+    uint64_t key;
+    z3D::D3D9HL_ShaderCacheComputeKey(&key, &cache, &desc);
+    char path[Z3D_D3D9HL_MAX_SHADER_PATH];
+    snprintf(path, sizeof(path), "%s/%08X%08X.z3dsc", dir,
+             static_cast<unsigned int>(key >> 32), static_cast<unsigned int>(key & 0xFFFFFFFF));
+    FILE* file = fopen(path, "r+b");
+    Z3D_TEST_CHECK(file != 0);
+    if (file != 0){
+        fseek(file, -1, SEEK_END);
+        fputc(0x55, file);
+        fclose(file);
+    }
+    Z3D_TEST_CHECK(RunJob(&cache, s_source, 0, &fFromCache) == compiled);
+    Z3D_TEST_CHECK(!fFromCache && s_numCompiles == 3);
+    Z3D_TEST_CHECK(RunJob(&cache, s_source, 0, &fFromCache) == compiled);
+    Z3D_TEST_CHECK(fFromCache && s_numCompiles == 3);
+
+    // ошибка компиляции: сообщения доступны, запись не создается
+    z3DD3D9HL_ShaderJob job;
+    InitJob(&job, s_failSource, 0, "main");
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheSubmit(&cache, &job) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheWait(&cache, &job) == Z3D_D3D9HL_NOTAVAILABLE);
+    Z3D_TEST_CHECK(job.state_ == Z3D_D3D9HL_SHADERJOB_FAILED && job.errors_ != 0 && job.code_ == 0);
+    z3D::D3D9HL_ShaderCacheReleaseJob(&cache, &job);
+    Z3D_TEST_CHECK(CountEntries(dir) == 2);
+    z3D::D3D9HL_ShaderCacheShutdown(&cache);
+}
+
+struct WaitTask{
+    z3DD3D9HL_ShaderCache* cache_;
+    z3DD3D9HL_ShaderJob* job_;
+    z3DD3D9HL_ErrCodes result_;
+};
+
+void* WaitThreadProc(void* param){
+    WaitTask* task = static_cast<WaitTask*>(param);
+    task->result_ = z3D::D3D9HL_ShaderCacheWait(task->cache_, task->job_);
+    return 0;
+}
+
+/* Ожидание задания не зависит от остальных заданий: пока одно задание заблокировано в компиляторе,
+другие завершаются и их ожидающие возвращаются. Одно задание ждут несколько потоков.
+*/
+void TestWait(const char* dir){
+    const uint32_t numJobs = 24;
+    const uint32_t numWaiters = 4;
+    z3DD3D9HL_ShaderCompiler compiler = MakeCompiler(3);
+    z3DD3D9HL_ShaderIncludeHandler include = MakeInclude();
+    z3DD3D9HL_ShaderCache cache;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheInit(&cache, dir, 4, &compiler, &include) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(cache.numThreads_ == 4);
+
+    s_fBlock = 1;
+    z3DD3D9HL_ShaderJob blocked;
+    InitJob(&blocked, s_source, 0, "blocked");
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheSubmit(&cache, &blocked) == Z3D_D3D9HL_NONE);
+
+    // одинаковые макросы у каждого третьего задания: совпадающие ключи компилируются параллельно
+    static const char* s_names[] = { "A", "B", "C" };
+    z3DD3D9HL_ShaderDefine defines[numJobs][2];
+    z3DD3D9HL_ShaderJob jobs[numJobs];
+    for (uint32_t iJob = 0; iJob < numJobs; ++iJob){
+        defines[iJob][0].name_ = s_names[iJob % 3];
+        defines[iJob][0].definition_ = "1";
+        defines[iJob][1].name_ = 0;
+        defines[iJob][1].definition_ = 0;
+        InitJob(&jobs[iJob], s_source, defines[iJob], "main");
+        Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheSubmit(&cache, &jobs[iJob]) == Z3D_D3D9HL_NONE);
+    }
+
+    // несколько потоков ждут одно и то же задание
+    WaitTask tasks[numWaiters];
+    pthread_t threads[numWaiters];
+    for (uint32_t iWaiter = 0; iWaiter < numWaiters; ++iWaiter){
+        tasks[iWaiter].cache_ = &cache;
+        tasks[iWaiter].job_ = &jobs[numJobs - 1];
+        tasks[iWaiter].result_ = Z3D_D3D9HL_INVALIDCALL;
+        pthread_create(&threads[iWaiter], 0, WaitThreadProc, &tasks[iWaiter]);
+    }
+    for (uint32_t iJob = 0; iJob < numJobs; ++iJob){
+        Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheWait(&cache, &jobs[iJob]) == Z3D_D3D9HL_NONE);
+        Z3D_TEST_CHECK(jobs[iJob].code_ != 0 && jobs[iJob].code_[1] == jobs[iJob % 3].code_[1]);
+    }
+    for (uint32_t iWaiter = 0; iWaiter < numWaiters; ++iWaiter){
+        pthread_join(threads[iWaiter], 0);
+        Z3D_TEST_CHECK(tasks[iWaiter].result_ == Z3D_D3D9HL_NONE);
+    }
+    // все остальные задания выполнены, а заблокированное еще нет
+    Z3D_TEST_CHECK(!z3D::D3D9HL_ShaderJobIsDone(&blocked));
+    for (uint32_t iJob = 0; iJob < numJobs; ++iJob)
+        z3D::D3D9HL_ShaderCacheReleaseJob(&cache, &jobs[iJob]);
+
+    s_fBlock = 0;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheWait(&cache, &blocked) == Z3D_D3D9HL_NONE);
+    z3D::D3D9HL_ShaderCacheReleaseJob(&cache, &blocked);
+
+    // задание, завершение которого проверяется без ожидания, освобождается сразу
+    z3DD3D9HL_ShaderJob polled;
+    InitJob(&polled, s_source, defines[0], "main");
+    Z3D_TEST_CHECK(z3D::D3D9HL_ShaderCacheSubmit(&cache, &polled) == Z3D_D3D9HL_NONE);
+    while (!z3D::D3D9HL_ShaderJobIsDone(&polled))
+        usleep(100);
+    z3D::D3D9HL_ShaderCacheReleaseJob(&cache, &polled);
+    Z3D_TEST_CHECK(polled.state_ == Z3D_D3D9HL_SHADERJOB_IDLE && polled.doneEvent_ == 0);
+
+    z3DD3D9HL_ShaderCacheStats stats;
+    z3D::D3D9HL_ShaderCacheGetStats(&stats, &cache);
+    Z3D_TEST_CHECK(stats.numRequests_ == numJobs + 2);
+    Z3D_TEST_CHECK(stats.numHits_ + stats.numMisses_ == stats.numRequests_);
+    Z3D_TEST_CHECK(stats.numWriteFailures_ == 0 && stats.numFailed_ == 0);
+    printf("%u jobs on %u threads: %u hits, %u compiled, hashing %u us, compiling %u us\n",
+           stats.numRequests_, cache.numThreads_, stats.numHits_, stats.numCompiled_, stats.hashTimeUs_, stats.compileTimeUs_);
+    z3D::D3D9HL_ShaderCacheShutdown(&cache);
+}
+} // end of namespace
+
+int main(){
+    char dir[] = "/tmp/z3DShaderCacheTest.XXXXXX";
+    Z3D_TEST_CHECK(mkdtemp(dir) != 0);
+    TestKeys(dir);
+    TestPersistence(dir);
+    TestWait(dir);
+    Z3D_TEST_CHECK(s_numBlobs == 0);
+    RemoveDir(dir);
+    return z3DTest::Report("ShaderCacheTest");
+}
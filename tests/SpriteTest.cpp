@@ -0,0 +1,123 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Пакет спрайтов на модели устройства: непрозрачные спрайты слоя упорядочиваются по текстуре,
+спрайты со смешиванием выводятся в порядке добавления с объединением соседних одинаковых, а неудачная
+регистрация слушателя не оставляет буферов и занятой памяти арены.
+*/
+
+#include <vector>
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+static char s_mem[1 << 20];
+
+bool ReleaseResources() { return true; }
+bool ResetResources() { return true; }
+
+z3DD3D9HL_VideoMode MakeVideoMode(UINT width, UINT height){
+    z3DD3D9HL_VideoMode videoMode;
+    ZeroMemory(&videoMode, sizeof(videoMode));
+    videoMode.d3ddm_.Width = width;
+    videoMode.d3ddm_.Height = height;
+    videoMode.d3ddm_.RefreshRate = 60;
+    videoMode.d3ddm_.Format = D3DFMT_X8R8G8B8;
+    videoMode.bpp_ = 32;
+    videoMode.depthStencilFmt_ = D3DFMT_D24S8;
+    return videoMode;
+}
+
+void OnRelease(LPDIRECT3DDEVICE9, void*) {}
+
+void TestOrder(z3DTest::MockDevice* mockDevice, z3DD3D9HL_SpriteBatch* batch, D3DPRESENT_PARAMETERS* presentParams){
+    LPDIRECT3DDEVICE9 device = mockDevice;
+    LPDIRECT3DTEXTURE9 texA = new z3DTest::MockTexture(16, 16);
+    LPDIRECT3DTEXTURE9 texB = new z3DTest::MockTexture(16, 16);
+
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    // Слой 0: непрозрачные B, A, B вперемешку со спрайтами A, B, A со смешиванием
+    z3D::D3D9HL_SpriteDraw(batch, texB, 0.0f, 0.0f, 8.0f, 8.0f, 0xFFFFFFFF, 0, Z3D_D3D9HL_SPRITE_OPAQUE);
+    z3D::D3D9HL_SpriteDraw(batch, texA, 10.0f, 0.0f, 8.0f, 8.0f);
+    z3D::D3D9HL_SpriteDraw(batch, texA, 0.0f, 0.0f, 8.0f, 8.0f, 0xFFFFFFFF, 0, Z3D_D3D9HL_SPRITE_OPAQUE);
+    z3D::D3D9HL_SpriteDraw(batch, texB, 20.0f, 0.0f, 8.0f, 8.0f);
+    z3D::D3D9HL_SpriteDraw(batch, texB, 0.0f, 0.0f, 8.0f, 8.0f, 0xFFFFFFFF, 0, Z3D_D3D9HL_SPRITE_OPAQUE);
+    z3D::D3D9HL_SpriteDraw(batch, texA, 30.0f, 0.0f, 8.0f, 8.0f);
+    // Слой 1: два A объединяются с последним A слоя 0, смена режима смешивания начинает новую группу
+    z3D::D3D9HL_SpriteDraw(batch, texA, 40.0f, 0.0f, 8.0f, 8.0f, 0xFFFFFFFF, 0, Z3D_D3D9HL_SPRITE_ALPHA, 1);
+    z3D::D3D9HL_SpriteDraw(batch, texA, 50.0f, 0.0f, 8.0f, 8.0f, 0xFFFFFFFF, 0, Z3D_D3D9HL_SPRITE_ALPHA, 1);
+    z3D::D3D9HL_SpriteDraw(batch, texA, 60.0f, 0.0f, 8.0f, 8.0f, 0xFFFFFFFF, 0, Z3D_D3D9HL_SPRITE_ADDITIVE, 1);
+    z3D::D3D9HL_SpriteDraw(batch, texB, 70.0f, 0.0f, 8.0f, 8.0f, 0xFFFFFFFF, 0, Z3D_D3D9HL_SPRITE_ALPHA, 1);
+    mockDevice->drawTextures_.clear();
+    mockDevice->drawPrimitives_.clear();
+    Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+
+    LPDIRECT3DTEXTURE9 texLow = (texA < texB) ? texA : texB;
+    LPDIRECT3DTEXTURE9 texHigh = (texA < texB) ? texB : texA;
+    IDirect3DBaseTexture9* expectedTextures[] = { texLow, texHigh, texA, texB, texA, texA, texB };
+    UINT expectedPrimitives[] = { (texLow == texA) ? 2u : 4u, (texHigh == texA) ? 2u : 4u, 2, 2, 6, 2, 2 };
+    const size_t numDraws = sizeof(expectedPrimitives) / sizeof(expectedPrimitives[0]);
+    Z3D_TEST_CHECK(mockDevice->drawTextures_.size() == numDraws);
+    if (mockDevice->drawTextures_.size() == numDraws){
+        for (size_t i = 0; i < numDraws; ++i){
+            Z3D_TEST_CHECK(mockDevice->drawTextures_[i] == expectedTextures[i]);
+            Z3D_TEST_CHECK(mockDevice->drawPrimitives_[i] == expectedPrimitives[i]);
+        }
+    }
+    // Спрайты со смешиванием лежат в буфере вершин в порядке добавления после трех непрозрачных
+    const z3DD3D9HL_SpriteVertex* vertices = reinterpret_cast<const z3DD3D9HL_SpriteVertex*>(&mockDevice->lastVertexBuffer_->mem_[0]);
+    for (uint32_t i = 0; i < 7; ++i)
+        Z3D_TEST_CHECK(vertices[(3 + i) * 4].x_ == 10.0f * (i + 1) - 0.5f);
+    z3DD3D9HL_SpriteStats stats;
+    z3D::D3D9HL_SpriteBatchGetStats(&stats, batch);
+    Z3D_TEST_CHECK(stats.numSprites_ == 10 && stats.numDrawCalls_ == numDraws);
+
+    texA->Release();
+    texB->Release();
+}
+
+/* Таблица слушателей заполнена: пакет не регистрируется и ничего не удерживает.
+*/
+void TestInitFailure(LPDIRECT3DDEVICE9 device, z3DD3D9HL_Arena* arena){
+    std::vector<z3DD3D9HL_DeviceListener> dummies;
+    for (uintptr_t i = 1; ; ++i){
+        z3DD3D9HL_DeviceListener listener = { OnRelease, 0, 0, reinterpret_cast<void*>(i) };
+        if (z3D::D3D9HL_AddDeviceListener(listener) != Z3D_D3D9HL_NONE)
+            break;
+        dummies.push_back(listener);
+    }
+    size_t marker = z3D::D3D9HL_ArenaGetMarker(arena);
+    int numLive = z3DTest::MockNumLiveObjects();
+    z3DD3D9HL_SpriteBatch batch;
+    Z3D_TEST_CHECK(z3D::D3D9HL_SpriteBatchInit(&batch, arena, device, 64) == Z3D_D3D9HL_OUTOFMEMORY);
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaGetMarker(arena) == marker);
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == numLive);
+    Z3D_TEST_CHECK(batch.vertexBuffer_ == 0 && batch.indexBuffer_ == 0 && batch.vertices_ == 0 && batch.maxSprites_ == 0);
+    for (size_t i = 0; i < dummies.size(); ++i)
+        z3D::D3D9HL_RemoveDeviceListener(dummies[i]);
+}
+} // end of namespace
+
+int main(){
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D;
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, MakeVideoMode(800, 600)) == Z3D_D3D9HL_NONE);
+    z3DD3D9HL_Arena arena;
+    Z3D_TEST_CHECK(z3D::D3D9HL_ArenaInit(&arena, s_mem, sizeof(s_mem)) == Z3D_D3D9HL_NONE);
+
+    z3DD3D9HL_SpriteBatch batch;
+    Z3D_TEST_CHECK(z3D::D3D9HL_SpriteBatchInit(&batch, &arena, device, 64) == Z3D_D3D9HL_NONE);
+    TestOrder(static_cast<z3DTest::MockDevice*>(device), &batch, &presentParams);
+    z3D::D3D9HL_SpriteBatchShutdown(&batch);
+
+    TestInitFailure(device, &arena);
+
+    device->Release();
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("SpriteTest");
+}
@@ -0,0 +1,137 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Переключение видеорежима на модели устройства: потеря устройства во время переключения
+и выбор между Reset() и пересозданием устройства.
+*/
+
+#include "z3DD3D9HL.h"
+#include "MockDevice.h"
+#include "Test.h"
+
+namespace
+{
+int s_numReleases = 0;
+int s_numResets = 0;
+int s_numListenerReleases = 0;
+int s_numListenerResets = 0;
+
+bool ReleaseResources() { s_numReleases++; return true; }
+bool ResetResources() { s_numResets++; return true; }
+void OnRelease(LPDIRECT3DDEVICE9, void*) { s_numListenerReleases++; }
+void OnReset(LPDIRECT3DDEVICE9, void*) { s_numListenerResets++; }
+
+z3DD3D9HL_VideoMode MakeVideoMode(UINT width, UINT height){
+    z3DD3D9HL_VideoMode videoMode;
+    ZeroMemory(&videoMode, sizeof(videoMode));
+    videoMode.d3ddm_.Width = width;
+    videoMode.d3ddm_.Height = height;
+    videoMode.d3ddm_.RefreshRate = 60;
+    videoMode.d3ddm_.Format = D3DFMT_X8R8G8B8;
+    videoMode.bpp_ = 32;
+    videoMode.fStencil_ = true;
+    videoMode.depthStencilFmt_ = D3DFMT_D24S8;
+    return videoMode;
+}
+
+/* Устройство потеряно во время переключения: ресурсы освобождаются один раз, а при восстановлении
+в D3D9HL_BeginDeviceRender() только восстанавливаются.
+*/
+void TestLostDuringSwitch(z3DTest::MockDirect3D* d3d){
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, MakeVideoMode(800, 600)) == Z3D_D3D9HL_NONE);
+    z3DTest::MockDevice* mockDevice = static_cast<z3DTest::MockDevice*>(device);
+    z3DD3D9HL_DeviceListener listener = { OnRelease, OnReset, 0, 0 };
+    Z3D_TEST_CHECK(z3D::D3D9HL_AddDeviceListener(listener) == Z3D_D3D9HL_NONE);
+    s_numReleases = s_numResets = s_numListenerReleases = s_numListenerResets = 0;
+
+    mockDevice->resetResult_ = D3DERR_DEVICELOST;
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(1024, 768),
+                                               ReleaseResources, ResetResources) == Z3D_D3D9HL_DEVICE_LOST);
+    Z3D_TEST_CHECK(device == mockDevice);
+    Z3D_TEST_CHECK(s_numReleases == 1 && s_numListenerReleases == 1);
+    Z3D_TEST_CHECK(s_numResets == 0 && s_numListenerResets == 0);
+    Z3D_TEST_CHECK(presentParams.BackBufferWidth == 1024);
+
+    // Устройство еще потеряно
+    mockDevice->cooperativeLevel_ = D3DERR_DEVICELOST;
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_DEVICE_LOST);
+    // Можно перезагрузить, но первая попытка Reset() неудачна
+    mockDevice->cooperativeLevel_ = D3DERR_DEVICENOTRESET;
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_DEVICE_NOT_RESET);
+    Z3D_TEST_CHECK(s_numReleases == 1 && s_numListenerReleases == 1);
+    mockDevice->resetResult_ = D3D_OK;
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_DEVICE_NOT_RESET);
+    Z3D_TEST_CHECK(s_numReleases == 1 && s_numListenerReleases == 1);
+    Z3D_TEST_CHECK(s_numResets == 1 && s_numListenerResets == 1);
+    Z3D_TEST_CHECK(mockDevice->presentParams_[0].BackBufferWidth == 1024);
+
+    // Следующая потеря устройства снова освобождает ресурсы
+    mockDevice->cooperativeLevel_ = D3DERR_DEVICENOTRESET;
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_DEVICE_NOT_RESET);
+    Z3D_TEST_CHECK(s_numReleases == 2 && s_numListenerReleases == 2);
+    Z3D_TEST_CHECK(s_numResets == 2 && s_numListenerResets == 2);
+
+    // Переключение после восстановления снова освобождает ресурсы
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, 0, d3d, MakeVideoMode(800, 600),
+                                               ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(s_numReleases == 3 && s_numResets == 3);
+    Z3D_TEST_CHECK(z3D::D3D9HL_BeginDeviceRender(device, &presentParams, ReleaseResources, ResetResources) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_EndDeviceRender(device) == Z3D_D3D9HL_NONE);
+
+    Z3D_TEST_CHECK(z3D::D3D9HL_RemoveDeviceListener(listener) == Z3D_D3D9HL_NONE);
+    device->Release();
+}
+
+/* Тип обработки вершин меняется только по сохраненному результату создания и только при
+policy.fUseCachedOutcome_; политика сама по себе пересоздания не вызывает.
+*/
+void TestRecreateDecision(z3DTest::MockDirect3D* d3d){
+    LPDIRECT3DDEVICE9 device = 0;
+    D3DPRESENT_PARAMETERS presentParams;
+    Z3D_TEST_CHECK(z3D::D3D9HL_CreateDevice(&device, &presentParams, 0, d3d, MakeVideoMode(800, 600)) == Z3D_D3D9HL_NONE);
+    D3DDEVICE_CREATION_PARAMETERS creationParams;
+    device->GetCreationParameters(&creationParams);
+    Z3D_TEST_CHECK((creationParams.BehaviorFlags & D3DCREATE_HARDWARE_VERTEXPROCESSING) != 0);
+
+    // Политика требует шейдеров 4.0, но живое устройство уже работает с аппаратной обработкой
+    z3DD3D9HL_DeviceCreationPolicy policy;
+    policy.fUseCachedOutcome_ = false;
+    policy.minVSMajor_ = 4;
+    z3DD3D9HL_ModeSwitchStats stats;
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, &stats, d3d, MakeVideoMode(1024, 768),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0,
+                                               false, false, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, &policy) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(!stats.fRecreated_);
+
+    // Сохраненный результат задает программную обработку вершин
+    z3DD3D9HL_DeviceCreationOutcome outcome;
+    Z3D_TEST_CHECK(z3D::D3D9HL_GetDeviceCreationOutcome(&outcome) == Z3D_D3D9HL_NONE);
+    outcome.behaviorFlags_ = D3DCREATE_SOFTWARE_VERTEXPROCESSING;
+    Z3D_TEST_CHECK(z3D::D3D9HL_SetDeviceCreationOutcome(outcome) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, 0, &stats, d3d, MakeVideoMode(800, 600),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0,
+                                               false, false, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, &policy) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(!stats.fRecreated_);
+
+    policy.fUseCachedOutcome_ = true;
+    policy.minVSMajor_ = 1;
+    uint32_t vertexProcessingType = 0;
+    Z3D_TEST_CHECK(z3D::D3D9HL_SwitchVideoMode(&device, &presentParams, &vertexProcessingType, &stats, d3d, MakeVideoMode(1024, 768),
+                                               ReleaseResources, ResetResources, D3DMULTISAMPLE_NONE, 0,
+                                               false, false, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, &policy) == Z3D_D3D9HL_NONE);
+    Z3D_TEST_CHECK(stats.fRecreated_);
+    Z3D_TEST_CHECK(vertexProcessingType == D3DCREATE_SOFTWARE_VERTEXPROCESSING);
+    device->Release();
+}
+} // end of namespace
+
+int main(){
+    z3DTest::MockDirect3D* d3d = new z3DTest::MockDirect3D;
+    TestLostDuringSwitch(d3d);
+    TestRecreateDecision(d3d);
+    d3d->Release();
+    Z3D_TEST_CHECK(z3DTest::MockNumLiveObjects() == 0);
+    return z3DTest::Report("SwitchVideoModeTest");
+}
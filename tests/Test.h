@@ -0,0 +1,50 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Проверки и замер времени в тестах.
+*/
+
+#ifndef Z3D_TEST_TEST_H
+#define Z3D_TEST_TEST_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "z3DD3D9HLDef.h"
+
+namespace z3DTest
+{
+
+inline int& NumFailures(){
+    static int numFailures = 0;
+    return numFailures;
+}
+
+/// Завершить тест: код возврата 0, если все проверки прошли
+inline int Report(const char* name){
+    if (NumFailures() == 0)
+        printf("%s: OK\n", name);
+    else
+        printf("%s: %d check(s) failed\n", name, NumFailures());
+    return (NumFailures() == 0) ? 0 : 1;
+}
+
+/// Текущее время в микросекундах
+inline uint64_t TimeUs(){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + static_cast<uint64_t>(ts.tv_nsec) / 1000;
+}
+
+} // end of z3DTest
+
+/// Проверить условие и продолжить тест при неудаче
+#define Z3D_TEST_CHECK(cond) \
+    do { \
+        if (!(cond)){ \
+            printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); \
+            z3DTest::NumFailures()++; \
+        } \
+    } while (0)
+
+#endif // Z3D_TEST_TEST_H
@@ -0,0 +1,120 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Реализация функций Win32, используемых библиотекой, для сборки тестов вне Windows.
+Потоки и атомарные операции библиотека берет из слоя платформы (z3DD3D9HLPlatformPosix.cpp).
+*/
+
+#include <windows.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+// Контекст устройства GDI: выбранная в него картинка
+struct TestDC{
+    HBITMAP bitmap_;
+};
+
+struct TestBitmap{
+    void* bits_;
+};
+
+int s_dummyWindow;
+} // end of namespace
+
+HWND GetActiveWindow(){
+    return &s_dummyWindow;
+}
+
+HDC GetDC(HWND){
+    return &s_dummyWindow;
+}
+
+int ReleaseDC(HWND, HDC){
+    return 1;
+}
+
+int GetDeviceCaps(HDC, int index){
+    return (index == VREFRESH) ? 60 : 0;
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* counter){
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    counter->QuadPart = static_cast<LONGLONG>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* freq){
+    freq->QuadPart = 1000000000;
+    return TRUE;
+}
+
+void Sleep(DWORD ms){
+    usleep(static_cast<useconds_t>(ms) * 1000);
+}
+
+// GDI: глифы рисуются сплошными прямоугольниками 8x16
+HDC CreateCompatibleDC(HDC){
+    TestDC* dc = new TestDC;
+    dc->bitmap_ = 0;
+    return dc;
+}
+
+BOOL DeleteDC(HDC dc){
+    delete static_cast<TestDC*>(dc);
+    return TRUE;
+}
+
+HBITMAP CreateDIBSection(HDC, const BITMAPINFO* info, UINT, void** bits, HANDLE, DWORD){
+    LONG height = info->bmiHeader.biHeight < 0 ? -info->bmiHeader.biHeight : info->bmiHeader.biHeight;
+    TestBitmap* bitmap = new TestBitmap;
+    bitmap->bits_ = calloc(static_cast<size_t>(info->bmiHeader.biWidth) * height, 4);
+    *bits = bitmap->bits_;
+    return bitmap;
+}
+
+HGDIOBJ SelectObject(HDC, HGDIOBJ obj){
+    return obj;
+}
+
+BOOL DeleteObject(HGDIOBJ obj){
+    TestBitmap* bitmap = static_cast<TestBitmap*>(obj);
+    free(bitmap->bits_);
+    delete bitmap;
+    return TRUE;
+}
+
+DWORD SetTextColor(HDC, DWORD){
+    return 0;
+}
+
+int SetBkMode(HDC, int){
+    return 1;
+}
+
+BOOL GetTextMetricsA(HDC, TEXTMETRICA* tm){
+    ZeroMemory(tm, sizeof(TEXTMETRICA));
+    tm->tmHeight = 16;
+    tm->tmAscent = 13;
+    tm->tmDescent = 3;
+    tm->tmAveCharWidth = 8;
+    tm->tmMaxCharWidth = 8;
+    return TRUE;
+}
+
+BOOL GetTextExtentPoint32A(HDC, LPCSTR, int len, SIZE* size){
+    size->cx = 8 * len;
+    size->cy = 16;
+    return TRUE;
+}
+
+BOOL TextOutA(HDC, int, int, LPCSTR, int){
+    return TRUE;
+}
+
+BOOL GdiFlush(){
+    return TRUE;
+}
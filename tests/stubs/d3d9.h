@@ -0,0 +1,243 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Заменитель <d3d9.h> для сборки тестов вне Windows.
+
+Объявлено только то, что использует библиотека. Порядок методов интерфейсов не совпадает с DX SDK:
+объекты Direct3D9 в тестах создаются только моделью устройства ( @see MockDevice.h ).
+*/
+
+#ifndef Z3D_TEST_D3D9_H
+#define Z3D_TEST_D3D9_H
+
+#include <windows.h>
+
+typedef DWORD D3DCOLOR;
+
+enum D3DFORMAT{
+    D3DFMT_UNKNOWN = 0,
+    D3DFMT_R8G8B8 = 20, D3DFMT_A8R8G8B8 = 21, D3DFMT_X8R8G8B8 = 22, D3DFMT_R5G6B5 = 23,
+    D3DFMT_X1R5G5B5 = 24, D3DFMT_A1R5G5B5 = 25, D3DFMT_A4R4G4B4 = 26, D3DFMT_R3G3B2 = 27,
+    D3DFMT_A8 = 28, D3DFMT_A8R3G3B2 = 29, D3DFMT_X4R4G4B4 = 30, D3DFMT_A8B8G8R8 = 32,
+    D3DFMT_A2R10G10B10 = 35, D3DFMT_A8P8 = 40, D3DFMT_P8 = 41,
+    D3DFMT_L8 = 50, D3DFMT_A8L8 = 51, D3DFMT_A4L4 = 52,
+    D3DFMT_V8U8 = 60, D3DFMT_L6V5U5 = 61, D3DFMT_X8L8V8U8 = 62, D3DFMT_Q8W8V8U8 = 63, D3DFMT_V16U16 = 64,
+    D3DFMT_D16_LOCKABLE = 70, D3DFMT_D32 = 71, D3DFMT_D15S1 = 73, D3DFMT_D24S8 = 75, D3DFMT_D24X8 = 77,
+    D3DFMT_D24X4S4 = 79, D3DFMT_D16 = 80,
+    D3DFMT_INDEX16 = 101, D3DFMT_INDEX32 = 102,
+    D3DFMT_G16R16F = 112, D3DFMT_A16B16G16R16F = 113, D3DFMT_R32F = 114
+};
+enum D3DDEVTYPE{ D3DDEVTYPE_HAL = 1, D3DDEVTYPE_REF = 2, D3DDEVTYPE_SW = 3 };
+enum D3DMULTISAMPLE_TYPE{
+    D3DMULTISAMPLE_NONE = 0, D3DMULTISAMPLE_NONMASKABLE = 1, D3DMULTISAMPLE_2_SAMPLES = 2,
+    D3DMULTISAMPLE_3_SAMPLES, D3DMULTISAMPLE_4_SAMPLES, D3DMULTISAMPLE_5_SAMPLES, D3DMULTISAMPLE_6_SAMPLES,
+    D3DMULTISAMPLE_7_SAMPLES, D3DMULTISAMPLE_8_SAMPLES, D3DMULTISAMPLE_16_SAMPLES = 16
+};
+enum D3DSWAPEFFECT{ D3DSWAPEFFECT_DISCARD = 1 };
+enum D3DRESOURCETYPE{ D3DRTYPE_SURFACE = 1, D3DRTYPE_TEXTURE = 3 };
+enum D3DPOOL{ D3DPOOL_DEFAULT = 0, D3DPOOL_MANAGED = 1, D3DPOOL_SYSTEMMEM = 2 };
+enum D3DRENDERSTATETYPE{
+    D3DRS_ZENABLE = 7, D3DRS_ZWRITEENABLE = 14, D3DRS_ALPHATESTENABLE = 15, D3DRS_SRCBLEND = 19,
+    D3DRS_DESTBLEND = 20, D3DRS_CULLMODE = 22, D3DRS_ZFUNC = 23, D3DRS_ALPHABLENDENABLE = 27,
+    D3DRS_FOGENABLE = 28, D3DRS_STENCILENABLE = 52, D3DRS_LIGHTING = 137, D3DRS_COLORWRITEENABLE = 168
+};
+enum D3DSAMPLERSTATETYPE{ D3DSAMP_ADDRESSU = 1, D3DSAMP_MAGFILTER = 5, D3DSAMP_MINFILTER = 6, D3DSAMP_MIPFILTER = 7 };
+enum D3DTEXTURESTAGESTATETYPE{
+    D3DTSS_COLOROP = 1, D3DTSS_COLORARG1, D3DTSS_COLORARG2, D3DTSS_ALPHAOP, D3DTSS_ALPHAARG1, D3DTSS_ALPHAARG2
+};
+enum D3DPRIMITIVETYPE{
+    D3DPT_POINTLIST = 1, D3DPT_LINELIST, D3DPT_LINESTRIP, D3DPT_TRIANGLELIST, D3DPT_TRIANGLESTRIP, D3DPT_TRIANGLEFAN
+};
+enum D3DBACKBUFFER_TYPE{ D3DBACKBUFFER_TYPE_MONO = 0 };
+enum D3DQUERYTYPE{
+    D3DQUERYTYPE_EVENT = 8, D3DQUERYTYPE_OCCLUSION = 9,
+    D3DQUERYTYPE_TIMESTAMP = 10, D3DQUERYTYPE_TIMESTAMPDISJOINT = 11, D3DQUERYTYPE_TIMESTAMPFREQ = 12
+};
+enum D3DDECLTYPE{ D3DDECLTYPE_FLOAT3 = 2, D3DDECLTYPE_UNUSED = 17 };
+enum D3DDECLMETHOD{ D3DDECLMETHOD_DEFAULT = 0 };
+enum D3DDECLUSAGE{ D3DDECLUSAGE_POSITION = 0, D3DDECLUSAGE_TEXCOORD = 5, D3DDECLUSAGE_COLOR = 10 };
+
+#define D3DISSUE_END (1 << 0)
+#define D3DISSUE_BEGIN (1 << 1)
+#define D3DGETDATA_FLUSH (1 << 0)
+#define D3DBLEND_ZERO 1
+#define D3DBLEND_ONE 2
+#define D3DBLEND_SRCALPHA 5
+#define D3DBLEND_INVSRCALPHA 6
+#define D3DCULL_NONE 1
+#define D3DCMP_LESSEQUAL 4
+#define D3DTOP_DISABLE 1
+#define D3DTOP_SELECTARG1 2
+#define D3DTOP_SELECTARG2 3
+#define D3DTOP_MODULATE 4
+#define D3DTA_DIFFUSE 0
+#define D3DTA_TEXTURE 2
+#define D3DTEXF_NONE 0
+#define D3DTEXF_POINT 1
+#define D3DTEXF_LINEAR 2
+#define D3DFVF_XYZRHW 0x004
+#define D3DFVF_DIFFUSE 0x040
+#define D3DFVF_TEX1 0x100
+#define D3DLOCK_NOOVERWRITE 0x1000
+#define D3DLOCK_DISCARD 0x2000
+#define D3DUSAGE_RENDERTARGET 0x1
+#define D3DUSAGE_DEPTHSTENCIL 0x2
+#define D3DUSAGE_WRITEONLY 0x8
+#define D3DUSAGE_DYNAMIC 0x200
+#define D3DCREATE_FPU_PRESERVE 0x2
+#define D3DCREATE_MULTITHREADED 0x4
+#define D3DCREATE_PUREDEVICE 0x10
+#define D3DCREATE_SOFTWARE_VERTEXPROCESSING 0x20
+#define D3DCREATE_HARDWARE_VERTEXPROCESSING 0x40
+#define D3DCREATE_MIXED_VERTEXPROCESSING 0x80
+#define D3DCREATE_ADAPTERGROUP_DEVICE 0x200
+#define D3DDEVCAPS_HWTRANSFORMANDLIGHT 0x10000
+#define D3DDEVCAPS_PUREDEVICE 0x100000
+#define D3DVS_VERSION(major, minor) (0xFFFE0000 | ((major) << 8) | (minor))
+#define D3DPRESENT_INTERVAL_ONE 0x1
+#define D3DPRESENT_INTERVAL_IMMEDIATE 0x80000000
+#define D3DADAPTER_DEFAULT 0
+#define D3D_SDK_VERSION 32
+
+#define D3D_OK S_OK
+#define D3DERR_DEVICELOST ((HRESULT)0x88760868)
+#define D3DERR_DEVICENOTRESET ((HRESULT)0x88760869)
+#define D3DERR_NOTAVAILABLE ((HRESULT)0x8876086A)
+#define D3DERR_INVALIDCALL ((HRESULT)0x8876086C)
+
+struct D3DDISPLAYMODE{ UINT Width; UINT Height; UINT RefreshRate; D3DFORMAT Format; };
+struct D3DPRESENT_PARAMETERS{
+    UINT BackBufferWidth; UINT BackBufferHeight; D3DFORMAT BackBufferFormat; UINT BackBufferCount;
+    D3DMULTISAMPLE_TYPE MultiSampleType; DWORD MultiSampleQuality; D3DSWAPEFFECT SwapEffect; HWND hDeviceWindow;
+    BOOL Windowed; BOOL EnableAutoDepthStencil; D3DFORMAT AutoDepthStencilFormat; DWORD Flags;
+    UINT FullScreen_RefreshRateInHz; UINT PresentationInterval;
+};
+struct D3DCAPS9{
+    D3DDEVTYPE DeviceType; UINT AdapterOrdinal; DWORD DevCaps; DWORD MaxStreams; DWORD VertexShaderVersion;
+    DWORD PixelShaderVersion; UINT MasterAdapterOrdinal; UINT AdapterOrdinalInGroup; UINT NumberOfAdaptersInGroup;
+    DWORD MaxPrimitiveCount; DWORD MaxVertexIndex;
+};
+struct D3DADAPTER_IDENTIFIER9{
+    char Driver[512]; char Description[512]; LARGE_INTEGER DriverVersion;
+    DWORD VendorId; DWORD DeviceId; DWORD SubSysId; DWORD Revision;
+};
+struct D3DDEVICE_CREATION_PARAMETERS{ UINT AdapterOrdinal; D3DDEVTYPE DeviceType; HWND hFocusWindow; DWORD BehaviorFlags; };
+struct D3DVERTEXELEMENT9{ WORD Stream; WORD Offset; BYTE Type; BYTE Method; BYTE Usage; BYTE UsageIndex; };
+#define D3DDECL_END() {0xFF, 0, D3DDECLTYPE_UNUSED, 0, 0, 0}
+struct D3DSURFACE_DESC{
+    D3DFORMAT Format; D3DRESOURCETYPE Type; DWORD Usage; D3DPOOL Pool;
+    D3DMULTISAMPLE_TYPE MultiSampleType; DWORD MultiSampleQuality; UINT Width; UINT Height;
+};
+struct D3DVIEWPORT9{ DWORD X; DWORD Y; DWORD Width; DWORD Height; float MinZ; float MaxZ; };
+struct D3DLOCKED_RECT{ INT Pitch; void* pBits; };
+
+struct IDirect3DResource9 : IUnknown {};
+struct IDirect3DSurface9 : IDirect3DResource9 {
+    virtual HRESULT GetDesc(D3DSURFACE_DESC* desc) = 0;
+};
+struct IDirect3DBaseTexture9 : IDirect3DResource9 {};
+struct IDirect3DTexture9 : IDirect3DBaseTexture9 {
+    virtual HRESULT GetSurfaceLevel(UINT level, IDirect3DSurface9** surface) = 0;
+    virtual HRESULT LockRect(UINT level, D3DLOCKED_RECT* lockedRect, const RECT* rect, DWORD flags) = 0;
+    virtual HRESULT UnlockRect(UINT level) = 0;
+};
+struct IDirect3DVertexBuffer9 : IDirect3DResource9 {
+    virtual HRESULT Lock(UINT offset, UINT size, void** data, DWORD flags) = 0;
+    virtual HRESULT Unlock() = 0;
+};
+struct IDirect3DIndexBuffer9 : IDirect3DResource9 {
+    virtual HRESULT Lock(UINT offset, UINT size, void** data, DWORD flags) = 0;
+    virtual HRESULT Unlock() = 0;
+};
+struct IDirect3DVertexDeclaration9 : IUnknown {};
+struct IDirect3DVertexShader9 : IUnknown {};
+struct IDirect3DPixelShader9 : IUnknown {};
+struct IDirect3DQuery9 : IUnknown {
+    virtual HRESULT Issue(DWORD flags) = 0;
+    virtual HRESULT GetData(void* data, DWORD size, DWORD flags) = 0;
+};
+struct IDirect3DSwapChain9 : IUnknown {
+    virtual HRESULT GetBackBuffer(UINT iBackBuffer, D3DBACKBUFFER_TYPE type, IDirect3DSurface9** backBuffer) = 0;
+};
+
+struct IDirect3DDevice9 : IUnknown {
+    virtual HRESULT TestCooperativeLevel() = 0;
+    virtual HRESULT Reset(D3DPRESENT_PARAMETERS* presentParams) = 0;
+    virtual HRESULT BeginScene() = 0;
+    virtual HRESULT EndScene() = 0;
+    virtual HRESULT Present(const RECT* srcRect, const RECT* destRect, HWND hDestWindow, const void* dirtyRegion) = 0;
+    virtual HRESULT GetCreationParameters(D3DDEVICE_CREATION_PARAMETERS* params) = 0;
+    virtual UINT GetNumberOfSwapChains() = 0;
+    virtual HRESULT GetSwapChain(UINT iSwapChain, IDirect3DSwapChain9** swapChain) = 0;
+    virtual HRESULT GetBackBuffer(UINT iSwapChain, UINT iBackBuffer, D3DBACKBUFFER_TYPE type, IDirect3DSurface9** backBuffer) = 0;
+    virtual HRESULT GetDepthStencilSurface(IDirect3DSurface9** surface) = 0;
+    virtual HRESULT SetDepthStencilSurface(IDirect3DSurface9* surface) = 0;
+    virtual HRESULT GetRenderTarget(DWORD index, IDirect3DSurface9** surface) = 0;
+    virtual HRESULT SetRenderTarget(DWORD index, IDirect3DSurface9* surface) = 0;
+    virtual HRESULT SetViewport(const D3DVIEWPORT9* viewport) = 0;
+    virtual HRESULT SetRenderState(D3DRENDERSTATETYPE state, DWORD value) = 0;
+    virtual HRESULT SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value) = 0;
+    virtual HRESULT SetTextureStageState(DWORD stage, D3DTEXTURESTAGESTATETYPE type, DWORD value) = 0;
+    virtual HRESULT SetTexture(DWORD stage, IDirect3DBaseTexture9* texture) = 0;
+    virtual HRESULT SetStreamSource(UINT stream, IDirect3DVertexBuffer9* vertexBuffer, UINT offset, UINT stride) = 0;
+    virtual HRESULT SetIndices(IDirect3DIndexBuffer9* indexBuffer) = 0;
+    virtual HRESULT SetVertexDeclaration(IDirect3DVertexDeclaration9* decl) = 0;
+    virtual HRESULT SetFVF(DWORD fvf) = 0;
+    virtual HRESULT SetVertexShader(IDirect3DVertexShader9* shader) = 0;
+    virtual HRESULT SetPixelShader(IDirect3DPixelShader9* shader) = 0;
+    virtual HRESULT SetVertexShaderConstantF(UINT startRegister, const float* data, UINT vector4fCount) = 0;
+    virtual HRESULT SetPixelShaderConstantF(UINT startRegister, const float* data, UINT vector4fCount) = 0;
+    virtual HRESULT DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primitiveCount) = 0;
+    virtual HRESULT DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertexIndex, UINT minVertexIndex,
+                                         UINT numVertices, UINT startIndex, UINT primitiveCount) = 0;
+    virtual HRESULT CreateVertexDeclaration(const D3DVERTEXELEMENT9* elements, IDirect3DVertexDeclaration9** decl) = 0;
+    virtual HRESULT CreateVertexShader(const DWORD* function, IDirect3DVertexShader9** shader) = 0;
+    virtual HRESULT CreatePixelShader(const DWORD* function, IDirect3DPixelShader9** shader) = 0;
+    virtual HRESULT CreateTexture(UINT width, UINT height, UINT levels, DWORD usage, D3DFORMAT format, D3DPOOL pool,
+                                  IDirect3DTexture9** texture, HANDLE* sharedHandle) = 0;
+    virtual HRESULT CreateRenderTarget(UINT width, UINT height, D3DFORMAT format, D3DMULTISAMPLE_TYPE multiSample,
+                                       DWORD multiSampleQuality, BOOL fLockable, IDirect3DSurface9** surface,
+                                       HANDLE* sharedHandle) = 0;
+    virtual HRESULT CreateDepthStencilSurface(UINT width, UINT height, D3DFORMAT format, D3DMULTISAMPLE_TYPE multiSample,
+                                              DWORD multiSampleQuality, BOOL fDiscard, IDirect3DSurface9** surface,
+                                              HANDLE* sharedHandle) = 0;
+    virtual HRESULT CreateVertexBuffer(UINT length, DWORD usage, DWORD fvf, D3DPOOL pool,
+                                       IDirect3DVertexBuffer9** vertexBuffer, HANDLE* sharedHandle) = 0;
+    virtual HRESULT CreateIndexBuffer(UINT length, DWORD usage, D3DFORMAT format, D3DPOOL pool,
+                                      IDirect3DIndexBuffer9** indexBuffer, HANDLE* sharedHandle) = 0;
+    virtual HRESULT CreateQuery(D3DQUERYTYPE type, IDirect3DQuery9** query) = 0;
+};
+
+struct IDirect3D9 : IUnknown {
+    virtual UINT GetAdapterCount() = 0;
+    virtual HRESULT GetAdapterIdentifier(UINT adapter, DWORD flags, D3DADAPTER_IDENTIFIER9* identifier) = 0;
+    virtual UINT GetAdapterModeCount(UINT adapter, D3DFORMAT format) = 0;
+    virtual HRESULT EnumAdapterModes(UINT adapter, D3DFORMAT format, UINT iMode, D3DDISPLAYMODE* mode) = 0;
+    virtual HRESULT GetAdapterDisplayMode(UINT adapter, D3DDISPLAYMODE* mode) = 0;
+    virtual HRESULT CheckDeviceType(UINT adapter, D3DDEVTYPE devType, D3DFORMAT displayFormat,
+                                    D3DFORMAT backBufferFormat, BOOL fWindowed) = 0;
+    virtual HRESULT CheckDeviceFormat(UINT adapter, D3DDEVTYPE devType, D3DFORMAT adapterFormat, DWORD usage,
+                                      D3DRESOURCETYPE resType, D3DFORMAT checkFormat) = 0;
+    virtual HRESULT CheckDeviceMultiSampleType(UINT adapter, D3DDEVTYPE devType, D3DFORMAT surfaceFormat, BOOL fWindowed,
+                                               D3DMULTISAMPLE_TYPE multiSampleType, DWORD* qualityLevels) = 0;
+    virtual HRESULT CheckDepthStencilMatch(UINT adapter, D3DDEVTYPE devType, D3DFORMAT adapterFormat,
+                                           D3DFORMAT renderTargetFormat, D3DFORMAT depthStencilFormat) = 0;
+    virtual HRESULT GetDeviceCaps(UINT adapter, D3DDEVTYPE devType, D3DCAPS9* caps) = 0;
+    virtual HRESULT CreateDevice(UINT adapter, D3DDEVTYPE devType, HWND hFocusWindow, DWORD behaviorFlags,
+                                 D3DPRESENT_PARAMETERS* presentParams, IDirect3DDevice9** device) = 0;
+};
+
+typedef IDirect3D9* LPDIRECT3D9;
+typedef IDirect3DDevice9* LPDIRECT3DDEVICE9;
+typedef IDirect3DSwapChain9* LPDIRECT3DSWAPCHAIN9;
+typedef IDirect3DSurface9* LPDIRECT3DSURFACE9;
+typedef IDirect3DBaseTexture9* LPDIRECT3DBASETEXTURE9;
+typedef IDirect3DTexture9* LPDIRECT3DTEXTURE9;
+typedef IDirect3DVertexBuffer9* LPDIRECT3DVERTEXBUFFER9;
+typedef IDirect3DIndexBuffer9* LPDIRECT3DINDEXBUFFER9;
+typedef IDirect3DVertexDeclaration9* LPDIRECT3DVERTEXDECLARATION9;
+typedef IDirect3DVertexShader9* LPDIRECT3DVERTEXSHADER9;
+typedef IDirect3DPixelShader9* LPDIRECT3DPIXELSHADER9;
+typedef IDirect3DQuery9* LPDIRECT3DQUERY9;
+
+#endif // Z3D_TEST_D3D9_H
@@ -0,0 +1,47 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Заменитель <d3dx9.h> для сборки тестов вне Windows. D3DXCompileShader() в тестах недоступна.
+*/
+
+#ifndef Z3D_TEST_D3DX9_H
+#define Z3D_TEST_D3DX9_H
+
+#include <d3d9.h>
+
+#define D3DX_SDK_VERSION 43
+
+#define STDMETHOD(method) virtual HRESULT method
+#define THIS_
+#define PURE = 0
+
+struct D3DXMACRO{ LPCSTR Name; LPCSTR Definition; };
+enum D3DXINCLUDE_TYPE{ D3DXINC_LOCAL, D3DXINC_SYSTEM };
+
+struct ID3DXInclude {
+    STDMETHOD(Open)(THIS_ D3DXINCLUDE_TYPE includeType, LPCSTR fileName, LPCVOID parentData, LPCVOID* data, UINT* bytes) PURE;
+    STDMETHOD(Close)(THIS_ LPCVOID data) PURE;
+    virtual ~ID3DXInclude() {}
+};
+struct ID3DXBuffer : IUnknown {
+    virtual LPVOID GetBufferPointer() = 0;
+    virtual DWORD GetBufferSize() = 0;
+};
+typedef ID3DXInclude* LPD3DXINCLUDE;
+typedef ID3DXBuffer* LPD3DXBUFFER;
+typedef void* LPD3DXCONSTANTTABLE;
+
+inline HRESULT D3DXCompileShader(LPCSTR, UINT, const D3DXMACRO*, LPD3DXINCLUDE, LPCSTR, LPCSTR, DWORD,
+                                 LPD3DXBUFFER*, LPD3DXBUFFER*, LPD3DXCONSTANTTABLE*){
+    return E_FAIL;
+}
+
+// Размер байт-кода шейдера вместе с завершающим маркером 0x0000FFFF
+inline UINT D3DXGetShaderSize(const DWORD* function){
+    UINT numTokens = 1;
+    while (function[numTokens - 1] != 0x0000FFFF)
+        numTokens++;
+    return numTokens * sizeof(DWORD);
+}
+
+#endif // Z3D_TEST_D3DX9_H
@@ -0,0 +1,104 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Заменитель <windows.h> для сборки тестов вне Windows.
+
+Объявлено только то, что использует библиотека. Размеры типов совпадают с Win32.
+Функции реализованы в TestWin32.cpp.
+*/
+
+#ifndef Z3D_TEST_WINDOWS_H
+#define Z3D_TEST_WINDOWS_H
+
+#include <stddef.h>
+#include <string.h>
+
+typedef unsigned int DWORD;
+typedef unsigned int UINT;
+typedef unsigned int ULONG;
+typedef int BOOL;
+typedef int INT;
+typedef int LONG;
+typedef int HRESULT;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef float FLOAT;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef size_t SIZE_T;
+typedef void* HANDLE;
+typedef void* HWND;
+typedef void* HDC;
+typedef void* HFONT;
+typedef void* HBITMAP;
+typedef void* HGDIOBJ;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef const char* LPCSTR;
+typedef char* LPSTR;
+typedef DWORD* LPDWORD;
+
+typedef union {
+    struct { DWORD LowPart; LONG HighPart; };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+struct RECT { LONG left, top, right, bottom; };
+struct SIZE { LONG cx, cy; };
+
+#define TRUE 1
+#define FALSE 0
+#define WINAPI
+#define CALLBACK
+#define S_OK 0
+#define S_FALSE 1
+#define E_FAIL ((HRESULT)0x80004005)
+#define FAILED(hr) ((HRESULT)(hr) < 0)
+#define SUCCEEDED(hr) ((HRESULT)(hr) >= 0)
+#define ZeroMemory(p, n) memset((p), 0, (n))
+#define MAX_PATH 260
+#define INFINITE 0xFFFFFFFF
+#define VREFRESH 116
+
+struct IUnknown {
+    virtual ULONG AddRef() = 0;
+    virtual ULONG Release() = 0;
+    virtual ~IUnknown() {}
+};
+
+HWND GetActiveWindow();
+HDC GetDC(HWND hWnd);
+int ReleaseDC(HWND hWnd, HDC hDC);
+int GetDeviceCaps(HDC hDC, int index);
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* counter);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* freq);
+void Sleep(DWORD ms);
+
+// GDI
+struct BITMAPINFOHEADER {
+    DWORD biSize; LONG biWidth; LONG biHeight; WORD biPlanes; WORD biBitCount; DWORD biCompression;
+    DWORD biSizeImage; LONG biXPelsPerMeter; LONG biYPelsPerMeter; DWORD biClrUsed; DWORD biClrImportant;
+};
+struct BITMAPINFO { BITMAPINFOHEADER bmiHeader; DWORD bmiColors[1]; };
+struct TEXTMETRICA {
+    LONG tmHeight, tmAscent, tmDescent, tmInternalLeading, tmExternalLeading, tmAveCharWidth, tmMaxCharWidth;
+};
+#define BI_RGB 0
+#define DIB_RGB_COLORS 0
+#define TRANSPARENT 1
+#define RGB(r, g, b) ((DWORD)(((BYTE)(r) | ((WORD)((BYTE)(g)) << 8)) | (((DWORD)(BYTE)(b)) << 16)))
+
+HDC CreateCompatibleDC(HDC hDC);
+BOOL DeleteDC(HDC hDC);
+HBITMAP CreateDIBSection(HDC hDC, const BITMAPINFO* info, UINT usage, void** bits, HANDLE section, DWORD offset);
+HGDIOBJ SelectObject(HDC hDC, HGDIOBJ obj);
+BOOL DeleteObject(HGDIOBJ obj);
+DWORD SetTextColor(HDC hDC, DWORD color);
+int SetBkMode(HDC hDC, int mode);
+BOOL GetTextMetricsA(HDC hDC, TEXTMETRICA* tm);
+BOOL GetTextExtentPoint32A(HDC hDC, LPCSTR str, int len, SIZE* size);
+BOOL TextOutA(HDC hDC, int x, int y, LPCSTR str, int len);
+BOOL GdiFlush();
+
+#endif // Z3D_TEST_WINDOWS_H
@@ -0,0 +1,20 @@
+/* This file is a part of Zavod3D engine project.
+It's licensed unser the MIT license (see "License.txt" for details).*/
+
+/* Заменитель отладочной системы Zavod3D для сборки тестов: проверки отключены,
+поэтому тесты проверяют коды ошибок, а не срабатывание утверждений.
+*/
+
+#ifndef Z3D_TEST_DEBUGSYSTEM_H
+#define Z3D_TEST_DEBUGSYSTEM_H
+
+#define Z3D_ERROR_PERMISSIBLE 1
+
+#define Z3D_ASSERT(cond, msg, flag) ((void)0)
+#define Z3D_ASSERT_HIGH(cond, msg, flag) ((void)0)
+#define Z3D_ASSERT_LOW(cond, msg, flag) ((void)0)
+#define Z3D_ERROR(level, cond, msg, flag) ((void)0)
+#define Z3D_ERROR1(level, cond, msg, arg, flag) ((void)(arg))
+#define Z3D_INFO(msg) ((void)0)
+
+#endif // Z3D_TEST_DEBUGSYSTEM_H